@@ -1,3 +1,11 @@
 #!/bin/sh
-glslc shaders/shader.vert -o shaders/out/vert.spv
-glslc shaders/shader.frag -o shaders/out/frag.spv
\ No newline at end of file
+# descriptor indexing (bindless) needs at least a vulkan 1.2 target
+# glslc resolves the #include of scene_common.glsl and post_common.glsl
+glslc --target-env=vulkan1.2 shaders/shader.vert -o shaders/out/vert.spv
+glslc --target-env=vulkan1.2 shaders/shader_pulled.vert -o shaders/out/vert_pulled.spv
+glslc --target-env=vulkan1.2 shaders/shader.frag -o shaders/out/frag.spv
+glslc --target-env=vulkan1.2 shaders/fullscreen.vert -o shaders/out/fullscreen_vert.spv
+glslc --target-env=vulkan1.2 shaders/post_subpass.frag -o shaders/out/post_subpass_frag.spv
+glslc --target-env=vulkan1.2 shaders/post_sampled.frag -o shaders/out/post_sampled_frag.spv
+glslc --target-env=vulkan1.2 shaders/hud.vert -o shaders/out/hud_vert.spv
+glslc --target-env=vulkan1.2 shaders/hud.frag -o shaders/out/hud_frag.spv
\ No newline at end of file
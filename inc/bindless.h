@@ -0,0 +1,67 @@
+#ifndef BINDLESS_H
+#define BINDLESS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <vulkan/vulkan.h>
+
+// Upper bounds, clamped to the device limits when the table is created
+#define BINDLESS_MAX_SAMPLED_IMAGES 4096
+#define BINDLESS_MAX_STORAGE_BUFFERS 1024
+
+#define BINDLESS_INVALID_INDEX UINT32_MAX
+
+// must match the bindings of set 1 in the shaders
+typedef enum {
+    BINDLESS_BINDING_SAMPLED_IMAGES = 0,
+    BINDLESS_BINDING_STORAGE_BUFFERS = 1,
+    BINDLESS_BINDING_COUNT,
+} BindlessBinding;
+
+// Hands out array slots. Released slots are reused before untouched ones. Releasing a slot that
+// is not handed out is refused, so that it cannot be handed out twice.
+typedef struct {
+    uint32_t capacity;
+    uint32_t next_unused;
+    uint32_t free_count;
+    uint32_t* free_slots;
+    uint32_t* in_use; // one bit per slot
+} BindlessSlotAllocator;
+
+// A single descriptor set holding big, partially bound arrays of every sampled image and storage
+// buffer. It is bound once per command buffer and resources are picked in the shaders by index.
+typedef struct {
+    VkDevice device;
+    const VkAllocationCallbacks* allocator;
+    VkDescriptorSetLayout layout;
+    VkDescriptorPool pool;
+    VkDescriptorSet set;
+
+    BindlessSlotAllocator images;
+    BindlessSlotAllocator buffers;
+} BindlessTable;
+
+// Checks the descriptor indexing features (core in 1.2) the table relies on
+bool bindless_is_supported(VkPhysicalDevice physical_device);
+// Enables these features, to chain into VkDeviceCreateInfo
+void bindless_enable_features(VkPhysicalDeviceVulkan12Features* features);
+
+void bindless_create(VkDevice device, VkPhysicalDevice physical_device,
+                     const VkAllocationCallbacks* allocator, BindlessTable* table);
+void bindless_destroy(BindlessTable* table);
+
+// Registration returns the index to use in the shader, or BINDLESS_INVALID_INDEX when full.
+// Thanks to update-after-bind, this is valid even while the set is bound in a command buffer
+// being recorded; only slots used by in-flight frames must not be overwritten.
+uint32_t bindless_register_image(BindlessTable* table, VkImageView view, VkSampler sampler,
+                                 VkImageLayout layout);
+void bindless_update_image(BindlessTable* table, uint32_t index, VkImageView view,
+                           VkSampler sampler, VkImageLayout layout);
+void bindless_release_image(BindlessTable* table, uint32_t index);
+
+uint32_t bindless_register_buffer(BindlessTable* table, VkBuffer buffer, VkDeviceSize offset,
+                                  VkDeviceSize range);
+void bindless_release_buffer(BindlessTable* table, uint32_t index);
+
+#endif
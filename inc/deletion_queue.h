@@ -0,0 +1,95 @@
+#ifndef DELETION_QUEUE_H
+#define DELETION_QUEUE_H
+
+#include <stdint.h>
+
+#include <vulkan/vulkan.h>
+
+#include "bindless.h"
+#include "gpu_memory.h"
+
+typedef enum {
+    DELETION_BUFFER = 0,
+    DELETION_IMAGE,
+    DELETION_IMAGE_VIEW,
+    DELETION_FRAMEBUFFER,
+    DELETION_PIPELINE,
+    DELETION_SWAPCHAIN,
+    DELETION_SEMAPHORE,
+    DELETION_DESCRIPTOR_SET,
+    DELETION_MEMORY,
+    DELETION_BINDLESS_IMAGE,
+    DELETION_BINDLESS_BUFFER,
+} DeletionType;
+
+typedef struct {
+    DeletionType type;
+    uint64_t retire_frame; // the first frame that no longer uses it
+    union {
+        VkBuffer buffer;
+        VkImage image;
+        VkImageView view;
+        VkFramebuffer framebuffer;
+        VkPipeline pipeline;
+        VkSwapchainKHR swapchain;
+        VkSemaphore semaphore;
+        VkDeviceMemory memory;
+        struct {
+            VkDescriptorPool pool; // created with VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT
+            VkDescriptorSet set;
+        } descriptor_set;
+        struct {
+            BindlessTable* table;
+            uint32_t index;
+        } bindless;
+    };
+} PendingDeletion;
+
+// Resources that frames in flight may still use, released once the GPU is done with those frames
+// instead of waiting for the whole device to be idle. Frame numbers can be anything increasing
+// that the GPU completes in order, eg a timeline semaphore value.
+// Entries are released in the order they were pushed: push views before their image, and
+// images before their memory. Not thread safe, everything is pushed from the render thread.
+typedef struct {
+    VkDevice device;
+    const VkAllocationCallbacks* allocator; // the one the resources were created with
+    GpuMemoryTracker* memory;               // optional, memory is freed through it
+
+    uint32_t count;
+    uint32_t capacity;
+    PendingDeletion* entries;
+    uint64_t released; // over the whole run
+} DeletionQueue;
+
+void deletion_queue_create(DeletionQueue* queue, VkDevice device,
+                           const VkAllocationCallbacks* allocator, GpuMemoryTracker* memory);
+// Releases everything that is left: the device must be idle
+void deletion_queue_destroy(DeletionQueue* queue);
+
+// retire_frame: the resource is used by frames up to, not including, this one. Usually the
+// number of the frame being prepared, when the resource is replaced before it is recorded.
+void deletion_queue_push_buffer(DeletionQueue* queue, VkBuffer buffer, uint64_t retire_frame);
+void deletion_queue_push_image(DeletionQueue* queue, VkImage image, uint64_t retire_frame);
+void deletion_queue_push_image_view(DeletionQueue* queue, VkImageView view, uint64_t retire_frame);
+void deletion_queue_push_framebuffer(DeletionQueue* queue, VkFramebuffer framebuffer,
+                                     uint64_t retire_frame);
+void deletion_queue_push_pipeline(DeletionQueue* queue, VkPipeline pipeline,
+                                  uint64_t retire_frame);
+void deletion_queue_push_swapchain(DeletionQueue* queue, VkSwapchainKHR swapchain,
+                                   uint64_t retire_frame);
+void deletion_queue_push_semaphore(DeletionQueue* queue, VkSemaphore semaphore,
+                                   uint64_t retire_frame);
+void deletion_queue_push_descriptor_set(DeletionQueue* queue, VkDescriptorPool pool,
+                                        VkDescriptorSet set, uint64_t retire_frame);
+void deletion_queue_push_memory(DeletionQueue* queue, VkDeviceMemory memory,
+                                uint64_t retire_frame);
+void deletion_queue_push_bindless_image(DeletionQueue* queue, BindlessTable* table,
+                                        uint32_t index, uint64_t retire_frame);
+void deletion_queue_push_bindless_buffer(DeletionQueue* queue, BindlessTable* table,
+                                         uint32_t index, uint64_t retire_frame);
+
+// Releases what only frames before first_pending_frame used: those are finished on the GPU.
+// Returns how many resources were released.
+uint32_t deletion_queue_collect(DeletionQueue* queue, uint64_t first_pending_frame);
+
+#endif
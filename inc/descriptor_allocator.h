@@ -0,0 +1,105 @@
+#ifndef DESCRIPTOR_ALLOCATOR_H
+#define DESCRIPTOR_ALLOCATOR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <vulkan/vulkan.h>
+
+#define DESCRIPTOR_ALLOCATOR_MAX_RATIOS 8
+#define DESCRIPTOR_ALLOCATOR_MAX_POOLS 16
+// each new pool of the chain is twice as large as the previous one, up to this
+#define DESCRIPTOR_ALLOCATOR_MAX_SETS_PER_POOL 4096
+
+// Power of two. The cache is flushed once three quarters of it are used.
+#define DESCRIPTOR_CACHE_CAPACITY 256
+#define DESCRIPTOR_CACHE_MAX_BINDINGS 4
+
+// How many descriptors of a type a pool holds for each of its sets
+typedef struct {
+    VkDescriptorType type;
+    uint32_t per_set;
+} DescriptorPoolRatio;
+
+// A chain of descriptor pools: when one is out of memory, sets come from the next one, created
+// on the spot if needed. Sets are never freed one by one, the whole chain is reset at once, and
+// its pools are kept for what comes after.
+// Not thread safe.
+typedef struct {
+    VkDevice device;
+    const VkAllocationCallbacks* allocator;
+    uint32_t ratio_count;
+    DescriptorPoolRatio ratios[DESCRIPTOR_ALLOCATOR_MAX_RATIOS];
+    uint32_t next_pool_sets; // size of the next pool created
+
+    uint32_t pool_count;
+    VkDescriptorPool pools[DESCRIPTOR_ALLOCATOR_MAX_POOLS];
+    uint32_t current; // the pools before it are full
+
+    // since the last report
+    uint32_t allocations; // vkAllocateDescriptorSets calls
+    uint32_t pools_created;
+} DescriptorAllocator;
+
+bool descriptor_allocator_create(DescriptorAllocator* allocator, VkDevice device,
+                                 const VkAllocationCallbacks* callbacks, uint32_t sets_per_pool,
+                                 const DescriptorPoolRatio* ratios, uint32_t ratio_count);
+// The device must be done with the sets
+void descriptor_allocator_destroy(DescriptorAllocator* allocator);
+// VK_NULL_HANDLE when no pool can be created anymore
+VkDescriptorSet descriptor_allocator_allocate(DescriptorAllocator* allocator,
+                                              VkDescriptorSetLayout layout);
+// Every set allocated so far goes back to the pools: the device must be done with them
+void descriptor_allocator_reset(DescriptorAllocator* allocator);
+
+// What one binding of a set points to. Only the info matching the type is read.
+typedef struct {
+    uint32_t binding;
+    VkDescriptorType type;
+    VkDescriptorBufferInfo buffer; // uniform and storage buffers
+    VkDescriptorImageInfo image;   // images, samplers and input attachments
+} DescriptorBinding;
+
+typedef struct {
+    uint64_t hash; // 0: free slot
+    VkDescriptorSetLayout layout;
+    uint32_t binding_count;
+    DescriptorBinding bindings[DESCRIPTOR_CACHE_MAX_BINDINGS];
+    VkDescriptorSet set;
+} DescriptorCacheEntry;
+
+// Descriptor sets already written, looked up by a hash of their layout and bindings: asking
+// twice for the same resources gives the same set, allocated and written once. Use one per frame
+// in flight, the sets are never written again while a frame may read them.
+// Everything is dropped at once, by resetting the pools, when the cache is full or when the
+// resources it points to go away.
+typedef struct {
+    DescriptorAllocator sets;
+    bool flush_requested;
+    uint32_t count;
+    DescriptorCacheEntry entries[DESCRIPTOR_CACHE_CAPACITY];
+
+    // since the last report
+    uint32_t lookups;
+    uint32_t hits;
+    uint32_t flushes;
+} DescriptorCache;
+
+bool descriptor_cache_create(DescriptorCache* cache, VkDevice device,
+                             const VkAllocationCallbacks* callbacks, uint32_t sets_per_pool,
+                             const DescriptorPoolRatio* ratios, uint32_t ratio_count);
+void descriptor_cache_destroy(DescriptorCache* cache);
+// Once the frame that last used the cache is done on the GPU, before any lookup: applies the
+// flushes requested since
+void descriptor_cache_begin_frame(DescriptorCache* cache);
+// Some resources the sets point to are about to be destroyed. Their handles could come back for
+// new resources: the whole cache is flushed on the next begin_frame.
+void descriptor_cache_invalidate(DescriptorCache* cache);
+// VK_NULL_HANDLE when it could not be allocated
+VkDescriptorSet descriptor_cache_get(DescriptorCache* cache, VkDescriptorSetLayout layout,
+                                     const DescriptorBinding* bindings, uint32_t binding_count);
+
+// Summed over the caches, and reset
+void descriptor_cache_print_stats(DescriptorCache* caches, uint32_t cache_count);
+
+#endif
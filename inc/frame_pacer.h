@@ -0,0 +1,43 @@
+#ifndef FRAME_PACER_H
+#define FRAME_PACER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+// Sleeps overshoot by up to a scheduler tick: the end of each wait is spent spinning on the clock
+#define FRAME_PACER_DEFAULT_SPIN_MS 1.5
+
+// Since the last report
+typedef struct {
+    uint32_t frames;
+    uint32_t late_frames; // the deadline had already passed when the frame was done
+    double slept_ms;
+    double spun_ms;
+    double max_error_ms; // how far past the deadline a wait ended
+} FramePacerStats;
+
+// Caps the frame rate. Deadlines are absolute, on the monotonic clock: a frame that finishes
+// early does not push the next ones, and a late one is not caught up with a burst of frames.
+typedef struct {
+    double frame_ms; // 0: no cap
+    double spin_ms;
+    struct timespec deadline;
+    bool started; // there is a deadline to wait for
+
+    FramePacerStats stats;
+} FramePacer;
+
+// max_fps 0 disables the cap
+void frame_pacer_init(FramePacer* pacer, double max_fps, double spin_ms);
+void frame_pacer_set_max_fps(FramePacer* pacer, double max_fps);
+// The next frame starts a new schedule, eg after the loop was idle waiting for events
+void frame_pacer_reset(FramePacer* pacer);
+// Call once per frame, after presenting. Returns once the frame's slot is over.
+void frame_pacer_wait(FramePacer* pacer);
+
+double frame_pacer_now_ms(void);
+
+void frame_pacer_print_stats(FramePacer* pacer); // and resets them
+
+#endif
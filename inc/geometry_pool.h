@@ -0,0 +1,180 @@
+#ifndef GEOMETRY_POOL_H
+#define GEOMETRY_POOL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <vulkan/vulkan.h>
+
+#include "deletion_queue.h"
+#include "gpu_memory.h"
+#include "submit_service.h"
+
+#define GEOMETRY_POOL_MAX_MESHES 1024
+#define GEOMETRY_POOL_MAX_UPLOADS 16
+// free space split in at least this many holes, in either buffer: compacted in the background
+#define GEOMETRY_POOL_COMPACT_HOLES 8
+// host visible device local heaps this small are the BAR window of a discrete GPU without
+// resizable BAR: too scarce to put the geometry there
+#define GEOMETRY_POOL_SMALL_BAR_HEAP_SIZE (256ull * 1024 * 1024)
+
+#define GEOMETRY_MESH_NONE UINT32_MAX
+
+// In elements of the buffer: vertices or indices
+typedef struct {
+    uint32_t offset;
+    uint32_t count;
+} GeometryRange;
+
+// First fit over the free ranges of one buffer, kept sorted by offset and merged with their
+// neighbours when freed
+typedef struct {
+    uint32_t capacity;
+    uint32_t used;
+    uint32_t free_count;
+    uint32_t free_capacity;
+    GeometryRange* free_ranges;
+} GeometryAllocator;
+
+typedef enum {
+    GEOMETRY_MESH_FREE = 0,
+    GEOMETRY_MESH_UPLOADING, // ranges allocated, copy on the transfer queue
+    GEOMETRY_MESH_READY,
+} GeometryMeshState;
+
+typedef struct {
+    GeometryMeshState state;
+    bool release_requested; // released while uploading
+    GeometryRange vertices; // offset: the vertexOffset of the draw
+    GeometryRange indices;  // offset: the firstIndex of the draw
+} GeometryMesh;
+
+typedef struct {
+    uint32_t mesh;
+    VkBuffer staging_buffer;
+    VkDeviceMemory staging_memory;
+    VkCommandBuffer command_buffer;
+    VkFence done;
+    VkDeviceSize size;
+    double start_ms;
+} GeometryUpload;
+
+typedef struct {
+    GeometryRange vertices;
+    GeometryRange indices;
+    uint64_t retire_frame; // back in the free lists once this frame number is reached
+} RetiredGeometryRanges;
+
+typedef struct {
+    VkBuffer vertex_buffer;
+    VkDeviceMemory vertex_memory;
+    VkBuffer index_buffer;
+    VkDeviceMemory index_memory;
+    // direct uploads only, mapped for as long as the buffers live
+    uint8_t* vertex_mapped;
+    uint8_t* index_mapped;
+} GeometryBuffers;
+
+// Every ready mesh copied back to back into new buffers, which replace the current ones once the
+// copy is done. Frames in flight keep using the old buffers, with the old offsets.
+typedef struct {
+    bool active;
+    GeometryBuffers target;
+    VkCommandBuffer command_buffer;
+    VkFence done;
+    uint32_t vertex_end;
+    uint32_t index_end;
+    uint32_t mesh_count;
+    uint32_t meshes[GEOMETRY_POOL_MAX_MESHES];
+    GeometryRange vertices[GEOMETRY_POOL_MAX_MESHES];
+    GeometryRange indices[GEOMETRY_POOL_MAX_MESHES];
+} GeometryCompaction;
+
+typedef struct {
+    VkDevice device;
+    VkPhysicalDevice physical_device;
+    const VkAllocationCallbacks* allocator;
+
+    uint32_t transfer_family;
+    VkCommandPool transfer_command_pool;
+    uint32_t graphics_family; // the buffers are shared with it
+
+    uint32_t vertex_stride; // bytes
+    VkIndexType index_type;
+    uint32_t vertex_capacity;
+    uint32_t index_capacity;
+
+    // replaced buffers are released through it
+    DeletionQueue* deletion_queue;
+    // optional, allocations are reported to it
+    GpuMemoryTracker* memory_tracker;
+    // the copies are submitted to the transfer queue through it
+    SubmitService* transfer_submit;
+    // always go through a staging buffer, eg to compare with direct uploads
+    bool force_staging;
+} GeometryPoolCreateInfo;
+
+// A few large device local vertex and index buffers that every mesh is suballocated from, so
+// that all draws share one vertex and one index buffer binding: a mesh is drawn with its
+// vertexOffset and firstIndex. The vertex buffer is a storage buffer too, for vertex pulling.
+// When the device has plenty of memory that is both device local and host visible (integrated
+// GPUs, resizable BAR, CPU implementations), the buffers live there and meshes are written in
+// place: no staging buffer, no copy on the transfer queue.
+// Not thread safe, everything happens on the render thread.
+typedef struct {
+    GeometryPoolCreateInfo info;
+    VkPhysicalDeviceMemoryProperties memory_properties;
+    uint32_t index_size; // bytes
+    uint64_t frame_number;
+    bool direct_upload;
+
+    GeometryBuffers buffers;
+    GeometryAllocator vertices;
+    GeometryAllocator indices;
+    GeometryMesh meshes[GEOMETRY_POOL_MAX_MESHES];
+    uint32_t mesh_count;
+
+    GeometryUpload uploads[GEOMETRY_POOL_MAX_UPLOADS];
+    bool upload_in_use[GEOMETRY_POOL_MAX_UPLOADS];
+    uint32_t upload_count;
+
+    uint32_t retired_count;
+    uint32_t retired_capacity;
+    RetiredGeometryRanges* retired;
+
+    GeometryCompaction compaction;
+    // over the whole run
+    uint32_t compactions;
+    VkDeviceSize compacted_bytes;
+    uint32_t uploaded_meshes;
+    VkDeviceSize uploaded_bytes;
+    // the two paths are compared on both: what the caller pays, and when the mesh can be drawn
+    double upload_cpu_ms;     // in geometry_pool_add_mesh, copying and submitting
+    double upload_latency_ms; // summed, from the call to the mesh being usable
+} GeometryPool;
+
+bool geometry_pool_create(GeometryPool* pool, const GeometryPoolCreateInfo* info);
+// The device must be idle
+void geometry_pool_destroy(GeometryPool* pool);
+
+// Copies the data to the GPU in the background and returns the handle of the mesh, or
+// GEOMETRY_MESH_NONE when the pool is full. index_count can be 0 for a non indexed mesh.
+uint32_t geometry_pool_add_mesh(GeometryPool* pool, const void* vertices, uint32_t vertex_count,
+                                const void* indices, uint32_t index_count);
+// Its ranges are reused once the frames recorded until now are done
+void geometry_pool_remove_mesh(GeometryPool* pool, uint32_t mesh, uint64_t frame_number);
+// NULL until the mesh is uploaded
+const GeometryMesh* geometry_pool_mesh(const GeometryPool* pool, uint32_t mesh);
+
+// Once per frame, before recording: finishes uploads and compactions whose copy is done, reuses
+// the ranges frames before first_pending_frame were reading, and starts a compaction when the
+// free space is too fragmented. Never waits.
+void geometry_pool_update(GeometryPool* pool, uint64_t frame_number, uint64_t first_pending_frame);
+// Blocks until every mesh added so far can be drawn, eg at startup
+void geometry_pool_finish_uploads(GeometryPool* pool);
+// Whether updates still have something to do
+bool geometry_pool_busy(const GeometryPool* pool);
+
+void geometry_pool_print_stats(const GeometryPool* pool);
+
+#endif
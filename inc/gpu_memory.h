@@ -0,0 +1,101 @@
+#ifndef GPU_MEMORY_H
+#define GPU_MEMORY_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <vulkan/vulkan.h>
+
+// Without VK_EXT_memory_budget, this share of each heap is assumed to be ours to use
+#define GPU_MEMORY_FALLBACK_BUDGET_RATIO 0.8
+
+typedef enum {
+    GPU_MEMORY_VERTEX = 0,
+    GPU_MEMORY_INDEX,
+    GPU_MEMORY_UNIFORM,
+    GPU_MEMORY_STORAGE,
+    GPU_MEMORY_STAGING,
+    GPU_MEMORY_TEXTURE,
+    GPU_MEMORY_RENDER_TARGET,
+    GPU_MEMORY_CATEGORY_COUNT,
+} GpuMemoryCategory;
+
+typedef struct {
+    VkDeviceSize bytes;
+    VkDeviceSize peak_bytes; // high-water mark
+    uint32_t allocations;
+} GpuMemoryCounter;
+
+typedef struct {
+    VkDeviceMemory memory;
+    VkDeviceSize size;
+    uint32_t memory_type;
+    GpuMemoryCategory category;
+} GpuMemoryAllocation;
+
+// Called from gpu_memory_poll when a heap goes above the pressure ratio of its budget
+typedef void (*GpuMemoryPressureCallback)(uint32_t heap, VkDeviceSize usage, VkDeviceSize budget,
+                                          void* user_data);
+
+// Every device memory allocation goes through here, so that we know where the memory goes.
+// Budget and usage per heap come from VK_EXT_memory_budget when the device has it (usage then
+// includes other processes and the driver's own allocations), from our own counts otherwise.
+typedef struct {
+    VkDevice device;
+    VkPhysicalDevice physical_device;
+    const VkAllocationCallbacks* allocator; // host memory of the driver, may be NULL
+    bool budget_extension;
+    VkPhysicalDeviceMemoryProperties properties;
+
+    pthread_mutex_t mutex; // allocations may come from several threads
+    GpuMemoryCounter categories[GPU_MEMORY_CATEGORY_COUNT];
+    GpuMemoryCounter heaps[VK_MAX_MEMORY_HEAPS]; // our allocations only
+    uint32_t failed_allocations;
+
+    // as of the last poll
+    VkDeviceSize heap_budget[VK_MAX_MEMORY_HEAPS];
+    VkDeviceSize heap_usage[VK_MAX_MEMORY_HEAPS];
+    VkDeviceSize heap_bytes_at_poll[VK_MAX_MEMORY_HEAPS]; // to account for allocations since
+
+    float pressure_ratio;
+    bool under_pressure[VK_MAX_MEMORY_HEAPS];
+    GpuMemoryPressureCallback pressure_callback;
+    void* pressure_user_data;
+
+    // live allocations, to know the size and category of what is freed
+    uint32_t allocation_count;
+    uint32_t allocation_capacity;
+    GpuMemoryAllocation* allocations;
+} GpuMemoryTracker;
+
+// budget_extension: VK_EXT_memory_budget was enabled on the device
+void gpu_memory_tracker_create(GpuMemoryTracker* tracker, VkDevice device,
+                               VkPhysicalDevice physical_device,
+                               const VkAllocationCallbacks* allocator, bool budget_extension);
+void gpu_memory_tracker_destroy(GpuMemoryTracker* tracker);
+
+// vkAllocateMemory/vkFreeMemory, with the bookkeeping. A failed allocation dumps the state.
+VkResult gpu_memory_allocate(GpuMemoryTracker* tracker, const VkMemoryAllocateInfo* allocate_info,
+                             GpuMemoryCategory category, VkDeviceMemory* memory);
+void gpu_memory_free(GpuMemoryTracker* tracker, VkDeviceMemory memory);
+
+// The callback fires once when usage goes above ratio * budget, and again only after it went
+// back under. Default ratio: 0.9.
+void gpu_memory_set_pressure_callback(GpuMemoryTracker* tracker, float ratio,
+                                      GpuMemoryPressureCallback callback, void* user_data);
+
+// Refreshes the budgets (once per frame is plenty), fires the pressure callbacks, and dumps the
+// state if the dump signal was received since the last poll
+void gpu_memory_poll(GpuMemoryTracker* tracker);
+
+// Bytes that can still be allocated from this memory type before its heap is under pressure
+VkDeviceSize gpu_memory_headroom(GpuMemoryTracker* tracker, uint32_t memory_type);
+
+void gpu_memory_dump(GpuMemoryTracker* tracker, FILE* file);
+
+// Dumps the state at the next poll when this signal is received, eg SIGUSR1
+void gpu_memory_dump_on_signal(int signal_number);
+
+#endif
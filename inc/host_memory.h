@@ -0,0 +1,105 @@
+#ifndef HOST_MEMORY_H
+#define HOST_MEMORY_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vulkan/vulkan.h>
+
+// Pooled blocks go from 32 bytes to 8 KiB, doubling. Bigger ones come straight from the heap.
+#define HOST_SIZE_CLASS_COUNT 9
+#define HOST_SMALLEST_SIZE_CLASS 32
+// Pools grow by this much at a time, and never give memory back until destroyed
+#define HOST_SLAB_SIZE (64 * 1024)
+
+typedef enum {
+    HOST_SCOPE_VK_COMMAND = 0, // the VkSystemAllocationScope values, in the same order
+    HOST_SCOPE_VK_OBJECT,
+    HOST_SCOPE_VK_CACHE,
+    HOST_SCOPE_VK_DEVICE,
+    HOST_SCOPE_VK_INSTANCE,
+    HOST_SCOPE_FRAME,     // frame arena, everything goes at the next frame
+    HOST_SCOPE_SWAPCHAIN, // lives until the swapchain is recreated
+    HOST_SCOPE_APP,       // the app outside of frames: init, replays, shutdown
+    HOST_SCOPE_COUNT,
+} HostScope;
+
+typedef struct {
+    uint64_t allocations; // over the whole run
+    uint64_t frees;
+    size_t bytes;
+    size_t peak_bytes;
+    uint64_t frame_allocations; // during the last complete frame
+} HostScopeStats;
+
+typedef struct HostBlock {
+    struct HostBlock* next;
+} HostBlock;
+
+// Fixed size blocks carved out of slabs, recycled through a free list
+typedef struct {
+    size_t block_size;
+    HostBlock* free_list;
+    HostBlock* slabs; // each slab starts with the link to the next one
+} HostPool;
+
+// Linear allocator: allocations are a pointer bump, and all of them are dropped at once
+typedef struct {
+    uint8_t* base;
+    size_t capacity;
+    size_t offset;
+    size_t peak;
+    HostBlock* overflow; // heap blocks taken when the arena was full, freed on reset
+} HostArena;
+
+// Host memory of the app and of the Vulkan driver. Pools and heap allocations are thread safe,
+// the frame arena is for the render thread only.
+// The modules create their Vulkan objects with callbacks too, but their own bookkeeping comes
+// from malloc (the texture streamer, the geometry pool, the scene graph, ...) and does not show up
+// in the heap counts.
+typedef struct {
+    pthread_mutex_t mutex;
+    HostPool pools[HOST_SIZE_CLASS_COUNT];
+    HostArena frame_arena;
+    HostScopeStats scopes[HOST_SCOPE_COUNT];
+
+    // what really hits malloc: new slabs, big blocks and arena overflows. Zero in a frame means
+    // the frame was served from memory reserved earlier.
+    uint64_t heap_allocations;
+    bool in_frame; // host_memory_begin_frame was called at least once
+    uint64_t frame_heap_allocations; // during the last complete frame
+    uint64_t frame_start_heap_allocations;
+    uint64_t frame_start_scope_allocations[HOST_SCOPE_COUNT];
+    uint64_t frames;
+    uint64_t frames_with_heap_allocations;
+    // reported by the driver, which allocated them on its own (eg executable memory)
+    uint64_t internal_allocations;
+    size_t internal_bytes;
+
+    // pass &callbacks to every Vulkan call, with pUserData pointing here
+    VkAllocationCallbacks callbacks;
+} HostMemory;
+
+void host_memory_create(HostMemory* memory, size_t frame_arena_capacity);
+// Every pooled block goes back at once, whether it was freed or not
+void host_memory_destroy(HostMemory* memory);
+
+void* host_alloc(HostMemory* memory, size_t size, HostScope scope);
+// Zeroed, like calloc
+void* host_calloc(HostMemory* memory, size_t count, size_t size, HostScope scope);
+void* host_alloc_aligned(HostMemory* memory, size_t size, size_t alignment, HostScope scope);
+void* host_realloc(HostMemory* memory, void* pointer, size_t size, size_t alignment,
+                   HostScope scope);
+void host_free(HostMemory* memory, void* pointer);
+
+// Valid until the next host_memory_begin_frame, never freed individually. Zeroed.
+void* host_frame_alloc(HostMemory* memory, size_t size);
+
+// Closes the accounting of the previous frame and empties the frame arena
+void host_memory_begin_frame(HostMemory* memory);
+
+void host_memory_print_stats(const HostMemory* memory);
+
+#endif
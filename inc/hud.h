@@ -0,0 +1,63 @@
+#ifndef HUD_H
+#define HUD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// frames shown in the frame time graph
+#define HUD_GRAPH_FRAMES 128
+// weight of a new value in the averages shown as text, so that they do not flicker
+#define HUD_SMOOTHING 0.05
+
+// 0xAABBGGRR: r in the lowest byte, read as VK_FORMAT_R8G8B8A8_UNORM
+#define HUD_COLOR_BACKGROUND 0xc0000000u
+#define HUD_COLOR_TEXT 0xffe0e0e0u
+#define HUD_COLOR_LABEL 0xffa0a0a0u
+#define HUD_COLOR_GOOD 0xff60d060u
+#define HUD_COLOR_WARNING 0xff40c0f0u
+#define HUD_COLOR_BAD 0xff4040f0u
+
+// must match the inputs of hud.vert
+typedef struct {
+    float position[2]; // in pixels, from the top left corner
+    uint32_t color;
+} HudVertex;
+
+// Builds the overlay as plain colored triangles, text included (a 3x5 font, one quad per run of
+// lit pixels), so that it is a single draw without texture. Vertices are written in order and
+// never read back: they can go straight to write-combined memory.
+typedef struct {
+    HudVertex* vertices;
+    uint32_t capacity;
+    uint32_t count;
+    bool overflowed; // vertices were dropped since hud_begin
+
+    float scale;    // pixels per font pixel
+    float origin_x; // of the panel
+    float origin_y;
+    float line_y;   // of the next line of text
+    float max_x;    // right edge of what was drawn, for the background
+    uint32_t first; // vertices of the background, filled in by hud_end
+
+    double frame_ms[HUD_GRAPH_FRAMES]; // ring, oldest at frame_head
+    uint32_t frame_head;
+} Hud;
+
+void hud_init(Hud* hud, float scale);
+double hud_smooth(double average, double value);
+void hud_push_frame_time(Hud* hud, double ms);
+
+// Starts a panel at (x, y), its vertices go to vertices
+void hud_begin(Hud* hud, HudVertex* vertices, uint32_t capacity, float x, float y);
+void hud_rect(Hud* hud, float x, float y, float width, float height, uint32_t color);
+// Returns the x after the last character. Lowercase is drawn as uppercase.
+float hud_text(Hud* hud, float x, float y, const char* text, uint32_t color);
+// One line of text under the previous one
+void hud_printf(Hud* hud, uint32_t color, const char* format, ...);
+// The pushed frame times as bars, under the previous line. budget_ms is drawn as a line, bars
+// above it are red.
+void hud_graph(Hud* hud, float height, double budget_ms);
+// Sizes the background to what was drawn. Returns the number of vertices to draw.
+uint32_t hud_end(Hud* hud);
+
+#endif
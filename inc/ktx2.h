@@ -0,0 +1,47 @@
+#ifndef KTX2_H
+#define KTX2_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vulkan/vulkan.h>
+
+#define KTX2_MAX_LEVELS 16
+
+// Block compressed formats the renderer accepts from KTX2 files. Each one may or may not be
+// sampleable on a given device, cf is_device_suitable.
+#define KTX2_COMPRESSED_FORMAT_COUNT 13
+extern const VkFormat KTX2_COMPRESSED_FORMATS[KTX2_COMPRESSED_FORMAT_COUNT];
+
+typedef struct {
+    size_t offset; // in Ktx2Texture.data
+    size_t size;
+    uint32_t width;
+    uint32_t height;
+} Ktx2Level;
+
+// A 2D texture with its prebuilt mip chain, level 0 being the largest. All the levels are packed
+// in data, in that order, so it can be copied to a staging buffer as is.
+typedef struct {
+    VkFormat format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t level_count;
+    Ktx2Level levels[KTX2_MAX_LEVELS];
+    uint8_t* data;
+    size_t data_size;
+} Ktx2Texture;
+
+// Only plain 2D textures are read: no array, cubemap, 3D or supercompression (Basis, zstd)
+bool ktx2_load(const char* path, Ktx2Texture* texture);
+void ktx2_free(Ktx2Texture* texture);
+
+// Index of the format in KTX2_COMPRESSED_FORMATS, -1 if it is not one of them
+int ktx2_compressed_format_index(VkFormat format);
+
+// Decodes every level to rgba8 (srgb when the source is), which every device can sample.
+// Returns false when there is no CPU decoder for the source format.
+bool ktx2_transcode_to_rgba8(const Ktx2Texture* src, Ktx2Texture* dst);
+
+#endif
@@ -2,5 +2,6 @@
 #define MACROS_H
 
 #define MAKE_SHADER_PATH(a) SHADERS_FOLDER_PATH a
+#define MAKE_TEXTURE_PATH(a) TEXTURES_FOLDER_PATH a
 
 #endif
\ No newline at end of file
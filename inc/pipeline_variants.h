@@ -0,0 +1,102 @@
+#ifndef PIPELINE_VARIANTS_H
+#define PIPELINE_VARIANTS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <vulkan/vulkan.h>
+
+#define PIPELINE_VARIANT_MAX_VERTEX_BINDINGS 4
+#define PIPELINE_VARIANT_MAX_VERTEX_ATTRIBUTES 8
+#define PIPELINE_VARIANT_MAX_SPECIALIZATION_CONSTANTS 8
+
+typedef enum {
+    PIPELINE_BLEND_OPAQUE = 0,
+    PIPELINE_BLEND_ALPHA,
+    PIPELINE_BLEND_ADDITIVE,
+    PIPELINE_BLEND_PREMULTIPLIED,
+} PipelineBlendMode;
+
+// Specialization constants of one shader stage. Every constant is stored on 32 bits, which covers
+// bool (as VkBool32), int, uint and float: the shader side decides how the bits are read.
+typedef struct {
+    uint32_t constant_count;
+    uint32_t constant_ids[PIPELINE_VARIANT_MAX_SPECIALIZATION_CONSTANTS];
+    uint32_t values[PIPELINE_VARIANT_MAX_SPECIALIZATION_CONSTANTS];
+} ShaderSpecialization;
+
+// Everything that makes two graphics pipelines different. The create info is entirely derived
+// from this, so hashing it is the same as hashing the create info (without chasing pointers).
+// Always start from pipeline_variant_desc_init to get sane defaults.
+typedef struct {
+    VkShaderModule vertex_shader;
+    VkShaderModule fragment_shader;
+    ShaderSpecialization vertex_specialization;
+    ShaderSpecialization fragment_specialization;
+
+    uint32_t vertex_binding_count;
+    VkVertexInputBindingDescription vertex_bindings[PIPELINE_VARIANT_MAX_VERTEX_BINDINGS];
+    uint32_t vertex_attribute_count;
+    VkVertexInputAttributeDescription vertex_attributes[PIPELINE_VARIANT_MAX_VERTEX_ATTRIBUTES];
+
+    VkPrimitiveTopology topology;
+    VkPolygonMode polygon_mode;
+    VkCullModeFlags cull_mode;
+    VkFrontFace front_face;
+    PipelineBlendMode blend_mode;
+    VkBool32 depth_test;
+    VkBool32 depth_write;
+    VkCompareOp depth_compare_op;
+    VkSampleCountFlagBits samples; // must match the attachments of the subpass
+
+    VkPipelineLayout layout;
+    VkRenderPass render_pass;
+    uint32_t subpass;
+} PipelineVariantDesc;
+
+// A set of requested variants. Requests with identical state share the same pipeline.
+typedef struct {
+    uint32_t request_count;
+    uint32_t* request_to_unique; // request index -> unique variant index
+
+    uint32_t unique_count;
+    uint32_t unique_capacity;
+    PipelineVariantDesc* descs; // per unique variant
+    uint64_t* hashes;
+    VkPipeline* pipelines;
+    double* compile_times_ms;
+    VkResult* results;
+
+    double build_wall_time_ms;
+} PipelineVariantSet;
+
+void pipeline_variant_desc_init(PipelineVariantDesc* desc);
+uint64_t pipeline_variant_desc_hash(const PipelineVariantDesc* desc);
+
+// Sets (or overrides) the value of a specialization constant. Constants left unset keep the
+// default written in the shader.
+void shader_specialization_set_bool(ShaderSpecialization* spec, uint32_t constant_id, bool value);
+void shader_specialization_set_uint(ShaderSpecialization* spec, uint32_t constant_id,
+                                    uint32_t value);
+void shader_specialization_set_float(ShaderSpecialization* spec, uint32_t constant_id,
+                                     float value);
+
+// Returns the request index to pass to pipeline_variants_get once the set is built, UINT32_MAX
+// when the set cannot grow.
+uint32_t pipeline_variants_add(PipelineVariantSet* set, const PipelineVariantDesc* desc);
+
+// Compiles every variant not built yet on worker threads, against a shared pipeline cache.
+// nb_threads == 0 picks one thread per online core. allocator is used from every worker.
+void pipeline_variants_build(VkDevice device, const VkAllocationCallbacks* allocator,
+                             VkPipelineCache cache, PipelineVariantSet* set, uint32_t nb_threads);
+
+VkPipeline pipeline_variants_get(const PipelineVariantSet* set, uint32_t request_index);
+
+// Prints the compile time of each variant, slowest first
+void pipeline_variants_report(const PipelineVariantSet* set);
+
+// allocator: the one given to pipeline_variants_build
+void pipeline_variants_destroy(VkDevice device, const VkAllocationCallbacks* allocator,
+                               PipelineVariantSet* set);
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef PRESENT_THREAD_H
+#define PRESENT_THREAD_H
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <vulkan/vulkan.h>
+
+#include "submit_service.h"
+
+// Power of two. The render thread never has more than an acquire and a few presents queued.
+#define PRESENT_RING_CAPACITY 16
+
+typedef enum {
+    PRESENT_MESSAGE_ACQUIRE = 0, // to the thread: acquire an image, signaling semaphore
+    PRESENT_MESSAGE_PRESENT,     // to the thread: present image_index once semaphore is signaled
+    PRESENT_MESSAGE_FLUSH,       // to the thread: answer once everything before is done
+    PRESENT_MESSAGE_STOP,
+    PRESENT_MESSAGE_ACQUIRED, // from the thread: result and image_index of an acquire
+    PRESENT_MESSAGE_FLUSHED,
+} PresentMessageType;
+
+typedef struct {
+    PresentMessageType type;
+    VkSwapchainKHR swapchain;
+    VkSemaphore semaphore;
+    uint32_t image_index;
+    VkResult result;
+    // presents wait until the batch signaling their semaphore is submitted
+    SubmitService* after;
+    uint64_t after_ticket;
+} PresentMessage;
+
+// Lock-free single producer, single consumer ring. The semaphore counts the messages, so that
+// the consumer can sleep while it is empty.
+typedef struct {
+    PresentMessage messages[PRESENT_RING_CAPACITY];
+    atomic_uint head; // next to read, only moved by the consumer
+    atomic_uint tail; // next to write, only moved by the producer
+    sem_t available;
+} PresentRing;
+
+// Acquires and presents swapchain images on its own thread, so that the render thread does not
+// block on the presentation engine (a whole vblank under FIFO).
+// The swapchain is only touched by this thread between a flush and the next message: flush
+// before recreating it.
+typedef struct {
+    VkDevice device;
+    VkQueue present_queue;
+    // locked around presents when other threads submit to the same VkQueue, NULL otherwise
+    pthread_mutex_t* queue_mutex;
+    bool threaded; // false: everything is done on the calling thread, as it was before
+
+    pthread_t thread;
+    PresentRing requests; // render thread -> present thread
+    PresentRing replies;  // present thread -> render thread
+    PresentMessage inline_reply;
+    // a present found the swapchain out of date or suboptimal, it has to be recreated
+    atomic_bool out_of_date;
+} PresentThread;
+
+void present_thread_create(PresentThread* present, VkDevice device, VkQueue present_queue,
+                           pthread_mutex_t* queue_mutex, bool threaded);
+// Presents what is queued, then stops the thread
+void present_thread_destroy(PresentThread* present);
+
+// Returns right away: the image comes out of present_thread_wait_acquired. Only one acquire can
+// be pending at a time.
+void present_thread_acquire(PresentThread* present, VkSwapchainKHR swapchain,
+                            VkSemaphore image_available);
+// Blocks until the acquire is done, returns its result
+VkResult present_thread_wait_acquired(PresentThread* present, uint32_t* image_index);
+// render_finished is signaled by the batch of this ticket of the submit service
+void present_thread_present(PresentThread* present, VkSwapchainKHR swapchain,
+                            VkSemaphore render_finished, uint32_t image_index,
+                            SubmitService* after, uint64_t after_ticket);
+// Blocks until every message sent before is processed
+void present_thread_flush(PresentThread* present);
+// Whether a present found the swapchain out of date since the last call
+bool present_thread_out_of_date(PresentThread* present);
+
+#endif
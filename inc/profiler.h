@@ -0,0 +1,68 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Power of two. A frame records a few dozen zones: this holds well over a thousand frames.
+#define PROFILER_DEFAULT_CAPACITY (64 * 1024)
+// Power of two, start times of the last frames
+#define PROFILER_MAX_FRAMES 4096
+#define PROFILER_MAX_TRACKS 64
+// GPU zones go on their own track, threads get the next ones
+#define PROFILER_GPU_TRACK 0
+
+typedef struct {
+    // 2 * index + 1 while being written, 2 * index + 2 once complete
+    atomic_uint_fast64_t sequence;
+    const char* name; // a string literal, it is not copied
+    int64_t start_ns; // CLOCK_MONOTONIC
+    int64_t end_ns;
+    uint32_t track;
+} ProfileEvent;
+
+// Records timed zones from any thread into a ring, always on: recording costs two clock reads
+// and a few stores, nothing is formatted until a window of frames is written out as a Chrome
+// trace (chrome://tracing, ui.perfetto.dev). The oldest events are overwritten.
+typedef struct {
+    uint32_t capacity;
+    ProfileEvent* events;
+    atomic_uint_fast64_t write_index;
+
+    int64_t frame_starts[PROFILER_MAX_FRAMES]; // by frame number, only written by one thread
+    uint64_t frame_count;                      // frames begun
+
+    atomic_uint track_count;
+    const char* track_names[PROFILER_MAX_TRACKS];
+} Profiler;
+
+typedef struct {
+    Profiler* profiler; // NULL: not recorded
+    const char* name;
+    int64_t start_ns;
+} ProfileZone;
+
+void profiler_create(Profiler* profiler, uint32_t capacity);
+void profiler_destroy(Profiler* profiler);
+
+int64_t profiler_now_ns(void);
+// Names the track of the calling thread. The string is not copied.
+void profiler_name_thread(Profiler* profiler, const char* name);
+
+// profiler can be NULL, for the code that only records when it is given one
+ProfileZone profiler_begin(Profiler* profiler, const char* name);
+// Returns the length of the zone in ns, 0 when it is not recorded
+int64_t profiler_end(const ProfileZone* zone);
+// A zone timed elsewhere, eg on the GPU, already on the CLOCK_MONOTONIC timebase
+void profiler_record(Profiler* profiler, const char* name, uint32_t track, int64_t start_ns,
+                     int64_t end_ns);
+
+// From the thread drawing the frames, when one starts
+void profiler_begin_frame(Profiler* profiler, uint64_t frame_number);
+// Everything recorded from the start of first_frame to the start of end_frame. The frames have
+// to be recent enough for the ring to still hold their start.
+bool profiler_write_chrome_trace(Profiler* profiler, const char* path, uint64_t first_frame,
+                                 uint64_t end_frame);
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <vulkan/vulkan.h>
+
+#define RENDER_QUEUE_MAX_DESCRIPTOR_SETS 4
+#define RENDER_QUEUE_MAX_PUSH_CONSTANTS 128 // the minimum maxPushConstantsSize
+// Below this many packets, sorting on a single thread is faster than waking up workers
+#define RENDER_QUEUE_PARALLEL_SORT_THRESHOLD 16384
+
+// Sort key layout, from the most significant bits:
+//   pass (4) | pipeline (12) | material (16) | mesh (16) | depth (16)
+// Packets sharing the most state end up next to each other, so most binds can be skipped.
+// Depth comes last: within identical state, draws go front-to-back.
+#define RENDER_QUEUE_PASS_BITS 4
+#define RENDER_QUEUE_PIPELINE_BITS 12
+#define RENDER_QUEUE_MATERIAL_BITS 16
+#define RENDER_QUEUE_MESH_BITS 16
+#define RENDER_QUEUE_DEPTH_BITS 16
+
+// Everything needed to record one draw. Only what differs from the previous packet is bound.
+typedef struct {
+    VkPipeline pipeline;
+    VkPipelineLayout layout;
+
+    uint32_t descriptor_set_count; // bound from set 0
+    VkDescriptorSet descriptor_sets[RENDER_QUEUE_MAX_DESCRIPTOR_SETS];
+
+    VkBuffer vertex_buffer;
+    VkDeviceSize vertex_buffer_offset;
+    VkBuffer index_buffer; // VK_NULL_HANDLE for a non indexed draw
+    VkDeviceSize index_buffer_offset;
+    VkIndexType index_type;
+
+    uint32_t count; // indices, or vertices for a non indexed draw
+    uint32_t instance_count;
+    uint32_t first_index; // first vertex for a non indexed draw
+    int32_t vertex_offset;
+    uint32_t first_instance;
+
+    VkShaderStageFlags push_constant_stages;
+    uint32_t push_constant_size; // 0: no push constants
+    uint8_t push_constants[RENDER_QUEUE_MAX_PUSH_CONSTANTS];
+} DrawPacket;
+
+// What the packet is sorted on, kept apart from the packet so that sorting moves 16 bytes
+typedef struct {
+    uint64_t key;
+    uint32_t packet;
+    uint32_t padding;
+} RenderQueueEntry;
+
+// Of the last recording
+typedef struct {
+    uint32_t draws;
+    uint64_t triangles; // every draw is a triangle list
+    uint32_t pipeline_binds;
+    uint32_t pipeline_binds_elided;
+    uint32_t descriptor_set_binds;
+    uint32_t descriptor_set_binds_elided;
+    uint32_t vertex_buffer_binds;
+    uint32_t vertex_buffer_binds_elided;
+    uint32_t index_buffer_binds;
+    uint32_t index_buffer_binds_elided;
+    uint32_t push_constants;
+    uint32_t push_constants_elided;
+    double sort_time_ms;
+} RenderQueueStats;
+
+typedef struct {
+    uint32_t capacity;
+    uint32_t count;
+    DrawPacket* packets;       // submission order
+    RenderQueueEntry* entries; // sorted by render_queue_sort
+    RenderQueueEntry* scratch; // radix sort ping-pong buffer
+    uint32_t nb_threads;
+    RenderQueueStats stats;
+} RenderQueue;
+
+// nb_threads == 0 picks one thread per online core, for the sorts of large queues
+void render_queue_create(RenderQueue* queue, uint32_t capacity, uint32_t nb_threads);
+void render_queue_destroy(RenderQueue* queue);
+
+// Empties the queue, to be filled again for the next frame
+void render_queue_reset(RenderQueue* queue);
+
+// Builds a key from its fields. Each one is truncated to its width; depth is in [0, 1], 0 being
+// the nearest.
+uint64_t render_queue_make_key(uint32_t pass, uint32_t pipeline, uint32_t material, uint32_t mesh,
+                               float depth);
+
+// Copies the packet in the queue. Returns false when the queue is full.
+bool render_queue_submit(RenderQueue* queue, uint64_t key, const DrawPacket* packet);
+
+// Stable sort by key: packets with equal keys keep their submission order
+void render_queue_sort(RenderQueue* queue);
+
+// Records every packet in key order, skipping binds of state that is already bound. Nothing is
+// assumed to be bound when it starts. Dynamic state (viewport, scissor) is left to the caller.
+void render_queue_record(RenderQueue* queue, VkCommandBuffer command_buffer);
+
+void render_queue_print_stats(const RenderQueue* queue);
+
+#endif
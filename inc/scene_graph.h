@@ -0,0 +1,65 @@
+#ifndef SCENE_GRAPH_H
+#define SCENE_GRAPH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <cglm/cglm.h>
+
+#define SCENE_NODE_NONE UINT32_MAX
+// GPU copies of the world matrices kept up to date, eg one per frame in flight
+#define SCENE_GRAPH_MAX_COPIES 8
+
+// Of the last update and upload
+typedef struct {
+    uint32_t nodes;
+    uint32_t nodes_updated;  // world matrix recomputed
+    uint32_t nodes_uploaded; // world matrix written in a GPU copy
+    double update_time_ms;
+} SceneGraphStats;
+
+// A hierarchy of transforms, in flat arrays indexed by node. Nodes are stored in topological
+// order (a parent always comes before its children), so a single walk in index order computes
+// every world matrix from an up to date parent.
+// Only the nodes whose local matrix changed, and their descendants, are recomputed; only the
+// recomputed ones are written to the GPU copies.
+typedef struct {
+    uint32_t capacity;
+    uint32_t count;
+    uint32_t copy_count;
+
+    uint32_t* parents; // SCENE_NODE_NONE for roots
+    mat4* locals;
+    mat4* worlds;
+
+    uint8_t* dirty;       // local changed since the last update, or parent recomputed
+    uint32_t dirty_count; // 0: the update has nothing to do
+    uint32_t first_dirty; // nothing before this index needs to be looked at
+
+    // per node, one bit per GPU copy that does not have its current world matrix yet. The nodes
+    // with any bit set are listed in stale_nodes, so uploads never walk the whole graph.
+    uint8_t* stale_copies;
+    uint32_t* stale_nodes;
+    uint32_t stale_count;
+
+    SceneGraphStats stats;
+} SceneGraph;
+
+void scene_graph_create(SceneGraph* graph, uint32_t capacity, uint32_t copy_count);
+void scene_graph_destroy(SceneGraph* graph);
+
+// Appends a node under an existing one (or SCENE_NODE_NONE for a root), which keeps the
+// topological order. Returns SCENE_NODE_NONE when the graph is full.
+uint32_t scene_graph_add_node(SceneGraph* graph, uint32_t parent, mat4 local);
+void scene_graph_set_local(SceneGraph* graph, uint32_t node, mat4 local);
+
+// Recomputes the world matrices of the changed nodes and of everything below them
+void scene_graph_update(SceneGraph* graph);
+
+// Writes in dst (capacity matrices, indexed by node) the world matrices this copy is missing.
+// Returns how many were written.
+uint32_t scene_graph_upload(SceneGraph* graph, uint32_t copy, mat4* dst);
+
+void scene_graph_print_stats(const SceneGraph* graph);
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Behind this much, the simulation drops time instead of running more steps to catch up
+#define SIMULATION_MAX_CATCH_UP_STEPS 8
+
+// Everything the renderer needs from the simulation, at one step
+typedef struct {
+    uint64_t step;
+    double time_s;         // monotonic clock time the step stands for
+    float turntable_angle; // radians, in [0, 2 pi)
+} SimulationState;
+
+// The last two steps, so the renderer can interpolate between them
+typedef struct {
+    SimulationState previous;
+    SimulationState current;
+} SimulationSnapshot;
+
+// Runs the scene logic on its own thread, at a fixed timestep on the monotonic clock, so a slow
+// frame does not slow the simulation down (and a fast one does not speed it up).
+// Snapshots go to the renderer through a triple buffer: the simulation always has a slot to
+// write, the renderer always has a complete one to read, and neither ever waits on the other.
+typedef struct {
+    double step_s;
+    float turntable_speed; // radians per second
+
+    pthread_t thread;
+    bool thread_started;
+    atomic_bool stopping;
+    atomic_bool animating; // the turntable spins
+
+    SimulationSnapshot slots[3];
+    // bits 0-1: index of the slot between the two threads, bit 2: it holds a snapshot the
+    // renderer has not taken yet
+    atomic_uint middle;
+    uint32_t back;  // simulation thread only
+    uint32_t front; // renderer only
+
+    // over the whole run. Written by the simulation thread, read for the reports.
+    atomic_uint_fast64_t steps;
+    atomic_uint_fast64_t dropped_steps; // skipped because the thread was too late
+    uint64_t snapshots_taken;           // by the renderer: fewer than steps when it runs slower
+} Simulation;
+
+// Starts the thread right away, from the given state
+void simulation_create(Simulation* simulation, double step_s, float turntable_speed,
+                       bool animating);
+void simulation_destroy(Simulation* simulation);
+
+void simulation_set_animating(Simulation* simulation, bool animating);
+
+// Renderer side: the state at render_time_s, interpolated between the last two steps. Render a
+// step in the past (now - step_s), so that there is a step on each side of it.
+// Returns whether the state still changes, ie the two steps differ.
+bool simulation_sample(Simulation* simulation, double render_time_s, SimulationState* state);
+
+double simulation_now_s(void);
+
+void simulation_print_stats(Simulation* simulation);
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef SUBMIT_SERVICE_H
+#define SUBMIT_SERVICE_H
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <vulkan/vulkan.h>
+
+// Power of two
+#define SUBMIT_RING_CAPACITY 256
+#define SUBMIT_MAX_COMMAND_BUFFERS 4
+#define SUBMIT_MAX_SEMAPHORES 4
+// batches merged in one vkQueueSubmit at most
+#define SUBMIT_MAX_COALESCED 32
+
+typedef struct SubmitService SubmitService;
+
+// One VkSubmitInfo worth of work
+typedef struct {
+    uint32_t command_buffer_count;
+    VkCommandBuffer command_buffers[SUBMIT_MAX_COMMAND_BUFFERS];
+    uint32_t wait_semaphore_count;
+    VkSemaphore wait_semaphores[SUBMIT_MAX_SEMAPHORES];
+    VkPipelineStageFlags wait_stages[SUBMIT_MAX_SEMAPHORES];
+    uint32_t signal_semaphore_count;
+    VkSemaphore signal_semaphores[SUBMIT_MAX_SEMAPHORES];
+    // signaled once this batch is done, and the ones submitted with it. Ends a vkQueueSubmit.
+    VkFence fence;
+    // optional: not submitted before this ticket of another service is, eg because it signals
+    // a semaphore this batch waits on
+    SubmitService* after;
+    uint64_t after_ticket;
+} SubmitBatch;
+
+typedef struct {
+    atomic_uint_fast64_t sequence; // the ring position it can be written at, or read at + 1
+    SubmitBatch batch;
+    double push_time_ms;
+} SubmitSlot;
+
+// Owns a VkQueue: every submit to it goes through here, so producers on any thread never lock.
+// Producers push batches in a lock-free bounded ring (multi producer, single consumer); one
+// submitter thread per queue takes everything that is waiting and hands it to the driver in as
+// few vkQueueSubmit calls as it can.
+struct SubmitService {
+    const char* name;
+    VkQueue queue;
+    // locked around submits when something else uses the queue (presents), NULL otherwise
+    pthread_mutex_t* queue_mutex;
+
+    SubmitSlot slots[SUBMIT_RING_CAPACITY];
+    atomic_uint_fast64_t enqueue_position; // producers
+    uint64_t dequeue_position;             // submitter thread only
+    sem_t available;                       // counts the pushed batches, the submitter sleeps on it
+    // tickets are ring positions + 1, handed to the driver in order
+    atomic_uint_fast64_t submitted;
+
+    pthread_t thread;
+    bool thread_started;
+    atomic_bool stopping;
+
+    // since the last report
+    atomic_uint_fast64_t submit_calls;
+    atomic_uint_fast64_t batches;
+    atomic_uint_fast64_t largest_call; // in batches
+    atomic_uint_fast64_t latency_total_us; // from push to vkQueueSubmit returning
+    atomic_uint_fast64_t latency_max_us;
+};
+
+void submit_service_create(SubmitService* service, const char* name, VkQueue queue,
+                           pthread_mutex_t* queue_mutex);
+// Submits what is left, then stops the thread
+void submit_service_destroy(SubmitService* service);
+
+// Thread safe, never blocks unless the ring is full. Returns the ticket of the batch.
+uint64_t submit_service_push(SubmitService* service, const SubmitBatch* batch);
+// Blocks until the batch of this ticket was given to the driver (not executed)
+void submit_service_wait_submitted(SubmitService* service, uint64_t ticket);
+// Blocks until everything pushed so far was given to the driver, eg before waiting for the device
+// to be idle: the queue is not in use after that
+void submit_service_flush(SubmitService* service);
+
+void submit_service_print_stats(SubmitService* service); // and resets them
+
+#endif
@@ -0,0 +1,156 @@
+#ifndef TEXTURE_STREAMER_H
+#define TEXTURE_STREAMER_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <vulkan/vulkan.h>
+
+#include "bindless.h"
+#include "gpu_memory.h"
+#include "profiler.h"
+#include "submit_service.h"
+
+#define TEXTURE_STREAMER_MAX_TEXTURES 1024
+#define TEXTURE_STREAMER_MAX_UPLOADS 16
+#define TEXTURE_STREAMER_MAX_PATH 256
+
+#define TEXTURE_HANDLE_NONE UINT32_MAX
+
+typedef enum {
+    TEXTURE_STATE_FREE = 0,
+    TEXTURE_STATE_LOADING,           // decoding on a worker thread
+    TEXTURE_STATE_PREVIEW_UPLOADING, // coarse version on its way to the GPU
+    TEXTURE_STATE_PREVIEW,           // coarse version usable, waiting for budget
+    TEXTURE_STATE_PREPARING,         // worker is downsampling the source to fit the budget
+    TEXTURE_STATE_UPLOADING,         // final version on its way to the GPU
+    TEXTURE_STATE_RESIDENT,          // final version usable
+    TEXTURE_STATE_FAILED,            // could not be loaded or uploaded, stays as it was
+} TextureState;
+
+// One GPU copy of a texture, with its full mip chain
+typedef struct {
+    VkImage image;
+    VkImageView view;
+    VkDeviceMemory memory;
+    VkDeviceSize size;
+    uint32_t width;
+    uint32_t height;
+    uint32_t mip_levels;
+    uint32_t bindless_index;
+} TextureVersion;
+
+typedef struct {
+    TextureState state;
+    bool release_requested; // released while a worker still had it
+    char path[TEXTURE_STREAMER_MAX_PATH];
+
+    // rgba8 source, kept until the final version is uploaded
+    uint8_t* pixels;
+    uint32_t width;
+    uint32_t height;
+
+    uint32_t mip_bias; // how many levels of the source are dropped in the current version
+    TextureVersion current;
+} StreamedTexture;
+
+// GPU mip generation needs the graphics queue (blits), the copy goes through the transfer queue
+typedef struct {
+    uint32_t texture;
+    uint32_t mip_bias;
+    bool is_preview;
+    TextureVersion version;
+
+    VkBuffer staging_buffer;
+    VkDeviceMemory staging_memory;
+    VkCommandBuffer transfer_command_buffer;
+    VkCommandBuffer graphics_command_buffer;
+    VkSemaphore copy_done;
+    VkFence done;
+} TextureUpload;
+
+typedef struct {
+    TextureVersion version;
+    uint64_t retire_frame; // destroyed once this frame number is reached
+} RetiredTextureVersion;
+
+typedef struct TextureJob TextureJob;
+
+typedef struct {
+    VkDevice device;
+    VkPhysicalDevice physical_device;
+    const VkAllocationCallbacks* allocator;
+    BindlessTable* bindless;
+
+    uint32_t transfer_family;
+    VkCommandPool transfer_command_pool;
+    uint32_t graphics_family;
+    VkCommandPool graphics_command_pool;
+
+    uint32_t frames_in_flight;
+    VkDeviceSize memory_budget; // bytes of image memory the streamer may keep resident
+    uint32_t preview_size;      // the coarse version is at most this wide/high
+    uint32_t max_uploads_per_frame;
+    uint32_t nb_worker_threads; // 0: one per core, minus the main thread
+    // optional. Allocations are reported to it, and no version is promoted past the headroom of
+    // the device local heap.
+    GpuMemoryTracker* memory_tracker;
+    // the copies and the mip generation are submitted to the queues through them
+    SubmitService* transfer_submit;
+    SubmitService* graphics_submit;
+    // optional, the jobs of the workers are not timed otherwise
+    Profiler* profiler;
+} TextureStreamerCreateInfo;
+
+typedef struct {
+    TextureStreamerCreateInfo info;
+    VkPhysicalDeviceMemoryProperties memory_properties;
+    uint32_t texture_memory_type; // UINT32_MAX until the first version is allocated
+    VkFilter blit_filter;
+    VkSampler sampler;
+
+    TextureVersion placeholder;
+    StreamedTexture* textures;
+    VkDeviceSize resident_bytes;
+
+    TextureUpload uploads[TEXTURE_STREAMER_MAX_UPLOADS];
+    bool upload_in_use[TEXTURE_STREAMER_MAX_UPLOADS];
+
+    uint32_t retired_count;
+    uint32_t retired_capacity;
+    RetiredTextureVersion* retired;
+
+    // worker threads: jobs go in pending, results come back in completed
+    uint32_t nb_workers;
+    pthread_t* workers;
+    pthread_mutex_t job_mutex;
+    pthread_cond_t job_available;
+    bool stopping;
+    TextureJob* pending_head;
+    TextureJob* pending_tail;
+    TextureJob* completed_head;
+} TextureStreamer;
+
+void texture_streamer_create(TextureStreamer* streamer, const TextureStreamerCreateInfo* info);
+void texture_streamer_destroy(TextureStreamer* streamer);
+
+// Starts loading the image in the background and returns immediately. The texture can be used
+// right away: it shows a placeholder, then a coarse version, then the highest resolution the
+// memory budget allows. Supported files: binary PPM (P6).
+uint32_t texture_streamer_request(TextureStreamer* streamer, const char* path);
+void texture_streamer_release(TextureStreamer* streamer, uint32_t handle, uint64_t frame_number);
+
+// Bindless slot of the best version currently on the GPU. It changes as better versions arrive,
+// so it has to be fetched again every frame.
+uint32_t texture_streamer_get_index(const TextureStreamer* streamer, uint32_t handle);
+
+// Call once per frame from the thread owning the queues. Finishes and starts uploads, and frees
+// the versions no frame in flight can use anymore. Never blocks on the GPU.
+void texture_streamer_update(TextureStreamer* streamer, uint64_t frame_number);
+
+// Whether updates still have something to do: textures on their way, or old versions to free.
+// Previews waiting for budget do not count, they only move when memory is released.
+bool texture_streamer_busy(const TextureStreamer* streamer);
+
+#endif
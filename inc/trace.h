@@ -0,0 +1,93 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define TRACE_MAGIC 0x4352544au // "JTRC"
+#define TRACE_VERSION 1
+// local matrices changed in a single frame
+#define TRACE_MAX_TRANSFORMS 64
+// parent of the roots, the same as SCENE_NODE_NONE
+#define TRACE_NODE_NONE UINT32_MAX
+
+// A trace is what a session drew, to draw it again headless and compare builds on the same
+// work: the scene nodes once, then for each frame the camera, the render settings and the nodes
+// that moved. Native byte order, replay it on the kind of machine it was captured on.
+//
+// TraceHeader, node_count TraceNode, then frame_count times a TraceFrame followed by its
+// transform_count TraceTransform.
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t width; // of the swapchain when the capture started
+    uint32_t height;
+    uint32_t node_count;
+    uint32_t frame_count;
+} TraceHeader;
+
+// In scene graph order: parents come first
+typedef struct {
+    uint32_t parent; // TRACE_NODE_NONE for roots
+    uint32_t drawn;  // a square is drawn with its transform
+    float local[16];
+} TraceNode;
+
+typedef struct {
+    float view[16];
+    float proj[16];
+    uint8_t debug_view;
+    uint8_t material_index;
+    uint8_t post_mode;
+    uint8_t vertex_fetch;
+    uint8_t sort_draws;
+    uint8_t padding;
+    uint16_t transform_count;
+} TraceFrame;
+
+typedef struct {
+    uint32_t node;
+    float local[16];
+} TraceTransform;
+
+// Frames are written as they end, the counts of the header once the file is closed
+typedef struct {
+    FILE* file;
+    TraceHeader header;
+    bool nodes_done; // nodes come before the first frame
+    uint32_t transform_count;
+    TraceTransform transforms[TRACE_MAX_TRANSFORMS]; // of the frame being captured
+} TraceWriter;
+
+bool trace_writer_open(TraceWriter* writer, const char* path, uint32_t width, uint32_t height);
+// Writes the counts, then closes the file
+void trace_writer_close(TraceWriter* writer);
+void trace_writer_add_node(TraceWriter* writer, uint32_t parent, bool drawn, const float* local);
+// The local matrix of a node changed during the frame being captured
+void trace_writer_set_local(TraceWriter* writer, uint32_t node, const float* local);
+// Writes the frame, with the local matrices set since the previous one
+void trace_writer_end_frame(TraceWriter* writer, const TraceFrame* frame);
+
+// The whole file is read up front, so that replays do not wait on the disk
+typedef struct {
+    uint8_t* data;
+    size_t size;
+    TraceHeader header;
+    const TraceNode* nodes;
+    size_t* frame_offsets; // in data, of each TraceFrame
+} TraceReader;
+
+// Refuses traces whose node indices are out of order or out of range, so that the replay can use
+// them as they are
+bool trace_reader_open(TraceReader* reader, const char* path);
+void trace_reader_close(TraceReader* reader);
+// transforms: the transform_count local matrices that changed in this frame
+const TraceFrame* trace_reader_frame(const TraceReader* reader, uint32_t index,
+                                     const TraceTransform** transforms);
+
+// Average, median, 95th percentile and worst of the values that are not negative (not measured)
+void trace_print_timings(const char* label, const double* ms, uint32_t count);
+
+#endif
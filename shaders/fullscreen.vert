@@ -0,0 +1,10 @@
+#version 460
+
+// A single triangle covering the whole screen, without vertex buffer: the 3 vertices are
+// (0, 0), (2, 0) and (0, 2) in uv space, built from the vertex index
+layout(location = 0) out vec2 frag_uv;
+
+void main() {
+    frag_uv = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2);
+    gl_Position = vec4(frag_uv * 2.0 - 1.0, 0.0, 1.0);
+}
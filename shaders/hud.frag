@@ -0,0 +1,9 @@
+#version 460
+
+layout(location = 0) in vec4 frag_color;
+layout(location = 0) out vec4 out_color;
+
+// blended over the antialiased image by the pipeline
+void main() {
+    out_color = frag_color;
+}
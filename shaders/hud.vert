@@ -0,0 +1,17 @@
+#version 460
+
+// must match HudPushConstants in simple_vulkan_app.c
+layout(push_constant) uniform HudPushConstants {
+    vec2 pixel_to_ndc; // 2 / swapchain extent
+} pc;
+
+// see HudVertex in hud.h
+layout(location = 0) in vec2 in_position; // pixels, from the top left corner
+layout(location = 1) in vec4 in_color;    // R8G8B8A8_UNORM
+
+layout(location = 0) out vec4 frag_color;
+
+void main() {
+    gl_Position = vec4(in_position * pc.pixel_to_ndc - 1.0, 0.0, 1.0);
+    frag_color = in_color;
+}
@@ -0,0 +1,24 @@
+// Shared by every post-processing shader
+
+// 0: tonemapping, 1: color grading, 2: fxaa (needs neighbours, only in post_sampled.frag)
+layout(constant_id = 3) const uint POST_EFFECT = 0;
+
+// Filmic curve, fitted on ACES by K. Narkowicz
+vec3 tonemap(vec3 color) {
+    const float a = 2.51;
+    const float b = 0.03;
+    const float c = 2.43;
+    const float d = 0.59;
+    const float e = 0.14;
+    return clamp((color * (a * color + b)) / (color * (c * color + d) + e), 0.0, 1.0);
+}
+
+// Lift/gain and saturation, with a hardcoded warm look
+vec3 color_grade(vec3 color) {
+    const vec3 lift = vec3(0.02, 0.0, 0.03);
+    const vec3 gain = vec3(1.05, 1.0, 0.95);
+    const float saturation = 1.1;
+    color = color * gain + lift * (1.0 - color);
+    float luma = dot(color, vec3(0.2126, 0.7152, 0.0722));
+    return clamp(mix(vec3(luma), color, saturation), 0.0, 1.0);
+}
@@ -0,0 +1,60 @@
+#version 460
+#extension GL_GOOGLE_include_directive : require
+
+#include "post_common.glsl"
+
+// The previous pass output, read from the bindless set like any other texture
+layout(set = 1, binding = 0) uniform sampler2D textures[];
+
+// must match PostPushConstants in simple_vulkan_app.c
+layout(push_constant) uniform PostPushConstants {
+    uint source;
+    vec2 texel_size;
+} pc;
+
+layout(location = 0) in vec2 frag_uv;
+layout(location = 0) out vec4 out_color;
+
+const float FXAA_SPAN_MAX = 8.0;
+const float FXAA_REDUCE_MUL = 1.0 / 8.0;
+const float FXAA_REDUCE_MIN = 1.0 / 128.0;
+
+// Blurs along the local edge direction, estimated from the luma of the 4 diagonal neighbours
+vec3 fxaa(vec2 uv) {
+    const vec3 to_luma = vec3(0.299, 0.587, 0.114);
+    vec2 texel = pc.texel_size;
+    float luma_nw = dot(texture(textures[pc.source], uv + vec2(-1.0, -1.0) * texel).rgb, to_luma);
+    float luma_ne = dot(texture(textures[pc.source], uv + vec2(1.0, -1.0) * texel).rgb, to_luma);
+    float luma_sw = dot(texture(textures[pc.source], uv + vec2(-1.0, 1.0) * texel).rgb, to_luma);
+    float luma_se = dot(texture(textures[pc.source], uv + vec2(1.0, 1.0) * texel).rgb, to_luma);
+    vec3 rgb_m = texture(textures[pc.source], uv).rgb;
+    float luma_m = dot(rgb_m, to_luma);
+
+    float luma_min = min(luma_m, min(min(luma_nw, luma_ne), min(luma_sw, luma_se)));
+    float luma_max = max(luma_m, max(max(luma_nw, luma_ne), max(luma_sw, luma_se)));
+
+    vec2 direction = vec2(-((luma_nw + luma_ne) - (luma_sw + luma_se)),
+                          (luma_nw + luma_sw) - (luma_ne + luma_se));
+    float reduce =
+        max((luma_nw + luma_ne + luma_sw + luma_se) * 0.25 * FXAA_REDUCE_MUL, FXAA_REDUCE_MIN);
+    float scale = 1.0 / (min(abs(direction.x), abs(direction.y)) + reduce);
+    direction = clamp(direction * scale, vec2(-FXAA_SPAN_MAX), vec2(FXAA_SPAN_MAX)) * texel;
+
+    vec3 rgb_a = 0.5 * (texture(textures[pc.source], uv + direction * (1.0 / 3.0 - 0.5)).rgb +
+                        texture(textures[pc.source], uv + direction * (2.0 / 3.0 - 0.5)).rgb);
+    vec3 rgb_b = rgb_a * 0.5 + 0.25 * (texture(textures[pc.source], uv - direction * 0.5).rgb +
+                                       texture(textures[pc.source], uv + direction * 0.5).rgb);
+    float luma_b = dot(rgb_b, to_luma);
+    return (luma_b < luma_min || luma_b > luma_max) ? rgb_a : rgb_b;
+}
+
+void main() {
+    vec3 color;
+    if(POST_EFFECT == 2) {
+        color = fxaa(frag_uv);
+    } else {
+        color = texture(textures[pc.source], frag_uv).rgb;
+        color = POST_EFFECT == 0 ? tonemap(color) : color_grade(color);
+    }
+    out_color = vec4(color, 1.0);
+}
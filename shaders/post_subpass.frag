@@ -0,0 +1,15 @@
+#version 460
+#extension GL_GOOGLE_include_directive : require
+
+#include "post_common.glsl"
+
+// The previous subpass output, at this very pixel: it can stay in tile memory
+layout(input_attachment_index = 0, set = 0, binding = 0) uniform subpassInput previous_pass;
+
+layout(location = 0) in vec2 frag_uv;
+layout(location = 0) out vec4 out_color;
+
+void main() {
+    vec3 color = subpassLoad(previous_pass).rgb;
+    out_color = vec4(POST_EFFECT == 0 ? tonemap(color) : color_grade(color), 1.0);
+}
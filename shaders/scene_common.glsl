@@ -0,0 +1,32 @@
+// Shared by the scene vertex shaders: shader.vert (fixed-function vertex input) and
+// shader_pulled.vert (vertex pulling)
+
+layout(binding = 0) uniform UniformBufferObject {
+    mat4 model;
+    mat4 view;
+    mat4 proj;
+} ubo;
+
+// World matrices of the scene graph nodes, in the bindless storage buffer array
+layout(set = 1, binding = 1, std430) readonly buffer TransformTable {
+    mat4 transforms[];
+} transform_buffers[];
+
+// must match PushConstants in simple_vulkan_app.c
+layout(push_constant) uniform PushConstants {
+    uint transform_table;
+    uint transform_index;
+    uint material_table;
+    uint material_index;
+    uint vertex_table;  // vertex pulling only: bindless slot of the vertex buffer
+    uint vertex_base;   // in words, where the mesh starts in it
+    uint vertex_format;
+} pc;
+
+layout(location = 0) out vec3 frag_color;
+layout(location = 1) out vec2 frag_uv;
+
+vec4 transform_position(vec2 position) {
+    mat4 model = transform_buffers[pc.transform_table].transforms[pc.transform_index];
+    return ubo.proj * ubo.view * ubo.model * model * vec4(position, 0.0, 1.0);
+}
@@ -1,5 +1,48 @@
 #version 460
+#extension GL_EXT_nonuniform_qualifier : require
+
+// 0: regular shading, 1: fragment depth as grayscale, 2: flat color to check coverage
+layout(constant_id = 2) const uint DEBUG_VIEW = 0;
+
+const uint INVALID_INDEX = 0xFFFFFFFF;
+
+// std430, must match Material in simple_vulkan_app.c
+struct Material {
+    vec4 tint;
+    uint texture_index;
+};
+
+// Bindless set: every resource, picked by index. Unwritten slots must never be read.
+layout(set = 1, binding = 0) uniform sampler2D textures[];
+layout(set = 1, binding = 1, std430) readonly buffer MaterialTable {
+    Material materials[];
+} buffers[];
+
+layout(push_constant) uniform PushConstants {
+    uint transform_table;
+    uint transform_index;
+    uint material_table;
+    uint material_index;
+    uint vertex_table;
+    uint vertex_base;
+    uint vertex_format;
+} pc;
 
 layout(location = 0) out vec4 out_color;
 layout(location = 0) in vec3 frag_color;
-void main() { out_color = vec4(frag_color, 1.0); }
\ No newline at end of file
+layout(location = 1) in vec2 frag_uv;
+void main() {
+    Material material = buffers[pc.material_table].materials[pc.material_index];
+
+    if(DEBUG_VIEW == 1) {
+        out_color = vec4(vec3(gl_FragCoord.z), 1.0);
+    } else if(DEBUG_VIEW == 2) {
+        out_color = vec4(1.0, 0.0, 1.0, 1.0);
+    } else {
+        out_color = vec4(frag_color, 1.0) * material.tint;
+        if(material.texture_index != INVALID_INDEX) {
+            // the index comes from a buffer, it may differ between invocations of a draw
+            out_color *= texture(textures[nonuniformEXT(material.texture_index)], frag_uv);
+        }
+    }
+}
\ No newline at end of file
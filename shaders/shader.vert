@@ -1,17 +1,21 @@
 #version 460
+#extension GL_EXT_nonuniform_qualifier : require
+#extension GL_GOOGLE_include_directive : require
 
-layout(binding = 0) uniform UniformBufferObject {
-    mat4 model;
-    mat4 view;
-    mat4 proj;
-} ubo;
+#include "scene_common.glsl"
+
+// Specialization constants: set when the pipeline is created, see create_graphics_pipeline
+// Quantized positions (eg. R16G16_SSCALED) are brought back to object space by a single scale
+layout(constant_id = 0) const bool DEQUANTIZE_POSITION = false;
+layout(constant_id = 1) const float POSITION_SCALE = 1.0;
 
 layout(location = 0) in vec2 in_position;
 layout(location = 1) in vec3 in_color;
-
-layout(location = 0) out vec3 frag_color; 
+layout(location = 2) in vec2 in_uv;
 
 void main() {
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(in_position, 0.0, 1.0);
+    vec2 position = DEQUANTIZE_POSITION ? in_position * POSITION_SCALE : in_position;
+    gl_Position = transform_position(position);
     frag_color = in_color;
-}
\ No newline at end of file
+    frag_uv = in_uv;
+}
@@ -0,0 +1,38 @@
+#version 460
+#extension GL_EXT_nonuniform_qualifier : require
+#extension GL_GOOGLE_include_directive : require
+
+#include "scene_common.glsl"
+
+// Vertex pulling: no vertex input state, the vertices are read from a storage buffer and
+// decoded here. Any format goes, and meshes of different formats share the pipeline.
+
+// values of pc.vertex_format, must match VertexFormat in simple_vulkan_app.c
+const uint VERTEX_FORMAT_FLOAT = 0;  // Vertex: position vec2, color vec3, uv vec2
+const uint VERTEX_FORMAT_PACKED = 1; // PackedVertex: position vec2, color unorm8x4, uv unorm16x2
+
+layout(set = 1, binding = 1, std430) readonly buffer VertexData {
+    uint words[];
+} vertex_buffers[];
+
+uint read_word(uint index) {
+    return vertex_buffers[pc.vertex_table].words[index];
+}
+
+void main() {
+    // the index buffer still picks the vertex, the draw has no vertexOffset: the base is in pc
+    if(pc.vertex_format == VERTEX_FORMAT_PACKED) {
+        uint base = pc.vertex_base + uint(gl_VertexIndex) * 4;
+        vec2 position = uintBitsToFloat(uvec2(read_word(base), read_word(base + 1)));
+        gl_Position = transform_position(position);
+        frag_color = unpackUnorm4x8(read_word(base + 2)).rgb;
+        frag_uv = unpackUnorm2x16(read_word(base + 3));
+    } else {
+        uint base = pc.vertex_base + uint(gl_VertexIndex) * 7;
+        vec2 position = uintBitsToFloat(uvec2(read_word(base), read_word(base + 1)));
+        gl_Position = transform_position(position);
+        frag_color = uintBitsToFloat(
+            uvec3(read_word(base + 2), read_word(base + 3), read_word(base + 4)));
+        frag_uv = uintBitsToFloat(uvec2(read_word(base + 5), read_word(base + 6)));
+    }
+}
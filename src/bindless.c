@@ -0,0 +1,244 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vulkan/vulkan.h>
+
+#include "bindless.h"
+
+bool bindless_is_supported(VkPhysicalDevice physical_device) {
+    VkPhysicalDeviceVulkan12Features features_12 = {0};
+    features_12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    VkPhysicalDeviceFeatures2 features = {0};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &features_12;
+    vkGetPhysicalDeviceFeatures2(physical_device, &features);
+
+    return features_12.descriptorIndexing && features_12.runtimeDescriptorArray &&
+           features_12.descriptorBindingPartiallyBound &&
+           features_12.descriptorBindingSampledImageUpdateAfterBind &&
+           features_12.descriptorBindingStorageBufferUpdateAfterBind &&
+           features_12.descriptorBindingUpdateUnusedWhilePending &&
+           features_12.shaderSampledImageArrayNonUniformIndexing &&
+           features_12.shaderStorageBufferArrayNonUniformIndexing;
+}
+
+void bindless_enable_features(VkPhysicalDeviceVulkan12Features* features) {
+    features->descriptorIndexing = VK_TRUE;
+    features->runtimeDescriptorArray = VK_TRUE;
+    features->descriptorBindingPartiallyBound = VK_TRUE;
+    features->descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+    features->descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+    features->descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+    features->shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+    features->shaderStorageBufferArrayNonUniformIndexing = VK_TRUE;
+}
+
+static void slot_allocator_init(BindlessSlotAllocator* allocator, uint32_t capacity) {
+    allocator->capacity = capacity;
+    allocator->next_unused = 0;
+    allocator->free_count = 0;
+    allocator->free_slots = calloc(capacity, sizeof(uint32_t));
+    allocator->in_use = calloc((capacity + 31) / 32, sizeof(uint32_t));
+}
+
+static uint32_t slot_allocator_acquire(BindlessSlotAllocator* allocator) {
+    uint32_t slot = BINDLESS_INVALID_INDEX;
+    if(allocator->free_count > 0) {
+        slot = allocator->free_slots[--(allocator->free_count)];
+    } else if(allocator->next_unused < allocator->capacity) {
+        slot = allocator->next_unused++;
+    } else {
+        return slot;
+    }
+    allocator->in_use[slot / 32] |= 1u << (slot % 32);
+    return slot;
+}
+
+static void slot_allocator_release(BindlessSlotAllocator* allocator, uint32_t slot) {
+    if(slot >= allocator->next_unused) {
+        printf("bindless slot %u was never handed out\n", slot);
+        return;
+    }
+    // a second release would put the slot twice in free_slots, which can then overflow
+    if(!(allocator->in_use[slot / 32] & (1u << (slot % 32)))) {
+        printf("bindless slot %u is released twice\n", slot);
+        return;
+    }
+    allocator->in_use[slot / 32] &= ~(1u << (slot % 32));
+    allocator->free_slots[allocator->free_count++] = slot;
+}
+
+void bindless_create(VkDevice device, VkPhysicalDevice physical_device,
+                     const VkAllocationCallbacks* allocator, BindlessTable* table) {
+    table->device = device;
+    table->allocator = allocator;
+
+    // update-after-bind descriptors have their own, usually much higher, limits
+    VkPhysicalDeviceDescriptorIndexingProperties indexing_properties = {0};
+    indexing_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES;
+    VkPhysicalDeviceProperties2 properties = {0};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties.pNext = &indexing_properties;
+    vkGetPhysicalDeviceProperties2(physical_device, &properties);
+
+    uint32_t image_count = BINDLESS_MAX_SAMPLED_IMAGES;
+    if(image_count > indexing_properties.maxDescriptorSetUpdateAfterBindSampledImages) {
+        image_count = indexing_properties.maxDescriptorSetUpdateAfterBindSampledImages;
+    }
+    if(image_count > indexing_properties.maxPerStageDescriptorUpdateAfterBindSampledImages) {
+        image_count = indexing_properties.maxPerStageDescriptorUpdateAfterBindSampledImages;
+    }
+    uint32_t buffer_count = BINDLESS_MAX_STORAGE_BUFFERS;
+    if(buffer_count > indexing_properties.maxDescriptorSetUpdateAfterBindStorageBuffers) {
+        buffer_count = indexing_properties.maxDescriptorSetUpdateAfterBindStorageBuffers;
+    }
+    if(buffer_count > indexing_properties.maxPerStageDescriptorUpdateAfterBindStorageBuffers) {
+        buffer_count = indexing_properties.maxPerStageDescriptorUpdateAfterBindStorageBuffers;
+    }
+
+    /* Layout */
+    VkDescriptorSetLayoutBinding bindings[BINDLESS_BINDING_COUNT] = {0};
+    bindings[BINDLESS_BINDING_SAMPLED_IMAGES].binding = BINDLESS_BINDING_SAMPLED_IMAGES;
+    bindings[BINDLESS_BINDING_SAMPLED_IMAGES].descriptorType =
+        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bindings[BINDLESS_BINDING_SAMPLED_IMAGES].descriptorCount = image_count;
+    bindings[BINDLESS_BINDING_SAMPLED_IMAGES].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    bindings[BINDLESS_BINDING_STORAGE_BUFFERS].binding = BINDLESS_BINDING_STORAGE_BUFFERS;
+    bindings[BINDLESS_BINDING_STORAGE_BUFFERS].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[BINDLESS_BINDING_STORAGE_BUFFERS].descriptorCount = buffer_count;
+    bindings[BINDLESS_BINDING_STORAGE_BUFFERS].stageFlags =
+        VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    // partially bound: slots not written yet are fine as long as the shaders do not read them.
+    // update after bind: slots can be written while the set is bound in a pending command buffer
+    VkDescriptorBindingFlags binding_flags[BINDLESS_BINDING_COUNT];
+    for(uint32_t i = 0; i < BINDLESS_BINDING_COUNT; i++) {
+        binding_flags[i] = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
+                           VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+                           VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+    }
+    VkDescriptorSetLayoutBindingFlagsCreateInfo binding_flags_info = {0};
+    binding_flags_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+    binding_flags_info.bindingCount = BINDLESS_BINDING_COUNT;
+    binding_flags_info.pBindingFlags = binding_flags;
+
+    VkDescriptorSetLayoutCreateInfo layout_create_info = {0};
+    layout_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layout_create_info.pNext = &binding_flags_info;
+    layout_create_info.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+    layout_create_info.bindingCount = BINDLESS_BINDING_COUNT;
+    layout_create_info.pBindings = bindings;
+
+    if(vkCreateDescriptorSetLayout(device, &layout_create_info, allocator, &(table->layout)) !=
+       VK_SUCCESS) {
+        printf("failed to create bindless descriptor set layout\n");
+    }
+
+    /* Pool and set */
+    VkDescriptorPoolSize pool_sizes[BINDLESS_BINDING_COUNT] = {0};
+    pool_sizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    pool_sizes[0].descriptorCount = image_count;
+    pool_sizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    pool_sizes[1].descriptorCount = buffer_count;
+
+    VkDescriptorPoolCreateInfo pool_create_info = {0};
+    pool_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_create_info.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+    pool_create_info.poolSizeCount = BINDLESS_BINDING_COUNT;
+    pool_create_info.pPoolSizes = pool_sizes;
+    pool_create_info.maxSets = 1; // the whole point
+
+    if(vkCreateDescriptorPool(device, &pool_create_info, allocator, &(table->pool)) != VK_SUCCESS) {
+        printf("failed to create bindless descriptor pool\n");
+    }
+
+    VkDescriptorSetAllocateInfo allocate_info = {0};
+    allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocate_info.descriptorPool = table->pool;
+    allocate_info.descriptorSetCount = 1;
+    allocate_info.pSetLayouts = &(table->layout);
+    if(vkAllocateDescriptorSets(device, &allocate_info, &(table->set)) != VK_SUCCESS) {
+        printf("failed to allocate bindless descriptor set\n");
+    }
+
+    slot_allocator_init(&(table->images), image_count);
+    slot_allocator_init(&(table->buffers), buffer_count);
+}
+
+void bindless_destroy(BindlessTable* table) {
+    // the set is free'd with its pool
+    vkDestroyDescriptorPool(table->device, table->pool, table->allocator);
+    vkDestroyDescriptorSetLayout(table->device, table->layout, table->allocator);
+    free(table->images.free_slots);
+    free(table->images.in_use);
+    free(table->buffers.free_slots);
+    free(table->buffers.in_use);
+}
+
+void bindless_update_image(BindlessTable* table, uint32_t index, VkImageView view,
+                           VkSampler sampler, VkImageLayout layout) {
+    VkDescriptorImageInfo image_info = {0};
+    image_info.imageView = view;
+    image_info.sampler = sampler;
+    image_info.imageLayout = layout;
+
+    VkWriteDescriptorSet descriptor_write = {0};
+    descriptor_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptor_write.dstSet = table->set;
+    descriptor_write.dstBinding = BINDLESS_BINDING_SAMPLED_IMAGES;
+    descriptor_write.dstArrayElement = index;
+    descriptor_write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    descriptor_write.descriptorCount = 1;
+    descriptor_write.pImageInfo = &image_info;
+
+    vkUpdateDescriptorSets(table->device, 1, &descriptor_write, 0, NULL);
+}
+
+uint32_t bindless_register_image(BindlessTable* table, VkImageView view, VkSampler sampler,
+                                 VkImageLayout layout) {
+    uint32_t index = slot_allocator_acquire(&(table->images));
+    if(index == BINDLESS_INVALID_INDEX) {
+        printf("bindless table is out of sampled image slots\n");
+        return index;
+    }
+    bindless_update_image(table, index, view, sampler, layout);
+    return index;
+}
+
+void bindless_release_image(BindlessTable* table, uint32_t index) {
+    slot_allocator_release(&(table->images), index);
+}
+
+uint32_t bindless_register_buffer(BindlessTable* table, VkBuffer buffer, VkDeviceSize offset,
+                                  VkDeviceSize range) {
+    uint32_t index = slot_allocator_acquire(&(table->buffers));
+    if(index == BINDLESS_INVALID_INDEX) {
+        printf("bindless table is out of storage buffer slots\n");
+        return index;
+    }
+
+    VkDescriptorBufferInfo buffer_info = {0};
+    buffer_info.buffer = buffer;
+    buffer_info.offset = offset;
+    buffer_info.range = range;
+
+    VkWriteDescriptorSet descriptor_write = {0};
+    descriptor_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptor_write.dstSet = table->set;
+    descriptor_write.dstBinding = BINDLESS_BINDING_STORAGE_BUFFERS;
+    descriptor_write.dstArrayElement = index;
+    descriptor_write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptor_write.descriptorCount = 1;
+    descriptor_write.pBufferInfo = &buffer_info;
+
+    vkUpdateDescriptorSets(table->device, 1, &descriptor_write, 0, NULL);
+    return index;
+}
+
+void bindless_release_buffer(BindlessTable* table, uint32_t index) {
+    slot_allocator_release(&(table->buffers), index);
+}
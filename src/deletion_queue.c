@@ -0,0 +1,218 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vulkan/vulkan.h>
+
+#include "bindless.h"
+#include "deletion_queue.h"
+#include "gpu_memory.h"
+
+void deletion_queue_create(DeletionQueue* queue, VkDevice device,
+                           const VkAllocationCallbacks* allocator, GpuMemoryTracker* memory) {
+    memset(queue, 0, sizeof(DeletionQueue));
+    queue->device = device;
+    queue->allocator = allocator;
+    queue->memory = memory;
+}
+
+static void release(DeletionQueue* queue, const PendingDeletion* entry) {
+    VkDevice device = queue->device;
+    const VkAllocationCallbacks* allocator = queue->allocator;
+    switch(entry->type) {
+    case DELETION_BUFFER:
+        vkDestroyBuffer(device, entry->buffer, allocator);
+        break;
+    case DELETION_IMAGE:
+        vkDestroyImage(device, entry->image, allocator);
+        break;
+    case DELETION_IMAGE_VIEW:
+        vkDestroyImageView(device, entry->view, allocator);
+        break;
+    case DELETION_FRAMEBUFFER:
+        vkDestroyFramebuffer(device, entry->framebuffer, allocator);
+        break;
+    case DELETION_PIPELINE:
+        vkDestroyPipeline(device, entry->pipeline, allocator);
+        break;
+    case DELETION_SWAPCHAIN:
+        vkDestroySwapchainKHR(device, entry->swapchain, allocator);
+        break;
+    case DELETION_SEMAPHORE:
+        vkDestroySemaphore(device, entry->semaphore, allocator);
+        break;
+    case DELETION_DESCRIPTOR_SET:
+        vkFreeDescriptorSets(device, entry->descriptor_set.pool, 1, &(entry->descriptor_set.set));
+        break;
+    case DELETION_MEMORY:
+        if(queue->memory != NULL) {
+            gpu_memory_free(queue->memory, entry->memory);
+        } else {
+            vkFreeMemory(device, entry->memory, allocator);
+        }
+        break;
+    case DELETION_BINDLESS_IMAGE:
+        bindless_release_image(entry->bindless.table, entry->bindless.index);
+        break;
+    case DELETION_BINDLESS_BUFFER:
+        bindless_release_buffer(entry->bindless.table, entry->bindless.index);
+        break;
+    }
+    queue->released++;
+}
+
+void deletion_queue_destroy(DeletionQueue* queue) {
+    for(uint32_t i = 0; i < queue->count; i++) {
+        release(queue, queue->entries + i);
+    }
+    free(queue->entries);
+    memset(queue, 0, sizeof(DeletionQueue));
+}
+
+// NULL when the queue cannot grow: the resource is leaked, destroying it could pull it from under
+// a frame in flight
+static PendingDeletion* push(DeletionQueue* queue, DeletionType type, uint64_t retire_frame) {
+    if(queue->count == queue->capacity) {
+        uint32_t capacity = queue->capacity == 0 ? 64 : 2 * queue->capacity;
+        PendingDeletion* entries = realloc(queue->entries, capacity * sizeof(PendingDeletion));
+        if(entries == NULL) {
+            printf("failed to grow the deletion queue, the resource is leaked\n");
+            return NULL;
+        }
+        queue->entries = entries;
+        queue->capacity = capacity;
+    }
+    PendingDeletion* entry = queue->entries + queue->count++;
+    memset(entry, 0, sizeof(PendingDeletion));
+    entry->type = type;
+    entry->retire_frame = retire_frame;
+    return entry;
+}
+
+// destroying VK_NULL_HANDLE is valid, but not worth a slot
+void deletion_queue_push_buffer(DeletionQueue* queue, VkBuffer buffer, uint64_t retire_frame) {
+    if(buffer != VK_NULL_HANDLE) {
+        PendingDeletion* entry = push(queue, DELETION_BUFFER, retire_frame);
+        if(entry != NULL) {
+            entry->buffer = buffer;
+        }
+    }
+}
+
+void deletion_queue_push_image(DeletionQueue* queue, VkImage image, uint64_t retire_frame) {
+    if(image != VK_NULL_HANDLE) {
+        PendingDeletion* entry = push(queue, DELETION_IMAGE, retire_frame);
+        if(entry != NULL) {
+            entry->image = image;
+        }
+    }
+}
+
+void deletion_queue_push_image_view(DeletionQueue* queue, VkImageView view,
+                                    uint64_t retire_frame) {
+    if(view != VK_NULL_HANDLE) {
+        PendingDeletion* entry = push(queue, DELETION_IMAGE_VIEW, retire_frame);
+        if(entry != NULL) {
+            entry->view = view;
+        }
+    }
+}
+
+void deletion_queue_push_framebuffer(DeletionQueue* queue, VkFramebuffer framebuffer,
+                                     uint64_t retire_frame) {
+    if(framebuffer != VK_NULL_HANDLE) {
+        PendingDeletion* entry = push(queue, DELETION_FRAMEBUFFER, retire_frame);
+        if(entry != NULL) {
+            entry->framebuffer = framebuffer;
+        }
+    }
+}
+
+void deletion_queue_push_pipeline(DeletionQueue* queue, VkPipeline pipeline,
+                                  uint64_t retire_frame) {
+    if(pipeline != VK_NULL_HANDLE) {
+        PendingDeletion* entry = push(queue, DELETION_PIPELINE, retire_frame);
+        if(entry != NULL) {
+            entry->pipeline = pipeline;
+        }
+    }
+}
+
+void deletion_queue_push_swapchain(DeletionQueue* queue, VkSwapchainKHR swapchain,
+                                   uint64_t retire_frame) {
+    if(swapchain != VK_NULL_HANDLE) {
+        PendingDeletion* entry = push(queue, DELETION_SWAPCHAIN, retire_frame);
+        if(entry != NULL) {
+            entry->swapchain = swapchain;
+        }
+    }
+}
+
+void deletion_queue_push_semaphore(DeletionQueue* queue, VkSemaphore semaphore,
+                                   uint64_t retire_frame) {
+    if(semaphore != VK_NULL_HANDLE) {
+        PendingDeletion* entry = push(queue, DELETION_SEMAPHORE, retire_frame);
+        if(entry != NULL) {
+            entry->semaphore = semaphore;
+        }
+    }
+}
+
+void deletion_queue_push_descriptor_set(DeletionQueue* queue, VkDescriptorPool pool,
+                                        VkDescriptorSet set, uint64_t retire_frame) {
+    if(set != VK_NULL_HANDLE) {
+        PendingDeletion* entry = push(queue, DELETION_DESCRIPTOR_SET, retire_frame);
+        if(entry != NULL) {
+            entry->descriptor_set.pool = pool;
+            entry->descriptor_set.set = set;
+        }
+    }
+}
+
+void deletion_queue_push_memory(DeletionQueue* queue, VkDeviceMemory memory,
+                                uint64_t retire_frame) {
+    if(memory != VK_NULL_HANDLE) {
+        PendingDeletion* entry = push(queue, DELETION_MEMORY, retire_frame);
+        if(entry != NULL) {
+            entry->memory = memory;
+        }
+    }
+}
+
+void deletion_queue_push_bindless_image(DeletionQueue* queue, BindlessTable* table,
+                                        uint32_t index, uint64_t retire_frame) {
+    if(index != BINDLESS_INVALID_INDEX) {
+        PendingDeletion* entry = push(queue, DELETION_BINDLESS_IMAGE, retire_frame);
+        if(entry != NULL) {
+            entry->bindless.table = table;
+            entry->bindless.index = index;
+        }
+    }
+}
+
+void deletion_queue_push_bindless_buffer(DeletionQueue* queue, BindlessTable* table,
+                                         uint32_t index, uint64_t retire_frame) {
+    if(index != BINDLESS_INVALID_INDEX) {
+        PendingDeletion* entry = push(queue, DELETION_BINDLESS_BUFFER, retire_frame);
+        if(entry != NULL) {
+            entry->bindless.table = table;
+            entry->bindless.index = index;
+        }
+    }
+}
+
+uint32_t deletion_queue_collect(DeletionQueue* queue, uint64_t first_pending_frame) {
+    // the entries that stay keep their order, so that views still go before their image
+    uint32_t kept = 0;
+    for(uint32_t i = 0; i < queue->count; i++) {
+        if(queue->entries[i].retire_frame <= first_pending_frame) {
+            release(queue, queue->entries + i);
+        } else {
+            queue->entries[kept++] = queue->entries[i];
+        }
+    }
+    uint32_t released = queue->count - kept;
+    queue->count = kept;
+    return released;
+}
@@ -0,0 +1,278 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <vulkan/vulkan.h>
+
+#include "descriptor_allocator.h"
+
+/* Pool chain ************************/
+static bool create_pool(DescriptorAllocator* allocator) {
+    if(allocator->pool_count == DESCRIPTOR_ALLOCATOR_MAX_POOLS) {
+        printf("descriptor allocator is out of pools\n");
+        return false;
+    }
+    VkDescriptorPoolSize pool_sizes[DESCRIPTOR_ALLOCATOR_MAX_RATIOS];
+    for(uint32_t i = 0; i < allocator->ratio_count; i++) {
+        pool_sizes[i].type = allocator->ratios[i].type;
+        pool_sizes[i].descriptorCount = allocator->ratios[i].per_set * allocator->next_pool_sets;
+    }
+    VkDescriptorPoolCreateInfo pool_create_info = {0};
+    pool_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    // no FREE_DESCRIPTOR_SET: sets only go back with the whole pool
+    pool_create_info.flags = 0;
+    pool_create_info.poolSizeCount = allocator->ratio_count;
+    pool_create_info.pPoolSizes = pool_sizes;
+    pool_create_info.maxSets = allocator->next_pool_sets;
+    if(vkCreateDescriptorPool(allocator->device, &pool_create_info, allocator->allocator,
+                              allocator->pools + allocator->pool_count) != VK_SUCCESS) {
+        printf("failed to create descriptor pool\n");
+        return false;
+    }
+    allocator->pool_count++;
+    allocator->pools_created++;
+    if(allocator->next_pool_sets < DESCRIPTOR_ALLOCATOR_MAX_SETS_PER_POOL) {
+        allocator->next_pool_sets *= 2;
+    }
+    return true;
+}
+
+bool descriptor_allocator_create(DescriptorAllocator* allocator, VkDevice device,
+                                 const VkAllocationCallbacks* callbacks, uint32_t sets_per_pool,
+                                 const DescriptorPoolRatio* ratios, uint32_t ratio_count) {
+    memset(allocator, 0, sizeof(DescriptorAllocator));
+    if(ratio_count > DESCRIPTOR_ALLOCATOR_MAX_RATIOS) {
+        printf("too many descriptor types for the allocator: %u\n", ratio_count);
+        return false;
+    }
+    allocator->device = device;
+    allocator->allocator = callbacks;
+    allocator->ratio_count = ratio_count;
+    memcpy(allocator->ratios, ratios, ratio_count * sizeof(DescriptorPoolRatio));
+    allocator->next_pool_sets = sets_per_pool > 0 ? sets_per_pool : 1;
+    // the first pool right away, the next ones when they are needed
+    return create_pool(allocator);
+}
+
+void descriptor_allocator_destroy(DescriptorAllocator* allocator) {
+    for(uint32_t i = 0; i < allocator->pool_count; i++) {
+        vkDestroyDescriptorPool(allocator->device, allocator->pools[i], allocator->allocator);
+    }
+    memset(allocator, 0, sizeof(DescriptorAllocator));
+}
+
+VkDescriptorSet descriptor_allocator_allocate(DescriptorAllocator* allocator,
+                                              VkDescriptorSetLayout layout) {
+    VkDescriptorSetAllocateInfo allocate_info = {0};
+    allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocate_info.descriptorSetCount = 1;
+    allocate_info.pSetLayouts = &layout;
+    while(true) {
+        if(allocator->current == allocator->pool_count && !create_pool(allocator)) {
+            return VK_NULL_HANDLE;
+        }
+        allocate_info.descriptorPool = allocator->pools[allocator->current];
+        VkDescriptorSet set = VK_NULL_HANDLE;
+        allocator->allocations++;
+        VkResult result = vkAllocateDescriptorSets(allocator->device, &allocate_info, &set);
+        if(result == VK_SUCCESS) {
+            return set;
+        }
+        if(result != VK_ERROR_OUT_OF_POOL_MEMORY && result != VK_ERROR_FRAGMENTED_POOL) {
+            printf("failed to allocate descriptor set\n");
+            return VK_NULL_HANDLE;
+        }
+        // this pool is full until the next reset, on to the next one of the chain
+        allocator->current++;
+    }
+}
+
+void descriptor_allocator_reset(DescriptorAllocator* allocator) {
+    for(uint32_t i = 0; i < allocator->pool_count; i++) {
+        vkResetDescriptorPool(allocator->device, allocator->pools[i], 0);
+    }
+    allocator->current = 0;
+}
+
+/* Set cache *************************/
+static bool is_buffer_type(VkDescriptorType type) {
+    return type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER || type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER ||
+           type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC ||
+           type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+}
+
+// FNV-1a
+static uint64_t hash_bytes(uint64_t hash, const void* data, size_t size) {
+    const uint8_t* bytes = data;
+    for(size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+// only the fields that are read, the others may hold anything
+static uint64_t hash_set(VkDescriptorSetLayout layout, const DescriptorBinding* bindings,
+                         uint32_t binding_count) {
+    uint64_t hash = hash_bytes(0xcbf29ce484222325ull, &layout, sizeof(layout));
+    for(uint32_t i = 0; i < binding_count; i++) {
+        const DescriptorBinding* binding = bindings + i;
+        hash = hash_bytes(hash, &(binding->binding), sizeof(binding->binding));
+        hash = hash_bytes(hash, &(binding->type), sizeof(binding->type));
+        if(is_buffer_type(binding->type)) {
+            hash = hash_bytes(hash, &(binding->buffer.buffer), sizeof(binding->buffer.buffer));
+            hash = hash_bytes(hash, &(binding->buffer.offset), sizeof(binding->buffer.offset));
+            hash = hash_bytes(hash, &(binding->buffer.range), sizeof(binding->buffer.range));
+        } else {
+            hash = hash_bytes(hash, &(binding->image.sampler), sizeof(binding->image.sampler));
+            hash = hash_bytes(hash, &(binding->image.imageView), sizeof(binding->image.imageView));
+            hash = hash_bytes(hash, &(binding->image.imageLayout),
+                              sizeof(binding->image.imageLayout));
+        }
+    }
+    // 0 marks the free slots
+    return hash != 0 ? hash : 1;
+}
+
+static bool same_binding(const DescriptorBinding* a, const DescriptorBinding* b) {
+    if(a->binding != b->binding || a->type != b->type) {
+        return false;
+    }
+    if(is_buffer_type(a->type)) {
+        return a->buffer.buffer == b->buffer.buffer && a->buffer.offset == b->buffer.offset &&
+               a->buffer.range == b->buffer.range;
+    }
+    return a->image.sampler == b->image.sampler && a->image.imageView == b->image.imageView &&
+           a->image.imageLayout == b->image.imageLayout;
+}
+
+static bool same_set(const DescriptorCacheEntry* entry, VkDescriptorSetLayout layout,
+                     const DescriptorBinding* bindings, uint32_t binding_count) {
+    if(entry->layout != layout || entry->binding_count != binding_count) {
+        return false;
+    }
+    for(uint32_t i = 0; i < binding_count; i++) {
+        if(!same_binding(entry->bindings + i, bindings + i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void write_set(VkDevice device, VkDescriptorSet set, const DescriptorBinding* bindings,
+                      uint32_t binding_count) {
+    VkWriteDescriptorSet descriptor_writes[DESCRIPTOR_CACHE_MAX_BINDINGS];
+    for(uint32_t i = 0; i < binding_count; i++) {
+        descriptor_writes[i] = (VkWriteDescriptorSet){0};
+        descriptor_writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptor_writes[i].dstSet = set;
+        descriptor_writes[i].dstBinding = bindings[i].binding;
+        descriptor_writes[i].dstArrayElement = 0;
+        descriptor_writes[i].descriptorType = bindings[i].type;
+        descriptor_writes[i].descriptorCount = 1;
+        if(is_buffer_type(bindings[i].type)) {
+            descriptor_writes[i].pBufferInfo = &(bindings[i].buffer);
+        } else {
+            descriptor_writes[i].pImageInfo = &(bindings[i].image);
+        }
+    }
+    vkUpdateDescriptorSets(device, binding_count, descriptor_writes, 0, NULL);
+}
+
+bool descriptor_cache_create(DescriptorCache* cache, VkDevice device,
+                             const VkAllocationCallbacks* callbacks, uint32_t sets_per_pool,
+                             const DescriptorPoolRatio* ratios, uint32_t ratio_count) {
+    memset(cache, 0, sizeof(DescriptorCache));
+    return descriptor_allocator_create(&(cache->sets), device, callbacks, sets_per_pool, ratios,
+                                       ratio_count);
+}
+
+void descriptor_cache_destroy(DescriptorCache* cache) {
+    descriptor_allocator_destroy(&(cache->sets));
+    memset(cache, 0, sizeof(DescriptorCache));
+}
+
+void descriptor_cache_begin_frame(DescriptorCache* cache) {
+    if(!cache->flush_requested) {
+        return;
+    }
+    descriptor_allocator_reset(&(cache->sets));
+    memset(cache->entries, 0, sizeof(cache->entries));
+    cache->count = 0;
+    cache->flush_requested = false;
+    cache->flushes++;
+}
+
+void descriptor_cache_invalidate(DescriptorCache* cache) {
+    cache->flush_requested = true;
+}
+
+VkDescriptorSet descriptor_cache_get(DescriptorCache* cache, VkDescriptorSetLayout layout,
+                                     const DescriptorBinding* bindings, uint32_t binding_count) {
+    if(binding_count > DESCRIPTOR_CACHE_MAX_BINDINGS) {
+        printf("too many bindings for the descriptor cache: %u\n", binding_count);
+        return VK_NULL_HANDLE;
+    }
+    cache->lookups++;
+    uint64_t hash = hash_set(layout, bindings, binding_count);
+    uint32_t slot = (uint32_t)hash & (DESCRIPTOR_CACHE_CAPACITY - 1);
+    // linear probing, the table is never full
+    while(cache->entries[slot].hash != 0) {
+        const DescriptorCacheEntry* entry = cache->entries + slot;
+        if(entry->hash == hash && same_set(entry, layout, bindings, binding_count)) {
+            cache->hits++;
+            return entry->set;
+        }
+        slot = (slot + 1) & (DESCRIPTOR_CACHE_CAPACITY - 1);
+    }
+
+    VkDescriptorSet set = descriptor_allocator_allocate(&(cache->sets), layout);
+    if(set == VK_NULL_HANDLE) {
+        return VK_NULL_HANDLE;
+    }
+    write_set(cache->sets.device, set, bindings, binding_count);
+    if(cache->count >= DESCRIPTOR_CACHE_CAPACITY / 4 * 3) {
+        // still good for this frame, but not kept: start over once the frame is done
+        cache->flush_requested = true;
+        return set;
+    }
+    DescriptorCacheEntry* entry = cache->entries + slot;
+    entry->hash = hash;
+    entry->layout = layout;
+    entry->binding_count = binding_count;
+    memcpy(entry->bindings, bindings, binding_count * sizeof(DescriptorBinding));
+    entry->set = set;
+    cache->count++;
+    return set;
+}
+
+void descriptor_cache_print_stats(DescriptorCache* caches, uint32_t cache_count) {
+    uint32_t lookups = 0;
+    uint32_t hits = 0;
+    uint32_t flushes = 0;
+    uint32_t allocations = 0;
+    uint32_t pools_created = 0;
+    uint32_t pools = 0;
+    for(uint32_t i = 0; i < cache_count; i++) {
+        DescriptorCache* cache = caches + i;
+        lookups += cache->lookups;
+        hits += cache->hits;
+        flushes += cache->flushes;
+        allocations += cache->sets.allocations;
+        pools_created += cache->sets.pools_created;
+        pools += cache->sets.pool_count;
+        cache->lookups = 0;
+        cache->hits = 0;
+        cache->flushes = 0;
+        cache->sets.allocations = 0;
+        cache->sets.pools_created = 0;
+    }
+    if(lookups == 0) {
+        return;
+    }
+    printf("descriptor sets: %u lookups, %.1f%% cached, %u vkAllocateDescriptorSets, %u flushes, "
+           "%u pools (%u new)\n",
+           lookups, 100.0 * (double)hits / (double)lookups, allocations, flushes, pools,
+           pools_created);
+}
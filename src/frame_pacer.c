@@ -0,0 +1,103 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "frame_pacer.h"
+
+#define NS_PER_MS 1000000LL
+#define NS_PER_S 1000000000LL
+
+static int64_t to_ns(const struct timespec* time) {
+    return (int64_t)time->tv_sec * NS_PER_S + time->tv_nsec;
+}
+
+static struct timespec from_ns(int64_t ns) {
+    struct timespec time = {0};
+    time.tv_sec = ns / NS_PER_S;
+    time.tv_nsec = ns % NS_PER_S;
+    return time;
+}
+
+static int64_t now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return to_ns(&now);
+}
+
+double frame_pacer_now_ms(void) {
+    return (double)now_ns() / (double)NS_PER_MS;
+}
+
+void frame_pacer_init(FramePacer* pacer, double max_fps, double spin_ms) {
+    memset(pacer, 0, sizeof(FramePacer));
+    pacer->spin_ms = spin_ms;
+    frame_pacer_set_max_fps(pacer, max_fps);
+}
+
+void frame_pacer_set_max_fps(FramePacer* pacer, double max_fps) {
+    pacer->frame_ms = max_fps > 0.0 ? 1000.0 / max_fps : 0.0;
+    pacer->started = false;
+}
+
+void frame_pacer_reset(FramePacer* pacer) {
+    pacer->started = false;
+}
+
+void frame_pacer_wait(FramePacer* pacer) {
+    if(pacer->frame_ms <= 0.0) {
+        return;
+    }
+    int64_t frame_ns = (int64_t)(pacer->frame_ms * (double)NS_PER_MS);
+    int64_t start = now_ns();
+    pacer->stats.frames++;
+    if(!pacer->started) {
+        // the first frame of a schedule ran unpaced, the slot of the next one starts now
+        pacer->deadline = from_ns(start + frame_ns);
+        pacer->started = true;
+        return;
+    }
+
+    int64_t deadline = to_ns(&(pacer->deadline));
+    if(start >= deadline) {
+        pacer->stats.late_frames++;
+        // more than a whole frame behind: restart from now instead of rushing to catch up
+        pacer->deadline = from_ns(start - deadline > frame_ns ? start + frame_ns
+                                                              : deadline + frame_ns);
+        return;
+    }
+
+    int64_t spin_ns = (int64_t)(pacer->spin_ms * (double)NS_PER_MS);
+    if(deadline - start > spin_ns) {
+        struct timespec wake_up = from_ns(deadline - spin_ns);
+        while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake_up, NULL) == EINTR) {
+        }
+    }
+    int64_t spin_start = now_ns();
+    int64_t now = spin_start;
+    while(now < deadline) {
+        now = now_ns();
+    }
+
+    pacer->stats.slept_ms += (double)(spin_start - start) / (double)NS_PER_MS;
+    pacer->stats.spun_ms += (double)(now - spin_start) / (double)NS_PER_MS;
+    double error_ms = (double)(now - deadline) / (double)NS_PER_MS;
+    if(error_ms > pacer->stats.max_error_ms) {
+        pacer->stats.max_error_ms = error_ms;
+    }
+    pacer->deadline = from_ns(deadline + frame_ns);
+}
+
+void frame_pacer_print_stats(FramePacer* pacer) {
+    const FramePacerStats* stats = &(pacer->stats);
+    if(pacer->frame_ms <= 0.0 || stats->frames == 0) {
+        return;
+    }
+    printf("frame pacing at %.1f fps: %u frames, %u late, %.2f ms slept and %.3f ms spun per "
+           "frame, worst wake up %.3f ms late\n",
+           1000.0 / pacer->frame_ms, stats->frames, stats->late_frames,
+           stats->slept_ms / stats->frames, stats->spun_ms / stats->frames, stats->max_error_ms);
+    memset(&(pacer->stats), 0, sizeof(FramePacerStats));
+}
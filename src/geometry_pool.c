@@ -0,0 +1,709 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <vulkan/vulkan.h>
+
+#include "deletion_queue.h"
+#include "geometry_pool.h"
+#include "gpu_memory.h"
+#include "submit_service.h"
+
+// where meshes are written in place
+static const VkMemoryPropertyFlags DIRECT_MEMORY_PROPERTIES =
+    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+    VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+static double now_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec * 1000.0 + (double)now.tv_nsec / 1000000.0;
+}
+
+/* Range allocator *******************/
+static void allocator_reset(GeometryAllocator* allocator, uint32_t used) {
+    allocator->used = used;
+    allocator->free_count = 0;
+    if(used < allocator->capacity) {
+        allocator->free_ranges[0] = (GeometryRange){used, allocator->capacity - used};
+        allocator->free_count = 1;
+    }
+}
+
+static void allocator_init(GeometryAllocator* allocator, uint32_t capacity) {
+    memset(allocator, 0, sizeof(GeometryAllocator));
+    allocator->capacity = capacity;
+    allocator->free_capacity = 16;
+    allocator->free_ranges = malloc(allocator->free_capacity * sizeof(GeometryRange));
+    allocator_reset(allocator, 0);
+}
+
+static bool allocator_allocate(GeometryAllocator* allocator, uint32_t count,
+                               GeometryRange* range) {
+    *range = (GeometryRange){0, count};
+    if(count == 0) {
+        return true;
+    }
+    for(uint32_t i = 0; i < allocator->free_count; i++) {
+        GeometryRange* free_range = allocator->free_ranges + i;
+        if(free_range->count < count) {
+            continue;
+        }
+        range->offset = free_range->offset;
+        free_range->offset += count;
+        free_range->count -= count;
+        if(free_range->count == 0) {
+            memmove(free_range, free_range + 1,
+                    (allocator->free_count - i - 1) * sizeof(GeometryRange));
+            allocator->free_count--;
+        }
+        allocator->used += count;
+        return true;
+    }
+    return false;
+}
+
+static void allocator_free(GeometryAllocator* allocator, GeometryRange range) {
+    if(range.count == 0) {
+        return;
+    }
+    allocator->used -= range.count;
+    uint32_t i = 0;
+    while(i < allocator->free_count && allocator->free_ranges[i].offset < range.offset) {
+        i++;
+    }
+    GeometryRange* ranges = allocator->free_ranges;
+    bool joins_previous = i > 0 && ranges[i - 1].offset + ranges[i - 1].count == range.offset;
+    bool joins_next = i < allocator->free_count && range.offset + range.count == ranges[i].offset;
+    if(joins_previous && joins_next) {
+        ranges[i - 1].count += range.count + ranges[i].count;
+        memmove(ranges + i, ranges + i + 1,
+                (allocator->free_count - i - 1) * sizeof(GeometryRange));
+        allocator->free_count--;
+    } else if(joins_previous) {
+        ranges[i - 1].count += range.count;
+    } else if(joins_next) {
+        ranges[i].offset = range.offset;
+        ranges[i].count += range.count;
+    } else {
+        if(allocator->free_count == allocator->free_capacity) {
+            uint32_t capacity = 2 * allocator->free_capacity;
+            ranges = realloc(allocator->free_ranges, capacity * sizeof(GeometryRange));
+            if(ranges == NULL) {
+                printf("failed to grow the free geometry ranges, %u elements are lost\n",
+                       range.count);
+                return;
+            }
+            allocator->free_ranges = ranges;
+            allocator->free_capacity = capacity;
+        }
+        memmove(ranges + i + 1, ranges + i, (allocator->free_count - i) * sizeof(GeometryRange));
+        ranges[i] = range;
+        allocator->free_count++;
+    }
+}
+
+// Free ranges that are not the tail of the buffer: space that only a compaction gets back in one
+// piece
+static uint32_t allocator_holes(const GeometryAllocator* allocator) {
+    if(allocator->free_count == 0) {
+        return 0;
+    }
+    const GeometryRange* last = allocator->free_ranges + allocator->free_count - 1;
+    bool tail = last->offset + last->count == allocator->capacity;
+    return allocator->free_count - (tail ? 1 : 0);
+}
+
+/* GPU resources *********************/
+static uint32_t find_memory_type_index(const GeometryPool* pool, uint32_t type_filter,
+                                       VkMemoryPropertyFlags properties) {
+    const VkPhysicalDeviceMemoryProperties* memory_properties = &(pool->memory_properties);
+    for(uint32_t i = 0; i < memory_properties->memoryTypeCount; i++) {
+        if(type_filter & (1 << i) &&
+           ((memory_properties->memoryTypes[i].propertyFlags & properties) == properties)) {
+            return i;
+        }
+    }
+    printf("failed to find suitable memory type for geometry\n");
+    return UINT32_MAX;
+}
+
+// Whether the geometry can be written by the CPU right where the GPU reads it
+static bool direct_memory_available(const GeometryPool* pool) {
+    const VkPhysicalDeviceMemoryProperties* memory_properties = &(pool->memory_properties);
+    for(uint32_t i = 0; i < memory_properties->memoryTypeCount; i++) {
+        const VkMemoryType* type = memory_properties->memoryTypes + i;
+        if((type->propertyFlags & DIRECT_MEMORY_PROPERTIES) == DIRECT_MEMORY_PROPERTIES &&
+           memory_properties->memoryHeaps[type->heapIndex].size >
+               GEOMETRY_POOL_SMALL_BAR_HEAP_SIZE) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void free_memory(GeometryPool* pool, VkDeviceMemory memory) {
+    if(pool->info.memory_tracker != NULL) {
+        gpu_memory_free(pool->info.memory_tracker, memory);
+    } else {
+        vkFreeMemory(pool->info.device, memory, pool->info.allocator);
+    }
+}
+
+// shared: with the graphics family too, staging buffers are only read by the transfer queue
+static bool create_buffer(GeometryPool* pool, VkDeviceSize size, VkBufferUsageFlags usage,
+                          VkMemoryPropertyFlags properties, GpuMemoryCategory category,
+                          bool shared, VkBuffer* buffer, VkDeviceMemory* memory) {
+    const GeometryPoolCreateInfo* info = &(pool->info);
+    uint32_t families[2] = {info->graphics_family, info->transfer_family};
+    VkBufferCreateInfo buffer_info = {0};
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.size = size;
+    buffer_info.usage = usage;
+    if(shared && info->graphics_family != info->transfer_family) {
+        buffer_info.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        buffer_info.queueFamilyIndexCount = 2;
+        buffer_info.pQueueFamilyIndices = families;
+    } else {
+        buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    }
+    if(vkCreateBuffer(info->device, &buffer_info, info->allocator, buffer) != VK_SUCCESS) {
+        printf("failed to create geometry buffer\n");
+        return false;
+    }
+
+    VkMemoryRequirements memory_requirements = {0};
+    vkGetBufferMemoryRequirements(info->device, *buffer, &memory_requirements);
+    VkMemoryAllocateInfo allocate_info = {0};
+    allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocate_info.allocationSize = memory_requirements.size;
+    allocate_info.memoryTypeIndex =
+        find_memory_type_index(pool, memory_requirements.memoryTypeBits, properties);
+    VkResult result = VK_ERROR_OUT_OF_DEVICE_MEMORY;
+    if(allocate_info.memoryTypeIndex != UINT32_MAX) {
+        result = info->memory_tracker != NULL
+                     ? gpu_memory_allocate(info->memory_tracker, &allocate_info, category, memory)
+                     : vkAllocateMemory(info->device, &allocate_info, info->allocator, memory);
+    }
+    if(result != VK_SUCCESS) {
+        printf("failed to allocate geometry buffer memory\n");
+        vkDestroyBuffer(info->device, *buffer, info->allocator);
+        *buffer = VK_NULL_HANDLE;
+        return false;
+    }
+    vkBindBufferMemory(info->device, *buffer, *memory, 0);
+    return true;
+}
+
+static bool create_buffers(GeometryPool* pool, GeometryBuffers* buffers) {
+    memset(buffers, 0, sizeof(GeometryBuffers));
+    VkDevice device = pool->info.device;
+    VkMemoryPropertyFlags properties =
+        pool->direct_upload ? DIRECT_MEMORY_PROPERTIES : VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    // src too: compactions copy out of them
+    VkBufferUsageFlags transfer =
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    VkDeviceSize vertex_size = (VkDeviceSize)pool->info.vertex_capacity * pool->info.vertex_stride;
+    VkDeviceSize index_size = (VkDeviceSize)pool->info.index_capacity * pool->index_size;
+    if(!create_buffer(pool, vertex_size,
+                      // storage too: shaders that pull their vertices read it directly
+                      transfer | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+                          VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                      properties, GPU_MEMORY_VERTEX, true, &(buffers->vertex_buffer),
+                      &(buffers->vertex_memory))) {
+        return false;
+    }
+    if(!create_buffer(pool, index_size, transfer | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, properties,
+                      GPU_MEMORY_INDEX, true, &(buffers->index_buffer),
+                      &(buffers->index_memory))) {
+        vkDestroyBuffer(device, buffers->vertex_buffer, pool->info.allocator);
+        free_memory(pool, buffers->vertex_memory);
+        memset(buffers, 0, sizeof(GeometryBuffers));
+        return false;
+    }
+    if(pool->direct_upload) {
+        // write only from the CPU side: this memory is uncached or write-combined
+        vkMapMemory(device, buffers->vertex_memory, 0, vertex_size, 0,
+                    (void**)&(buffers->vertex_mapped));
+        vkMapMemory(device, buffers->index_memory, 0, index_size, 0,
+                    (void**)&(buffers->index_mapped));
+    }
+    return true;
+}
+
+static void destroy_buffers(GeometryPool* pool, GeometryBuffers* buffers) {
+    vkDestroyBuffer(pool->info.device, buffers->vertex_buffer, pool->info.allocator);
+    vkDestroyBuffer(pool->info.device, buffers->index_buffer, pool->info.allocator);
+    if(buffers->vertex_memory != VK_NULL_HANDLE) {
+        free_memory(pool, buffers->vertex_memory);
+    }
+    if(buffers->index_memory != VK_NULL_HANDLE) {
+        free_memory(pool, buffers->index_memory);
+    }
+    memset(buffers, 0, sizeof(GeometryBuffers));
+}
+
+// Frames in flight may still read them: released once they are all done
+static void retire_buffers(GeometryPool* pool, GeometryBuffers* buffers) {
+    DeletionQueue* queue = pool->info.deletion_queue;
+    deletion_queue_push_buffer(queue, buffers->vertex_buffer, pool->frame_number);
+    deletion_queue_push_memory(queue, buffers->vertex_memory, pool->frame_number);
+    deletion_queue_push_buffer(queue, buffers->index_buffer, pool->frame_number);
+    deletion_queue_push_memory(queue, buffers->index_memory, pool->frame_number);
+    memset(buffers, 0, sizeof(GeometryBuffers));
+}
+
+static VkCommandBuffer begin_commands(GeometryPool* pool) {
+    VkCommandBufferAllocateInfo allocate_info = {0};
+    allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocate_info.commandPool = pool->info.transfer_command_pool;
+    allocate_info.commandBufferCount = 1;
+    VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+    vkAllocateCommandBuffers(pool->info.device, &allocate_info, &command_buffer);
+
+    VkCommandBufferBeginInfo begin_info = {0};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(command_buffer, &begin_info);
+    return command_buffer;
+}
+
+// The fence tells when the copy is done. The graphics queue only reads what was copied after the
+// fence was seen, so there is nothing to wait on there.
+static VkFence submit_commands(GeometryPool* pool, VkCommandBuffer command_buffer) {
+    vkEndCommandBuffer(command_buffer);
+
+    VkFenceCreateInfo fence_info = {0};
+    fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    VkFence fence = VK_NULL_HANDLE;
+    if(vkCreateFence(pool->info.device, &fence_info, pool->info.allocator, &fence) != VK_SUCCESS) {
+        printf("failed to create geometry copy fence\n");
+    }
+
+    SubmitBatch batch = {0};
+    batch.command_buffer_count = 1;
+    batch.command_buffers[0] = command_buffer;
+    batch.fence = fence;
+    submit_service_push(pool->info.transfer_submit, &batch);
+    return fence;
+}
+
+static void end_commands(GeometryPool* pool, VkCommandBuffer command_buffer, VkFence fence) {
+    vkDestroyFence(pool->info.device, fence, pool->info.allocator);
+    vkFreeCommandBuffers(pool->info.device, pool->info.transfer_command_pool, 1, &command_buffer);
+}
+
+static bool copy_done(GeometryPool* pool, VkFence fence) {
+    return vkGetFenceStatus(pool->info.device, fence) == VK_SUCCESS;
+}
+
+/* Retired ranges ********************/
+static void retire_ranges(GeometryPool* pool, const GeometryMesh* mesh, uint64_t frame_number) {
+    if(pool->retired_count == pool->retired_capacity) {
+        uint32_t capacity = pool->retired_capacity == 0 ? 16 : 2 * pool->retired_capacity;
+        RetiredGeometryRanges* retired_ranges =
+            realloc(pool->retired, capacity * sizeof(RetiredGeometryRanges));
+        if(retired_ranges == NULL) {
+            // frames in flight may still draw them, so they cannot be freed now
+            printf("failed to grow the retired geometry ranges, they are lost\n");
+            return;
+        }
+        pool->retired = retired_ranges;
+        pool->retired_capacity = capacity;
+    }
+    RetiredGeometryRanges* retired = pool->retired + pool->retired_count++;
+    retired->vertices = mesh->vertices;
+    retired->indices = mesh->indices;
+    retired->retire_frame = frame_number;
+}
+
+static void collect_ranges(GeometryPool* pool, uint64_t first_pending_frame) {
+    uint32_t kept = 0;
+    for(uint32_t i = 0; i < pool->retired_count; i++) {
+        RetiredGeometryRanges* retired = pool->retired + i;
+        if(retired->retire_frame > first_pending_frame) {
+            pool->retired[kept++] = *retired;
+            continue;
+        }
+        allocator_free(&(pool->vertices), retired->vertices);
+        allocator_free(&(pool->indices), retired->indices);
+    }
+    pool->retired_count = kept;
+}
+
+static void free_mesh(GeometryPool* pool, uint32_t handle) {
+    memset(pool->meshes + handle, 0, sizeof(GeometryMesh));
+    pool->mesh_count--;
+}
+
+/* Uploads ***************************/
+static void finish_upload(GeometryPool* pool, uint32_t slot) {
+    GeometryUpload* upload = pool->uploads + slot;
+    pool->uploaded_meshes++;
+    pool->upload_latency_ms += now_ms() - upload->start_ms;
+    end_commands(pool, upload->command_buffer, upload->done);
+    vkDestroyBuffer(pool->info.device, upload->staging_buffer, pool->info.allocator);
+    free_memory(pool, upload->staging_memory);
+    pool->upload_in_use[slot] = false;
+    pool->upload_count--;
+
+    GeometryMesh* mesh = pool->meshes + upload->mesh;
+    if(mesh->release_requested) {
+        // never drawn: the ranges are free as soon as the copy is done
+        allocator_free(&(pool->vertices), mesh->vertices);
+        allocator_free(&(pool->indices), mesh->indices);
+        free_mesh(pool, upload->mesh);
+        return;
+    }
+    mesh->state = GEOMETRY_MESH_READY;
+}
+
+static void poll_uploads(GeometryPool* pool, bool wait) {
+    for(uint32_t i = 0; i < GEOMETRY_POOL_MAX_UPLOADS; i++) {
+        if(!pool->upload_in_use[i]) {
+            continue;
+        }
+        if(wait) {
+            vkWaitForFences(pool->info.device, 1, &(pool->uploads[i].done), VK_TRUE, UINT64_MAX);
+        } else if(!copy_done(pool, pool->uploads[i].done)) {
+            continue;
+        }
+        finish_upload(pool, i);
+    }
+}
+
+static bool start_upload(GeometryPool* pool, uint32_t handle, const void* vertices,
+                         const void* indices) {
+    uint32_t slot = 0;
+    while(pool->upload_in_use[slot]) {
+        slot++;
+    }
+    GeometryUpload* upload = pool->uploads + slot;
+    const GeometryMesh* mesh = pool->meshes + handle;
+    VkDeviceSize vertex_bytes = (VkDeviceSize)mesh->vertices.count * pool->info.vertex_stride;
+    VkDeviceSize index_bytes = (VkDeviceSize)mesh->indices.count * pool->index_size;
+
+    // both in one staging buffer, indices after the vertices
+    memset(upload, 0, sizeof(GeometryUpload));
+    upload->mesh = handle;
+    upload->size = vertex_bytes + index_bytes;
+    upload->start_ms = now_ms();
+    if(!create_buffer(pool, vertex_bytes + index_bytes, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                      GPU_MEMORY_STAGING, false, &(upload->staging_buffer),
+                      &(upload->staging_memory))) {
+        return false;
+    }
+    uint8_t* data;
+    vkMapMemory(pool->info.device, upload->staging_memory, 0, vertex_bytes + index_bytes, 0,
+                (void**)&data);
+    memcpy(data, vertices, (size_t)vertex_bytes);
+    if(index_bytes > 0) {
+        memcpy(data + vertex_bytes, indices, (size_t)index_bytes);
+    }
+    vkUnmapMemory(pool->info.device, upload->staging_memory);
+
+    upload->command_buffer = begin_commands(pool);
+    VkBufferCopy region = {0};
+    region.srcOffset = 0;
+    region.dstOffset = (VkDeviceSize)mesh->vertices.offset * pool->info.vertex_stride;
+    region.size = vertex_bytes;
+    vkCmdCopyBuffer(upload->command_buffer, upload->staging_buffer, pool->buffers.vertex_buffer, 1,
+                    &region);
+    if(index_bytes > 0) {
+        region.srcOffset = vertex_bytes;
+        region.dstOffset = (VkDeviceSize)mesh->indices.offset * pool->index_size;
+        region.size = index_bytes;
+        vkCmdCopyBuffer(upload->command_buffer, upload->staging_buffer,
+                        pool->buffers.index_buffer, 1, &region);
+    }
+    upload->done = submit_commands(pool, upload->command_buffer);
+
+    pool->upload_in_use[slot] = true;
+    pool->upload_count++;
+    pool->uploaded_bytes += upload->size;
+    pool->upload_cpu_ms += now_ms() - upload->start_ms;
+    return true;
+}
+
+// Straight into the buffers: the ranges are not used by any frame, the writes are visible to
+// the next submit
+static void write_mesh(GeometryPool* pool, const GeometryMesh* mesh, const void* vertices,
+                       const void* indices) {
+    double start = now_ms();
+    size_t vertex_bytes = (size_t)mesh->vertices.count * pool->info.vertex_stride;
+    size_t index_bytes = (size_t)mesh->indices.count * pool->index_size;
+    memcpy(pool->buffers.vertex_mapped + (size_t)mesh->vertices.offset * pool->info.vertex_stride,
+           vertices, vertex_bytes);
+    if(index_bytes > 0) {
+        memcpy(pool->buffers.index_mapped + (size_t)mesh->indices.offset * pool->index_size,
+               indices, index_bytes);
+    }
+    // usable as soon as it is written
+    double elapsed = now_ms() - start;
+    pool->uploaded_meshes++;
+    pool->uploaded_bytes += vertex_bytes + index_bytes;
+    pool->upload_cpu_ms += elapsed;
+    pool->upload_latency_ms += elapsed;
+}
+
+/* Compaction ************************/
+static void add_copy(VkBufferCopy* regions, uint32_t* region_count, VkDeviceSize src,
+                     VkDeviceSize dst, VkDeviceSize size) {
+    if(size == 0) {
+        return;
+    }
+    // meshes that were already next to each other move in one region
+    if(*region_count > 0) {
+        VkBufferCopy* last = regions + *region_count - 1;
+        if(last->srcOffset + last->size == src && last->dstOffset + last->size == dst) {
+            last->size += size;
+            return;
+        }
+    }
+    regions[(*region_count)++] = (VkBufferCopy){src, dst, size};
+}
+
+// Only with no upload in flight: every mesh that is not free is ready, and its data in place
+static void start_compaction(GeometryPool* pool) {
+    GeometryCompaction* compaction = &(pool->compaction);
+    if(!create_buffers(pool, &(compaction->target))) {
+        return;
+    }
+
+    VkBufferCopy* vertex_regions = malloc(GEOMETRY_POOL_MAX_MESHES * sizeof(VkBufferCopy));
+    VkBufferCopy* index_regions = malloc(GEOMETRY_POOL_MAX_MESHES * sizeof(VkBufferCopy));
+    uint32_t vertex_region_count = 0, index_region_count = 0;
+    VkDeviceSize stride = pool->info.vertex_stride;
+    VkDeviceSize index_size = pool->index_size;
+    compaction->vertex_end = 0;
+    compaction->index_end = 0;
+    compaction->mesh_count = 0;
+    for(uint32_t i = 0; i < GEOMETRY_POOL_MAX_MESHES; i++) {
+        const GeometryMesh* mesh = pool->meshes + i;
+        if(mesh->state != GEOMETRY_MESH_READY) {
+            continue;
+        }
+        uint32_t n = compaction->mesh_count++;
+        compaction->meshes[n] = i;
+        compaction->vertices[n] = (GeometryRange){compaction->vertex_end, mesh->vertices.count};
+        compaction->indices[n] = (GeometryRange){compaction->index_end, mesh->indices.count};
+        add_copy(vertex_regions, &vertex_region_count, mesh->vertices.offset * stride,
+                 compaction->vertex_end * stride, mesh->vertices.count * stride);
+        add_copy(index_regions, &index_region_count, mesh->indices.offset * index_size,
+                 compaction->index_end * index_size, mesh->indices.count * index_size);
+        compaction->vertex_end += mesh->vertices.count;
+        compaction->index_end += mesh->indices.count;
+    }
+
+    compaction->command_buffer = begin_commands(pool);
+    if(vertex_region_count > 0) {
+        vkCmdCopyBuffer(compaction->command_buffer, pool->buffers.vertex_buffer,
+                        compaction->target.vertex_buffer, vertex_region_count, vertex_regions);
+    }
+    if(index_region_count > 0) {
+        vkCmdCopyBuffer(compaction->command_buffer, pool->buffers.index_buffer,
+                        compaction->target.index_buffer, index_region_count, index_regions);
+    }
+    compaction->done = submit_commands(pool, compaction->command_buffer);
+    compaction->active = true;
+    free(vertex_regions);
+    free(index_regions);
+}
+
+static void finish_compaction(GeometryPool* pool) {
+    GeometryCompaction* compaction = &(pool->compaction);
+    end_commands(pool, compaction->command_buffer, compaction->done);
+    compaction->active = false;
+
+    retire_buffers(pool, &(pool->buffers));
+    pool->buffers = compaction->target;
+    memset(&(compaction->target), 0, sizeof(GeometryBuffers));
+
+    // the retired ranges were in the old buffers, which are retired as a whole
+    pool->retired_count = 0;
+    allocator_reset(&(pool->vertices), compaction->vertex_end);
+    allocator_reset(&(pool->indices), compaction->index_end);
+    for(uint32_t n = 0; n < compaction->mesh_count; n++) {
+        GeometryMesh* mesh = pool->meshes + compaction->meshes[n];
+        if(mesh->state == GEOMETRY_MESH_READY) {
+            mesh->vertices = compaction->vertices[n];
+            mesh->indices = compaction->indices[n];
+        } else {
+            // removed during the copy: nothing will ever read its new place
+            allocator_free(&(pool->vertices), compaction->vertices[n]);
+            allocator_free(&(pool->indices), compaction->indices[n]);
+        }
+    }
+    pool->compactions++;
+    pool->compacted_bytes +=
+        (VkDeviceSize)compaction->vertex_end * pool->info.vertex_stride +
+        (VkDeviceSize)compaction->index_end * pool->index_size;
+}
+
+static bool fragmented(const GeometryPool* pool) {
+    return allocator_holes(&(pool->vertices)) >= GEOMETRY_POOL_COMPACT_HOLES ||
+           allocator_holes(&(pool->indices)) >= GEOMETRY_POOL_COMPACT_HOLES;
+}
+
+// Anything added to the old buffers during the copy would be lost
+static void wait_compaction(GeometryPool* pool) {
+    if(pool->compaction.active) {
+        vkWaitForFences(pool->info.device, 1, &(pool->compaction.done), VK_TRUE, UINT64_MAX);
+        finish_compaction(pool);
+    }
+}
+
+/* Lifetime **************************/
+bool geometry_pool_create(GeometryPool* pool, const GeometryPoolCreateInfo* info) {
+    assert(info->transfer_submit != NULL);
+    memset(pool, 0, sizeof(GeometryPool));
+    pool->info = *info;
+    pool->index_size = info->index_type == VK_INDEX_TYPE_UINT32 ? 4 : 2;
+    vkGetPhysicalDeviceMemoryProperties(info->physical_device, &(pool->memory_properties));
+    allocator_init(&(pool->vertices), info->vertex_capacity);
+    allocator_init(&(pool->indices), info->index_capacity);
+
+    pool->direct_upload = !info->force_staging && direct_memory_available(pool);
+    bool created = create_buffers(pool, &(pool->buffers));
+    if(!created && pool->direct_upload) {
+        // the memory type does not suit these buffers after all
+        pool->direct_upload = false;
+        created = create_buffers(pool, &(pool->buffers));
+    }
+    printf("geometry uploads %s\n", pool->direct_upload
+                                         ? "written directly to device local memory"
+                                         : "staged and copied on the transfer queue");
+    return created;
+}
+
+void geometry_pool_destroy(GeometryPool* pool) {
+    poll_uploads(pool, true);
+    wait_compaction(pool);
+    destroy_buffers(pool, &(pool->buffers));
+    free(pool->vertices.free_ranges);
+    free(pool->indices.free_ranges);
+    free(pool->retired);
+    memset(pool, 0, sizeof(GeometryPool));
+}
+
+/* Meshes ****************************/
+uint32_t geometry_pool_add_mesh(GeometryPool* pool, const void* vertices, uint32_t vertex_count,
+                                const void* indices, uint32_t index_count) {
+    if(pool->mesh_count == GEOMETRY_POOL_MAX_MESHES) {
+        printf("geometry pool full, %u meshes\n", pool->mesh_count);
+        return GEOMETRY_MESH_NONE;
+    }
+    wait_compaction(pool);
+    if(pool->upload_count == GEOMETRY_POOL_MAX_UPLOADS) {
+        poll_uploads(pool, true);
+    }
+
+    GeometryMesh mesh = {0};
+    bool allocated = allocator_allocate(&(pool->vertices), vertex_count, &(mesh.vertices));
+    if(allocated && !allocator_allocate(&(pool->indices), index_count, &(mesh.indices))) {
+        allocator_free(&(pool->vertices), mesh.vertices);
+        allocated = false;
+    }
+    bool fits = pool->vertices.capacity - pool->vertices.used >= vertex_count &&
+                pool->indices.capacity - pool->indices.used >= index_count;
+    if(!allocated && fits) {
+        // only too fragmented: compact now, waiting for it, and try again
+        poll_uploads(pool, true);
+        start_compaction(pool);
+        wait_compaction(pool);
+        allocated = allocator_allocate(&(pool->vertices), vertex_count, &(mesh.vertices));
+        if(allocated && !allocator_allocate(&(pool->indices), index_count, &(mesh.indices))) {
+            allocator_free(&(pool->vertices), mesh.vertices);
+            allocated = false;
+        }
+    }
+    if(!allocated) {
+        printf("geometry pool out of space for a mesh of %u vertices and %u indices\n",
+               vertex_count, index_count);
+        return GEOMETRY_MESH_NONE;
+    }
+
+    uint32_t handle = 0;
+    while(pool->meshes[handle].state != GEOMETRY_MESH_FREE) {
+        handle++;
+    }
+    pool->mesh_count++;
+    if(pool->direct_upload) {
+        mesh.state = GEOMETRY_MESH_READY;
+        pool->meshes[handle] = mesh;
+        write_mesh(pool, &mesh, vertices, indices);
+        return handle;
+    }
+    mesh.state = GEOMETRY_MESH_UPLOADING;
+    pool->meshes[handle] = mesh;
+    if(!start_upload(pool, handle, vertices, indices)) {
+        allocator_free(&(pool->vertices), mesh.vertices);
+        allocator_free(&(pool->indices), mesh.indices);
+        free_mesh(pool, handle);
+        return GEOMETRY_MESH_NONE;
+    }
+    return handle;
+}
+
+void geometry_pool_remove_mesh(GeometryPool* pool, uint32_t handle, uint64_t frame_number) {
+    if(handle >= GEOMETRY_POOL_MAX_MESHES) {
+        return;
+    }
+    GeometryMesh* mesh = pool->meshes + handle;
+    if(mesh->state == GEOMETRY_MESH_UPLOADING) {
+        mesh->release_requested = true;
+    } else if(mesh->state == GEOMETRY_MESH_READY) {
+        retire_ranges(pool, mesh, frame_number);
+        free_mesh(pool, handle);
+    }
+}
+
+const GeometryMesh* geometry_pool_mesh(const GeometryPool* pool, uint32_t handle) {
+    if(handle >= GEOMETRY_POOL_MAX_MESHES || pool->meshes[handle].state != GEOMETRY_MESH_READY) {
+        return NULL;
+    }
+    return pool->meshes + handle;
+}
+
+void geometry_pool_update(GeometryPool* pool, uint64_t frame_number, uint64_t first_pending_frame) {
+    pool->frame_number = frame_number;
+    poll_uploads(pool, false);
+    if(pool->compaction.active && copy_done(pool, pool->compaction.done)) {
+        finish_compaction(pool);
+    }
+    collect_ranges(pool, first_pending_frame);
+    if(!pool->compaction.active && pool->upload_count == 0 && fragmented(pool)) {
+        start_compaction(pool);
+    }
+}
+
+void geometry_pool_finish_uploads(GeometryPool* pool) {
+    poll_uploads(pool, true);
+}
+
+bool geometry_pool_busy(const GeometryPool* pool) {
+    return pool->upload_count > 0 || pool->compaction.active || pool->retired_count > 0;
+}
+
+void geometry_pool_print_stats(const GeometryPool* pool) {
+    printf("geometry pool: %u meshes, %u/%u vertices and %u/%u indices used, %u+%u holes, %u "
+           "compactions moved %.2f MiB\n",
+           pool->mesh_count, pool->vertices.used, pool->vertices.capacity, pool->indices.used,
+           pool->indices.capacity, allocator_holes(&(pool->vertices)),
+           allocator_holes(&(pool->indices)), pool->compactions,
+           (double)pool->compacted_bytes / (1024.0 * 1024.0));
+    if(pool->uploaded_meshes > 0 && pool->upload_cpu_ms > 0.0) {
+        double mib = (double)pool->uploaded_bytes / (1024.0 * 1024.0);
+        printf("geometry uploads (%s): %u meshes, %.2f MiB, %.3f ms on the CPU (%.1f MiB/s), "
+               "%.3f ms average latency\n",
+               pool->direct_upload ? "direct" : "staged", pool->uploaded_meshes, mib,
+               pool->upload_cpu_ms, mib / (pool->upload_cpu_ms / 1000.0),
+               pool->upload_latency_ms / (double)pool->uploaded_meshes);
+    }
+}
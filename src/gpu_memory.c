@@ -0,0 +1,238 @@
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vulkan/vulkan.h>
+
+#include "gpu_memory.h"
+
+#define DEFAULT_PRESSURE_RATIO 0.9f
+#define MIB (1024.0 * 1024.0)
+
+static const char* CATEGORY_NAMES[GPU_MEMORY_CATEGORY_COUNT] = {
+    "vertex", "index", "uniform", "storage", "staging", "texture", "render target",
+};
+
+// set from the signal handler, only an atomic flag can be touched there
+static volatile sig_atomic_t dump_requested = 0;
+
+static void dump_signal_handler(int signal_number) {
+    (void)signal_number;
+    dump_requested = 1;
+}
+
+void gpu_memory_dump_on_signal(int signal_number) {
+    struct sigaction action = {0};
+    action.sa_handler = dump_signal_handler;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    if(sigaction(signal_number, &action, NULL) != 0) {
+        printf("failed to install the gpu memory dump signal handler\n");
+    }
+}
+
+void gpu_memory_tracker_create(GpuMemoryTracker* tracker, VkDevice device,
+                               VkPhysicalDevice physical_device,
+                               const VkAllocationCallbacks* allocator, bool budget_extension) {
+    memset(tracker, 0, sizeof(GpuMemoryTracker));
+    tracker->device = device;
+    tracker->physical_device = physical_device;
+    tracker->allocator = allocator;
+    tracker->budget_extension = budget_extension;
+    vkGetPhysicalDeviceMemoryProperties(physical_device, &(tracker->properties));
+    pthread_mutex_init(&(tracker->mutex), NULL);
+    tracker->pressure_ratio = DEFAULT_PRESSURE_RATIO;
+    gpu_memory_poll(tracker);
+}
+
+void gpu_memory_tracker_destroy(GpuMemoryTracker* tracker) {
+    if(tracker->allocation_count > 0) {
+        printf("%u gpu memory allocations were never freed\n", tracker->allocation_count);
+    }
+    free(tracker->allocations);
+    pthread_mutex_destroy(&(tracker->mutex));
+    memset(tracker, 0, sizeof(GpuMemoryTracker));
+}
+
+static void counter_add(GpuMemoryCounter* counter, VkDeviceSize size) {
+    counter->bytes += size;
+    counter->allocations++;
+    if(counter->bytes > counter->peak_bytes) {
+        counter->peak_bytes = counter->bytes;
+    }
+}
+
+static void counter_remove(GpuMemoryCounter* counter, VkDeviceSize size) {
+    counter->bytes -= size;
+    counter->allocations--;
+}
+
+VkResult gpu_memory_allocate(GpuMemoryTracker* tracker, const VkMemoryAllocateInfo* allocate_info,
+                             GpuMemoryCategory category, VkDeviceMemory* memory) {
+    VkResult result = vkAllocateMemory(tracker->device, allocate_info, tracker->allocator, memory);
+    if(result != VK_SUCCESS) {
+        pthread_mutex_lock(&(tracker->mutex));
+        tracker->failed_allocations++;
+        pthread_mutex_unlock(&(tracker->mutex));
+        printf("failed to allocate %.2f MiB of %s memory (type %u, error %d)\n",
+               (double)allocate_info->allocationSize / MIB, CATEGORY_NAMES[category],
+               allocate_info->memoryTypeIndex, result);
+        gpu_memory_dump(tracker, stdout);
+        return result;
+    }
+
+    pthread_mutex_lock(&(tracker->mutex));
+    if(tracker->allocation_count == tracker->allocation_capacity) {
+        uint32_t capacity =
+            tracker->allocation_capacity == 0 ? 64 : 2 * tracker->allocation_capacity;
+        GpuMemoryAllocation* allocations =
+            realloc(tracker->allocations, capacity * sizeof(GpuMemoryAllocation));
+        if(allocations == NULL) {
+            pthread_mutex_unlock(&(tracker->mutex));
+            // an untracked allocation would throw the budgets off for the rest of the run
+            printf("failed to grow the tracked %s allocations\n", CATEGORY_NAMES[category]);
+            vkFreeMemory(tracker->device, *memory, tracker->allocator);
+            *memory = VK_NULL_HANDLE;
+            return VK_ERROR_OUT_OF_HOST_MEMORY;
+        }
+        tracker->allocations = allocations;
+        tracker->allocation_capacity = capacity;
+    }
+    GpuMemoryAllocation* allocation = tracker->allocations + tracker->allocation_count++;
+    allocation->memory = *memory;
+    allocation->size = allocate_info->allocationSize;
+    allocation->memory_type = allocate_info->memoryTypeIndex;
+    allocation->category = category;
+
+    uint32_t heap = tracker->properties.memoryTypes[allocation->memory_type].heapIndex;
+    counter_add(tracker->categories + category, allocation->size);
+    counter_add(tracker->heaps + heap, allocation->size);
+    pthread_mutex_unlock(&(tracker->mutex));
+    return VK_SUCCESS;
+}
+
+void gpu_memory_free(GpuMemoryTracker* tracker, VkDeviceMemory memory) {
+    if(memory == VK_NULL_HANDLE) {
+        return;
+    }
+    pthread_mutex_lock(&(tracker->mutex));
+    // there are few allocations (this is not a suballocator), a linear search is fine
+    bool found = false;
+    for(uint32_t i = 0; i < tracker->allocation_count; i++) {
+        GpuMemoryAllocation* allocation = tracker->allocations + i;
+        if(allocation->memory != memory) {
+            continue;
+        }
+        uint32_t heap = tracker->properties.memoryTypes[allocation->memory_type].heapIndex;
+        counter_remove(tracker->categories + allocation->category, allocation->size);
+        counter_remove(tracker->heaps + heap, allocation->size);
+        *allocation = tracker->allocations[--tracker->allocation_count];
+        found = true;
+        break;
+    }
+    pthread_mutex_unlock(&(tracker->mutex));
+    if(!found) {
+        printf("freeing gpu memory that was not allocated through the tracker\n");
+    }
+    vkFreeMemory(tracker->device, memory, tracker->allocator);
+}
+
+void gpu_memory_set_pressure_callback(GpuMemoryTracker* tracker, float ratio,
+                                      GpuMemoryPressureCallback callback, void* user_data) {
+    tracker->pressure_ratio = ratio;
+    tracker->pressure_callback = callback;
+    tracker->pressure_user_data = user_data;
+}
+
+void gpu_memory_poll(GpuMemoryTracker* tracker) {
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budget_properties = {0};
+    budget_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+    if(tracker->budget_extension) {
+        VkPhysicalDeviceMemoryProperties2 properties = {0};
+        properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+        properties.pNext = &budget_properties;
+        vkGetPhysicalDeviceMemoryProperties2(tracker->physical_device, &properties);
+    }
+
+    uint32_t pressured_heaps[VK_MAX_MEMORY_HEAPS];
+    uint32_t pressured_count = 0;
+    pthread_mutex_lock(&(tracker->mutex));
+    for(uint32_t i = 0; i < tracker->properties.memoryHeapCount; i++) {
+        if(tracker->budget_extension) {
+            tracker->heap_budget[i] = budget_properties.heapBudget[i];
+            tracker->heap_usage[i] = budget_properties.heapUsage[i];
+        } else {
+            tracker->heap_budget[i] = (VkDeviceSize)(
+                (double)tracker->properties.memoryHeaps[i].size * GPU_MEMORY_FALLBACK_BUDGET_RATIO);
+            tracker->heap_usage[i] = tracker->heaps[i].bytes;
+        }
+        tracker->heap_bytes_at_poll[i] = tracker->heaps[i].bytes;
+
+        double limit = (double)tracker->heap_budget[i] * tracker->pressure_ratio;
+        bool under_pressure = (double)tracker->heap_usage[i] > limit;
+        if(under_pressure && !tracker->under_pressure[i]) {
+            pressured_heaps[pressured_count++] = i;
+        }
+        tracker->under_pressure[i] = under_pressure;
+    }
+    pthread_mutex_unlock(&(tracker->mutex));
+
+    // outside of the lock: the callback will probably free or allocate memory
+    if(tracker->pressure_callback != NULL) {
+        for(uint32_t i = 0; i < pressured_count; i++) {
+            uint32_t heap = pressured_heaps[i];
+            tracker->pressure_callback(heap, tracker->heap_usage[heap], tracker->heap_budget[heap],
+                                       tracker->pressure_user_data);
+        }
+    }
+
+    if(dump_requested) {
+        dump_requested = 0;
+        gpu_memory_dump(tracker, stdout);
+    }
+}
+
+VkDeviceSize gpu_memory_headroom(GpuMemoryTracker* tracker, uint32_t memory_type) {
+    uint32_t heap = tracker->properties.memoryTypes[memory_type].heapIndex;
+    pthread_mutex_lock(&(tracker->mutex));
+    // what the driver reported at the last poll, plus what we allocated since
+    double usage = (double)tracker->heap_usage[heap] + (double)tracker->heaps[heap].bytes -
+                   (double)tracker->heap_bytes_at_poll[heap];
+    double limit = (double)tracker->heap_budget[heap] * tracker->pressure_ratio;
+    pthread_mutex_unlock(&(tracker->mutex));
+    return usage < limit ? (VkDeviceSize)(limit - usage) : 0;
+}
+
+void gpu_memory_dump(GpuMemoryTracker* tracker, FILE* file) {
+    pthread_mutex_lock(&(tracker->mutex));
+    fprintf(file, "gpu memory (budget from %s):\n",
+            tracker->budget_extension ? "VK_EXT_memory_budget" : "heap sizes");
+    for(uint32_t i = 0; i < tracker->properties.memoryHeapCount; i++) {
+        const GpuMemoryCounter* heap = tracker->heaps + i;
+        fprintf(file,
+                "    heap %u%s: %8.2f / %8.2f MiB used (ours: %8.2f MiB, peak %8.2f MiB, %u "
+                "allocations)%s\n",
+                i,
+                tracker->properties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT
+                    ? " (device local)"
+                    : "",
+                (double)tracker->heap_usage[i] / MIB, (double)tracker->heap_budget[i] / MIB,
+                (double)heap->bytes / MIB, (double)heap->peak_bytes / MIB, heap->allocations,
+                tracker->under_pressure[i] ? " UNDER PRESSURE" : "");
+    }
+    for(uint32_t i = 0; i < GPU_MEMORY_CATEGORY_COUNT; i++) {
+        const GpuMemoryCounter* category = tracker->categories + i;
+        fprintf(file, "    %-13s %8.2f MiB (peak %8.2f MiB), %u allocations\n", CATEGORY_NAMES[i],
+                (double)category->bytes / MIB, (double)category->peak_bytes / MIB,
+                category->allocations);
+    }
+    if(tracker->failed_allocations > 0) {
+        fprintf(file, "    %u failed allocations\n", tracker->failed_allocations);
+    }
+    pthread_mutex_unlock(&(tracker->mutex));
+    fflush(file);
+}
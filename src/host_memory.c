@@ -0,0 +1,345 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vulkan/vulkan.h>
+
+#include "host_memory.h"
+
+// malloc already aligns to this, enough for anything the app stores
+#define DEFAULT_ALIGNMENT 16
+#define ARENA_ALIGNMENT 16
+// size_class of the blocks that do not come from a pool
+#define HEAP_CLASS HOST_SIZE_CLASS_COUNT
+
+static const char* SCOPE_NAMES[HOST_SCOPE_COUNT] = {
+    "vk command", "vk object", "vk cache", "vk device", "vk instance", "frame", "swapchain", "app",
+};
+
+// Right before every pointer handed out, so that free and realloc know where it comes from
+typedef struct {
+    void* base; // start of the pool block, or of the heap allocation
+    size_t size;
+    uint32_t size_class;
+    uint32_t scope;
+} AllocationHeader;
+
+static size_t align_up(size_t value, size_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+static void* vk_allocation(void* user_data, size_t size, size_t alignment,
+                           VkSystemAllocationScope scope) {
+    return host_alloc_aligned(user_data, size, alignment, (HostScope)scope);
+}
+
+static void* vk_reallocation(void* user_data, void* original, size_t size, size_t alignment,
+                             VkSystemAllocationScope scope) {
+    return host_realloc(user_data, original, size, alignment, (HostScope)scope);
+}
+
+static void vk_free(void* user_data, void* memory) {
+    host_free(user_data, memory);
+}
+
+static void vk_internal_allocation(void* user_data, size_t size, VkInternalAllocationType type,
+                                   VkSystemAllocationScope scope) {
+    (void)type;
+    (void)scope;
+    HostMemory* memory = user_data;
+    pthread_mutex_lock(&(memory->mutex));
+    memory->internal_allocations++;
+    memory->internal_bytes += size;
+    pthread_mutex_unlock(&(memory->mutex));
+}
+
+static void vk_internal_free(void* user_data, size_t size, VkInternalAllocationType type,
+                             VkSystemAllocationScope scope) {
+    (void)type;
+    (void)scope;
+    HostMemory* memory = user_data;
+    pthread_mutex_lock(&(memory->mutex));
+    memory->internal_bytes -= size;
+    pthread_mutex_unlock(&(memory->mutex));
+}
+
+void host_memory_create(HostMemory* memory, size_t frame_arena_capacity) {
+    memset(memory, 0, sizeof(HostMemory));
+    pthread_mutex_init(&(memory->mutex), NULL);
+    for(uint32_t i = 0; i < HOST_SIZE_CLASS_COUNT; i++) {
+        memory->pools[i].block_size = (size_t)HOST_SMALLEST_SIZE_CLASS << i;
+    }
+    memory->frame_arena.capacity = align_up(frame_arena_capacity, ARENA_ALIGNMENT);
+    memory->frame_arena.base = aligned_alloc(ARENA_ALIGNMENT, memory->frame_arena.capacity);
+    memory->heap_allocations = 1;
+
+    memory->callbacks.pUserData = memory;
+    memory->callbacks.pfnAllocation = vk_allocation;
+    memory->callbacks.pfnReallocation = vk_reallocation;
+    memory->callbacks.pfnFree = vk_free;
+    memory->callbacks.pfnInternalAllocation = vk_internal_allocation;
+    memory->callbacks.pfnInternalFree = vk_internal_free;
+}
+
+static void free_overflow(HostArena* arena) {
+    while(arena->overflow != NULL) {
+        HostBlock* next = arena->overflow->next;
+        free(arena->overflow);
+        arena->overflow = next;
+    }
+}
+
+void host_memory_destroy(HostMemory* memory) {
+    for(uint32_t i = 0; i < HOST_SIZE_CLASS_COUNT; i++) {
+        HostBlock* slab = memory->pools[i].slabs;
+        while(slab != NULL) {
+            HostBlock* next = slab->next;
+            free(slab);
+            slab = next;
+        }
+    }
+    free_overflow(&(memory->frame_arena));
+    free(memory->frame_arena.base);
+    pthread_mutex_destroy(&(memory->mutex));
+    memset(memory, 0, sizeof(HostMemory));
+}
+
+/* Pools *****************************/
+
+// A new slab is cut in blocks, all of them go in the free list. Called with the mutex held.
+static bool grow_pool(HostMemory* memory, HostPool* pool) {
+    // the first block of the slab holds the slab link, so that slabs can be freed at the end
+    size_t block_count = HOST_SLAB_SIZE / pool->block_size;
+    if(block_count < 2) {
+        block_count = 2;
+    }
+    uint8_t* slab = malloc(block_count * pool->block_size);
+    if(slab == NULL) {
+        return false;
+    }
+    memory->heap_allocations++;
+    ((HostBlock*)slab)->next = pool->slabs;
+    pool->slabs = (HostBlock*)slab;
+    for(size_t i = block_count - 1; i > 0; i--) {
+        HostBlock* block = (HostBlock*)(slab + i * pool->block_size);
+        block->next = pool->free_list;
+        pool->free_list = block;
+    }
+    return true;
+}
+
+// Smallest class that fits, or HEAP_CLASS
+static uint32_t size_class(size_t needed) {
+    for(uint32_t i = 0; i < HOST_SIZE_CLASS_COUNT; i++) {
+        if(needed <= ((size_t)HOST_SMALLEST_SIZE_CLASS << i)) {
+            return i;
+        }
+    }
+    return HEAP_CLASS;
+}
+
+void* host_alloc_aligned(HostMemory* memory, size_t size, size_t alignment, HostScope scope) {
+    if(size == 0) {
+        return NULL;
+    }
+    if(alignment < DEFAULT_ALIGNMENT) {
+        alignment = DEFAULT_ALIGNMENT;
+    }
+    // worst case: the header, then padding up to the alignment
+    size_t needed = sizeof(AllocationHeader) + alignment - 1 + size;
+    uint32_t class = size_class(needed);
+
+    pthread_mutex_lock(&(memory->mutex));
+    void* base = NULL;
+    if(class == HEAP_CLASS) {
+        base = malloc(needed);
+        memory->heap_allocations += base != NULL;
+    } else {
+        HostPool* pool = memory->pools + class;
+        if(pool->free_list != NULL || grow_pool(memory, pool)) {
+            base = pool->free_list;
+            pool->free_list = pool->free_list->next;
+        }
+    }
+    if(base == NULL) {
+        pthread_mutex_unlock(&(memory->mutex));
+        printf("failed to allocate %zu bytes of host memory\n", size);
+        return NULL;
+    }
+    HostScopeStats* stats = memory->scopes + scope;
+    stats->allocations++;
+    stats->bytes += size;
+    if(stats->bytes > stats->peak_bytes) {
+        stats->peak_bytes = stats->bytes;
+    }
+    pthread_mutex_unlock(&(memory->mutex));
+
+    uint8_t* pointer = (uint8_t*)align_up((uintptr_t)base + sizeof(AllocationHeader), alignment);
+    AllocationHeader* header = (AllocationHeader*)pointer - 1;
+    header->base = base;
+    header->size = size;
+    header->size_class = class;
+    header->scope = scope;
+    return pointer;
+}
+
+void* host_alloc(HostMemory* memory, size_t size, HostScope scope) {
+    return host_alloc_aligned(memory, size, DEFAULT_ALIGNMENT, scope);
+}
+
+void* host_calloc(HostMemory* memory, size_t count, size_t size, HostScope scope) {
+    if(size != 0 && count > SIZE_MAX / size) {
+        printf("failed to allocate %zu blocks of %zu bytes of host memory\n", count, size);
+        return NULL;
+    }
+    void* pointer = host_alloc(memory, count * size, scope);
+    if(pointer != NULL) {
+        memset(pointer, 0, count * size);
+    }
+    return pointer;
+}
+
+void host_free(HostMemory* memory, void* pointer) {
+    if(pointer == NULL) {
+        return;
+    }
+    AllocationHeader* header = (AllocationHeader*)pointer - 1;
+    pthread_mutex_lock(&(memory->mutex));
+    HostScopeStats* stats = memory->scopes + header->scope;
+    stats->frees++;
+    stats->bytes -= header->size;
+    if(header->size_class == HEAP_CLASS) {
+        free(header->base);
+    } else {
+        HostPool* pool = memory->pools + header->size_class;
+        HostBlock* block = header->base;
+        block->next = pool->free_list;
+        pool->free_list = block;
+    }
+    pthread_mutex_unlock(&(memory->mutex));
+}
+
+void* host_realloc(HostMemory* memory, void* pointer, size_t size, size_t alignment,
+                   HostScope scope) {
+    if(pointer == NULL) {
+        return host_alloc_aligned(memory, size, alignment, scope);
+    }
+    if(size == 0) {
+        host_free(memory, pointer);
+        return NULL;
+    }
+    if(alignment < DEFAULT_ALIGNMENT) {
+        alignment = DEFAULT_ALIGNMENT;
+    }
+    AllocationHeader* header = (AllocationHeader*)pointer - 1;
+    // still fits in its pool block, with the same alignment: nothing to move
+    uint8_t* block_end =
+        (uint8_t*)header->base + ((size_t)HOST_SMALLEST_SIZE_CLASS << header->size_class);
+    if(header->size_class != HEAP_CLASS && (uintptr_t)pointer % alignment == 0 &&
+       (uint8_t*)pointer + size <= block_end) {
+        pthread_mutex_lock(&(memory->mutex));
+        HostScopeStats* stats = memory->scopes + header->scope;
+        stats->bytes = stats->bytes - header->size + size;
+        if(stats->bytes > stats->peak_bytes) {
+            stats->peak_bytes = stats->bytes;
+        }
+        pthread_mutex_unlock(&(memory->mutex));
+        header->size = size;
+        return pointer;
+    }
+    void* moved = host_alloc_aligned(memory, size, alignment, scope);
+    if(moved == NULL) {
+        return NULL; // the original stays valid, as Vulkan expects
+    }
+    memcpy(moved, pointer, header->size < size ? header->size : size);
+    host_free(memory, pointer);
+    return moved;
+}
+
+/* Frame arena ***********************/
+
+void* host_frame_alloc(HostMemory* memory, size_t size) {
+    HostArena* arena = &(memory->frame_arena);
+    HostScopeStats* stats = memory->scopes + HOST_SCOPE_FRAME;
+    stats->allocations++;
+    stats->bytes += size;
+    if(stats->bytes > stats->peak_bytes) {
+        stats->peak_bytes = stats->bytes;
+    }
+
+    size_t offset = align_up(arena->offset, ARENA_ALIGNMENT);
+    if(offset + size <= arena->capacity) {
+        arena->offset = offset + size;
+        if(arena->offset > arena->peak) {
+            arena->peak = arena->offset;
+        }
+        memset(arena->base + offset, 0, size);
+        return arena->base + offset;
+    }
+
+    // too small for this frame: still works, but it shows in the stats
+    HostBlock* block = calloc(1, ARENA_ALIGNMENT + size);
+    if(block == NULL) {
+        printf("failed to allocate %zu bytes of frame memory\n", size);
+        return NULL;
+    }
+    pthread_mutex_lock(&(memory->mutex));
+    memory->heap_allocations++;
+    pthread_mutex_unlock(&(memory->mutex));
+    block->next = arena->overflow;
+    arena->overflow = block;
+    return (uint8_t*)block + ARENA_ALIGNMENT;
+}
+
+void host_memory_begin_frame(HostMemory* memory) {
+    HostArena* arena = &(memory->frame_arena);
+    free_overflow(arena);
+    arena->offset = 0;
+
+    pthread_mutex_lock(&(memory->mutex));
+    memory->scopes[HOST_SCOPE_FRAME].frees = memory->scopes[HOST_SCOPE_FRAME].allocations;
+    memory->scopes[HOST_SCOPE_FRAME].bytes = 0;
+    // before the first frame, it was the initialization: not a frame
+    if(memory->in_frame) {
+        memory->frame_heap_allocations =
+            memory->heap_allocations - memory->frame_start_heap_allocations;
+        memory->frames++;
+        memory->frames_with_heap_allocations += memory->frame_heap_allocations > 0;
+    }
+    memory->frame_start_heap_allocations = memory->heap_allocations;
+    for(uint32_t i = 0; i < HOST_SCOPE_COUNT; i++) {
+        HostScopeStats* stats = memory->scopes + i;
+        if(memory->in_frame) {
+            stats->frame_allocations =
+                stats->allocations - memory->frame_start_scope_allocations[i];
+        }
+        memory->frame_start_scope_allocations[i] = stats->allocations;
+    }
+    memory->in_frame = true;
+    pthread_mutex_unlock(&(memory->mutex));
+}
+
+void host_memory_print_stats(const HostMemory* memory) {
+    // the allocations of other modules going to malloc directly are not seen here
+    printf("host memory: %llu/%llu frames hit the heap through it (%llu times in the last one), "
+           "frame arena peak %zu/%zu bytes\n",
+           (unsigned long long)memory->frames_with_heap_allocations,
+           (unsigned long long)memory->frames,
+           (unsigned long long)memory->frame_heap_allocations, memory->frame_arena.peak,
+           memory->frame_arena.capacity);
+    for(uint32_t i = 0; i < HOST_SCOPE_COUNT; i++) {
+        const HostScopeStats* stats = memory->scopes + i;
+        printf("    %-11s %6llu allocations in the last frame, %8llu in total, %9zu bytes live "
+               "(peak %zu)\n",
+               SCOPE_NAMES[i], (unsigned long long)stats->frame_allocations,
+               (unsigned long long)stats->allocations, stats->bytes, stats->peak_bytes);
+    }
+    if(memory->internal_allocations > 0) {
+        printf("    driver internal: %llu allocations, %zu bytes live\n",
+               (unsigned long long)memory->internal_allocations, memory->internal_bytes);
+    }
+}
@@ -0,0 +1,163 @@
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "hud.h"
+
+#define GLYPH_WIDTH 3
+#define GLYPH_HEIGHT 5
+// in font pixels
+#define GLYPH_ADVANCE 4
+#define LINE_ADVANCE 7
+#define PANEL_MARGIN 4
+#define HUD_MAX_LINE 128
+
+// One octal digit per row, top to bottom, the high bit of a digit is the left pixel. Characters
+// missing here are drawn as blanks.
+static const uint16_t GLYPHS[64] = {
+    ['0' - 32] = 075557, ['1' - 32] = 026227, ['2' - 32] = 071747, ['3' - 32] = 071317,
+    ['4' - 32] = 055711, ['5' - 32] = 074717, ['6' - 32] = 074757, ['7' - 32] = 071111,
+    ['8' - 32] = 075757, ['9' - 32] = 075717, ['A' - 32] = 025755, ['B' - 32] = 065656,
+    ['C' - 32] = 034443, ['D' - 32] = 065556, ['E' - 32] = 074647, ['F' - 32] = 074644,
+    ['G' - 32] = 034553, ['H' - 32] = 055755, ['I' - 32] = 072227, ['J' - 32] = 011152,
+    ['K' - 32] = 055655, ['L' - 32] = 044447, ['M' - 32] = 057755, ['N' - 32] = 065555,
+    ['O' - 32] = 025552, ['P' - 32] = 065644, ['Q' - 32] = 025563, ['R' - 32] = 065655,
+    ['S' - 32] = 034216, ['T' - 32] = 072222, ['U' - 32] = 055557, ['V' - 32] = 055552,
+    ['W' - 32] = 055775, ['X' - 32] = 055255, ['Y' - 32] = 055222, ['Z' - 32] = 071247,
+    ['.' - 32] = 000002, [':' - 32] = 002020, ['/' - 32] = 011244, ['%' - 32] = 051245,
+    ['-' - 32] = 000700, ['(' - 32] = 012221, [')' - 32] = 042224, ['=' - 32] = 007070,
+    ['+' - 32] = 002720, [',' - 32] = 000024, ['_' - 32] = 000007,
+};
+
+void hud_init(Hud* hud, float scale) {
+    memset(hud, 0, sizeof(Hud));
+    hud->scale = scale;
+}
+
+double hud_smooth(double average, double value) {
+    return average + (value - average) * HUD_SMOOTHING;
+}
+
+void hud_push_frame_time(Hud* hud, double ms) {
+    hud->frame_ms[hud->frame_head] = ms;
+    hud->frame_head = (hud->frame_head + 1) % HUD_GRAPH_FRAMES;
+}
+
+/* Geometry **************************/
+static void write_vertex(HudVertex* vertex, float x, float y, uint32_t color) {
+    vertex->position[0] = x;
+    vertex->position[1] = y;
+    vertex->color = color;
+}
+
+// Two triangles, not indexed: the whole overlay is one vkCmdDraw
+static void write_quad(HudVertex* vertices, float x, float y, float width, float height,
+                       uint32_t color) {
+    write_vertex(vertices + 0, x, y, color);
+    write_vertex(vertices + 1, x + width, y, color);
+    write_vertex(vertices + 2, x, y + height, color);
+    write_vertex(vertices + 3, x + width, y, color);
+    write_vertex(vertices + 4, x + width, y + height, color);
+    write_vertex(vertices + 5, x, y + height, color);
+}
+
+void hud_begin(Hud* hud, HudVertex* vertices, uint32_t capacity, float x, float y) {
+    hud->vertices = vertices;
+    hud->capacity = capacity;
+    hud->count = 0;
+    hud->overflowed = false;
+    hud->origin_x = x;
+    hud->origin_y = y;
+    hud->line_y = y + PANEL_MARGIN * hud->scale;
+    hud->max_x = x;
+    // the background is drawn first, but its size is only known at the end
+    hud->first = 0;
+    hud_rect(hud, x, y, 0.0f, 0.0f, HUD_COLOR_BACKGROUND);
+}
+
+void hud_rect(Hud* hud, float x, float y, float width, float height, uint32_t color) {
+    if(hud->count + 6 > hud->capacity) {
+        hud->overflowed = true;
+        return;
+    }
+    write_quad(hud->vertices + hud->count, x, y, width, height, color);
+    hud->count += 6;
+    if(x + width > hud->max_x) {
+        hud->max_x = x + width;
+    }
+}
+
+float hud_text(Hud* hud, float x, float y, const char* text, uint32_t color) {
+    float pixel = hud->scale;
+    for(const char* c = text; *c != '\0'; c++, x += GLYPH_ADVANCE * pixel) {
+        char character = *c >= 'a' && *c <= 'z' ? (char)(*c - 'a' + 'A') : *c;
+        if(character < 32 || character >= 32 + 64) {
+            continue;
+        }
+        uint16_t glyph = GLYPHS[character - 32];
+        for(uint32_t row = 0; row < GLYPH_HEIGHT; row++) {
+            uint32_t bits = (glyph >> (3 * (GLYPH_HEIGHT - 1 - row))) & 07;
+            // consecutive lit pixels of a row are a single quad
+            uint32_t column = 0;
+            while(column < GLYPH_WIDTH) {
+                if(!(bits & (04 >> column))) {
+                    column++;
+                    continue;
+                }
+                uint32_t run = 1;
+                while(column + run < GLYPH_WIDTH && (bits & (04 >> (column + run)))) {
+                    run++;
+                }
+                hud_rect(hud, x + column * pixel, y + row * pixel, run * pixel, pixel, color);
+                column += run;
+            }
+        }
+    }
+    if(x > hud->max_x) {
+        hud->max_x = x;
+    }
+    return x;
+}
+
+void hud_printf(Hud* hud, uint32_t color, const char* format, ...) {
+    char line[HUD_MAX_LINE];
+    va_list arguments;
+    va_start(arguments, format);
+    vsnprintf(line, sizeof(line), format, arguments);
+    va_end(arguments);
+    hud_text(hud, hud->origin_x + PANEL_MARGIN * hud->scale, hud->line_y, line, color);
+    hud->line_y += LINE_ADVANCE * hud->scale;
+}
+
+void hud_graph(Hud* hud, float height, double budget_ms) {
+    float x = hud->origin_x + PANEL_MARGIN * hud->scale;
+    float bottom = hud->line_y + height;
+    // twice the budget fills the graph
+    float pixels_per_ms = height / (float)(2.0 * budget_ms);
+    for(uint32_t i = 0; i < HUD_GRAPH_FRAMES; i++) {
+        double ms = hud->frame_ms[(hud->frame_head + i) % HUD_GRAPH_FRAMES];
+        float bar = (float)ms * pixels_per_ms;
+        bar = bar < height ? bar : height;
+        uint32_t color = ms <= budget_ms         ? HUD_COLOR_GOOD
+                         : ms <= 2.0 * budget_ms ? HUD_COLOR_WARNING
+                                                 : HUD_COLOR_BAD;
+        hud_rect(hud, x + (float)i * hud->scale, bottom - bar, hud->scale, bar, color);
+    }
+    hud_rect(hud, x, bottom - (float)budget_ms * pixels_per_ms, HUD_GRAPH_FRAMES * hud->scale,
+             1.0f, HUD_COLOR_TEXT);
+    hud->line_y = bottom + (LINE_ADVANCE - GLYPH_HEIGHT) * hud->scale;
+}
+
+uint32_t hud_end(Hud* hud) {
+    if(hud->count >= 6) {
+        float margin = PANEL_MARGIN * hud->scale;
+        // line_y is past the spacing under the last line
+        float bottom = hud->line_y - (LINE_ADVANCE - GLYPH_HEIGHT) * hud->scale + margin;
+        write_quad(hud->vertices + hud->first, hud->origin_x, hud->origin_y,
+                   hud->max_x - hud->origin_x + margin, bottom - hud->origin_y,
+                   HUD_COLOR_BACKGROUND);
+    }
+    return hud->count;
+}
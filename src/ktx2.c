@@ -0,0 +1,365 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vulkan/vulkan.h>
+
+#include "ktx2.h"
+
+const VkFormat KTX2_COMPRESSED_FORMATS[KTX2_COMPRESSED_FORMAT_COUNT] = {
+    VK_FORMAT_BC1_RGB_UNORM_BLOCK,  VK_FORMAT_BC1_RGB_SRGB_BLOCK,   VK_FORMAT_BC1_RGBA_UNORM_BLOCK,
+    VK_FORMAT_BC1_RGBA_SRGB_BLOCK,  VK_FORMAT_BC3_UNORM_BLOCK,      VK_FORMAT_BC3_SRGB_BLOCK,
+    VK_FORMAT_BC5_UNORM_BLOCK,      VK_FORMAT_BC7_UNORM_BLOCK,      VK_FORMAT_BC7_SRGB_BLOCK,
+    VK_FORMAT_ASTC_4x4_UNORM_BLOCK, VK_FORMAT_ASTC_4x4_SRGB_BLOCK,  VK_FORMAT_ASTC_8x8_UNORM_BLOCK,
+    VK_FORMAT_ASTC_8x8_SRGB_BLOCK,
+};
+
+static const uint8_t KTX2_IDENTIFIER[12] = {0xAB, 'K',  'T',  'X',  ' ', '2',
+                                            '0',  0xBB, '\r', '\n', 0x1A, '\n'};
+
+// identifier, then 9 uint32 (format to supercompression), then the index
+#define KTX2_HEADER_SIZE 48
+#define KTX2_INDEX_SIZE 32
+#define KTX2_LEVEL_INDEX_ENTRY_SIZE 24
+
+int ktx2_compressed_format_index(VkFormat format) {
+    for(int i = 0; i < KTX2_COMPRESSED_FORMAT_COUNT; i++) {
+        if(KTX2_COMPRESSED_FORMATS[i] == format) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Block footprint and size in bytes. Uncompressed rgba8 is seen as 1x1 blocks of 4 bytes.
+static bool format_block_info(VkFormat format, uint32_t* block_width, uint32_t* block_height,
+                              uint32_t* block_size) {
+    switch(format) {
+    case VK_FORMAT_R8G8B8A8_UNORM:
+    case VK_FORMAT_R8G8B8A8_SRGB:
+        *block_width = 1;
+        *block_height = 1;
+        *block_size = 4;
+        return true;
+    case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+    case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+        *block_width = 4;
+        *block_height = 4;
+        *block_size = 8;
+        return true;
+    case VK_FORMAT_BC3_UNORM_BLOCK:
+    case VK_FORMAT_BC3_SRGB_BLOCK:
+    case VK_FORMAT_BC5_UNORM_BLOCK:
+    case VK_FORMAT_BC7_UNORM_BLOCK:
+    case VK_FORMAT_BC7_SRGB_BLOCK:
+    case VK_FORMAT_ASTC_4x4_UNORM_BLOCK:
+    case VK_FORMAT_ASTC_4x4_SRGB_BLOCK:
+        *block_width = 4;
+        *block_height = 4;
+        *block_size = 16;
+        return true;
+    case VK_FORMAT_ASTC_8x8_UNORM_BLOCK:
+    case VK_FORMAT_ASTC_8x8_SRGB_BLOCK:
+        *block_width = 8;
+        *block_height = 8;
+        *block_size = 16;
+        return true;
+    default:
+        return false;
+    }
+}
+
+static uint32_t read_u32(const uint8_t* bytes) {
+    uint32_t value;
+    memcpy(&value, bytes, sizeof(uint32_t)); // KTX2 is little endian, so are we
+    return value;
+}
+
+static uint64_t read_u64(const uint8_t* bytes) {
+    uint64_t value;
+    memcpy(&value, bytes, sizeof(uint64_t));
+    return value;
+}
+
+bool ktx2_load(const char* path, Ktx2Texture* texture) {
+    memset(texture, 0, sizeof(Ktx2Texture));
+
+    FILE* file = fopen(path, "rb");
+    if(!file) {
+        printf("failed to open ktx2 file %s\n", path);
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    long file_size = ftell(file);
+    rewind(file);
+    if(file_size < 0) {
+        printf("failed to get the size of ktx2 file %s\n", path);
+        fclose(file);
+        return false;
+    }
+    uint8_t* file_data = malloc(file_size > 0 ? file_size : 1);
+    if(file_data == NULL) {
+        printf("failed to allocate %ld bytes for ktx2 file %s\n", file_size, path);
+        fclose(file);
+        return false;
+    }
+    size_t read_size = fread(file_data, 1, file_size, file);
+    fclose(file);
+
+    bool valid = read_size == (size_t)file_size &&
+                 file_size >= KTX2_HEADER_SIZE + KTX2_INDEX_SIZE &&
+                 memcmp(file_data, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) == 0;
+    if(!valid) {
+        printf("%s is not a ktx2 file\n", path);
+        free(file_data);
+        return false;
+    }
+
+    VkFormat format = (VkFormat)read_u32(file_data + 12);
+    uint32_t width = read_u32(file_data + 20);
+    uint32_t height = read_u32(file_data + 24);
+    uint32_t depth = read_u32(file_data + 28);
+    uint32_t layer_count = read_u32(file_data + 32);
+    uint32_t face_count = read_u32(file_data + 36);
+    uint32_t level_count = read_u32(file_data + 40);
+    uint32_t supercompression = read_u32(file_data + 44);
+
+    uint32_t block_width, block_height, block_size;
+    if(!format_block_info(format, &block_width, &block_height, &block_size)) {
+        printf("%s: unsupported format %d\n", path, format);
+        valid = false;
+    } else if(width == 0 || height == 0 || depth != 0 || layer_count != 0 || face_count != 1) {
+        printf("%s: only 2D textures are supported\n", path);
+        valid = false;
+    } else if(supercompression != 0) {
+        printf("%s: supercompressed textures are not supported\n", path);
+        valid = false;
+    } else if(level_count == 0 || level_count > KTX2_MAX_LEVELS) {
+        // 0 asks the loader to generate the mips: use the texture streamer for that
+        printf("%s: expected between 1 and %d prebuilt mip levels\n", path, KTX2_MAX_LEVELS);
+        valid = false;
+    } else if((size_t)file_size <
+              KTX2_HEADER_SIZE + KTX2_INDEX_SIZE + level_count * KTX2_LEVEL_INDEX_ENTRY_SIZE) {
+        printf("%s: truncated level index\n", path);
+        valid = false;
+    }
+
+    // first pass: validate every level and compute the packed size
+    const uint8_t* level_index = file_data + KTX2_HEADER_SIZE + KTX2_INDEX_SIZE;
+    size_t data_size = 0;
+    for(uint32_t level = 0; valid && level < level_count; level++) {
+        uint64_t offset = read_u64(level_index + level * KTX2_LEVEL_INDEX_ENTRY_SIZE);
+        uint64_t length = read_u64(level_index + level * KTX2_LEVEL_INDEX_ENTRY_SIZE + 8);
+
+        uint32_t level_width = width >> level > 0 ? width >> level : 1;
+        uint32_t level_height = height >> level > 0 ? height >> level : 1;
+        uint64_t expected = (uint64_t)((level_width + block_width - 1) / block_width) *
+                            ((level_height + block_height - 1) / block_height) * block_size;
+        // offset + length could wrap around
+        if(length < expected || offset > (uint64_t)file_size ||
+           length > (uint64_t)file_size - offset) {
+            printf("%s: level %u is truncated\n", path, level);
+            valid = false;
+            break;
+        }
+
+        Ktx2Level* out_level = texture->levels + level;
+        out_level->offset = data_size;
+        out_level->size = (size_t)expected;
+        out_level->width = level_width;
+        out_level->height = level_height;
+        data_size += (size_t)expected;
+    }
+    if(!valid) {
+        free(file_data);
+        return false;
+    }
+
+    // second pass: pack them largest first (files store the smallest first)
+    texture->data = malloc(data_size);
+    if(texture->data == NULL) {
+        printf("%s: failed to allocate %zu bytes for the levels\n", path, data_size);
+        free(file_data);
+        return false;
+    }
+    for(uint32_t level = 0; level < level_count; level++) {
+        uint64_t offset = read_u64(level_index + level * KTX2_LEVEL_INDEX_ENTRY_SIZE);
+        memcpy(texture->data + texture->levels[level].offset, file_data + offset,
+               texture->levels[level].size);
+    }
+    free(file_data);
+
+    texture->format = format;
+    texture->width = width;
+    texture->height = height;
+    texture->level_count = level_count;
+    texture->data_size = data_size;
+    return true;
+}
+
+void ktx2_free(Ktx2Texture* texture) {
+    free(texture->data);
+    memset(texture, 0, sizeof(Ktx2Texture));
+}
+
+/* CPU decoders **********************/
+
+static void rgb565_to_rgba8(uint16_t color, uint8_t out[4]) {
+    uint8_t r = (color >> 11) & 31;
+    uint8_t g = (color >> 5) & 63;
+    uint8_t b = color & 31;
+    out[0] = (r << 3) | (r >> 2);
+    out[1] = (g << 2) | (g >> 4);
+    out[2] = (b << 3) | (b >> 2);
+    out[3] = 255;
+}
+
+// BC1 color block, 8 bytes. BC3 always uses the 4 colors mode, whatever the endpoint order.
+static void decode_bc1_block(const uint8_t* block, bool force_four_colors, uint8_t out[16][4]) {
+    uint16_t color0 = block[0] | (block[1] << 8);
+    uint16_t color1 = block[2] | (block[3] << 8);
+    uint8_t palette[4][4];
+    rgb565_to_rgba8(color0, palette[0]);
+    rgb565_to_rgba8(color1, palette[1]);
+    for(int c = 0; c < 3; c++) {
+        if(color0 > color1 || force_four_colors) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c] + 1) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c] + 1) / 3;
+        } else {
+            palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+            palette[3][c] = 0;
+        }
+    }
+    palette[2][3] = 255;
+    palette[3][3] = color0 > color1 || force_four_colors ? 255 : 0; // punch-through alpha
+
+    uint32_t indices = read_u32(block + 4);
+    for(int i = 0; i < 16; i++) {
+        memcpy(out[i], palette[(indices >> (2 * i)) & 3], 4);
+    }
+}
+
+// BC4 block (one channel), 8 bytes: used for BC3 alpha and both BC5 channels
+static void decode_bc4_block(const uint8_t* block, int channel, uint8_t out[16][4]) {
+    uint8_t palette[8];
+    palette[0] = block[0];
+    palette[1] = block[1];
+    if(palette[0] > palette[1]) {
+        for(int i = 1; i < 7; i++) {
+            palette[i + 1] = ((7 - i) * palette[0] + i * palette[1] + 3) / 7;
+        }
+    } else {
+        for(int i = 1; i < 5; i++) {
+            palette[i + 1] = ((5 - i) * palette[0] + i * palette[1] + 2) / 5;
+        }
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+
+    uint64_t indices = 0;
+    for(int i = 0; i < 6; i++) {
+        indices |= (uint64_t)block[2 + i] << (8 * i);
+    }
+    for(int i = 0; i < 16; i++) {
+        out[i][channel] = palette[(indices >> (3 * i)) & 7];
+    }
+}
+
+static bool decode_block(VkFormat format, const uint8_t* block, uint8_t out[16][4]) {
+    switch(format) {
+    case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+        decode_bc1_block(block, false, out);
+        for(int i = 0; i < 16; i++) {
+            out[i][3] = 255; // no punch-through in the rgb variant
+        }
+        return true;
+    case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+        decode_bc1_block(block, false, out);
+        return true;
+    case VK_FORMAT_BC3_UNORM_BLOCK:
+    case VK_FORMAT_BC3_SRGB_BLOCK:
+        decode_bc1_block(block + 8, true, out);
+        decode_bc4_block(block, 3, out);
+        return true;
+    case VK_FORMAT_BC5_UNORM_BLOCK:
+        decode_bc4_block(block, 0, out);
+        decode_bc4_block(block + 8, 1, out);
+        for(int i = 0; i < 16; i++) {
+            out[i][2] = 0;
+            out[i][3] = 255;
+        }
+        return true;
+    default:
+        // BC7 (8 modes, 3 partition tables) and ASTC are out of scope for a fallback path
+        return false;
+    }
+}
+
+static bool is_srgb(VkFormat format) {
+    return format == VK_FORMAT_BC1_RGB_SRGB_BLOCK || format == VK_FORMAT_BC1_RGBA_SRGB_BLOCK ||
+           format == VK_FORMAT_BC3_SRGB_BLOCK || format == VK_FORMAT_BC7_SRGB_BLOCK ||
+           format == VK_FORMAT_ASTC_4x4_SRGB_BLOCK || format == VK_FORMAT_ASTC_8x8_SRGB_BLOCK ||
+           format == VK_FORMAT_R8G8B8A8_SRGB;
+}
+
+bool ktx2_transcode_to_rgba8(const Ktx2Texture* src, Ktx2Texture* dst) {
+    memset(dst, 0, sizeof(Ktx2Texture));
+    uint8_t probe[16][4];
+    if(!decode_block(src->format, src->data, probe)) {
+        printf("no cpu decoder for texture format %d\n", src->format);
+        return false;
+    }
+
+    dst->format = is_srgb(src->format) ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+    dst->width = src->width;
+    dst->height = src->height;
+    dst->level_count = src->level_count;
+    for(uint32_t level = 0; level < src->level_count; level++) {
+        dst->levels[level].offset = dst->data_size;
+        dst->levels[level].width = src->levels[level].width;
+        dst->levels[level].height = src->levels[level].height;
+        dst->levels[level].size =
+            (size_t)src->levels[level].width * src->levels[level].height * 4;
+        dst->data_size += dst->levels[level].size;
+    }
+    dst->data = malloc(dst->data_size);
+    if(dst->data == NULL) {
+        printf("failed to allocate %zu bytes for the decoded texture\n", dst->data_size);
+        memset(dst, 0, sizeof(Ktx2Texture));
+        return false;
+    }
+
+    // every format with a decoder uses 4x4 blocks
+    for(uint32_t level = 0; level < src->level_count; level++) {
+        const Ktx2Level* src_level = src->levels + level;
+        uint32_t width = src_level->width;
+        uint32_t height = src_level->height;
+        uint32_t blocks_x = (width + 3) / 4;
+        uint32_t blocks_y = (height + 3) / 4;
+        size_t block_size = src_level->size / ((size_t)blocks_x * blocks_y);
+        uint8_t* level_pixels = dst->data + dst->levels[level].offset;
+
+        for(uint32_t by = 0; by < blocks_y; by++) {
+            for(uint32_t bx = 0; bx < blocks_x; bx++) {
+                const uint8_t* block =
+                    src->data + src_level->offset + ((size_t)by * blocks_x + bx) * block_size;
+                uint8_t texels[16][4];
+                decode_block(src->format, block, texels);
+                // blocks overhang the edges of levels that are not a multiple of 4
+                for(uint32_t y = 0; y < 4 && 4 * by + y < height; y++) {
+                    for(uint32_t x = 0; x < 4 && 4 * bx + x < width; x++) {
+                        memcpy(level_pixels + (((size_t)4 * by + y) * width + 4 * bx + x) * 4,
+                               texels[4 * y + x], 4);
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,547 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <vulkan/vulkan.h>
+
+#include "pipeline_variants.h"
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+static uint64_t hash_bytes(uint64_t hash, const void* data, size_t size) {
+    const uint8_t* bytes = data;
+    for(size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+#define HASH_FIELD(hash, field) hash = hash_bytes(hash, &(field), sizeof(field))
+
+static double elapsed_ms(struct timespec start, struct timespec end) {
+    return (double)(end.tv_sec - start.tv_sec) * 1e3 + (double)(end.tv_nsec - start.tv_nsec) / 1e6;
+}
+
+void pipeline_variant_desc_init(PipelineVariantDesc* desc) {
+    // zero everything, padding included, so that unused array slots hash the same
+    memset(desc, 0, sizeof(PipelineVariantDesc));
+    desc->topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    desc->polygon_mode = VK_POLYGON_MODE_FILL;
+    desc->cull_mode = VK_CULL_MODE_BACK_BIT;
+    desc->front_face = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    desc->blend_mode = PIPELINE_BLEND_OPAQUE;
+    desc->depth_test = VK_TRUE;
+    desc->depth_write = VK_TRUE;
+    desc->depth_compare_op = VK_COMPARE_OP_LESS;
+    desc->samples = VK_SAMPLE_COUNT_1_BIT;
+}
+
+static uint64_t hash_specialization(uint64_t hash, const ShaderSpecialization* spec) {
+    HASH_FIELD(hash, spec->constant_count);
+    for(uint32_t i = 0; i < spec->constant_count; i++) {
+        HASH_FIELD(hash, spec->constant_ids[i]);
+        HASH_FIELD(hash, spec->values[i]);
+    }
+    return hash;
+}
+
+uint64_t pipeline_variant_desc_hash(const PipelineVariantDesc* desc) {
+    // field by field: padding bytes of the caller's struct are not guaranteed to be zeroed
+    uint64_t hash = FNV_OFFSET_BASIS;
+    HASH_FIELD(hash, desc->vertex_shader);
+    HASH_FIELD(hash, desc->fragment_shader);
+    // shader variants differing only by their constants are different pipelines
+    hash = hash_specialization(hash, &(desc->vertex_specialization));
+    hash = hash_specialization(hash, &(desc->fragment_specialization));
+    HASH_FIELD(hash, desc->vertex_binding_count);
+    for(uint32_t i = 0; i < desc->vertex_binding_count; i++) {
+        HASH_FIELD(hash, desc->vertex_bindings[i].binding);
+        HASH_FIELD(hash, desc->vertex_bindings[i].stride);
+        HASH_FIELD(hash, desc->vertex_bindings[i].inputRate);
+    }
+    HASH_FIELD(hash, desc->vertex_attribute_count);
+    for(uint32_t i = 0; i < desc->vertex_attribute_count; i++) {
+        HASH_FIELD(hash, desc->vertex_attributes[i].location);
+        HASH_FIELD(hash, desc->vertex_attributes[i].binding);
+        HASH_FIELD(hash, desc->vertex_attributes[i].format);
+        HASH_FIELD(hash, desc->vertex_attributes[i].offset);
+    }
+    HASH_FIELD(hash, desc->topology);
+    HASH_FIELD(hash, desc->polygon_mode);
+    HASH_FIELD(hash, desc->cull_mode);
+    HASH_FIELD(hash, desc->front_face);
+    HASH_FIELD(hash, desc->blend_mode);
+    HASH_FIELD(hash, desc->depth_test);
+    HASH_FIELD(hash, desc->depth_write);
+    HASH_FIELD(hash, desc->depth_compare_op);
+    HASH_FIELD(hash, desc->samples);
+    HASH_FIELD(hash, desc->layout);
+    HASH_FIELD(hash, desc->render_pass);
+    HASH_FIELD(hash, desc->subpass);
+    return hash;
+}
+
+static bool specialization_equal(const ShaderSpecialization* a, const ShaderSpecialization* b) {
+    if(a->constant_count != b->constant_count) {
+        return false;
+    }
+    for(uint32_t i = 0; i < a->constant_count; i++) {
+        if(a->constant_ids[i] != b->constant_ids[i] || a->values[i] != b->values[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The same fields as the hash, which only tells that two descs are probably the same
+static bool desc_equal(const PipelineVariantDesc* a, const PipelineVariantDesc* b) {
+    if(a->vertex_shader != b->vertex_shader || a->fragment_shader != b->fragment_shader ||
+       !specialization_equal(&(a->vertex_specialization), &(b->vertex_specialization)) ||
+       !specialization_equal(&(a->fragment_specialization), &(b->fragment_specialization)) ||
+       a->vertex_binding_count != b->vertex_binding_count ||
+       a->vertex_attribute_count != b->vertex_attribute_count) {
+        return false;
+    }
+    for(uint32_t i = 0; i < a->vertex_binding_count; i++) {
+        const VkVertexInputBindingDescription* left = a->vertex_bindings + i;
+        const VkVertexInputBindingDescription* right = b->vertex_bindings + i;
+        if(left->binding != right->binding || left->stride != right->stride ||
+           left->inputRate != right->inputRate) {
+            return false;
+        }
+    }
+    for(uint32_t i = 0; i < a->vertex_attribute_count; i++) {
+        const VkVertexInputAttributeDescription* left = a->vertex_attributes + i;
+        const VkVertexInputAttributeDescription* right = b->vertex_attributes + i;
+        if(left->location != right->location || left->binding != right->binding ||
+           left->format != right->format || left->offset != right->offset) {
+            return false;
+        }
+    }
+    return a->topology == b->topology && a->polygon_mode == b->polygon_mode &&
+           a->cull_mode == b->cull_mode && a->front_face == b->front_face &&
+           a->blend_mode == b->blend_mode && a->depth_test == b->depth_test &&
+           a->depth_write == b->depth_write && a->depth_compare_op == b->depth_compare_op &&
+           a->samples == b->samples && a->layout == b->layout &&
+           a->render_pass == b->render_pass && a->subpass == b->subpass;
+}
+
+static void specialization_set_bits(ShaderSpecialization* spec, uint32_t constant_id,
+                                    uint32_t bits) {
+    for(uint32_t i = 0; i < spec->constant_count; i++) {
+        if(spec->constant_ids[i] == constant_id) {
+            spec->values[i] = bits;
+            return;
+        }
+    }
+    if(spec->constant_count == PIPELINE_VARIANT_MAX_SPECIALIZATION_CONSTANTS) {
+        printf("too many specialization constants, constant %u ignored\n", constant_id);
+        return;
+    }
+    spec->constant_ids[spec->constant_count] = constant_id;
+    spec->values[spec->constant_count] = bits;
+    spec->constant_count++;
+}
+
+void shader_specialization_set_bool(ShaderSpecialization* spec, uint32_t constant_id, bool value) {
+    specialization_set_bits(spec, constant_id, value ? VK_TRUE : VK_FALSE);
+}
+
+void shader_specialization_set_uint(ShaderSpecialization* spec, uint32_t constant_id,
+                                    uint32_t value) {
+    specialization_set_bits(spec, constant_id, value);
+}
+
+void shader_specialization_set_float(ShaderSpecialization* spec, uint32_t constant_id,
+                                     float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(float));
+    specialization_set_bits(spec, constant_id, bits);
+}
+
+// Each array is kept as soon as it is grown, the capacity only once they all are
+static bool grow_unique(PipelineVariantSet* set) {
+    uint32_t capacity = set->unique_capacity == 0 ? 8 : 2 * set->unique_capacity;
+    PipelineVariantDesc* descs = realloc(set->descs, capacity * sizeof(PipelineVariantDesc));
+    if(descs == NULL) {
+        return false;
+    }
+    set->descs = descs;
+    uint64_t* hashes = realloc(set->hashes, capacity * sizeof(uint64_t));
+    if(hashes == NULL) {
+        return false;
+    }
+    set->hashes = hashes;
+    VkPipeline* pipelines = realloc(set->pipelines, capacity * sizeof(VkPipeline));
+    if(pipelines == NULL) {
+        return false;
+    }
+    set->pipelines = pipelines;
+    double* compile_times_ms = realloc(set->compile_times_ms, capacity * sizeof(double));
+    if(compile_times_ms == NULL) {
+        return false;
+    }
+    set->compile_times_ms = compile_times_ms;
+    VkResult* results = realloc(set->results, capacity * sizeof(VkResult));
+    if(results == NULL) {
+        return false;
+    }
+    set->results = results;
+    set->unique_capacity = capacity;
+    return true;
+}
+
+uint32_t pipeline_variants_add(PipelineVariantSet* set, const PipelineVariantDesc* desc) {
+    uint64_t hash = pipeline_variant_desc_hash(desc);
+
+    uint32_t unique_index = set->unique_count;
+    for(uint32_t i = 0; i < set->unique_count; i++) {
+        // a hash collision must not hand out the pipeline of another state
+        if(set->hashes[i] == hash && desc_equal(set->descs + i, desc)) {
+            unique_index = i;
+            break;
+        }
+    }
+
+    if(unique_index == set->unique_count) {
+        if(set->unique_count == set->unique_capacity && !grow_unique(set)) {
+            printf("failed to grow the pipeline variants\n");
+            return UINT32_MAX;
+        }
+        set->descs[unique_index] = *desc;
+        set->hashes[unique_index] = hash;
+        set->pipelines[unique_index] = VK_NULL_HANDLE;
+        set->compile_times_ms[unique_index] = 0.0;
+        set->results[unique_index] = VK_NOT_READY;
+        set->unique_count++;
+    }
+
+    uint32_t* request_to_unique =
+        realloc(set->request_to_unique, (set->request_count + 1) * sizeof(uint32_t));
+    if(request_to_unique == NULL) {
+        printf("failed to grow the pipeline variant requests\n");
+        return UINT32_MAX;
+    }
+    set->request_to_unique = request_to_unique;
+    set->request_to_unique[set->request_count] = unique_index;
+    return set->request_count++;
+}
+
+static void get_blend_attachment(PipelineBlendMode mode,
+                                 VkPipelineColorBlendAttachmentState* attachment) {
+    attachment->colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+                                 VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    attachment->colorBlendOp = VK_BLEND_OP_ADD;
+    attachment->alphaBlendOp = VK_BLEND_OP_ADD;
+    attachment->srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    attachment->dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+
+    switch(mode) {
+    case PIPELINE_BLEND_ALPHA:
+        attachment->blendEnable = VK_TRUE;
+        attachment->srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+        attachment->dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+        attachment->dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+        break;
+    case PIPELINE_BLEND_ADDITIVE:
+        attachment->blendEnable = VK_TRUE;
+        attachment->srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+        attachment->dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
+        attachment->dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+        break;
+    case PIPELINE_BLEND_PREMULTIPLIED:
+        attachment->blendEnable = VK_TRUE;
+        attachment->srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+        attachment->dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+        attachment->dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+        break;
+    case PIPELINE_BLEND_OPAQUE:
+    default:
+        attachment->blendEnable = VK_FALSE;
+        attachment->srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+        attachment->dstColorBlendFactor = VK_BLEND_FACTOR_ZERO;
+        break;
+    }
+}
+
+// The map entries point into spec->values, so spec must outlive the pipeline creation
+static void fill_specialization_info(
+    const ShaderSpecialization* spec,
+    VkSpecializationMapEntry entries[PIPELINE_VARIANT_MAX_SPECIALIZATION_CONSTANTS],
+    VkSpecializationInfo* info) {
+    for(uint32_t i = 0; i < spec->constant_count; i++) {
+        entries[i].constantID = spec->constant_ids[i];
+        entries[i].offset = i * sizeof(uint32_t);
+        entries[i].size = sizeof(uint32_t);
+    }
+    info->mapEntryCount = spec->constant_count;
+    info->pMapEntries = entries;
+    info->dataSize = spec->constant_count * sizeof(uint32_t);
+    info->pData = spec->values;
+}
+
+static VkResult build_variant(VkDevice device, const VkAllocationCallbacks* allocator,
+                              VkPipelineCache cache, const PipelineVariantDesc* desc,
+                              VkPipeline* pipeline) {
+    /* Specialization */
+    // Constants are baked in when the pipeline is compiled, so the driver can fold branches and
+    // unroll loops depending on them instead of evaluating them for every vertex/fragment
+    VkSpecializationMapEntry vertex_entries[PIPELINE_VARIANT_MAX_SPECIALIZATION_CONSTANTS];
+    VkSpecializationInfo vertex_specialization = {0};
+    fill_specialization_info(&(desc->vertex_specialization), vertex_entries,
+                             &vertex_specialization);
+    VkSpecializationMapEntry fragment_entries[PIPELINE_VARIANT_MAX_SPECIALIZATION_CONSTANTS];
+    VkSpecializationInfo fragment_specialization = {0};
+    fill_specialization_info(&(desc->fragment_specialization), fragment_entries,
+                             &fragment_specialization);
+
+    VkPipelineShaderStageCreateInfo shader_stages[2] = {0};
+    shader_stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shader_stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+    shader_stages[0].module = desc->vertex_shader;
+    shader_stages[0].pName = "main";
+    shader_stages[0].pSpecializationInfo = &vertex_specialization;
+    shader_stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shader_stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    shader_stages[1].module = desc->fragment_shader;
+    shader_stages[1].pName = "main";
+    shader_stages[1].pSpecializationInfo = &fragment_specialization;
+
+    /* Dynamic state */
+    // Some stuff can be dynamically changed without recreating the pipeline, eg: size of the
+    // viewport, line width, blend constants. But we need to choose which one before building it.
+    // The chosen states will then be ignored from the config
+    VkDynamicState dynamic_states[2] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+    VkPipelineDynamicStateCreateInfo dynamic_state = {0};
+    dynamic_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamic_state.dynamicStateCount = 2;
+    dynamic_state.pDynamicStates = dynamic_states;
+
+    /* Vertex input */
+    // Describes how the data is passed to the vertex shader: bindings, ie per vertex or per
+    // instance. Also describes the attribute passed, offset etc
+    VkPipelineVertexInputStateCreateInfo vertex_input_info = {0};
+    vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertex_input_info.vertexBindingDescriptionCount = desc->vertex_binding_count;
+    vertex_input_info.pVertexBindingDescriptions = desc->vertex_bindings;
+    vertex_input_info.vertexAttributeDescriptionCount = desc->vertex_attribute_count;
+    vertex_input_info.pVertexAttributeDescriptions = desc->vertex_attributes;
+
+    /* Input assembly */
+    // What kind of geometry will be drawn from the vertices, and if primitive restart should be
+    // enabled.
+    VkPipelineInputAssemblyStateCreateInfo input_assembly = {0};
+    input_assembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    input_assembly.topology = desc->topology;
+    input_assembly.primitiveRestartEnable = VK_FALSE;
+
+    /* Viewports, scissors */
+    // Both are dynamic: only their count matters here, the values are set when recording
+    VkPipelineViewportStateCreateInfo viewport_state = {0};
+    viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewport_state.viewportCount = 1;
+    viewport_state.scissorCount = 1;
+
+    /* Rasterizer */
+    VkPipelineRasterizationStateCreateInfo rasterizer = {0};
+    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    // clamp fragments beyond far & near plane to them instead of discarding. See shadow maps
+    rasterizer.depthClampEnable = VK_FALSE;
+    // If true: nothing passes through, basically disabling it
+    rasterizer.rasterizerDiscardEnable = VK_FALSE;
+    rasterizer.polygonMode = desc->polygon_mode; // Fill, line or point
+    rasterizer.lineWidth = 1.0f;                 // is number of fragment
+    // Face culling
+    rasterizer.cullMode = desc->cull_mode;
+    rasterizer.frontFace = desc->front_face;
+
+    /* Multisampling */
+    // coverage only: the fragment shader still runs once per pixel
+    VkPipelineMultisampleStateCreateInfo multisampling = {0};
+    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampling.sampleShadingEnable = VK_FALSE;
+    multisampling.rasterizationSamples = desc->samples;
+    multisampling.minSampleShading = 1.0f;
+
+    /* Color blending */
+    // Attachment state is per attached framebuffer, and the other is for the global blending
+    // settings.
+    VkPipelineColorBlendAttachmentState color_blend_attachment = {0};
+    get_blend_attachment(desc->blend_mode, &color_blend_attachment);
+
+    VkPipelineColorBlendStateCreateInfo color_blending = {0};
+    color_blending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    color_blending.logicOpEnable = VK_FALSE;
+    color_blending.logicOp = VK_LOGIC_OP_COPY;
+    color_blending.attachmentCount = 1;
+    color_blending.pAttachments = &color_blend_attachment;
+
+    /* Depth */
+    // no fragment shader writes gl_FragDepth, so the test can run before shading (early-Z)
+    VkPipelineDepthStencilStateCreateInfo depth_stencil = {0};
+    depth_stencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depth_stencil.depthTestEnable = desc->depth_test;
+    depth_stencil.depthWriteEnable = desc->depth_write;
+    depth_stencil.depthCompareOp = desc->depth_compare_op;
+    depth_stencil.depthBoundsTestEnable = VK_FALSE;
+    depth_stencil.stencilTestEnable = VK_FALSE;
+
+    VkGraphicsPipelineCreateInfo pipeline_info = {0};
+    pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipeline_info.stageCount = 2; // vertex and fragment
+    pipeline_info.pStages = shader_stages;
+    pipeline_info.pVertexInputState = &vertex_input_info;
+    pipeline_info.pInputAssemblyState = &input_assembly;
+    pipeline_info.pViewportState = &viewport_state;
+    pipeline_info.pRasterizationState = &rasterizer;
+    pipeline_info.pMultisampleState = &multisampling;
+    pipeline_info.pDepthStencilState = &depth_stencil;
+    pipeline_info.pColorBlendState = &color_blending;
+    pipeline_info.pDynamicState = &dynamic_state;
+    pipeline_info.layout = desc->layout;
+    pipeline_info.renderPass = desc->render_pass;
+    pipeline_info.subpass = desc->subpass;
+    pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
+    pipeline_info.basePipelineIndex = -1;
+
+    // The cache is internally synchronized, so every worker can feed the same one
+    return vkCreateGraphicsPipelines(device, cache, 1, &pipeline_info, allocator, pipeline);
+}
+
+typedef struct {
+    VkDevice device;
+    const VkAllocationCallbacks* allocator;
+    VkPipelineCache cache;
+    PipelineVariantSet* set;
+    atomic_uint next_variant;
+} PipelineBuildJob;
+
+static void* pipeline_build_worker(void* arg) {
+    PipelineBuildJob* job = arg;
+    PipelineVariantSet* set = job->set;
+
+    // grab the next variant to compile until there is none left
+    for(uint32_t i = atomic_fetch_add(&(job->next_variant), 1); i < set->unique_count;
+        i = atomic_fetch_add(&(job->next_variant), 1)) {
+        if(set->pipelines[i] != VK_NULL_HANDLE) {
+            continue; // built by a previous call
+        }
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        set->results[i] = build_variant(job->device, job->allocator, job->cache, set->descs + i,
+                                        set->pipelines + i);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        set->compile_times_ms[i] = elapsed_ms(start, end);
+    }
+    return NULL;
+}
+
+void pipeline_variants_build(VkDevice device, const VkAllocationCallbacks* allocator,
+                             VkPipelineCache cache, PipelineVariantSet* set, uint32_t nb_threads) {
+    if(nb_threads == 0) {
+        long nb_cores = sysconf(_SC_NPROCESSORS_ONLN);
+        nb_threads = nb_cores > 0 ? (uint32_t)nb_cores : 1;
+    }
+    if(nb_threads > set->unique_count) {
+        nb_threads = set->unique_count;
+    }
+    if(nb_threads == 0) {
+        return;
+    }
+
+    PipelineBuildJob job = {0};
+    job.device = device;
+    job.allocator = allocator;
+    job.cache = cache;
+    job.set = set;
+    atomic_init(&(job.next_variant), 0);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // the calling thread works too, so only nb_threads - 1 extra threads are spawned
+    pthread_t threads[nb_threads];
+    uint32_t nb_spawned = 0;
+    for(uint32_t i = 1; i < nb_threads; i++) {
+        if(pthread_create(threads + nb_spawned, NULL, pipeline_build_worker, &job) != 0) {
+            printf("failed to spawn pipeline build worker, continuing with %u threads\n",
+                   nb_spawned + 1);
+            break;
+        }
+        nb_spawned++;
+    }
+    pipeline_build_worker(&job);
+    for(uint32_t i = 0; i < nb_spawned; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    set->build_wall_time_ms = elapsed_ms(start, end);
+
+    for(uint32_t i = 0; i < set->unique_count; i++) {
+        if(set->results[i] != VK_SUCCESS) {
+            printf("failed to create graphics pipeline variant %u (hash %016llx)\n", i,
+                   (unsigned long long)set->hashes[i]);
+        }
+    }
+}
+
+VkPipeline pipeline_variants_get(const PipelineVariantSet* set, uint32_t request_index) {
+    if(request_index >= set->request_count) {
+        printf("pipeline variant request %u does not exist\n", request_index);
+        return VK_NULL_HANDLE;
+    }
+    return set->pipelines[set->request_to_unique[request_index]];
+}
+
+void pipeline_variants_report(const PipelineVariantSet* set) {
+    if(set->unique_count == 0) {
+        return;
+    }
+    uint32_t order[set->unique_count];
+    double total_ms = 0.0;
+    for(uint32_t i = 0; i < set->unique_count; i++) {
+        order[i] = i;
+        total_ms += set->compile_times_ms[i];
+    }
+    // insertion sort, slowest first. There will never be enough variants for it to matter.
+    for(uint32_t i = 1; i < set->unique_count; i++) {
+        uint32_t current = order[i];
+        uint32_t j = i;
+        while(j > 0 && set->compile_times_ms[order[j - 1]] < set->compile_times_ms[current]) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = current;
+    }
+
+    printf("pipeline variants: %u requested, %u unique, %.3f ms wall (%.3f ms summed)\n",
+           set->request_count, set->unique_count, set->build_wall_time_ms, total_ms);
+    for(uint32_t i = 0; i < set->unique_count; i++) {
+        uint32_t v = order[i];
+        printf("\tvariant %u (hash %016llx): %.3f ms\n", v, (unsigned long long)set->hashes[v],
+               set->compile_times_ms[v]);
+    }
+}
+
+void pipeline_variants_destroy(VkDevice device, const VkAllocationCallbacks* allocator,
+                               PipelineVariantSet* set) {
+    for(uint32_t i = 0; i < set->unique_count; i++) {
+        vkDestroyPipeline(device, set->pipelines[i], allocator);
+    }
+    free(set->request_to_unique);
+    free(set->descs);
+    free(set->hashes);
+    free(set->pipelines);
+    free(set->compile_times_ms);
+    free(set->results);
+    memset(set, 0, sizeof(PipelineVariantSet));
+}
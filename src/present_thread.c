@@ -0,0 +1,199 @@
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <vulkan/vulkan.h>
+
+#include "present_thread.h"
+#include "submit_service.h"
+
+/* Ring ******************************/
+static void ring_init(PresentRing* ring) {
+    atomic_init(&(ring->head), 0);
+    atomic_init(&(ring->tail), 0);
+    sem_init(&(ring->available), 0, 0);
+}
+
+static void ring_destroy(PresentRing* ring) {
+    sem_destroy(&(ring->available));
+}
+
+static void ring_push(PresentRing* ring, const PresentMessage* message) {
+    uint32_t tail = atomic_load_explicit(&(ring->tail), memory_order_relaxed);
+    // never happens with the way the render thread uses it, but do not overwrite a message
+    while(tail - atomic_load_explicit(&(ring->head), memory_order_acquire) >=
+          PRESENT_RING_CAPACITY) {
+        sched_yield();
+    }
+    ring->messages[tail % PRESENT_RING_CAPACITY] = *message;
+    // release: the message is written before the consumer sees the new tail
+    atomic_store_explicit(&(ring->tail), tail + 1, memory_order_release);
+    sem_post(&(ring->available));
+}
+
+static PresentMessage ring_pop(PresentRing* ring) {
+    while(sem_wait(&(ring->available)) != 0 && errno == EINTR) {
+    }
+    uint32_t head = atomic_load_explicit(&(ring->head), memory_order_relaxed);
+    // the semaphore is posted after the tail moves, so this never spins. Acquire: pairs with the
+    // release of the producer, the message is complete.
+    while(atomic_load_explicit(&(ring->tail), memory_order_acquire) == head) {
+    }
+    PresentMessage message = ring->messages[head % PRESENT_RING_CAPACITY];
+    atomic_store_explicit(&(ring->head), head + 1, memory_order_release);
+    return message;
+}
+
+/* Presentation engine ***************/
+static void acquire(PresentThread* present, const PresentMessage* message,
+                    PresentMessage* reply) {
+    memset(reply, 0, sizeof(PresentMessage));
+    reply->type = PRESENT_MESSAGE_ACQUIRED;
+    reply->result =
+        vkAcquireNextImageKHR(present->device, message->swapchain, UINT64_MAX, message->semaphore,
+                              VK_NULL_HANDLE, &(reply->image_index));
+}
+
+static void present_image(PresentThread* present, const PresentMessage* message) {
+    VkPresentInfoKHR present_info = {0};
+    present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+    present_info.waitSemaphoreCount = 1;
+    present_info.pWaitSemaphores = &(message->semaphore);
+    present_info.swapchainCount = 1;
+    present_info.pSwapchains = &(message->swapchain);
+    present_info.pImageIndices = &(message->image_index);
+
+    // a binary semaphore can only be waited on once its signal is submitted
+    if(message->after != NULL) {
+        submit_service_wait_submitted(message->after, message->after_ticket);
+    }
+    if(present->queue_mutex != NULL) {
+        pthread_mutex_lock(present->queue_mutex);
+    }
+    VkResult result = vkQueuePresentKHR(present->present_queue, &present_info);
+    if(present->queue_mutex != NULL) {
+        pthread_mutex_unlock(present->queue_mutex);
+    }
+
+    if(result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
+        atomic_store(&(present->out_of_date), true);
+    } else if(result != VK_SUCCESS) {
+        printf("failed to present swapchain image\n");
+    }
+}
+
+static void* present_thread_main(void* arg) {
+    PresentThread* present = arg;
+    while(true) {
+        PresentMessage message = ring_pop(&(present->requests));
+        PresentMessage reply = {0};
+        switch(message.type) {
+        case PRESENT_MESSAGE_ACQUIRE:
+            acquire(present, &message, &reply);
+            ring_push(&(present->replies), &reply);
+            break;
+        case PRESENT_MESSAGE_PRESENT:
+            present_image(present, &message);
+            break;
+        case PRESENT_MESSAGE_FLUSH:
+            reply.type = PRESENT_MESSAGE_FLUSHED;
+            ring_push(&(present->replies), &reply);
+            break;
+        case PRESENT_MESSAGE_STOP:
+            return NULL;
+        default:
+            break;
+        }
+    }
+}
+
+/* Render thread side ****************/
+void present_thread_create(PresentThread* present, VkDevice device, VkQueue present_queue,
+                           pthread_mutex_t* queue_mutex, bool threaded) {
+    memset(present, 0, sizeof(PresentThread));
+    present->device = device;
+    present->present_queue = present_queue;
+    present->queue_mutex = queue_mutex;
+    atomic_init(&(present->out_of_date), false);
+    ring_init(&(present->requests));
+    ring_init(&(present->replies));
+
+    if(threaded && pthread_create(&(present->thread), NULL, present_thread_main, present) != 0) {
+        printf("failed to start the present thread, presenting from the render thread\n");
+        threaded = false;
+    }
+    present->threaded = threaded;
+}
+
+void present_thread_destroy(PresentThread* present) {
+    if(present->threaded) {
+        PresentMessage message = {0};
+        message.type = PRESENT_MESSAGE_STOP;
+        ring_push(&(present->requests), &message);
+        pthread_join(present->thread, NULL);
+    }
+    ring_destroy(&(present->requests));
+    ring_destroy(&(present->replies));
+    memset(present, 0, sizeof(PresentThread));
+}
+
+void present_thread_acquire(PresentThread* present, VkSwapchainKHR swapchain,
+                            VkSemaphore image_available) {
+    PresentMessage message = {0};
+    message.type = PRESENT_MESSAGE_ACQUIRE;
+    message.swapchain = swapchain;
+    message.semaphore = image_available;
+    if(present->threaded) {
+        ring_push(&(present->requests), &message);
+    } else {
+        acquire(present, &message, &(present->inline_reply));
+    }
+}
+
+VkResult present_thread_wait_acquired(PresentThread* present, uint32_t* image_index) {
+    PresentMessage reply =
+        present->threaded ? ring_pop(&(present->replies)) : present->inline_reply;
+    if(reply.type != PRESENT_MESSAGE_ACQUIRED) {
+        printf("present thread answered something else than an acquire\n");
+        return VK_ERROR_UNKNOWN;
+    }
+    *image_index = reply.image_index;
+    return reply.result;
+}
+
+void present_thread_present(PresentThread* present, VkSwapchainKHR swapchain,
+                            VkSemaphore render_finished, uint32_t image_index,
+                            SubmitService* after, uint64_t after_ticket) {
+    PresentMessage message = {0};
+    message.type = PRESENT_MESSAGE_PRESENT;
+    message.swapchain = swapchain;
+    message.semaphore = render_finished;
+    message.image_index = image_index;
+    message.after = after;
+    message.after_ticket = after_ticket;
+    if(present->threaded) {
+        ring_push(&(present->requests), &message);
+    } else {
+        present_image(present, &message);
+    }
+}
+
+void present_thread_flush(PresentThread* present) {
+    if(!present->threaded) {
+        return;
+    }
+    PresentMessage message = {0};
+    message.type = PRESENT_MESSAGE_FLUSH;
+    ring_push(&(present->requests), &message);
+    ring_pop(&(present->replies));
+}
+
+bool present_thread_out_of_date(PresentThread* present) {
+    return atomic_exchange(&(present->out_of_date), false);
+}
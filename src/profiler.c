@@ -0,0 +1,162 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "profiler.h"
+
+// 0: the thread has no track yet, the GPU has that one
+static _Thread_local uint32_t thread_track = 0;
+
+int64_t profiler_now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+void profiler_create(Profiler* profiler, uint32_t capacity) {
+    memset(profiler, 0, sizeof(Profiler));
+    profiler->capacity = capacity;
+    profiler->events = calloc(capacity, sizeof(ProfileEvent));
+    for(uint32_t i = 0; i < capacity; i++) {
+        atomic_init(&(profiler->events[i].sequence), 0);
+    }
+    atomic_init(&(profiler->write_index), 0);
+    atomic_init(&(profiler->track_count), PROFILER_GPU_TRACK + 1);
+    profiler->track_names[PROFILER_GPU_TRACK] = "GPU";
+}
+
+void profiler_destroy(Profiler* profiler) {
+    free(profiler->events);
+    memset(profiler, 0, sizeof(Profiler));
+}
+
+static uint32_t current_track(Profiler* profiler) {
+    if(thread_track == 0) {
+        uint32_t track = atomic_fetch_add(&(profiler->track_count), 1);
+        // past the limit, the last threads share a track
+        thread_track = track < PROFILER_MAX_TRACKS ? track : PROFILER_MAX_TRACKS - 1;
+    }
+    return thread_track;
+}
+
+void profiler_name_thread(Profiler* profiler, const char* name) {
+    if(profiler != NULL) {
+        profiler->track_names[current_track(profiler)] = name;
+    }
+}
+
+/* Recording *************************/
+void profiler_record(Profiler* profiler, const char* name, uint32_t track, int64_t start_ns,
+                     int64_t end_ns) {
+    uint64_t index =
+        atomic_fetch_add_explicit(&(profiler->write_index), 1, memory_order_relaxed);
+    ProfileEvent* event = profiler->events + (index & (profiler->capacity - 1));
+    // a seqlock: the writer of the previous lap may still be in there, the reader checks
+    atomic_store_explicit(&(event->sequence), 2 * index + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    event->name = name;
+    event->start_ns = start_ns;
+    event->end_ns = end_ns;
+    event->track = track;
+    atomic_store_explicit(&(event->sequence), 2 * index + 2, memory_order_release);
+}
+
+ProfileZone profiler_begin(Profiler* profiler, const char* name) {
+    ProfileZone zone = {profiler, name, 0};
+    if(profiler != NULL) {
+        zone.start_ns = profiler_now_ns();
+    }
+    return zone;
+}
+
+int64_t profiler_end(const ProfileZone* zone) {
+    if(zone->profiler == NULL) {
+        return 0;
+    }
+    int64_t end_ns = profiler_now_ns();
+    profiler_record(zone->profiler, zone->name, current_track(zone->profiler), zone->start_ns,
+                    end_ns);
+    return end_ns - zone->start_ns;
+}
+
+void profiler_begin_frame(Profiler* profiler, uint64_t frame_number) {
+    profiler->frame_starts[frame_number & (PROFILER_MAX_FRAMES - 1)] = profiler_now_ns();
+    profiler->frame_count = frame_number + 1;
+}
+
+/* Chrome trace **********************/
+// Copies the event at index, if it is still there and complete
+static bool read_event(Profiler* profiler, uint64_t index, ProfileEvent* copy) {
+    ProfileEvent* event = profiler->events + (index & (profiler->capacity - 1));
+    uint64_t before = atomic_load_explicit(&(event->sequence), memory_order_acquire);
+    copy->name = event->name;
+    copy->start_ns = event->start_ns;
+    copy->end_ns = event->end_ns;
+    copy->track = event->track;
+    atomic_thread_fence(memory_order_acquire);
+    uint64_t after = atomic_load_explicit(&(event->sequence), memory_order_relaxed);
+    return before == 2 * index + 2 && after == before;
+}
+
+bool profiler_write_chrome_trace(Profiler* profiler, const char* path, uint64_t first_frame,
+                                 uint64_t end_frame) {
+    if(end_frame > profiler->frame_count || first_frame >= end_frame ||
+       profiler->frame_count - first_frame > PROFILER_MAX_FRAMES) {
+        printf("frames %llu to %llu are not all in the profiler\n",
+               (unsigned long long)first_frame, (unsigned long long)end_frame);
+        return false;
+    }
+    FILE* file = fopen(path, "w");
+    if(!file) {
+        printf("failed to open trace file %s\n", path);
+        return false;
+    }
+    int64_t from_ns = profiler->frame_starts[first_frame & (PROFILER_MAX_FRAMES - 1)];
+    int64_t to_ns = end_frame < profiler->frame_count
+                        ? profiler->frame_starts[end_frame & (PROFILER_MAX_FRAMES - 1)]
+                        : profiler_now_ns();
+
+    // timestamps in microseconds, relative to the start of the window
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    uint32_t track_count = atomic_load(&(profiler->track_count));
+    track_count = track_count < PROFILER_MAX_TRACKS ? track_count : PROFILER_MAX_TRACKS;
+    for(uint32_t track = 0; track < track_count; track++) {
+        fprintf(file,
+                "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+                "\"args\":{\"name\":\"%s\"}},\n",
+                track, profiler->track_names[track] != NULL ? profiler->track_names[track]
+                                                             : "thread");
+    }
+    uint64_t end = atomic_load_explicit(&(profiler->write_index), memory_order_acquire);
+    uint64_t begin = end > profiler->capacity ? end - profiler->capacity : 0;
+    uint32_t written = 0;
+    uint32_t lost = 0;
+    for(uint64_t index = begin; index < end; index++) {
+        ProfileEvent event;
+        if(!read_event(profiler, index, &event)) {
+            lost++;
+            continue;
+        }
+        if(event.end_ns < from_ns || event.start_ns >= to_ns) {
+            continue;
+        }
+        fprintf(file, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,"
+                      "\"dur\":%.3f},\n",
+                event.name, event.track, (double)(event.start_ns - from_ns) / 1000.0,
+                (double)(event.end_ns - event.start_ns) / 1000.0);
+        written++;
+    }
+    // JSON does not allow the trailing comma of the last event
+    fprintf(file, "{\"name\":\"window\",\"ph\":\"i\",\"s\":\"g\",\"pid\":1,\"tid\":0,\"ts\":%.3f}"
+                  "\n]}\n",
+            (double)(to_ns - from_ns) / 1000.0);
+    fclose(file);
+    printf("wrote frames %llu to %llu to %s: %u zones, %u overwritten while writing\n",
+           (unsigned long long)first_frame, (unsigned long long)end_frame - 1, path, written,
+           lost);
+    return true;
+}
@@ -0,0 +1,366 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <vulkan/vulkan.h>
+
+#include "render_queue.h"
+
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+#define RADIX_PASSES (64 / RADIX_BITS)
+
+static double elapsed_ms(struct timespec start, struct timespec end) {
+    return (double)(end.tv_sec - start.tv_sec) * 1e3 + (double)(end.tv_nsec - start.tv_nsec) / 1e6;
+}
+
+void render_queue_create(RenderQueue* queue, uint32_t capacity, uint32_t nb_threads) {
+    memset(queue, 0, sizeof(RenderQueue));
+    queue->capacity = capacity;
+    queue->packets = calloc(capacity, sizeof(DrawPacket));
+    queue->entries = calloc(capacity, sizeof(RenderQueueEntry));
+    queue->scratch = calloc(capacity, sizeof(RenderQueueEntry));
+    if(nb_threads == 0) {
+        long nb_cores = sysconf(_SC_NPROCESSORS_ONLN);
+        nb_threads = nb_cores > 0 ? (uint32_t)nb_cores : 1;
+    }
+    queue->nb_threads = nb_threads;
+}
+
+void render_queue_destroy(RenderQueue* queue) {
+    free(queue->packets);
+    free(queue->entries);
+    free(queue->scratch);
+    memset(queue, 0, sizeof(RenderQueue));
+}
+
+void render_queue_reset(RenderQueue* queue) {
+    queue->count = 0;
+}
+
+static uint64_t truncate_field(uint32_t value, uint32_t bits) {
+    return (uint64_t)value & ((1ULL << bits) - 1);
+}
+
+uint64_t render_queue_make_key(uint32_t pass, uint32_t pipeline, uint32_t material, uint32_t mesh,
+                               float depth) {
+    depth = depth < 0.0f ? 0.0f : (depth > 1.0f ? 1.0f : depth);
+    uint32_t quantized_depth = (uint32_t)(depth * (float)((1 << RENDER_QUEUE_DEPTH_BITS) - 1));
+
+    uint64_t key = truncate_field(pass, RENDER_QUEUE_PASS_BITS);
+    key <<= RENDER_QUEUE_PIPELINE_BITS;
+    key |= truncate_field(pipeline, RENDER_QUEUE_PIPELINE_BITS);
+    key <<= RENDER_QUEUE_MATERIAL_BITS;
+    key |= truncate_field(material, RENDER_QUEUE_MATERIAL_BITS);
+    key <<= RENDER_QUEUE_MESH_BITS;
+    key |= truncate_field(mesh, RENDER_QUEUE_MESH_BITS);
+    key <<= RENDER_QUEUE_DEPTH_BITS;
+    key |= truncate_field(quantized_depth, RENDER_QUEUE_DEPTH_BITS);
+    return key;
+}
+
+bool render_queue_submit(RenderQueue* queue, uint64_t key, const DrawPacket* packet) {
+    if(queue->count == queue->capacity) {
+        return false;
+    }
+    uint32_t index = queue->count++;
+    queue->packets[index] = *packet;
+    queue->entries[index].key = key;
+    queue->entries[index].packet = index;
+    return true;
+}
+
+/* Radix sort ************************/
+// LSD radix sort on 8 bits per pass. Each thread owns a contiguous slice of the entries: it
+// counts the digits of its slice, then scatters it after the slices of the threads before it.
+// This keeps the sort stable, which LSD needs between passes.
+
+typedef struct {
+    RenderQueueEntry* src;
+    RenderQueueEntry* dst;
+    uint32_t count;
+    uint32_t nb_threads;
+    uint32_t (*histograms)[RADIX_BUCKETS]; // one per thread
+    pthread_barrier_t barrier;
+    // spawned workers wait until the final thread count is known, in case some failed to spawn
+    pthread_mutex_t start_mutex;
+    pthread_cond_t start_cond;
+    bool started;
+    RenderQueueEntry* sorted; // src or dst, depending on how many passes were skipped
+} RadixSort;
+
+typedef struct {
+    RadixSort* sort;
+    uint32_t thread;
+} RadixSortWorker;
+
+static void radix_sync(RadixSort* sort) {
+    if(sort->nb_threads > 1) {
+        pthread_barrier_wait(&(sort->barrier));
+    }
+}
+
+static void* radix_sort_worker(void* arg) {
+    RadixSortWorker* worker = arg;
+    RadixSort* sort = worker->sort;
+    uint32_t thread = worker->thread;
+    if(thread != 0) {
+        pthread_mutex_lock(&(sort->start_mutex));
+        while(!sort->started) {
+            pthread_cond_wait(&(sort->start_cond), &(sort->start_mutex));
+        }
+        pthread_mutex_unlock(&(sort->start_mutex));
+    }
+    uint32_t begin = (uint32_t)((uint64_t)sort->count * thread / sort->nb_threads);
+    uint32_t end = (uint32_t)((uint64_t)sort->count * (thread + 1) / sort->nb_threads);
+    // every thread swaps its own copy of the pointers, in lockstep with the others
+    RenderQueueEntry* src = sort->src;
+    RenderQueueEntry* dst = sort->dst;
+
+    for(uint32_t pass = 0; pass < RADIX_PASSES; pass++) {
+        uint32_t shift = pass * RADIX_BITS;
+        uint32_t* histogram = sort->histograms[thread];
+        memset(histogram, 0, RADIX_BUCKETS * sizeof(uint32_t));
+        for(uint32_t i = begin; i < end; i++) {
+            histogram[(src[i].key >> shift) & (RADIX_BUCKETS - 1)]++;
+        }
+        radix_sync(sort);
+
+        // where this thread writes each digit: after every smaller digit, and after the same
+        // digit of the slices before this one
+        uint32_t offsets[RADIX_BUCKETS];
+        uint32_t total = 0;
+        bool skip = false;
+        for(uint32_t digit = 0; digit < RADIX_BUCKETS; digit++) {
+            uint32_t digit_total = 0;
+            for(uint32_t t = 0; t < sort->nb_threads; t++) {
+                if(t == thread) {
+                    offsets[digit] = total + digit_total;
+                }
+                digit_total += sort->histograms[t][digit];
+            }
+            // every key has the same digit: the pass would not move anything. Frequent in the
+            // high bits, since the ids packed there are small.
+            skip = skip || digit_total == sort->count;
+            total += digit_total;
+        }
+
+        if(!skip) {
+            for(uint32_t i = begin; i < end; i++) {
+                dst[offsets[(src[i].key >> shift) & (RADIX_BUCKETS - 1)]++] = src[i];
+            }
+        }
+        // the histograms are cleared at the start of the next pass, and dst becomes src
+        radix_sync(sort);
+        if(!skip) {
+            RenderQueueEntry* swap = src;
+            src = dst;
+            dst = swap;
+        }
+    }
+    if(thread == 0) {
+        sort->sorted = src;
+    }
+    return NULL;
+}
+
+void render_queue_sort(RenderQueue* queue) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    RadixSort sort = {0};
+    sort.src = queue->entries;
+    sort.dst = queue->scratch;
+    sort.count = queue->count;
+    sort.nb_threads = queue->count >= RENDER_QUEUE_PARALLEL_SORT_THRESHOLD ? queue->nb_threads : 1;
+    uint32_t histograms[sort.nb_threads][RADIX_BUCKETS];
+    sort.histograms = histograms;
+
+    if(queue->count > 1) {
+        RadixSortWorker workers[sort.nb_threads];
+        for(uint32_t i = 0; i < sort.nb_threads; i++) {
+            workers[i].sort = &sort;
+            workers[i].thread = i;
+        }
+        if(sort.nb_threads > 1) {
+            // the calling thread works too, so only nb_threads - 1 extra threads are spawned
+            pthread_mutex_init(&(sort.start_mutex), NULL);
+            pthread_cond_init(&(sort.start_cond), NULL);
+            pthread_t threads[sort.nb_threads];
+            uint32_t nb_spawned = 0;
+            for(uint32_t i = 1; i < sort.nb_threads; i++) {
+                if(pthread_create(threads + nb_spawned, NULL, radix_sort_worker, workers + i) !=
+                   0) {
+                    printf("failed to spawn radix sort worker, continuing with %u threads\n",
+                           nb_spawned + 1);
+                    break;
+                }
+                nb_spawned++;
+            }
+            // the slices and the barrier depend on the number of threads that actually run
+            pthread_mutex_lock(&(sort.start_mutex));
+            sort.nb_threads = nb_spawned + 1;
+            pthread_barrier_init(&(sort.barrier), NULL, sort.nb_threads);
+            sort.started = true;
+            pthread_cond_broadcast(&(sort.start_cond));
+            pthread_mutex_unlock(&(sort.start_mutex));
+
+            radix_sort_worker(workers);
+            for(uint32_t i = 0; i < nb_spawned; i++) {
+                pthread_join(threads[i], NULL);
+            }
+            pthread_barrier_destroy(&(sort.barrier));
+            pthread_cond_destroy(&(sort.start_cond));
+            pthread_mutex_destroy(&(sort.start_mutex));
+        } else {
+            radix_sort_worker(workers);
+        }
+
+        // the sorted entries end up in scratch after an odd number of passes
+        if(sort.sorted == queue->scratch) {
+            queue->scratch = queue->entries;
+            queue->entries = sort.sorted;
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    queue->stats.sort_time_ms = elapsed_ms(start, end);
+}
+
+/* Recording *************************/
+// What is currently bound in the command buffer
+typedef struct {
+    VkPipeline pipeline;
+    VkPipelineLayout layout;
+    uint32_t descriptor_set_count;
+    VkDescriptorSet descriptor_sets[RENDER_QUEUE_MAX_DESCRIPTOR_SETS];
+    VkBuffer vertex_buffer;
+    VkDeviceSize vertex_buffer_offset;
+    VkBuffer index_buffer;
+    VkDeviceSize index_buffer_offset;
+    VkIndexType index_type;
+    uint32_t push_constant_size;
+    uint8_t push_constants[RENDER_QUEUE_MAX_PUSH_CONSTANTS];
+} BoundState;
+
+static void record_packet(const DrawPacket* packet, BoundState* bound, RenderQueueStats* stats,
+                          VkCommandBuffer command_buffer) {
+    if(packet->pipeline != bound->pipeline) {
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, packet->pipeline);
+        bound->pipeline = packet->pipeline;
+        stats->pipeline_binds++;
+    } else {
+        stats->pipeline_binds_elided++;
+    }
+
+    // Sets stay bound across pipelines with compatible layouts. The layouts are not compared
+    // set by set, so any layout change rebinds everything.
+    bool layout_changed = packet->layout != bound->layout;
+    uint32_t first_changed = packet->descriptor_set_count;
+    for(uint32_t i = 0; i < packet->descriptor_set_count; i++) {
+        if(layout_changed || i >= bound->descriptor_set_count ||
+           packet->descriptor_sets[i] != bound->descriptor_sets[i]) {
+            first_changed = i;
+            break;
+        }
+    }
+    if(first_changed < packet->descriptor_set_count) {
+        vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, packet->layout,
+                                first_changed, packet->descriptor_set_count - first_changed,
+                                packet->descriptor_sets + first_changed, 0, NULL);
+        stats->descriptor_set_binds++;
+    } else if(packet->descriptor_set_count > 0) {
+        stats->descriptor_set_binds_elided++;
+    }
+    memcpy(bound->descriptor_sets, packet->descriptor_sets,
+           packet->descriptor_set_count * sizeof(VkDescriptorSet));
+    if(layout_changed || packet->descriptor_set_count > bound->descriptor_set_count) {
+        bound->descriptor_set_count = packet->descriptor_set_count;
+    }
+
+    if(packet->vertex_buffer != VK_NULL_HANDLE) {
+        if(packet->vertex_buffer != bound->vertex_buffer ||
+           packet->vertex_buffer_offset != bound->vertex_buffer_offset) {
+            vkCmdBindVertexBuffers(command_buffer, 0, 1, &(packet->vertex_buffer),
+                                   &(packet->vertex_buffer_offset));
+            bound->vertex_buffer = packet->vertex_buffer;
+            bound->vertex_buffer_offset = packet->vertex_buffer_offset;
+            stats->vertex_buffer_binds++;
+        } else {
+            stats->vertex_buffer_binds_elided++;
+        }
+    }
+
+    if(packet->index_buffer != VK_NULL_HANDLE) {
+        if(packet->index_buffer != bound->index_buffer ||
+           packet->index_buffer_offset != bound->index_buffer_offset ||
+           packet->index_type != bound->index_type) {
+            vkCmdBindIndexBuffer(command_buffer, packet->index_buffer,
+                                 packet->index_buffer_offset, packet->index_type);
+            bound->index_buffer = packet->index_buffer;
+            bound->index_buffer_offset = packet->index_buffer_offset;
+            bound->index_type = packet->index_type;
+            stats->index_buffer_binds++;
+        } else {
+            stats->index_buffer_binds_elided++;
+        }
+    }
+
+    // push constants are invalidated by an incompatible layout too
+    if(packet->push_constant_size > 0) {
+        if(layout_changed || packet->push_constant_size != bound->push_constant_size ||
+           memcmp(packet->push_constants, bound->push_constants, packet->push_constant_size) != 0) {
+            vkCmdPushConstants(command_buffer, packet->layout, packet->push_constant_stages, 0,
+                               packet->push_constant_size, packet->push_constants);
+            bound->push_constant_size = packet->push_constant_size;
+            memcpy(bound->push_constants, packet->push_constants, packet->push_constant_size);
+            stats->push_constants++;
+        } else {
+            stats->push_constants_elided++;
+        }
+    }
+    bound->layout = packet->layout;
+
+    if(packet->index_buffer != VK_NULL_HANDLE) {
+        vkCmdDrawIndexed(command_buffer, packet->count, packet->instance_count,
+                         packet->first_index, packet->vertex_offset, packet->first_instance);
+    } else {
+        vkCmdDraw(command_buffer, packet->count, packet->instance_count, packet->first_index,
+                  packet->first_instance);
+    }
+    stats->draws++;
+    stats->triangles += (uint64_t)(packet->count / 3) * packet->instance_count;
+}
+
+void render_queue_record(RenderQueue* queue, VkCommandBuffer command_buffer) {
+    double sort_time_ms = queue->stats.sort_time_ms;
+    memset(&(queue->stats), 0, sizeof(RenderQueueStats));
+    queue->stats.sort_time_ms = sort_time_ms;
+
+    BoundState bound = {0};
+    for(uint32_t i = 0; i < queue->count; i++) {
+        record_packet(queue->packets + queue->entries[i].packet, &bound, &(queue->stats),
+                      command_buffer);
+    }
+}
+
+void render_queue_print_stats(const RenderQueue* queue) {
+    const RenderQueueStats* stats = &(queue->stats);
+    printf("render queue: %u draws, %llu triangles, sorted in %.3f ms\n", stats->draws,
+           (unsigned long long)stats->triangles, stats->sort_time_ms);
+    printf("    pipelines       %6u bound,  %6u elided\n", stats->pipeline_binds,
+           stats->pipeline_binds_elided);
+    printf("    descriptor sets %6u bound,  %6u elided\n", stats->descriptor_set_binds,
+           stats->descriptor_set_binds_elided);
+    printf("    vertex buffers  %6u bound,  %6u elided\n", stats->vertex_buffer_binds,
+           stats->vertex_buffer_binds_elided);
+    printf("    index buffers   %6u bound,  %6u elided\n", stats->index_buffer_binds,
+           stats->index_buffer_binds_elided);
+    printf("    push constants  %6u pushed, %6u elided\n", stats->push_constants,
+           stats->push_constants_elided);
+}
@@ -0,0 +1,143 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <cglm/cglm.h>
+
+#include "scene_graph.h"
+
+// cglm may use aligned loads on mat4 (32 bytes with AVX), malloc only guarantees 16
+#define MATRIX_ALIGNMENT 32
+
+static double elapsed_ms(struct timespec start, struct timespec end) {
+    return (double)(end.tv_sec - start.tv_sec) * 1e3 + (double)(end.tv_nsec - start.tv_nsec) / 1e6;
+}
+
+void scene_graph_create(SceneGraph* graph, uint32_t capacity, uint32_t copy_count) {
+    memset(graph, 0, sizeof(SceneGraph));
+    if(copy_count > SCENE_GRAPH_MAX_COPIES) {
+        printf("scene graph can only keep %u GPU copies up to date\n", SCENE_GRAPH_MAX_COPIES);
+        copy_count = SCENE_GRAPH_MAX_COPIES;
+    }
+    graph->capacity = capacity;
+    graph->copy_count = copy_count;
+    graph->parents = calloc(capacity, sizeof(uint32_t));
+    // sizeof(mat4) is a multiple of the alignment, as aligned_alloc requires
+    graph->locals = aligned_alloc(MATRIX_ALIGNMENT, capacity * sizeof(mat4));
+    graph->worlds = aligned_alloc(MATRIX_ALIGNMENT, capacity * sizeof(mat4));
+    graph->dirty = calloc(capacity, sizeof(uint8_t));
+    graph->stale_copies = calloc(capacity, sizeof(uint8_t));
+    graph->stale_nodes = calloc(capacity, sizeof(uint32_t));
+    graph->first_dirty = capacity;
+}
+
+void scene_graph_destroy(SceneGraph* graph) {
+    free(graph->parents);
+    free(graph->locals);
+    free(graph->worlds);
+    free(graph->dirty);
+    free(graph->stale_copies);
+    free(graph->stale_nodes);
+    memset(graph, 0, sizeof(SceneGraph));
+}
+
+static void mark_dirty(SceneGraph* graph, uint32_t node) {
+    if(!graph->dirty[node]) {
+        graph->dirty[node] = 1;
+        graph->dirty_count++;
+    }
+    if(node < graph->first_dirty) {
+        graph->first_dirty = node;
+    }
+}
+
+uint32_t scene_graph_add_node(SceneGraph* graph, uint32_t parent, mat4 local) {
+    if(graph->count == graph->capacity) {
+        return SCENE_NODE_NONE;
+    }
+    if(parent != SCENE_NODE_NONE && parent >= graph->count) {
+        printf("scene node parent %u does not exist\n", parent);
+        return SCENE_NODE_NONE;
+    }
+    uint32_t node = graph->count++;
+    graph->parents[node] = parent;
+    glm_mat4_copy(local, graph->locals[node]);
+    mark_dirty(graph, node);
+    return node;
+}
+
+void scene_graph_set_local(SceneGraph* graph, uint32_t node, mat4 local) {
+    glm_mat4_copy(local, graph->locals[node]);
+    mark_dirty(graph, node);
+}
+
+void scene_graph_update(SceneGraph* graph) {
+    graph->stats.nodes = graph->count;
+    graph->stats.nodes_updated = 0;
+    graph->stats.update_time_ms = 0.0;
+    // static scene: not a single node is looked at
+    if(graph->dirty_count == 0) {
+        return;
+    }
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    uint8_t all_copies = (uint8_t)((1u << graph->copy_count) - 1);
+    for(uint32_t i = graph->first_dirty; i < graph->count; i++) {
+        uint32_t parent = graph->parents[i];
+        // the parent was handled earlier in this walk: its flag tells if its world changed
+        if(!graph->dirty[i] && (parent == SCENE_NODE_NONE || !graph->dirty[parent])) {
+            continue;
+        }
+        graph->dirty[i] = 1;
+        if(parent == SCENE_NODE_NONE) {
+            glm_mat4_copy(graph->locals[i], graph->worlds[i]);
+        } else {
+            glm_mat4_mul(graph->worlds[parent], graph->locals[i], graph->worlds[i]);
+        }
+        graph->stats.nodes_updated++;
+
+        if(graph->stale_copies[i] == 0) {
+            graph->stale_nodes[graph->stale_count++] = i;
+        }
+        graph->stale_copies[i] = all_copies;
+    }
+    // children were only flagged during the walk, the flags are cleared once it is over
+    memset(graph->dirty + graph->first_dirty, 0, graph->count - graph->first_dirty);
+    graph->dirty_count = 0;
+    graph->first_dirty = graph->capacity;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    graph->stats.update_time_ms = elapsed_ms(start, end);
+}
+
+uint32_t scene_graph_upload(SceneGraph* graph, uint32_t copy, mat4* dst) {
+    uint8_t bit = (uint8_t)(1u << copy);
+    uint32_t uploaded = 0;
+    uint32_t i = 0;
+    while(i < graph->stale_count) {
+        uint32_t node = graph->stale_nodes[i];
+        if(graph->stale_copies[node] & bit) {
+            glm_mat4_copy(graph->worlds[node], dst[node]);
+            graph->stale_copies[node] &= (uint8_t)~bit;
+            uploaded++;
+        }
+        if(graph->stale_copies[node] == 0) {
+            // every copy is up to date: swap with the last one, which is looked at next
+            graph->stale_nodes[i] = graph->stale_nodes[--graph->stale_count];
+        } else {
+            i++;
+        }
+    }
+    graph->stats.nodes_uploaded = uploaded;
+    return uploaded;
+}
+
+void scene_graph_print_stats(const SceneGraph* graph) {
+    const SceneGraphStats* stats = &(graph->stats);
+    printf("scene graph: %u/%u nodes updated in %.3f ms, %u uploaded\n", stats->nodes_updated,
+           stats->nodes, stats->update_time_ms, stats->nodes_uploaded);
+}
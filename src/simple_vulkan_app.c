@@ -1,4 +1,6 @@
 #include <math.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -15,7 +17,25 @@
 
 #include <cglm/cglm.h>
 
+#include "bindless.h"
+#include "deletion_queue.h"
+#include "descriptor_allocator.h"
+#include "frame_pacer.h"
+#include "geometry_pool.h"
+#include "gpu_memory.h"
+#include "host_memory.h"
+#include "hud.h"
+#include "ktx2.h"
 #include "macros.h"
+#include "pipeline_variants.h"
+#include "present_thread.h"
+#include "profiler.h"
+#include "render_queue.h"
+#include "scene_graph.h"
+#include "simulation.h"
+#include "submit_service.h"
+#include "texture_streamer.h"
+#include "trace.h"
 
 #define WINDOW_WIDTH 400
 #define WINDOW_HEIGHT 300
@@ -33,22 +53,26 @@ const char* REQUIRED_DEVICE_EXTENSIONS[NB_REQUIRED_DEVICE_EXTENSIONS] = {
     VK_KHR_SWAPCHAIN_EXTENSION_NAME};
 
 #define MAX_FRAMES_IN_FLIGHT 2
+// 1, 2, 4 or 8. Clamped to what the device supports
+#define REQUESTED_MSAA_SAMPLES 4
 
-#define NB_VERTEX_ATTRIBUTES 2
+#define NB_VERTEX_ATTRIBUTES 3
 typedef struct {
     vec2 position;
     vec3 color;
+    vec2 uv;
 } Vertex;
 
 const size_t NB_TRIANGLE_VERTICES = 3;
-const Vertex TRIANGLE_VERTICES[3] = {
-    {{0.0, -0.5}, {1.0, 0.0, 0.0}}, {{0.5, 0.5}, {0.0, 1.0, 0.0}}, {{-0.5, 0.5}, {0.0, 0.0, 1.0}}};
+const Vertex TRIANGLE_VERTICES[3] = {{{0.0, -0.5}, {1.0, 0.0, 0.0}, {0.5, 0.0}},
+                                     {{0.5, 0.5}, {0.0, 1.0, 0.0}, {1.0, 1.0}},
+                                     {{-0.5, 0.5}, {0.0, 0.0, 1.0}, {0.0, 1.0}}};
 
 const size_t NB_SQUARE_VERTICES = 4;
-const Vertex SQUARE_VERTICES[4] = {{{-0.5, -0.5}, {0.5, 0.5, 0.0}},
-                                   {{0.5, -0.5}, {0.5, 0.0, 0.5}},
-                                   {{0.5, 0.5}, {0.0, 1.0, 0.5}},
-                                   {{-0.5, 0.5}, {1.0, 0.0, 0.0}}};
+const Vertex SQUARE_VERTICES[4] = {{{-0.5, -0.5}, {0.5, 0.5, 0.0}, {0.0, 0.0}},
+                                   {{0.5, -0.5}, {0.5, 0.0, 0.5}, {1.0, 0.0}},
+                                   {{0.5, 0.5}, {0.0, 1.0, 0.5}, {1.0, 1.0}},
+                                   {{-0.5, 0.5}, {1.0, 0.0, 0.0}, {0.0, 1.0}}};
 
 const size_t NB_SQUARE_INDICES = 6;
 // vulkan is limited to uint16 or uint32
@@ -60,6 +84,173 @@ typedef struct {
     mat4 proj;
 } UniformBufferObject;
 
+#define MAX_MATERIALS 256
+// Texture streaming settings
+#define TEXTURE_MEMORY_BUDGET (64 * 1024 * 1024)
+#define TEXTURE_PREVIEW_SIZE 32
+#define TEXTURE_MAX_UPLOADS_PER_FRAME 4
+
+// every mesh is suballocated from one vertex and one index buffer of this size
+#define GEOMETRY_POOL_VERTEX_CAPACITY (64 * 1024)
+#define GEOMETRY_POOL_INDEX_CAPACITY (3 * 64 * 1024)
+
+// std430, must match Material in shader.frag
+typedef struct {
+    vec4 tint;
+    uint32_t texture_index; // bindless image slot, BINDLESS_INVALID_INDEX when untextured
+    uint32_t padding[3];
+} Material;
+
+// Texture with a prebuilt mip chain, loaded at once (no streaming)
+typedef struct {
+    VkImage image;
+    VkDeviceMemory memory;
+    VkImageView view;
+    uint32_t bindless_index;
+} StaticTexture;
+
+// must match the push constant block in the shaders
+typedef struct {
+    uint32_t transform_table; // bindless storage buffer slot of the world matrices
+    uint32_t transform_index; // scene node of the draw
+    uint32_t material_table;  // bindless storage buffer slot of the material table
+    uint32_t material_index;
+    uint32_t vertex_table;  // vertex pulling only: bindless storage buffer slot of the vertices
+    uint32_t vertex_base;   // in 32 bits words, where the mesh starts in the vertex table
+    uint32_t vertex_format; // VertexFormat
+} PushConstants;
+
+// how the scene vertex shader gets its vertices, switched with F8
+typedef enum {
+    VERTEX_FETCH_FIXED_FUNCTION = 0, // vertex input state, shader.vert
+    VERTEX_FETCH_PULLED,             // storage buffer reads, shader_pulled.vert
+    VERTEX_FETCH_COUNT,
+} VertexFetch;
+
+// must match the VERTEX_FORMAT_ constants in shader_pulled.vert. Only pulled vertices can be
+// anything else than Vertex: the fixed-function path has a single vertex input state.
+typedef enum {
+    VERTEX_FORMAT_FLOAT = 0,
+    VERTEX_FORMAT_PACKED,
+} VertexFormat;
+
+// 16 bytes instead of the 28 of Vertex: the shader unpacks color and uv
+typedef struct {
+    vec2 position;
+    uint32_t color; // unorm8x4, alpha unused
+    uint32_t uv;    // unorm16x2
+} PackedVertex;
+
+#define MAX_DRAWS 64
+#define NB_STACKED_SQUARES 8
+// An opaque draw of the square mesh
+typedef struct {
+    uint32_t node;    // its transform in the scene graph
+    float view_depth; // distance to the camera along its axis, refreshed every frame
+} DrawItem;
+
+// The world matrices of the scene graph are read by the vertex shader from a storage buffer
+#define MAX_SCENE_NODES 1024
+#define SCENE_GRAPH_REPORT_PERIOD 240
+
+// the scene logic runs on its own thread at a fixed rate, frames interpolate between its steps
+#define SIMULATION_STEP_S (1.0 / 60.0)
+#define TURNTABLE_SPEED (10.0f * (float)M_PI) // radians per second
+#define SIMULATION_REPORT_PERIOD 240
+
+// transient host allocations of a frame (swapchain queries...), dropped when the next one starts
+#define FRAME_ARENA_SIZE (64 * 1024)
+#define HOST_MEMORY_REPORT_PERIOD 240
+
+// share of a heap's budget above which it is reported, and the texture streamer stops promoting
+#define MEMORY_PRESSURE_RATIO 0.9f
+
+// main loop pacing, see the command line options in main. 0: no frame rate cap
+#define DEFAULT_MAX_FPS 0.0
+// when rendering on demand and nothing changed: how long to wait for events before checking
+// again on the work that does not send any (texture workers...)
+#define IDLE_WAIT_TIMEOUT_S 0.1
+#define FRAME_PACER_REPORT_PERIOD 240
+// time the render thread spends waiting on the GPU and the presentation engine
+#define BLOCKED_TIME_REPORT_PERIOD 240
+#define SUBMIT_REPORT_PERIOD 240
+// replays leave these first frames out of the timings: pipelines, uploads and caches warm up
+#define REPLAY_WARMUP_FRAMES 16
+// F9 writes this many of the last frames to a Chrome trace, --profile-frames a given window
+#define PROFILE_DEFAULT_FRAMES 120
+#define PROFILE_DEFAULT_PATH "jubilant_trace.json"
+// the GPU and CPU clocks drift apart, they are sampled together again this often
+#define GPU_CALIBRATION_PERIOD 240
+
+#define CAMERA_NEAR_PLANE 0.1f
+#define CAMERA_FAR_PLANE 10.0f
+
+// submitted to the render queue, which sorts them by state first
+typedef enum {
+    RENDER_PASS_OPAQUE = 0,
+    RENDER_PASS_TRANSPARENT,
+} RenderPassLayer;
+
+// How often the bind counters of the render queue are printed, in frames
+#define RENDER_QUEUE_REPORT_PERIOD 240
+
+// How many frames the overdraw is averaged on before being printed
+#define OVERDRAW_REPORT_PERIOD 240
+
+// Post-processing: the scene is drawn in hdr, then tonemapped, graded and antialiased (fxaa)
+#define SCENE_COLOR_FORMAT VK_FORMAT_R16G16B16A16_SFLOAT
+#define POST_COLOR_FORMAT VK_FORMAT_R8G8B8A8_SRGB
+// sets of the first descriptor pool of each frame in flight, the next ones are larger
+#define DESCRIPTOR_SETS_PER_POOL 16
+#define DESCRIPTOR_REPORT_PERIOD 240
+// GPU frame time is averaged on this many frames before being printed
+#define FRAME_TIME_REPORT_PERIOD 240
+// start of the frame, end of the scene, end of the frame
+#define FRAME_TIMESTAMP_COUNT 3
+
+// CPU stages of draw_frame, timed for the profile and the HUD
+typedef enum {
+    FRAME_STAGE_WAIT_FENCE = 0,
+    FRAME_STAGE_HOUSEKEEPING,
+    FRAME_STAGE_UPDATE,
+    FRAME_STAGE_FILL_RENDER_QUEUE,
+    FRAME_STAGE_READ_QUERIES,
+    FRAME_STAGE_WAIT_ACQUIRE,
+    FRAME_STAGE_RECORD,
+    FRAME_STAGE_SUBMIT,
+    FRAME_STAGE_PRESENT,
+    FRAME_STAGE_COUNT,
+} FrameStage;
+
+static const char* FRAME_STAGE_NAMES[FRAME_STAGE_COUNT] = {
+    [FRAME_STAGE_WAIT_FENCE] = "wait fence",
+    [FRAME_STAGE_HOUSEKEEPING] = "housekeeping",
+    [FRAME_STAGE_UPDATE] = "update",
+    [FRAME_STAGE_FILL_RENDER_QUEUE] = "fill render queue",
+    [FRAME_STAGE_READ_QUERIES] = "read queries",
+    [FRAME_STAGE_WAIT_ACQUIRE] = "wait acquire",
+    [FRAME_STAGE_RECORD] = "record",
+    [FRAME_STAGE_SUBMIT] = "submit",
+    [FRAME_STAGE_PRESENT] = "present",
+};
+
+// F10 overlay, drawn over the antialiased image. A frame uses a few thousand vertices.
+#define HUD_MAX_VERTICES (32 * 1024)
+#define HUD_SCALE 2.0f // pixels per font pixel
+#define HUD_FRAME_BUDGET_MS (1000.0 / 60.0)
+
+// must match HudPushConstants in hud.vert
+typedef struct {
+    vec2 pixel_to_ndc;
+} HudPushConstants;
+
+// must match PostPushConstants in post_sampled.frag
+typedef struct {
+    uint32_t source; // bindless slot of the image to read
+    uint32_t padding;
+    vec2 texel_size;
+} PostPushConstants;
+
 VkVertexInputBindingDescription get_binding_description() {
     VkVertexInputBindingDescription binding_description = {0};
     binding_description.binding = 0;
@@ -83,10 +274,111 @@ void get_attribute_description(
     color_attribute.format = VK_FORMAT_R32G32B32_SFLOAT;
     color_attribute.offset = offsetof(Vertex, color);
 
+    VkVertexInputAttributeDescription uv_attribute = {0};
+    uv_attribute.binding = 0;
+    uv_attribute.location = 2;
+    uv_attribute.format = VK_FORMAT_R32G32_SFLOAT;
+    uv_attribute.offset = offsetof(Vertex, uv);
+
     output_attribute_descriptions[0] = position_attribute;
     output_attribute_descriptions[1] = color_attribute;
+    output_attribute_descriptions[2] = uv_attribute;
 }
 
+typedef enum {
+    PIPELINE_KIND_OPAQUE = 0,
+    PIPELINE_KIND_TRANSPARENT,
+    PIPELINE_KIND_DEBUG_DEPTH,
+    PIPELINE_KIND_DEBUG_COVERAGE,
+    PIPELINE_KIND_COUNT,
+} PipelineKind;
+
+// must match the constant_id declared in the shaders
+typedef enum {
+    SPEC_CONSTANT_DEQUANTIZE_POSITION = 0, // vertex, bool
+    SPEC_CONSTANT_POSITION_SCALE = 1,      // vertex, float
+    SPEC_CONSTANT_DEBUG_VIEW = 2,          // fragment, uint
+    SPEC_CONSTANT_POST_EFFECT = 3,         // fragment, uint, post-processing shaders only
+} SpecializationConstantId;
+
+// values of SPEC_CONSTANT_DEBUG_VIEW, cycled with F1
+typedef enum {
+    DEBUG_VIEW_NONE = 0,
+    DEBUG_VIEW_DEPTH = 1,
+    DEBUG_VIEW_COVERAGE = 2,
+    DEBUG_VIEW_COUNT,
+} DebugView;
+
+// values of SPEC_CONSTANT_POST_EFFECT
+typedef enum {
+    POST_EFFECT_TONEMAP = 0,
+    POST_EFFECT_GRADE = 1,
+    POST_EFFECT_FXAA = 2,
+} PostEffect;
+
+// How tonemapping and grading are chained after the scene, toggled with F4. Fxaa reads the
+// neighbouring pixels, which an input attachment cannot do: it is always a separate pass.
+typedef enum {
+    // subpasses of the scene render pass, reading the previous one through an input attachment:
+    // on tile-based GPUs the intermediate images never leave tile memory
+    POST_MODE_SUBPASSES = 0,
+    // one render pass each, sampling the previous output: every intermediate goes through memory
+    POST_MODE_SEPARATE_PASSES,
+    POST_MODE_COUNT,
+} PostMode;
+
+typedef enum {
+    POST_PIPELINE_TONEMAP_SUBPASS = 0,
+    POST_PIPELINE_GRADE_SUBPASS,
+    POST_PIPELINE_TONEMAP_PASS,
+    POST_PIPELINE_GRADE_PASS,
+    POST_PIPELINE_FXAA,
+    POST_PIPELINE_COUNT,
+} PostPipeline;
+
+// Passes measured by pipeline statistics queries. A query cannot span subpasses, so in subpass
+// mode they are the subpasses.
+typedef enum {
+    STATISTICS_PASS_SCENE = 0,
+    STATISTICS_PASS_TONEMAP,
+    STATISTICS_PASS_GRADE,
+    STATISTICS_PASS_FXAA,
+    STATISTICS_PASS_COUNT,
+} StatisticsPass;
+
+static const char* STATISTICS_PASS_NAMES[STATISTICS_PASS_COUNT] = {
+    [STATISTICS_PASS_SCENE] = "scene",
+    [STATISTICS_PASS_TONEMAP] = "tonemap",
+    [STATISTICS_PASS_GRADE] = "grade",
+    [STATISTICS_PASS_FXAA] = "fxaa",
+};
+
+static const StatisticsPass POST_PIPELINE_PASSES[POST_PIPELINE_COUNT] = {
+    [POST_PIPELINE_TONEMAP_SUBPASS] = STATISTICS_PASS_TONEMAP,
+    [POST_PIPELINE_GRADE_SUBPASS] = STATISTICS_PASS_GRADE,
+    [POST_PIPELINE_TONEMAP_PASS] = STATISTICS_PASS_TONEMAP,
+    [POST_PIPELINE_GRADE_PASS] = STATISTICS_PASS_GRADE,
+    [POST_PIPELINE_FXAA] = STATISTICS_PASS_FXAA,
+};
+
+// Results of a pipeline statistics query come in the order of their flag bits
+static const VkQueryPipelineStatisticFlags PIPELINE_STATISTICS_FLAGS =
+    VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+typedef struct {
+    uint64_t input_vertices;
+    uint64_t input_primitives;
+    uint64_t vertex_invocations;
+    uint64_t clipping_invocations; // primitives reaching the clipper
+    uint64_t clipping_primitives;  // primitives out of it
+    uint64_t fragment_invocations;
+} PipelineStatistics;
+#define PIPELINE_STATISTICS_REPORT_PERIOD 240
+
 #define QUEUE_FAMILY_COUNT 3
 
 typedef struct {
@@ -141,14 +433,24 @@ typedef struct {
 
 typedef struct {
     GLFWwindow* window;
+    // host memory of the app and of the driver: allocator is passed to every Vulkan call
+    HostMemory host_memory;
+    const VkAllocationCallbacks* allocator;
     VkInstance instance;
     bool validation_layers_available;
     bool framebuffer_resized;
+    bool swapchain_out_of_date; // said by a present, recreated at the start of the next frame
+    DebugView debug_view;
 
     VkDebugUtilsMessengerEXT debug_messenger;
 
     VkPhysicalDevice physical_device;
+    // of the picked device, indexed like KTX2_COMPRESSED_FORMATS
+    bool compressed_format_supported[KTX2_COMPRESSED_FORMAT_COUNT];
     VkDevice device;
+    bool memory_budget_supported; // VK_EXT_memory_budget is enabled
+    // every device memory allocation goes through it
+    GpuMemoryTracker memory;
     VkQueue graphics_queue;
     VkQueue present_queue;
     VkQueue transfer_queue;
@@ -165,15 +467,60 @@ typedef struct {
     VkImageView* swapchain_images_views;
     VkFramebuffer* swapchain_framebuffers;
 
+    // render targets, recreated with the swapchain
+    VkSampleCountFlagBits msaa_samples;
+    VkFormat depth_format;
+    VkImage depth_image;
+    VkDeviceMemory depth_image_memory;
+    VkImageView depth_image_view;
+    VkImage msaa_color_image; // only with msaa, resolved in scene_color
+    VkDeviceMemory msaa_color_image_memory;
+    VkImageView msaa_color_image_view;
+    // hdr scene, then tonemapped. Transient in subpass mode, sampled in separate passes mode.
+    VkImage scene_color_image;
+    VkDeviceMemory scene_color_image_memory;
+    VkImageView scene_color_image_view;
+    VkImage ldr_color_image;
+    VkDeviceMemory ldr_color_image_memory;
+    VkImageView ldr_color_image_view;
+    // graded, read by fxaa that writes the swapchain image
+    VkImage post_color_image;
+    VkDeviceMemory post_color_image_memory;
+    VkImageView post_color_image_view;
+    // bindless slots of the sampled ones, BINDLESS_INVALID_INDEX otherwise
+    uint32_t scene_color_index;
+    uint32_t ldr_color_index;
+    uint32_t post_color_index;
+
+    PostMode post_mode;
+    PostMode post_mode_requested; // applied at the start of the next frame
+
     uint32_t current_frame;
     /* Graphics rendering pipeline */
-    VkRenderPass render_pass;
+    VkRenderPass render_pass;          // scene + tonemap + grade subpasses
+    VkRenderPass scene_render_pass;    // scene alone, separate passes mode
+    VkRenderPass post_render_pass;     // tonemap or grade alone, separate passes mode
+    VkRenderPass present_render_pass;  // fxaa, in the swapchain image
+    VkFramebuffer scene_framebuffer;   // for the scene pass of the current post mode
+    VkFramebuffer tonemap_framebuffer; // separate passes mode only
+    VkFramebuffer grade_framebuffer;   // separate passes mode only
     VkDescriptorSetLayout descriptor_set_layout;
-    VkDescriptorPool descriptor_pool;
-    VkDescriptorSet* descriptor_sets;
+    // the sets of each frame in flight, written once for each combination of resources
+    DescriptorCache descriptor_caches[MAX_FRAMES_IN_FLIGHT];
+    BindlessTable bindless; // set 1, shared by every draw
 
     VkPipelineLayout pipeline_layout;
-    VkPipeline graphics_pipeline;
+    VkPipelineCache pipeline_cache;
+    PipelineVariantSet pipeline_variants;
+    // scene pipelines, built for the scene render pass of each mode
+    uint32_t pipeline_variant_ids[POST_MODE_COUNT][VERTEX_FETCH_COUNT][PIPELINE_KIND_COUNT];
+    VertexFetch vertex_fetch;
+
+    // set 0: the input attachment of the subpass, set 1: bindless
+    VkDescriptorSetLayout post_input_set_layout;
+    VkPipelineLayout post_pipeline_layout;
+    VkSampler post_sampler;
+    uint32_t post_variant_ids[POST_PIPELINE_COUNT];
 
     VkCommandPool graphics_command_pool;
     VkCommandBuffer* graphics_command_buffers; // free'd with their pool
@@ -182,21 +529,163 @@ typedef struct {
     VkSemaphore* image_available;
     VkSemaphore* image_ready_present;
     VkFence* in_flight;
+    uint64_t in_flight_frame_numbers[MAX_FRAMES_IN_FLIGHT]; // last frame submitted with each fence
+    // trace frame submitted with each fence, UINT32_MAX outside replays. The frame numbers drift
+    // from it when a frame bails out before its submit.
+    uint32_t in_flight_replay_frames[MAX_FRAMES_IN_FLIGHT];
+    // resources replaced at runtime, destroyed once the frames using them are done
+    DeletionQueue deletion_queue;
 
     /* Buffers */
-    VkBuffer shape_vertex_buffer;
-    VkDeviceMemory shape_vertex_buffer_memory;
-    VkBuffer shape_index_buffer;
-    VkDeviceMemory shape_index_buffer_memory;
+    // vertices and indices of every mesh, all drawn from the same two bindings
+    GeometryPool geometry_pool;
+    uint32_t square_mesh;
+    uint32_t square_mesh_packed; // the same square, as PackedVertex, for vertex pulling
+    bool staged_uploads; // even when the device local memory can be written directly
+    // the pool vertex buffer in the bindless table, registered again when compactions replace it
+    VkBuffer vertex_table_buffer;
+    uint32_t vertex_table_index;
 
     // uniforms
     VkBuffer* uniform_buffers;
     VkDeviceMemory* uniform_buffers_memory;
     void** uniform_buffers_mapped;
 
+    // materials, read from the bindless storage buffer array. The GPU table is rewritten every
+    // frame (texture indices change as textures stream in), so there is one per frame in flight.
+    VkBuffer material_buffer;
+    VkDeviceMemory material_buffer_memory;
+    Material* material_buffer_mapped;
+    uint32_t material_table_indices[MAX_FRAMES_IN_FLIGHT];
+    uint32_t material_count;
+    Material materials[MAX_MATERIALS];
+    uint32_t material_textures[MAX_MATERIALS]; // streamer handle, TEXTURE_HANDLE_NONE if none
+    uint32_t material_index;                   // the one the square is drawn with, F2 to cycle
+
+    TextureStreamer texture_streamer;
+    StaticTexture compressed_texture;
+
+    // transforms: only the nodes that moved are recomputed, and written in the GPU table of the
+    // frame. One table per frame in flight, like the materials.
+    SceneGraph scene;
+    uint32_t turntable_node; // parent of the squares, spins while animate_scene is set
+    bool animate_scene;      // F5 to toggle
+    Simulation simulation;
+    float turntable_angle;  // of the last frame, the node is only touched when it changes
+    bool simulation_moving; // the last steps sampled differ, frames would still change
+    VkBuffer transform_buffer;
+    VkDeviceMemory transform_buffer_memory;
+    mat4* transform_buffer_mapped;
+    uint32_t transform_table_indices[MAX_FRAMES_IN_FLIGHT];
+
+    // opaque draws, recorded front-to-back when sorted so early-Z rejects hidden fragments
+    uint32_t draw_count;
+    DrawItem draws[MAX_DRAWS]; // scene order
+    RenderQueue render_queue;  // recording order, rebuilt every frame
+    bool sort_draws;           // by depth, F3 to toggle
+    mat4 view; // of the last ubo, to compute the view depth of the draws
+
+    // overdraw: fragments passing the depth test per pixel, from a precise occlusion query
+    bool overdraw_query_supported;
+    VkQueryPool overdraw_queries; // one per frame in flight
+    bool overdraw_query_pending[MAX_FRAMES_IN_FLIGHT];
+    // why a pass costs what it costs: vertices, primitives and shader invocations of each pass
+    bool pipeline_statistics_supported;
+    VkQueryPool pipeline_statistics_queries; // STATISTICS_PASS_COUNT per frame in flight
+    bool pipeline_statistics_pending[MAX_FRAMES_IN_FLIGHT];
+    PipelineStatistics pipeline_statistics[STATISTICS_PASS_COUNT]; // summed since the last report
+    uint32_t pipeline_statistics_frames;
+    // replays sum the frames after the warmup instead
+    PipelineStatistics replay_statistics[STATISTICS_PASS_COUNT];
+    uint32_t replay_statistics_frames;
+    uint64_t overdraw_samples;
+    uint32_t overdraw_frames;
+    uint64_t frame_number;
+
+    // GPU time of the whole frame, from timestamps at its start and end
+    bool frame_timer_supported;
+    double timestamp_period_ns;
+    VkQueryPool frame_timestamps; // FRAME_TIMESTAMP_COUNT per frame in flight
+    bool frame_timestamps_pending[MAX_FRAMES_IN_FLIGHT];
+    double frame_time_total_ms;
+    uint32_t frame_time_frames;
+
     VkCommandPool transfer_command_pool;
     VkCommandBuffer* transfer_command_buffers;
 
+    /* Main loop pacing */
+    VkPresentModeKHR present_mode;           // of the current swapchain
+    VkPresentModeKHR present_mode_requested; // F6 to cycle, falls back to FIFO if unsupported
+    bool present_mode_changed;               // applied at the start of the next frame
+    FramePacer frame_pacer;
+    bool render_on_demand; // F7 to toggle: frames are only drawn when something changed
+    bool redraw_requested; // input since the last frame
+
+    // acquire and present, off the render thread unless --sync-present
+    PresentThread present_thread;
+    bool sync_present;
+    // every submit goes through the service of its queue. Graphics and transfer share one when
+    // they are the same VkQueue.
+    SubmitService submit_services[2];
+    SubmitService* graphics_submit;
+    SubmitService* transfer_submit;
+    // the present queue is also submitted to by a service: presents and submits one at a time
+    bool present_queue_shared;
+    pthread_mutex_t queue_mutex;
+    // render thread blocked, since the last report
+    double blocked_fence_ms;
+    double blocked_acquire_ms;
+    double blocked_present_ms;
+    uint32_t blocked_frames;
+
+    /* Capture and replay */
+    // --capture: every frame drawn goes to a trace, see trace.h
+    const char* capture_path;
+    TraceWriter capture;
+    TraceFrame capture_frame; // of the frame being prepared
+    // replay build: no window, the scene, camera and settings of each frame come from the trace
+    bool replaying;
+    TraceReader replay;
+    const TraceFrame* replay_frame;
+    uint32_t replay_frame_index; // of replay_frame in the trace
+    const TraceTransform* replay_transforms;
+    double* replay_gpu_ms; // per trace frame, negative until read
+    const char* replay_csv_path;
+    uint32_t replay_warmup_frames; // clamped by replay_loop, 0 when the trace is shorter
+
+    /* Profiling */
+    // zones of the render thread, the texture workers and the GPU, always recorded
+    Profiler profiler;
+    const char* profile_path;
+    uint64_t profile_frame_count; // of F9
+    uint64_t profile_first_frame; // window to write, frames [first, end)
+    uint64_t profile_end_frame;
+    uint64_t profile_write_frame; // once the GPU zones of the window are in, UINT64_MAX: none
+    // GPU timestamps to CLOCK_MONOTONIC: a pair of both sampled at once (calibrated timestamps),
+    // otherwise the frame is assumed to start on the GPU when it is submitted
+    bool calibrated_timestamps_supported;
+    PFN_vkGetCalibratedTimestampsEXT get_calibrated_timestamps;
+    uint64_t gpu_calibration_ticks;
+    int64_t gpu_calibration_ns;
+    int64_t frame_submit_ns[MAX_FRAMES_IN_FLIGHT];
+
+    /* HUD */
+    bool hud_enabled; // F10 to toggle, --hud to start with it
+    Hud hud;
+    VkPipelineLayout hud_pipeline_layout;
+    uint32_t hud_variant_id;
+    // one per frame in flight, persistently mapped and rewritten by each frame
+    VkBuffer hud_vertex_buffers[MAX_FRAMES_IN_FLIGHT];
+    VkDeviceMemory hud_vertex_buffers_memory[MAX_FRAMES_IN_FLIGHT];
+    HudVertex* hud_vertices[MAX_FRAMES_IN_FLIGHT];
+    uint32_t hud_vertex_count; // of the frame being recorded
+    bool hud_overflow_reported; // the cut is only printed once
+    // smoothed, see hud_smooth
+    double stage_cpu_ms[FRAME_STAGE_COUNT];
+    double gpu_scene_ms;
+    double gpu_post_ms;
+    double frame_interval_ms;
+    int64_t last_frame_start_ns;
 } SimpleVkApp;
 
 QueueFamilyIndices find_queue_families(SimpleVkApp* app, VkPhysicalDevice device) {
@@ -239,7 +728,7 @@ QueueFamilyIndices find_queue_families(SimpleVkApp* app, VkPhysicalDevice device
     return indices;
 }
 
-// WARNING: allocates memory when creating struct
+// The arrays are in the frame arena: nothing to free, but they are gone at the next frame
 SwapchainSupportDetails query_swapchain_support(SimpleVkApp* app, VkPhysicalDevice device) {
     SwapchainSupportDetails details = {0};
 
@@ -247,7 +736,8 @@ SwapchainSupportDetails query_swapchain_support(SimpleVkApp* app, VkPhysicalDevi
 
     vkGetPhysicalDeviceSurfaceFormatsKHR(device, app->surface, &(details.format_count), NULL);
     if(details.format_count != 0) {
-        details.formats = calloc(details.format_count, sizeof(VkSurfaceFormatKHR));
+        details.formats = host_frame_alloc(&(app->host_memory),
+                                           details.format_count * sizeof(VkSurfaceFormatKHR));
     }
     vkGetPhysicalDeviceSurfaceFormatsKHR(device, app->surface, &(details.format_count),
                                          details.formats);
@@ -255,7 +745,8 @@ SwapchainSupportDetails query_swapchain_support(SimpleVkApp* app, VkPhysicalDevi
     vkGetPhysicalDeviceSurfacePresentModesKHR(device, app->surface, &(details.present_mode_count),
                                               NULL);
     if(details.present_mode_count != 0) {
-        details.present_modes = calloc(details.present_mode_count, sizeof(VkPresentModeKHR));
+        details.present_modes = host_frame_alloc(
+            &(app->host_memory), details.present_mode_count * sizeof(VkPresentModeKHR));
     }
     vkGetPhysicalDeviceSurfacePresentModesKHR(device, app->surface, &(details.present_mode_count),
                                               details.present_modes);
@@ -275,14 +766,33 @@ VkSurfaceFormatKHR choose_swap_surface_format(uint32_t available_format_count,
     return available_formats[0];
 }
 
-VkPresentModeKHR choose_swap_present_mode(uint32_t available_present_mode_count,
+const char* present_mode_name(VkPresentModeKHR present_mode) {
+    switch(present_mode) {
+    case VK_PRESENT_MODE_IMMEDIATE_KHR:
+        return "immediate";
+    case VK_PRESENT_MODE_MAILBOX_KHR:
+        return "mailbox";
+    case VK_PRESENT_MODE_FIFO_KHR:
+        return "fifo";
+    case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+        return "fifo relaxed";
+    default:
+        return "unknown";
+    }
+}
+
+// FIFO is the only mode every device has to support
+VkPresentModeKHR choose_swap_present_mode(VkPresentModeKHR requested_present_mode,
+                                          uint32_t available_present_mode_count,
                                           VkPresentModeKHR* available_present_modes) {
     for(uint32_t i = 0; i < available_present_mode_count; i++) {
-        if(available_present_modes[i] == VK_PRESENT_MODE_MAILBOX_KHR) {
-            return VK_PRESENT_MODE_MAILBOX_KHR;
+        if(available_present_modes[i] == requested_present_mode) {
+            return requested_present_mode;
         }
     }
 
+    printf("present mode %s is not supported, falling back to fifo\n",
+           present_mode_name(requested_present_mode));
     return VK_PRESENT_MODE_FIFO_KHR;
 }
 
@@ -292,7 +802,13 @@ VkExtent2D choose_swap_extent(SimpleVkApp* app, VkSurfaceCapabilitiesKHR* capabi
         return capabilities->currentExtent;
     } else {
         int width, height;
-        glfwGetFramebufferSize(app->window, &width, &height);
+        if(app->replaying) {
+            // no window, the size of the capture
+            width = (int)app->replay.header.width;
+            height = (int)app->replay.header.height;
+        } else {
+            glfwGetFramebufferSize(app->window, &width, &height);
+        }
 
         VkExtent2D actual_extent = {(uint32_t)width, (uint32_t)height};
         actual_extent.width = actual_extent.width < capabilities->maxImageExtent.width
@@ -319,12 +835,98 @@ void framebuffer_resized_callback(GLFWwindow* window, int height, int width) {
     return;
 }
 
+// the window was uncovered or restored, and its content lost
+void window_refresh_callback(GLFWwindow* window) {
+    SimpleVkApp* app_pointer = (SimpleVkApp*)glfwGetWindowUserPointer(window);
+    app_pointer->redraw_requested = true;
+}
+
+// Frames [first_frame, end_frame) go to the profile path once the GPU is done with them
+void request_profile(SimpleVkApp* app, uint64_t first_frame, uint64_t end_frame) {
+    app->profile_first_frame = first_frame;
+    app->profile_end_frame = end_frame;
+    app->profile_write_frame = end_frame + MAX_FRAMES_IN_FLIGHT;
+}
+
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+    SimpleVkApp* app_pointer = (SimpleVkApp*)glfwGetWindowUserPointer(window);
+    if(action != GLFW_PRESS) {
+        return;
+    }
+    app_pointer->redraw_requested = true;
+    switch(key) {
+    case GLFW_KEY_F1:
+        app_pointer->debug_view = (app_pointer->debug_view + 1) % DEBUG_VIEW_COUNT;
+        break;
+    case GLFW_KEY_F2:
+        app_pointer->material_index =
+            (app_pointer->material_index + 1) % app_pointer->material_count;
+        break;
+    case GLFW_KEY_F3:
+        app_pointer->sort_draws = !app_pointer->sort_draws;
+        printf("draw sorting %s\n", app_pointer->sort_draws ? "on" : "off");
+        break;
+    case GLFW_KEY_F4:
+        // needs new render targets, so not done in the middle of a frame
+        app_pointer->post_mode_requested = (app_pointer->post_mode + 1) % POST_MODE_COUNT;
+        break;
+    case GLFW_KEY_F5:
+        // a still scene should cost (almost) nothing to update, check the scene graph stats
+        app_pointer->animate_scene = !app_pointer->animate_scene;
+        simulation_set_animating(&(app_pointer->simulation), app_pointer->animate_scene);
+        printf("scene animation %s\n", app_pointer->animate_scene ? "on" : "off");
+        break;
+    case GLFW_KEY_F6:
+        // the swapchain is recreated for it, like for F4
+        switch(app_pointer->present_mode_requested) {
+        case VK_PRESENT_MODE_FIFO_KHR:
+            app_pointer->present_mode_requested = VK_PRESENT_MODE_MAILBOX_KHR;
+            break;
+        case VK_PRESENT_MODE_MAILBOX_KHR:
+            app_pointer->present_mode_requested = VK_PRESENT_MODE_IMMEDIATE_KHR;
+            break;
+        default:
+            app_pointer->present_mode_requested = VK_PRESENT_MODE_FIFO_KHR;
+            break;
+        }
+        app_pointer->present_mode_changed = true;
+        break;
+    case GLFW_KEY_F7:
+        app_pointer->render_on_demand = !app_pointer->render_on_demand;
+        printf("rendering %s\n", app_pointer->render_on_demand ? "on demand" : "continuously");
+        break;
+    case GLFW_KEY_F8:
+        // only the pipeline changes, compare the GPU frame times of both
+        app_pointer->vertex_fetch = (app_pointer->vertex_fetch + 1) % VERTEX_FETCH_COUNT;
+        app_pointer->frame_time_total_ms = 0.0;
+        app_pointer->frame_time_frames = 0;
+        printf("%s vertex fetch\n",
+               app_pointer->vertex_fetch == VERTEX_FETCH_PULLED ? "pulled" : "fixed-function");
+        break;
+    case GLFW_KEY_F9:
+        // the last frames, up to the one being drawn
+        request_profile(app_pointer,
+                        app_pointer->frame_number > app_pointer->profile_frame_count
+                            ? app_pointer->frame_number - app_pointer->profile_frame_count
+                            : 0,
+                        app_pointer->frame_number);
+        break;
+    case GLFW_KEY_F10:
+        app_pointer->hud_enabled = !app_pointer->hud_enabled;
+        break;
+    default:
+        break;
+    }
+}
+
 void init_window(SimpleVkApp* app) {
     glfwInit();
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
     app->window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, "jubilant", NULL, NULL);
     glfwSetWindowUserPointer(app->window, app); // set userdata for window
     glfwSetFramebufferSizeCallback(app->window, framebuffer_resized_callback);
+    glfwSetKeyCallback(app->window, key_callback);
+    glfwSetWindowRefreshCallback(app->window, window_refresh_callback);
 }
 
 /* VkInstance CREATION *********************************************/
@@ -392,7 +994,8 @@ void setup_debug_messenger(SimpleVkApp* app) {
         (PFN_vkCreateDebugUtilsMessengerEXT)vkGetInstanceProcAddr(app->instance,
                                                                   "vkCreateDebugUtilsMessengerEXT");
     if(function != NULL) {
-        if(function(app->instance, &create_info, NULL, &(app->debug_messenger)) != VK_SUCCESS) {
+        if(function(app->instance, &create_info, app->allocator,
+                    &(app->debug_messenger)) != VK_SUCCESS) {
             printf("failed to setup debug messager");
         }
     } else {
@@ -428,16 +1031,22 @@ bool check_validation_layer_support() {
 /* Instance Creation *****************/
 
 void get_required_extensions(uint32_t* nb_extensions, const char** required_extensions,
-                             bool validation_layers_available) {
-    uint32_t nb_glfw_extensions;
-    const char** glfw_extensions = glfwGetRequiredInstanceExtensions(&nb_glfw_extensions);
-    *nb_extensions = nb_glfw_extensions;
-    for(size_t i = 0; i < nb_glfw_extensions; i++) {
-        required_extensions[i] = glfw_extensions[i];
+                             bool validation_layers_available, bool headless) {
+    // without a window, the swapchain presents to a headless surface
+    static const char* headless_extensions[] = {VK_KHR_SURFACE_EXTENSION_NAME,
+                                                VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME};
+    uint32_t nb_surface_extensions = 2;
+    const char** surface_extensions = headless_extensions;
+    if(!headless) {
+        surface_extensions = glfwGetRequiredInstanceExtensions(&nb_surface_extensions);
+    }
+    *nb_extensions = nb_surface_extensions;
+    for(size_t i = 0; i < nb_surface_extensions; i++) {
+        required_extensions[i] = surface_extensions[i];
     }
     if(ENABLE_VALIDATION_LAYERS && validation_layers_available) {
         *nb_extensions += 1;
-        required_extensions[nb_glfw_extensions] = VK_EXT_DEBUG_UTILS_EXTENSION_NAME;
+        required_extensions[nb_surface_extensions] = VK_EXT_DEBUG_UTILS_EXTENSION_NAME;
     }
 }
 
@@ -467,7 +1076,7 @@ void create_instance(SimpleVkApp* app) {
     // Fetch required extensions: count and their names
     const char* enabled_extensions[255];
     get_required_extensions(&(create_info.enabledExtensionCount), enabled_extensions,
-                            app->validation_layers_available);
+                            app->validation_layers_available, app->replaying);
     create_info.ppEnabledExtensionNames = enabled_extensions;
 
     // Request validation layers
@@ -479,7 +1088,7 @@ void create_instance(SimpleVkApp* app) {
         create_info.pNext = &debug_create_info;
     }
 
-    VkResult result = vkCreateInstance(&create_info, NULL, &(app->instance));
+    VkResult result = vkCreateInstance(&create_info, app->allocator, &(app->instance));
     if(result != VK_SUCCESS) {
         printf("failed to create instance\n");
     }
@@ -507,15 +1116,50 @@ bool check_device_extension_support(VkPhysicalDevice device) {
     return all_required_present;
 }
 
-bool is_device_suitable(SimpleVkApp* app, VkPhysicalDevice device) {
-    // Properties: name, type, supported vulkan version...
-    VkPhysicalDeviceProperties device_properties;
-    vkGetPhysicalDeviceProperties(device, &device_properties);
+bool device_extension_available(VkPhysicalDevice device, const char* name) {
+    uint32_t extension_count;
+    vkEnumerateDeviceExtensionProperties(device, NULL, &extension_count, NULL);
+    VkExtensionProperties available_extensions[extension_count];
+    vkEnumerateDeviceExtensionProperties(device, NULL, &extension_count, available_extensions);
+    for(uint32_t i = 0; i < extension_count; i++) {
+        if(strcmp(available_extensions[i].extensionName, name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// A format is only worth using if it can be uploaded to, sampled and filtered
+void query_compressed_format_support(VkPhysicalDevice device,
+                                     bool supported[KTX2_COMPRESSED_FORMAT_COUNT]) {
+    VkFormatFeatureFlags required = VK_FORMAT_FEATURE_TRANSFER_DST_BIT |
+                                    VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT |
+                                    VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    for(size_t i = 0; i < KTX2_COMPRESSED_FORMAT_COUNT; i++) {
+        VkFormatProperties properties = {0};
+        vkGetPhysicalDeviceFormatProperties(device, KTX2_COMPRESSED_FORMATS[i], &properties);
+        supported[i] = (properties.optimalTilingFeatures & required) == required;
+    }
+}
 
-    // Texture compression, 64 bits floats, multi viewport rendering...
-    VkPhysicalDeviceFeatures device_features;
-    vkGetPhysicalDeviceFeatures(device, &device_features);
+// Any type of device can run the app: integrated GPUs and CPU implementations are where the
+// geometry pool writes meshes in place. When there are several, the fastest kind is preferred.
+uint32_t device_type_rank(VkPhysicalDeviceType type) {
+    switch(type) {
+    case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+        return 4;
+    case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+        return 3;
+    case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+        return 2;
+    case VK_PHYSICAL_DEVICE_TYPE_CPU:
+        return 1;
+    default:
+        return 0;
+    }
+}
 
+bool is_device_suitable(SimpleVkApp* app, VkPhysicalDevice device) {
     bool extension_supported;
     bool swapchain_adequate = false;
 
@@ -524,21 +1168,14 @@ bool is_device_suitable(SimpleVkApp* app, VkPhysicalDevice device) {
         SwapchainSupportDetails swapchain_support = query_swapchain_support(app, device);
         swapchain_adequate =
             (swapchain_support.format_count != 0) && (swapchain_support.present_mode_count != 0);
-        if(swapchain_adequate) {
-            free(swapchain_support.formats);
-            free(swapchain_support.present_modes);
-        }
     }
 
-    if(device_properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU &&
-       device_features.geometryShader &&
-       is_queue_family_complete(find_queue_families(app, device)) && extension_supported &&
-       swapchain_adequate) {
+    // descriptor indexing is core since 1.2, but its features are still optional
+    bool bindless_supported = bindless_is_supported(device);
 
-        printf("device %s is suitable\n", device_properties.deviceName);
-        return true;
-    }
-    return false;
+    // optional features (texture compression, queries, ...) are enabled when supported
+    return is_queue_family_complete(find_queue_families(app, device)) && extension_supported &&
+           swapchain_adequate && bindless_supported;
 }
 
 void pick_physical_device(SimpleVkApp* app) {
@@ -550,16 +1187,53 @@ void pick_physical_device(SimpleVkApp* app) {
     }
     VkPhysicalDevice devices[device_count];
     vkEnumeratePhysicalDevices(app->instance, &device_count, devices);
+    uint32_t best_rank = 0;
     for(size_t i = 0; i < device_count; i++) {
-        if(is_device_suitable(app, devices[i])) {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(devices[i], &properties);
+        uint32_t rank = device_type_rank(properties.deviceType);
+        if((app->physical_device == VK_NULL_HANDLE || rank > best_rank) &&
+           is_device_suitable(app, devices[i])) {
             app->physical_device = devices[i];
-            break;
+            best_rank = rank;
         }
     }
 
     if(app->physical_device == VK_NULL_HANDLE) {
         printf("no suitable GPU found\n");
+        return;
+    }
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(app->physical_device, &properties);
+    printf("device %s is suitable\n", properties.deviceName);
+    // not required: textures in a missing format are transcoded on the CPU when loaded
+    query_compressed_format_support(app->physical_device, app->compressed_format_supported);
+}
+
+// Calibrated timestamps are only useful if the GPU clock can be sampled with CLOCK_MONOTONIC, the
+// clock of the profiler
+bool monotonic_time_domain_available(SimpleVkApp* app) {
+    if(!device_extension_available(app->physical_device,
+                                   VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME)) {
+        return false;
+    }
+    PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT function =
+        (PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT)vkGetInstanceProcAddr(
+            app->instance, "vkGetPhysicalDeviceCalibrateableTimeDomainsEXT");
+    if(function == NULL) {
+        return false;
+    }
+    uint32_t domain_count = 0;
+    function(app->physical_device, &domain_count, NULL);
+    VkTimeDomainEXT domains[domain_count > 0 ? domain_count : 1];
+    function(app->physical_device, &domain_count, domains);
+    bool device_domain = false;
+    bool monotonic_domain = false;
+    for(uint32_t i = 0; i < domain_count; i++) {
+        device_domain |= domains[i] == VK_TIME_DOMAIN_DEVICE_EXT;
+        monotonic_domain |= domains[i] == VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT;
     }
+    return device_domain && monotonic_domain;
 }
 
 void create_logical_device(SimpleVkApp* app) {
@@ -581,14 +1255,45 @@ void create_logical_device(SimpleVkApp* app) {
         all_queues_create_infos[i] = queue_create_info;
     }
 
+    VkPhysicalDeviceFeatures supported_features;
+    vkGetPhysicalDeviceFeatures(app->physical_device, &supported_features);
     VkPhysicalDeviceFeatures device_features = {0};
+    device_features.textureCompressionBC = supported_features.textureCompressionBC;
+    device_features.textureCompressionASTC_LDR = supported_features.textureCompressionASTC_LDR;
+    // only used to measure overdraw: without it, occlusion queries may only say zero or not zero
+    device_features.occlusionQueryPrecise = supported_features.occlusionQueryPrecise;
+    app->overdraw_query_supported = supported_features.occlusionQueryPrecise;
+    // only used to report what each pass does, nothing depends on it
+    device_features.pipelineStatisticsQuery = supported_features.pipelineStatisticsQuery;
+    app->pipeline_statistics_supported = supported_features.pipelineStatisticsQuery;
+    // newer features are enabled through structs chained in pNext
+    VkPhysicalDeviceVulkan12Features device_features_12 = {0};
+    device_features_12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    bindless_enable_features(&device_features_12);
+
     VkDeviceCreateInfo create_info = {0};
     create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    create_info.pNext = &device_features_12;
     create_info.queueCreateInfoCount = unique_indices_count;
     create_info.pQueueCreateInfos = all_queues_create_infos;
     create_info.pEnabledFeatures = &device_features;
-    create_info.enabledExtensionCount = NB_REQUIRED_DEVICE_EXTENSIONS;
-    create_info.ppEnabledExtensionNames = REQUIRED_DEVICE_EXTENSIONS;
+    // optional extensions go after the required ones
+    const char* enabled_extensions[NB_REQUIRED_DEVICE_EXTENSIONS + 2];
+    memcpy(enabled_extensions, REQUIRED_DEVICE_EXTENSIONS, sizeof(REQUIRED_DEVICE_EXTENSIONS));
+    uint32_t enabled_extension_count = NB_REQUIRED_DEVICE_EXTENSIONS;
+    app->memory_budget_supported =
+        device_extension_available(app->physical_device, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    if(app->memory_budget_supported) {
+        enabled_extensions[enabled_extension_count++] = VK_EXT_MEMORY_BUDGET_EXTENSION_NAME;
+    }
+    // GPU zones of the profiler on the CPU timeline
+    app->calibrated_timestamps_supported = monotonic_time_domain_available(app);
+    if(app->calibrated_timestamps_supported) {
+        enabled_extensions[enabled_extension_count++] =
+            VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME;
+    }
+    create_info.enabledExtensionCount = enabled_extension_count;
+    create_info.ppEnabledExtensionNames = enabled_extensions;
 
     // instance and device specific validation layers used to be separate. This is no longer the
     // case, and I don't really care about older implementations compatibility, so the code is left
@@ -598,7 +1303,8 @@ void create_logical_device(SimpleVkApp* app) {
     //     create_info.enabledLayerCount = NB_VALIDATION_LAYERS;
     //     create_info.ppEnabledLayerNames = VALIDATION_LAYERS;
     // }
-    if(vkCreateDevice(app->physical_device, &create_info, NULL, &(app->device)) != VK_SUCCESS) {
+    if(vkCreateDevice(app->physical_device, &create_info, app->allocator,
+                      &(app->device)) != VK_SUCCESS) {
         printf("failed to create logical device \n");
     }
 
@@ -607,10 +1313,76 @@ void create_logical_device(SimpleVkApp* app) {
     vkGetDeviceQueue(app->device, indices.transfer_family, 0, &(app->transfer_queue));
 }
 
+// From here on, only the submitter threads (and the present thread) touch the queues
+void create_submit_services(SimpleVkApp* app) {
+    app->present_queue_shared = app->present_queue == app->graphics_queue ||
+                                app->present_queue == app->transfer_queue;
+    pthread_mutex_init(&(app->queue_mutex), NULL);
+    pthread_mutex_t* graphics_mutex =
+        app->present_queue == app->graphics_queue ? &(app->queue_mutex) : NULL;
+    pthread_mutex_t* transfer_mutex =
+        app->present_queue == app->transfer_queue ? &(app->queue_mutex) : NULL;
+
+    app->graphics_submit = app->submit_services;
+    submit_service_create(app->graphics_submit, "graphics", app->graphics_queue, graphics_mutex);
+    if(app->transfer_queue == app->graphics_queue) {
+        app->transfer_submit = app->graphics_submit;
+    } else {
+        app->transfer_submit = app->submit_services + 1;
+        submit_service_create(app->transfer_submit, "transfer", app->transfer_queue,
+                              transfer_mutex);
+    }
+}
+
+void destroy_submit_services(SimpleVkApp* app) {
+    if(app->transfer_submit != app->graphics_submit) {
+        submit_service_destroy(app->transfer_submit);
+    }
+    submit_service_destroy(app->graphics_submit);
+    pthread_mutex_destroy(&(app->queue_mutex));
+}
+
+/* Memory tracking *******************/
+
+void on_memory_pressure(uint32_t heap, VkDeviceSize usage, VkDeviceSize budget, void* user_data) {
+    (void)user_data;
+    // the texture streamer backs off on its own, see gpu_memory_headroom
+    printf("memory heap %u is almost full: %.1f / %.1f MiB\n", heap,
+           (double)usage / (1024.0 * 1024.0), (double)budget / (1024.0 * 1024.0));
+}
+
+void create_host_memory(SimpleVkApp* app) {
+    host_memory_create(&(app->host_memory), FRAME_ARENA_SIZE);
+    app->allocator = &(app->host_memory.callbacks);
+}
+
+void create_memory_tracker(SimpleVkApp* app) {
+    gpu_memory_tracker_create(&(app->memory), app->device, app->physical_device, app->allocator,
+                              app->memory_budget_supported);
+    gpu_memory_set_pressure_callback(&(app->memory), MEMORY_PRESSURE_RATIO, on_memory_pressure,
+                                     app);
+    // kill -USR1 <pid> prints where the memory goes
+    gpu_memory_dump_on_signal(SIGUSR1);
+}
+
 /* Window surface creation ***********/
 
 void create_surface(SimpleVkApp* app) {
-    if(glfwCreateWindowSurface(app->instance, app->window, NULL, &(app->surface)) != VK_SUCCESS) {
+    if(app->replaying) {
+        VkHeadlessSurfaceCreateInfoEXT create_info = {0};
+        create_info.sType = VK_STRUCTURE_TYPE_HEADLESS_SURFACE_CREATE_INFO_EXT;
+        // in an extension, loaded manually like the debug messenger
+        PFN_vkCreateHeadlessSurfaceEXT function =
+            (PFN_vkCreateHeadlessSurfaceEXT)vkGetInstanceProcAddr(app->instance,
+                                                                  "vkCreateHeadlessSurfaceEXT");
+        if(function == NULL ||
+           function(app->instance, &create_info, app->allocator, &(app->surface)) != VK_SUCCESS) {
+            printf("failed to create headless surface\n");
+        }
+        return;
+    }
+    if(glfwCreateWindowSurface(app->instance, app->window, app->allocator,
+                               &(app->surface)) != VK_SUCCESS) {
         printf("failed to create window surface");
     }
 }
@@ -622,13 +1394,16 @@ void create_swapchain(SimpleVkApp* app) {
 
     VkSurfaceFormatKHR surface_format =
         choose_swap_surface_format(swapchain_support.format_count, swapchain_support.formats);
-    VkPresentModeKHR present_mode = choose_swap_present_mode(swapchain_support.present_mode_count,
-                                                             swapchain_support.present_modes);
+    VkPresentModeKHR present_mode =
+        choose_swap_present_mode(app->present_mode_requested, swapchain_support.present_mode_count,
+                                 swapchain_support.present_modes);
+    if(present_mode != app->present_mode || app->swapchain == VK_NULL_HANDLE) {
+        printf("presenting in %s mode\n", present_mode_name(present_mode));
+    }
+    app->present_mode = present_mode;
+    app->present_mode_changed = false;
     VkExtent2D extent = choose_swap_extent(app, &(swapchain_support.capabilities));
 
-    free(swapchain_support.formats);
-    free(swapchain_support.present_modes);
-
     // add an extra image if the driver has to handle some internal op or smtg
     uint32_t image_count = swapchain_support.capabilities.minImageCount + 1;
     if(swapchain_support.capabilities.maxImageCount > 0 &&
@@ -673,13 +1448,16 @@ void create_swapchain(SimpleVkApp* app) {
 
     // if the swap chain is changed, if e.g. window is resized, it might become unoptimized and
     // needs to be recreated from scratch and a ref to the old one must be specified.
-    create_info.oldSwapchain = VK_NULL_HANDLE;
-    if(vkCreateSwapchainKHR(app->device, &create_info, NULL, &(app->swapchain)) != VK_SUCCESS) {
+    create_info.oldSwapchain = app->swapchain; // VK_NULL_HANDLE the first time
+    if(vkCreateSwapchainKHR(app->device, &create_info, app->allocator,
+                            &(app->swapchain)) != VK_SUCCESS) {
         printf("failed to create swapchain\n");
     }
 
     vkGetSwapchainImagesKHR(app->device, app->swapchain, &(app->swapchain_image_count), NULL);
-    app->swapchain_images = calloc(app->swapchain_image_count, sizeof(VkImage));
+    app->swapchain_images = host_alloc(&(app->host_memory),
+                                       app->swapchain_image_count * sizeof(VkImage),
+                                       HOST_SCOPE_SWAPCHAIN);
     vkGetSwapchainImagesKHR(app->device, app->swapchain, &(app->swapchain_image_count),
                             app->swapchain_images);
 
@@ -688,7 +1466,9 @@ void create_swapchain(SimpleVkApp* app) {
 }
 
 void create_image_views(SimpleVkApp* app) {
-    app->swapchain_images_views = calloc(app->swapchain_image_count, sizeof(VkImageView));
+    app->swapchain_images_views = host_alloc(&(app->host_memory),
+                                             app->swapchain_image_count * sizeof(VkImageView),
+                                             HOST_SCOPE_SWAPCHAIN);
 
     for(size_t i = 0; i < app->swapchain_image_count; i++) {
         VkImageViewCreateInfo create_info = {0};
@@ -709,8 +1489,8 @@ void create_image_views(SimpleVkApp* app) {
         create_info.subresourceRange.levelCount = 1;
         create_info.subresourceRange.baseArrayLayer = 0;
         create_info.subresourceRange.layerCount = 1;
-        if(vkCreateImageView(app->device, &create_info, NULL, &(app->swapchain_images_views[i])) !=
-           VK_SUCCESS) {
+        if(vkCreateImageView(app->device, &create_info, app->allocator,
+                             &(app->swapchain_images_views[i])) != VK_SUCCESS) {
             printf("failed to create image view %zu", i);
         }
     }
@@ -719,7 +1499,7 @@ void create_image_views(SimpleVkApp* app) {
 /* Graphics pipeline *****************/
 
 /* Shader loading */
-uint32_t* read_spirv_file(size_t* buffer_size, const char* path) {
+uint32_t* read_spirv_file(SimpleVkApp* app, size_t* buffer_size, const char* path) {
     FILE* file = fopen(path, "rb");
     if(!file) {
         printf("failed to open shader file %s\n", path);
@@ -738,7 +1518,12 @@ uint32_t* read_spirv_file(size_t* buffer_size, const char* path) {
     }
     *buffer_size = file_size / sizeof(uint32_t);
 
-    uint32_t* buffer = calloc(*buffer_size, sizeof(uint32_t));
+    uint32_t* buffer =
+        host_calloc(&(app->host_memory), *buffer_size, sizeof(uint32_t), HOST_SCOPE_APP);
+    if(buffer == NULL) {
+        fclose(file);
+        return NULL;
+    }
     fread(buffer, sizeof(uint32_t), *buffer_size, file);
     fclose(file);
 
@@ -752,220 +1537,448 @@ VkShaderModule create_shader_module(SimpleVkApp* app, size_t code_buffer_size, u
     create_info.pCode = code;
 
     VkShaderModule shader_module;
-    if(vkCreateShaderModule(app->device, &create_info, NULL, &shader_module) != VK_SUCCESS) {
+    if(vkCreateShaderModule(app->device, &create_info, app->allocator,
+                            &shader_module) != VK_SUCCESS) {
         printf("failed to create shader module\n");
     }
     return shader_module;
 }
 
+void create_pipeline_cache(SimpleVkApp* app) {
+    // Shared by every pipeline variant. Compiling against a cache lets the driver skip the
+    // backend compilation of state it has already seen.
+    VkPipelineCacheCreateInfo cache_info = {0};
+    cache_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    cache_info.initialDataSize = 0;
+    cache_info.pInitialData = NULL;
+    if(vkCreatePipelineCache(app->device, &cache_info, app->allocator, &(app->pipeline_cache)) !=
+       VK_SUCCESS) {
+        printf("failed to create pipeline cache\n");
+    }
+}
+
 void create_graphics_pipeline(SimpleVkApp* app) {
 
     /* SHADERS */
     size_t vertex_shader_code_buffer_size = 0;
     uint32_t* vertex_shader_code =
-        read_spirv_file(&vertex_shader_code_buffer_size, MAKE_SHADER_PATH("out/vert.spv"));
+        read_spirv_file(app, &vertex_shader_code_buffer_size, MAKE_SHADER_PATH("out/vert.spv"));
     VkShaderModule vertex_shader_module =
         create_shader_module(app, vertex_shader_code_buffer_size, vertex_shader_code);
-    free(vertex_shader_code);
+    host_free(&(app->host_memory), vertex_shader_code);
 
     size_t fragment_shader_code_buffer_size = 0;
     uint32_t* fragment_shader_code =
-        read_spirv_file(&fragment_shader_code_buffer_size, MAKE_SHADER_PATH("out/frag.spv"));
+        read_spirv_file(app, &fragment_shader_code_buffer_size, MAKE_SHADER_PATH("out/frag.spv"));
     VkShaderModule fragment_shader_module =
         create_shader_module(app, fragment_shader_code_buffer_size, fragment_shader_code);
-    free(fragment_shader_code);
-
-    VkPipelineShaderStageCreateInfo vertex_shader_stage_create_info = {0};
-    vertex_shader_stage_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    vertex_shader_stage_create_info.stage = VK_SHADER_STAGE_VERTEX_BIT;
-    vertex_shader_stage_create_info.module = vertex_shader_module;
-    vertex_shader_stage_create_info.pName = "main";
-
-    VkPipelineShaderStageCreateInfo fragment_shader_stage_create_info = {0};
-    fragment_shader_stage_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    fragment_shader_stage_create_info.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-    fragment_shader_stage_create_info.module = fragment_shader_module;
-    fragment_shader_stage_create_info.pName = "main";
-
-    VkPipelineShaderStageCreateInfo shader_stages[] = {vertex_shader_stage_create_info,
-                                                       fragment_shader_stage_create_info};
-
-    /* Dynamic state */
-    // Some stuff can be dynamically changed without recreating the pipeline, eg: size of the
-    // viewport, line width, blend constants. But we need to choose which one before building it.
-    // The chosen states will then be ignored from the config
-    VkDynamicState dynamic_states[2] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
-    VkPipelineDynamicStateCreateInfo dynamic_state = {0};
-    dynamic_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-    dynamic_state.dynamicStateCount = 2;
-    dynamic_state.pDynamicStates = dynamic_states;
-
-    /* Vertex input */
-    // Describes how the data is passed to the vertex shader: bindings, ie per vertex or per
-    // instance. Also describes the attribute passed, offset etc
-    VkPipelineVertexInputStateCreateInfo vertex_input_info = {0};
-    vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-
-    VkVertexInputBindingDescription binding_description = get_binding_description();
-    VkVertexInputAttributeDescription attribute_descriptions[NB_VERTEX_ATTRIBUTES];
-    get_attribute_description(attribute_descriptions);
-
-    vertex_input_info.vertexBindingDescriptionCount = 1;
-    vertex_input_info.vertexAttributeDescriptionCount = NB_VERTEX_ATTRIBUTES;
-    vertex_input_info.pVertexBindingDescriptions = &binding_description;
-    vertex_input_info.pVertexAttributeDescriptions = attribute_descriptions;
-
-    /* Input assembly */
-    // What kind of geometry will be drawn from the vertices, and if primitive restart should be
-    // enabled.
-    VkPipelineInputAssemblyStateCreateInfo input_assembly = {0};
-    input_assembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-    input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-    input_assembly.primitiveRestartEnable = VK_FALSE;
-
-    /* Viewports, scissors */
-    // Viewports describes the region of the framebuffer that the output will be rendered to
-    VkViewport viewport = {0};
-    viewport.x = 0.0f;
-    viewport.y = 0.0f;
-    viewport.width = (float)app->swapchain_extent.width;
-    viewport.height = (float)app->swapchain_extent.height;
-    viewport.minDepth = 0.0f;
-    viewport.maxDepth = 0.0f;
-    // Scissors describes in whic regions pixels will actually be stored. Kinda like a filter
-    VkRect2D scissor = {0};
-    scissor.offset = (VkOffset2D){0, 0};
-    scissor.extent = app->swapchain_extent;
-    VkPipelineViewportStateCreateInfo viewport_state = {0};
-    viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-    viewport_state.viewportCount = 1;
-    viewport_state.pViewports = &viewport;
-    viewport_state.scissorCount = 1;
-    viewport_state.pScissors = &scissor;
-
-    /* Rasterizer */
-    VkPipelineRasterizationStateCreateInfo rasterizer = {0};
-    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-    // clamp fragments beyond far & near plane to them instead of discarding. See shadow maps
-    rasterizer.depthClampEnable = VK_FALSE;
-    // If true: nothing passes through, basically disabling it
-    rasterizer.rasterizerDiscardEnable = VK_FALSE;
-    rasterizer.polygonMode = VK_POLYGON_MODE_FILL; // Fill, line or point
-    rasterizer.lineWidth = 1.0f;                   // is number of fragment
-    // Face culling
-    rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-    rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-
-    /* Multisampling */ // disabled for now
-    VkPipelineMultisampleStateCreateInfo multisampling = {0};
-    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-    multisampling.sampleShadingEnable = VK_FALSE;
-    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-    multisampling.minSampleShading = 1.0f;          // Optional
-    multisampling.pSampleMask = NULL;               // Optional
-    multisampling.alphaToCoverageEnable = VK_FALSE; // Optional
-    multisampling.alphaToOneEnable = VK_FALSE;      // Optional
-
-    /* Color blending */
-    // describes how the colors are blended
-    // Attachment state is per attached framebuffer, and the other is for the global blending
-    // settings.
-    VkPipelineColorBlendAttachmentState color_blend_attachment = {0};
-    color_blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
-                                            VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-    color_blend_attachment.blendEnable = VK_FALSE;
-    color_blend_attachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;  // Optional
-    color_blend_attachment.dstColorBlendFactor = VK_BLEND_FACTOR_ZERO; // Optional
-    color_blend_attachment.colorBlendOp = VK_BLEND_OP_ADD;             // Optional
-    color_blend_attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;  // Optional
-    color_blend_attachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO; // Optional
-    color_blend_attachment.alphaBlendOp = VK_BLEND_OP_ADD;             // Optional
-
-    VkPipelineColorBlendStateCreateInfo color_blending = {0};
-    color_blending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-    color_blending.logicOpEnable = VK_FALSE;
-    color_blending.logicOp = VK_LOGIC_OP_COPY; // Optional
-    color_blending.attachmentCount = 1;
-    color_blending.pAttachments = &color_blend_attachment;
-    color_blending.blendConstants[0] = 0.0f; // Optional
-    color_blending.blendConstants[1] = 0.0f; // Optional
-    color_blending.blendConstants[2] = 0.0f; // Optional
-    color_blending.blendConstants[3] = 0.0f; // Optional
+    host_free(&(app->host_memory), fragment_shader_code);
+
+    vertex_shader_code = read_spirv_file(app, &vertex_shader_code_buffer_size,
+                                         MAKE_SHADER_PATH("out/vert_pulled.spv"));
+    VkShaderModule pulled_vertex_shader_module =
+        create_shader_module(app, vertex_shader_code_buffer_size, vertex_shader_code);
+    host_free(&(app->host_memory), vertex_shader_code);
 
     /* Pipeline layout */
+    // set 0: per frame data, set 1: bindless resources
+    VkDescriptorSetLayout set_layouts[2] = {app->descriptor_set_layout, app->bindless.layout};
+    // push constants are the cheapest way to pass the few indices a draw needs
+    VkPushConstantRange push_constant_range = {0};
+    push_constant_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+    push_constant_range.offset = 0;
+    push_constant_range.size = sizeof(PushConstants);
+
     VkPipelineLayoutCreateInfo pipeline_layout_info = {0};
     pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipeline_layout_info.setLayoutCount = 1;
-    pipeline_layout_info.pSetLayouts = &(app->descriptor_set_layout);
-    pipeline_layout_info.pushConstantRangeCount = 0;
-    pipeline_layout_info.pPushConstantRanges = NULL;
+    pipeline_layout_info.setLayoutCount = 2;
+    pipeline_layout_info.pSetLayouts = set_layouts;
+    pipeline_layout_info.pushConstantRangeCount = 1;
+    pipeline_layout_info.pPushConstantRanges = &push_constant_range;
 
-    if(vkCreatePipelineLayout(app->device, &pipeline_layout_info, NULL, &(app->pipeline_layout)) !=
-       VK_SUCCESS) {
+    if(vkCreatePipelineLayout(app->device, &pipeline_layout_info, app->allocator,
+                              &(app->pipeline_layout)) != VK_SUCCESS) {
         printf("failed to create pipeline layout \n");
     }
 
-    VkGraphicsPipelineCreateInfo pipeline_info = {0};
-    pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    /* Shader stages */
-    pipeline_info.stageCount = 2; // vertex and fragment
-    pipeline_info.pStages = shader_stages;
-    pipeline_info.pVertexInputState = &vertex_input_info;
-    /* Fixed-function stages */
-    pipeline_info.pInputAssemblyState = &input_assembly;
-    pipeline_info.pViewportState = &viewport_state;
-    pipeline_info.pRasterizationState = &rasterizer;
-    pipeline_info.pMultisampleState = &multisampling;
-    pipeline_info.pDepthStencilState = NULL;
-    pipeline_info.pColorBlendState = &color_blending;
-    pipeline_info.pDynamicState = &dynamic_state;
-    /* layout */
-    pipeline_info.layout = app->pipeline_layout;
-    /* render pass and the index of the sub pass where the graphics pipeline will be used */
-    pipeline_info.renderPass = app->render_pass;
-    pipeline_info.subpass = 0;
-    /* Can derive pipelines from existing one: the idea is that it is cheaper to swap when you have
-     * a lot of common points to begin with*/
-    pipeline_info.basePipelineHandle = VK_NULL_HANDLE; // Optional
-    pipeline_info.basePipelineIndex = -1;              // Optional
-
-    // Second handle can be used to cache data and reuse it for several pipelines.
-    if(vkCreateGraphicsPipelines(app->device, VK_NULL_HANDLE, 1, &pipeline_info, NULL,
-                                 &(app->graphics_pipeline)) != VK_SUCCESS) {
-        printf("failed to create graphics pipeline");
-    }
-
-    vkDestroyShaderModule(app->device, vertex_shader_module, NULL);
-    vkDestroyShaderModule(app->device, fragment_shader_module, NULL);
+    // post-processing: set 0 is the input attachment of the subpass, set 1 the bindless table
+    VkDescriptorSetLayout post_set_layouts[2] = {app->post_input_set_layout,
+                                                 app->bindless.layout};
+    VkPushConstantRange post_push_constant_range = {0};
+    post_push_constant_range.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    post_push_constant_range.offset = 0;
+    post_push_constant_range.size = sizeof(PostPushConstants);
+    pipeline_layout_info.pSetLayouts = post_set_layouts;
+    pipeline_layout_info.pPushConstantRanges = &post_push_constant_range;
+    if(vkCreatePipelineLayout(app->device, &pipeline_layout_info, app->allocator,
+                              &(app->post_pipeline_layout)) != VK_SUCCESS) {
+        printf("failed to create post-processing pipeline layout \n");
+    }
+
+    /* Variants */
+    // The fixed-function state lives in pipeline_variants.c; here we only describe what differs
+    // from one pipeline to the other. Identical descriptions end up sharing the same pipeline.
+    // The scene is drawn in a different render pass depending on the post mode, so every scene
+    // pipeline exists once per mode, and once more with vertex pulling (no vertex input state).
+    VkRenderPass scene_render_passes[POST_MODE_COUNT] = {app->render_pass,
+                                                         app->scene_render_pass};
+    for(uint32_t variant = 0; variant < POST_MODE_COUNT * VERTEX_FETCH_COUNT; variant++) {
+        uint32_t mode = variant / VERTEX_FETCH_COUNT;
+        VertexFetch fetch = variant % VERTEX_FETCH_COUNT;
+        PipelineVariantDesc desc;
+        pipeline_variant_desc_init(&desc);
+        desc.fragment_shader = fragment_shader_module;
+        if(fetch == VERTEX_FETCH_PULLED) {
+            desc.vertex_shader = pulled_vertex_shader_module;
+        } else {
+            desc.vertex_shader = vertex_shader_module;
+            desc.vertex_binding_count = 1;
+            desc.vertex_bindings[0] = get_binding_description();
+            desc.vertex_attribute_count = NB_VERTEX_ATTRIBUTES;
+            get_attribute_description(desc.vertex_attributes);
+        }
+        desc.layout = app->pipeline_layout;
+        desc.samples = app->msaa_samples;
+        /* render pass and the index of the sub pass where the graphics pipeline will be used */
+        desc.render_pass = scene_render_passes[mode];
+        desc.subpass = 0;
+
+        // vertices are plain floats for now, so no dequantization
+        shader_specialization_set_bool(&(desc.vertex_specialization),
+                                       SPEC_CONSTANT_DEQUANTIZE_POSITION, false);
+        shader_specialization_set_float(&(desc.vertex_specialization),
+                                        SPEC_CONSTANT_POSITION_SCALE, 1.0f);
+        shader_specialization_set_uint(&(desc.fragment_specialization), SPEC_CONSTANT_DEBUG_VIEW,
+                                       DEBUG_VIEW_NONE);
+
+        uint32_t* ids = app->pipeline_variant_ids[mode][fetch];
+        desc.blend_mode = PIPELINE_BLEND_OPAQUE;
+        ids[PIPELINE_KIND_OPAQUE] = pipeline_variants_add(&(app->pipeline_variants), &desc);
+
+        // transparent surfaces are tested against the opaque ones but do not hide each other
+        desc.blend_mode = PIPELINE_BLEND_ALPHA;
+        desc.depth_write = VK_FALSE;
+        ids[PIPELINE_KIND_TRANSPARENT] = pipeline_variants_add(&(app->pipeline_variants), &desc);
+
+        // debug views are shader variants: the branch is resolved at compile time, not per
+        // fragment
+        desc.blend_mode = PIPELINE_BLEND_OPAQUE;
+        desc.depth_write = VK_TRUE;
+        shader_specialization_set_uint(&(desc.fragment_specialization), SPEC_CONSTANT_DEBUG_VIEW,
+                                       DEBUG_VIEW_DEPTH);
+        ids[PIPELINE_KIND_DEBUG_DEPTH] = pipeline_variants_add(&(app->pipeline_variants), &desc);
+
+        shader_specialization_set_uint(&(desc.fragment_specialization), SPEC_CONSTANT_DEBUG_VIEW,
+                                       DEBUG_VIEW_COVERAGE);
+        ids[PIPELINE_KIND_DEBUG_COVERAGE] =
+            pipeline_variants_add(&(app->pipeline_variants), &desc);
+    }
+
+    /* Post-processing variants */
+    size_t code_size = 0;
+    uint32_t* code = read_spirv_file(app, &code_size, MAKE_SHADER_PATH("out/fullscreen_vert.spv"));
+    VkShaderModule fullscreen_module = create_shader_module(app, code_size, code);
+    host_free(&(app->host_memory), code);
+    code = read_spirv_file(app, &code_size, MAKE_SHADER_PATH("out/post_subpass_frag.spv"));
+    VkShaderModule post_subpass_module = create_shader_module(app, code_size, code);
+    host_free(&(app->host_memory), code);
+    code = read_spirv_file(app, &code_size, MAKE_SHADER_PATH("out/post_sampled_frag.spv"));
+    VkShaderModule post_sampled_module = create_shader_module(app, code_size, code);
+    host_free(&(app->host_memory), code);
+
+    // {render pass, subpass, fragment shader, effect} of each post pipeline
+    struct {
+        VkRenderPass render_pass;
+        uint32_t subpass;
+        VkShaderModule fragment_shader;
+        PostEffect effect;
+    } post_pipelines[POST_PIPELINE_COUNT] = {
+        [POST_PIPELINE_TONEMAP_SUBPASS] = {app->render_pass, 1, post_subpass_module,
+                                           POST_EFFECT_TONEMAP},
+        [POST_PIPELINE_GRADE_SUBPASS] = {app->render_pass, 2, post_subpass_module,
+                                         POST_EFFECT_GRADE},
+        [POST_PIPELINE_TONEMAP_PASS] = {app->post_render_pass, 0, post_sampled_module,
+                                        POST_EFFECT_TONEMAP},
+        [POST_PIPELINE_GRADE_PASS] = {app->post_render_pass, 0, post_sampled_module,
+                                      POST_EFFECT_GRADE},
+        [POST_PIPELINE_FXAA] = {app->present_render_pass, 0, post_sampled_module,
+                                POST_EFFECT_FXAA},
+    };
+    for(uint32_t i = 0; i < POST_PIPELINE_COUNT; i++) {
+        // a single triangle covering the screen: no vertex input, no depth, nothing to cull
+        PipelineVariantDesc desc;
+        pipeline_variant_desc_init(&desc);
+        desc.vertex_shader = fullscreen_module;
+        desc.fragment_shader = post_pipelines[i].fragment_shader;
+        desc.cull_mode = VK_CULL_MODE_NONE;
+        desc.depth_test = VK_FALSE;
+        desc.depth_write = VK_FALSE;
+        desc.layout = app->post_pipeline_layout;
+        desc.render_pass = post_pipelines[i].render_pass;
+        desc.subpass = post_pipelines[i].subpass;
+        shader_specialization_set_uint(&(desc.fragment_specialization), SPEC_CONSTANT_POST_EFFECT,
+                                       post_pipelines[i].effect);
+        app->post_variant_ids[i] = pipeline_variants_add(&(app->pipeline_variants), &desc);
+    }
+
+    /* HUD variant */
+    code = read_spirv_file(app, &code_size, MAKE_SHADER_PATH("out/hud_vert.spv"));
+    VkShaderModule hud_vertex_module = create_shader_module(app, code_size, code);
+    host_free(&(app->host_memory), code);
+    code = read_spirv_file(app, &code_size, MAKE_SHADER_PATH("out/hud_frag.spv"));
+    VkShaderModule hud_fragment_module = create_shader_module(app, code_size, code);
+    host_free(&(app->host_memory), code);
+    // no descriptors, only the size of the screen
+    VkPushConstantRange hud_push_constant_range = {0};
+    hud_push_constant_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    hud_push_constant_range.offset = 0;
+    hud_push_constant_range.size = sizeof(HudPushConstants);
+    pipeline_layout_info.setLayoutCount = 0;
+    pipeline_layout_info.pSetLayouts = NULL;
+    pipeline_layout_info.pPushConstantRanges = &hud_push_constant_range;
+    if(vkCreatePipelineLayout(app->device, &pipeline_layout_info, app->allocator,
+                              &(app->hud_pipeline_layout)) != VK_SUCCESS) {
+        printf("failed to create HUD pipeline layout \n");
+    }
+    // colored triangles blended over the fxaa output, in the same pass
+    PipelineVariantDesc hud_desc;
+    pipeline_variant_desc_init(&hud_desc);
+    hud_desc.vertex_shader = hud_vertex_module;
+    hud_desc.fragment_shader = hud_fragment_module;
+    hud_desc.vertex_binding_count = 1;
+    hud_desc.vertex_bindings[0].binding = 0;
+    hud_desc.vertex_bindings[0].stride = sizeof(HudVertex);
+    hud_desc.vertex_bindings[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+    hud_desc.vertex_attribute_count = 2;
+    hud_desc.vertex_attributes[0].location = 0;
+    hud_desc.vertex_attributes[0].binding = 0;
+    hud_desc.vertex_attributes[0].format = VK_FORMAT_R32G32_SFLOAT;
+    hud_desc.vertex_attributes[0].offset = offsetof(HudVertex, position);
+    hud_desc.vertex_attributes[1].location = 1;
+    hud_desc.vertex_attributes[1].binding = 0;
+    hud_desc.vertex_attributes[1].format = VK_FORMAT_R8G8B8A8_UNORM;
+    hud_desc.vertex_attributes[1].offset = offsetof(HudVertex, color);
+    hud_desc.cull_mode = VK_CULL_MODE_NONE;
+    hud_desc.blend_mode = PIPELINE_BLEND_ALPHA;
+    hud_desc.depth_test = VK_FALSE;
+    hud_desc.depth_write = VK_FALSE;
+    hud_desc.layout = app->hud_pipeline_layout;
+    hud_desc.render_pass = app->present_render_pass;
+    hud_desc.subpass = 0;
+    app->hud_variant_id = pipeline_variants_add(&(app->pipeline_variants), &hud_desc);
+
+    // all variants are compiled at once, on as many threads as there are cores
+    pipeline_variants_build(app->device, app->allocator, app->pipeline_cache,
+                            &(app->pipeline_variants), 0);
+    pipeline_variants_report(&(app->pipeline_variants));
+
+    // pipelines keep what they need from the modules, they can go as soon as everything is built
+    vkDestroyShaderModule(app->device, vertex_shader_module, app->allocator);
+    vkDestroyShaderModule(app->device, pulled_vertex_shader_module, app->allocator);
+    vkDestroyShaderModule(app->device, fragment_shader_module, app->allocator);
+    vkDestroyShaderModule(app->device, fullscreen_module, app->allocator);
+    vkDestroyShaderModule(app->device, post_subpass_module, app->allocator);
+    vkDestroyShaderModule(app->device, post_sampled_module, app->allocator);
+    vkDestroyShaderModule(app->device, hud_vertex_module, app->allocator);
+    vkDestroyShaderModule(app->device, hud_fragment_module, app->allocator);
 }
 
 /* Render passes *********************/
-void create_render_pass(SimpleVkApp* app) {
-    // Render passes have information about the framebuffer attachements that will be used while
-    // rendering. We need to specify how many color and depth buffers there will be, how many
-    // samples to use for each of them and how their contents should handled throughout the
-    // rendering operations
-
-    // We will have a single color buffer attachment, represented by one of the images from the
-    // swapchain
-    VkAttachmentDescription color_attachment = {0};
-    color_attachment.format = app->swapchain_image_format;
-    color_attachment.samples = VK_SAMPLE_COUNT_1_BIT;        // no multisampling yet
-    color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;   // clear the buffer before rendering
-    color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE; // store. can also be undefined lmao
+// Render passes have information about the framebuffer attachements that will be used while
+// rendering. We need to specify how many color and depth buffers there will be, how many samples
+// to use for each of them and how their contents should handled throughout the rendering
+// operations.
+// Every pass (or subpass chain) ends with its output in a layout the next one can read.
+
+VkAttachmentDescription make_attachment(VkFormat format, VkSampleCountFlagBits samples,
+                                        VkAttachmentLoadOp load_op, VkAttachmentStoreOp store_op,
+                                        VkImageLayout final_layout) {
+    VkAttachmentDescription attachment = {0};
+    attachment.format = format;
+    attachment.samples = samples;
+    attachment.loadOp = load_op;
+    attachment.storeOp = store_op;
     // Nothing to do with the stencil: dont care about both
-    color_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    color_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    // Textures/Framebuffers are represented as VkImage objects with a certain pixel format, but the
-    // layout of said pixels in memory can (and should) change depending on what we want to do with
-    // the image.
-    color_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED; // no info + dont care
-    color_attachment.finalLayout =
-        VK_IMAGE_LAYOUT_PRESENT_SRC_KHR; // optimal for presentation using the swap chain
+    attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    // Textures/Framebuffers are represented as VkImage objects with a certain pixel format, but
+    // the layout of said pixels in memory can (and should) change depending on what we want to do
+    // with the image. Every attachment is fully overwritten, so the previous layout does not
+    // matter: no info + dont care
+    attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    attachment.finalLayout = final_layout;
+    return attachment;
+}
+
+// The depth and msaa images are shared by every frame in flight: the previous frame must be done
+// with them before they are cleared. Same for the images the previous frame was sampling.
+VkSubpassDependency make_incoming_dependency(uint32_t subpass) {
+    VkSubpassDependency dependency = {0};
+    // refers to implicit subpass before/after. Since it is src, it is the one before.
+    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependency.dstSubpass = subpass; // dst > src to avoid cycles (except if external)
+    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                              VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
+                              VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    dependency.srcAccessMask =
+        VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                              VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+    dependency.dstAccessMask =
+        VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    return dependency;
+}
+
+// The output is sampled by the fragment shader of the next pass
+VkSubpassDependency make_outgoing_dependency(uint32_t subpass) {
+    VkSubpassDependency dependency = {0};
+    dependency.srcSubpass = subpass;
+    dependency.dstSubpass = VK_SUBPASS_EXTERNAL;
+    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    dependency.dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    dependency.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    return dependency;
+}
+
+// The next subpass reads, at the same pixel, what the previous one wrote. BY_REGION lets a tiler
+// run both on a tile before moving to the next one instead of flushing the whole image between
+// them.
+VkSubpassDependency make_input_attachment_dependency(uint32_t src_subpass, uint32_t dst_subpass) {
+    VkSubpassDependency dependency = {0};
+    dependency.srcSubpass = src_subpass;
+    dependency.dstSubpass = dst_subpass;
+    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    dependency.dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    dependency.dstAccessMask = VK_ACCESS_INPUT_ATTACHMENT_READ_BIT;
+    dependency.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+    return dependency;
+}
+
+// Scene pass of both modes. In subpass mode it goes on with tonemapping and grading, and only
+// the graded image is stored; in separate passes mode it stores the hdr scene color.
+void create_scene_render_pass(SimpleVkApp* app, PostMode mode, VkRenderPass* render_pass) {
+    bool msaa = app->msaa_samples != VK_SAMPLE_COUNT_1_BIT;
+    bool subpasses = mode == POST_MODE_SUBPASSES;
+
+    // Attachment indices, the same order is used by the framebuffers and the clear values
+    uint32_t post_color = 0, depth = 1, scene_color = 2, ldr_color = 3, msaa_color = 4;
+    if(!subpasses) {
+        scene_color = 0;
+        msaa_color = 2;
+    }
+    uint32_t attachment_count = 0;
+    VkAttachmentDescription attachments[5] = {0};
+
+    // Scene color: the resolve target with msaa (overwritten entirely, no need to clear), drawn
+    // into directly without. In subpass mode it is consumed by tonemapping and thrown away.
+    attachments[scene_color] = make_attachment(
+        SCENE_COLOR_FORMAT, VK_SAMPLE_COUNT_1_BIT,
+        msaa ? VK_ATTACHMENT_LOAD_OP_DONT_CARE : VK_ATTACHMENT_LOAD_OP_CLEAR,
+        subpasses ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    // Depth is only needed while rendering: cleared when the pass starts, and never stored
+    attachments[depth] =
+        make_attachment(app->depth_format, app->msaa_samples, VK_ATTACHMENT_LOAD_OP_CLEAR,
+                        VK_ATTACHMENT_STORE_OP_DONT_CARE,
+                        VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+    attachment_count = 2;
+    if(subpasses) {
+        // written by grading, sampled by fxaa
+        attachments[post_color] = make_attachment(
+            POST_COLOR_FORMAT, VK_SAMPLE_COUNT_1_BIT, VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+            VK_ATTACHMENT_STORE_OP_STORE, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        // written by tonemapping, read by grading, never leaves the render pass
+        attachments[ldr_color] = make_attachment(
+            POST_COLOR_FORMAT, VK_SAMPLE_COUNT_1_BIT, VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+            VK_ATTACHMENT_STORE_OP_DONT_CARE, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        attachment_count = 4;
+    }
+    // Multisampled color: same as depth, it never leaves the render pass. Only its resolve does.
+    if(msaa) {
+        attachments[msaa_color] = make_attachment(
+            SCENE_COLOR_FORMAT, app->msaa_samples, VK_ATTACHMENT_LOAD_OP_CLEAR,
+            VK_ATTACHMENT_STORE_OP_DONT_CARE, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+        attachment_count++;
+    }
 
     /* Subpasses and attachment references */
-    // If doing eg post processing (wink) can do mulitple render passes. If they are grouped in a
-    // single render pass, some memory optimizations can take place to conserve bandwith.
+    VkSubpassDescription subpass_descs[3] = {0};
+
+    // 0: the scene
+    VkAttachmentReference color_attachment_ref = {0};
+    color_attachment_ref.attachment = msaa ? msaa_color : scene_color;
+    color_attachment_ref.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    // resolved at the end of the subpass, while the samples are still on chip
+    VkAttachmentReference resolve_attachment_ref = {0};
+    resolve_attachment_ref.attachment = scene_color;
+    resolve_attachment_ref.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    VkAttachmentReference depth_attachment_ref = {0};
+    depth_attachment_ref.attachment = depth;
+    depth_attachment_ref.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    subpass_descs[0].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass_descs[0].colorAttachmentCount = 1;
+    subpass_descs[0].pColorAttachments = &color_attachment_ref;
+    subpass_descs[0].pResolveAttachments = msaa ? &resolve_attachment_ref : NULL;
+    subpass_descs[0].pDepthStencilAttachment = &depth_attachment_ref;
+
+    // 1: tonemapping, scene color -> ldr color. 2: grading, ldr color -> post color
+    VkAttachmentReference tonemap_input_ref = {scene_color,
+                                               VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+    VkAttachmentReference tonemap_output_ref = {ldr_color,
+                                                VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+    VkAttachmentReference grade_input_ref = {ldr_color, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+    VkAttachmentReference grade_output_ref = {post_color,
+                                              VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+    subpass_descs[1].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass_descs[1].inputAttachmentCount = 1;
+    subpass_descs[1].pInputAttachments = &tonemap_input_ref;
+    subpass_descs[1].colorAttachmentCount = 1;
+    subpass_descs[1].pColorAttachments = &tonemap_output_ref;
+    subpass_descs[2].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass_descs[2].inputAttachmentCount = 1;
+    subpass_descs[2].pInputAttachments = &grade_input_ref;
+    subpass_descs[2].colorAttachmentCount = 1;
+    subpass_descs[2].pColorAttachments = &grade_output_ref;
+
+    // Dependencies
+    VkSubpassDependency dependencies[5];
+    uint32_t dependency_count = 0;
+    dependencies[dependency_count++] = make_incoming_dependency(0);
+    if(subpasses) {
+        dependencies[dependency_count++] = make_input_attachment_dependency(0, 1);
+        dependencies[dependency_count++] = make_input_attachment_dependency(1, 2);
+        // post color was sampled by the fxaa of the previous frame
+        dependencies[dependency_count++] = make_incoming_dependency(2);
+        dependencies[dependency_count++] = make_outgoing_dependency(2);
+    } else {
+        dependencies[dependency_count++] = make_outgoing_dependency(0);
+    }
+
+    VkRenderPassCreateInfo render_pass_info = {0};
+    render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    render_pass_info.attachmentCount = attachment_count;
+    render_pass_info.pAttachments = attachments;
+    render_pass_info.subpassCount = subpasses ? 3 : 1;
+    render_pass_info.pSubpasses = subpass_descs;
+    render_pass_info.dependencyCount = dependency_count;
+    render_pass_info.pDependencies = dependencies;
+
+    if(vkCreateRenderPass(app->device, &render_pass_info, app->allocator,
+                          render_pass) != VK_SUCCESS) {
+        printf("failed to create scene render pass\n");
+    }
+}
+
+// A fullscreen pass writing a single color attachment
+void create_fullscreen_render_pass(SimpleVkApp* app, VkFormat format, VkImageLayout final_layout,
+                                   VkRenderPass* render_pass) {
+    VkAttachmentDescription attachment =
+        make_attachment(format, VK_SAMPLE_COUNT_1_BIT, VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+                        VK_ATTACHMENT_STORE_OP_STORE, final_layout);
+
     VkAttachmentReference color_attachment_ref = {0};
     color_attachment_ref.attachment = 0;
     color_attachment_ref.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
@@ -975,33 +1988,34 @@ void create_render_pass(SimpleVkApp* app) {
     subpass.colorAttachmentCount = 1;
     subpass.pColorAttachments = &color_attachment_ref;
 
+    VkSubpassDependency dependencies[2] = {make_incoming_dependency(0),
+                                           make_outgoing_dependency(0)};
+
     VkRenderPassCreateInfo render_pass_info = {0};
     render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
     render_pass_info.attachmentCount = 1;
-    render_pass_info.pAttachments = &color_attachment;
+    render_pass_info.pAttachments = &attachment;
     render_pass_info.subpassCount = 1;
     render_pass_info.pSubpasses = &subpass;
-    // Dependencies
-    VkSubpassDependency dependency = {0};
-    // refers to implicit subpass before/after. Since it is src, it is the one before.
-    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-    dependency.dstSubpass =
-        0; // subpass 0: our only one. dst > src to avoid cycles (except if external)
-    dependency.srcStageMask =
-        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT; // finish reading before accessing
-    dependency.srcAccessMask = 0;
-    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-
-    render_pass_info.dependencyCount = 1;
-    render_pass_info.pDependencies = &dependency;
-
-    if(vkCreateRenderPass(app->device, &render_pass_info, NULL, &(app->render_pass)) !=
-       VK_SUCCESS) {
-        printf("failed to create render pass");
+    // presentation is synchronized by a semaphore, not a dependency
+    render_pass_info.dependencyCount = final_layout == VK_IMAGE_LAYOUT_PRESENT_SRC_KHR ? 1 : 2;
+    render_pass_info.pDependencies = dependencies;
+
+    if(vkCreateRenderPass(app->device, &render_pass_info, app->allocator,
+                          render_pass) != VK_SUCCESS) {
+        printf("failed to create fullscreen render pass\n");
     }
 }
 
+void create_render_pass(SimpleVkApp* app) {
+    create_scene_render_pass(app, POST_MODE_SUBPASSES, &(app->render_pass));
+    create_scene_render_pass(app, POST_MODE_SEPARATE_PASSES, &(app->scene_render_pass));
+    create_fullscreen_render_pass(app, POST_COLOR_FORMAT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                  &(app->post_render_pass));
+    create_fullscreen_render_pass(app, app->swapchain_image_format,
+                                  VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, &(app->present_render_pass));
+}
+
 /* Descriptor Binding *****************/
 void create_descriptor_set_layout(SimpleVkApp* app) {
     VkDescriptorSetLayoutBinding ubo_layout_binding = {0};
@@ -1016,29 +2030,113 @@ void create_descriptor_set_layout(SimpleVkApp* app) {
     layout_create_info.bindingCount = 1;
     layout_create_info.pBindings = &ubo_layout_binding;
 
-    if(vkCreateDescriptorSetLayout(app->device, &layout_create_info, NULL,
+    if(vkCreateDescriptorSetLayout(app->device, &layout_create_info, app->allocator,
                                    &(app->descriptor_set_layout)) != VK_SUCCESS) {
         printf("failed to create descriptor set layout\n");
     }
 }
 
+void create_bindless_table(SimpleVkApp* app) {
+    bindless_create(app->device, app->physical_device, app->allocator, &(app->bindless));
+}
+
+// Subpass mode reads the previous subpass through an input attachment (set 0), separate passes
+// mode samples it from the bindless table
+void create_post_descriptors(SimpleVkApp* app) {
+    VkDescriptorSetLayoutBinding input_binding = {0};
+    input_binding.binding = 0;
+    input_binding.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+    input_binding.descriptorCount = 1;
+    input_binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    VkDescriptorSetLayoutCreateInfo layout_create_info = {0};
+    layout_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layout_create_info.bindingCount = 1;
+    layout_create_info.pBindings = &input_binding;
+    if(vkCreateDescriptorSetLayout(app->device, &layout_create_info, app->allocator,
+                                   &(app->post_input_set_layout)) != VK_SUCCESS) {
+        printf("failed to create post-processing descriptor set layout\n");
+    }
+
+    // fxaa reads past the edges of the image
+    VkSamplerCreateInfo sampler_info = {0};
+    sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    sampler_info.magFilter = VK_FILTER_LINEAR;
+    sampler_info.minFilter = VK_FILTER_LINEAR;
+    sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.maxLod = 0.0f;
+    if(vkCreateSampler(app->device, &sampler_info, app->allocator,
+                       &(app->post_sampler)) != VK_SUCCESS) {
+        printf("failed to create post-processing sampler\n");
+    }
+}
+
 /* Framebuffers **********************/
+VkFramebuffer create_framebuffer(SimpleVkApp* app, VkRenderPass render_pass,
+                                 uint32_t attachment_count, VkImageView* attachments) {
+    VkFramebufferCreateInfo framebuffer_info = {0};
+    framebuffer_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    framebuffer_info.renderPass = render_pass;
+    framebuffer_info.attachmentCount = attachment_count;
+    framebuffer_info.pAttachments = attachments;
+    framebuffer_info.width = app->swapchain_extent.width;
+    framebuffer_info.height = app->swapchain_extent.height;
+    framebuffer_info.layers = 1;
+    VkFramebuffer framebuffer = VK_NULL_HANDLE;
+    if(vkCreateFramebuffer(app->device, &framebuffer_info, app->allocator,
+                           &framebuffer) != VK_SUCCESS) {
+        printf("failed to created framebuffer\n");
+    }
+    return framebuffer;
+}
+
 void create_framebuffers(SimpleVkApp* app) {
-    app->swapchain_framebuffers = calloc(app->swapchain_image_count, sizeof(VkFramebuffer));
+    // a single set of render targets is enough: only one frame renders at a time
+    uint32_t msaa = app->msaa_samples != VK_SAMPLE_COUNT_1_BIT ? 1 : 0;
+    if(app->post_mode == POST_MODE_SUBPASSES) {
+        VkImageView attachments[] = {app->post_color_image_view, app->depth_image_view,
+                                     app->scene_color_image_view, app->ldr_color_image_view,
+                                     app->msaa_color_image_view};
+        app->scene_framebuffer = create_framebuffer(app, app->render_pass, 4 + msaa, attachments);
+    } else {
+        VkImageView attachments[] = {app->scene_color_image_view, app->depth_image_view,
+                                     app->msaa_color_image_view};
+        app->scene_framebuffer =
+            create_framebuffer(app, app->scene_render_pass, 2 + msaa, attachments);
+        app->tonemap_framebuffer =
+            create_framebuffer(app, app->post_render_pass, 1, &(app->ldr_color_image_view));
+        app->grade_framebuffer =
+            create_framebuffer(app, app->post_render_pass, 1, &(app->post_color_image_view));
+    }
+
+    // fxaa writes straight into the swapchain image
+    app->swapchain_framebuffers = host_alloc(&(app->host_memory),
+                                             app->swapchain_image_count * sizeof(VkFramebuffer),
+                                             HOST_SCOPE_SWAPCHAIN);
     for(size_t i = 0; i < app->swapchain_image_count; i++) {
-        VkImageView attachments[] = {app->swapchain_images_views[i]};
-        VkFramebufferCreateInfo framebuffer_info = {0};
-        framebuffer_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-        framebuffer_info.renderPass = app->render_pass;
-        framebuffer_info.attachmentCount = 1;
-        framebuffer_info.pAttachments = attachments;
-        framebuffer_info.width = app->swapchain_extent.width;
-        framebuffer_info.height = app->swapchain_extent.height;
-        framebuffer_info.layers = 1;
-        if(vkCreateFramebuffer(app->device, &framebuffer_info, NULL,
-                               &(app->swapchain_framebuffers[i])) != VK_SUCCESS) {
-            printf("failed to created framebuffer %zu for swapchain", i);
-        }
+        app->swapchain_framebuffers[i] = create_framebuffer(app, app->present_render_pass, 1,
+                                                            &(app->swapchain_images_views[i]));
+    }
+}
+
+// Frames in flight may still use them: they are destroyed by the deletion queue
+void destroy_framebuffers(SimpleVkApp* app) {
+    DeletionQueue* queue = &(app->deletion_queue);
+    for(size_t i = 0; i < app->swapchain_image_count; i++) {
+        deletion_queue_push_framebuffer(queue, app->swapchain_framebuffers[i], app->frame_number);
+    }
+    host_free(&(app->host_memory), app->swapchain_framebuffers);
+    deletion_queue_push_framebuffer(queue, app->scene_framebuffer, app->frame_number);
+    if(app->post_mode == POST_MODE_SEPARATE_PASSES) {
+        deletion_queue_push_framebuffer(queue, app->tonemap_framebuffer, app->frame_number);
+        deletion_queue_push_framebuffer(queue, app->grade_framebuffer, app->frame_number);
+    }
+    // the cached input attachment sets point to the render targets, which go away too
+    for(size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        descriptor_cache_invalidate(&(app->descriptor_caches[i]));
     }
 }
 
@@ -1066,7 +2164,8 @@ uint32_t find_memory_type(SimpleVkApp* app, uint32_t type_filter,
 
 void create_buffer(SimpleVkApp* app, uint32_t nb_sharing_queues, uint32_t sharing_queues[2],
                    VkBuffer* buffer, VkDeviceSize size, VkBufferUsageFlags usage,
-                   VkDeviceMemory* buffer_memory, VkMemoryPropertyFlags properties) {
+                   VkDeviceMemory* buffer_memory, VkMemoryPropertyFlags properties,
+                   GpuMemoryCategory category) {
     VkBufferCreateInfo buffer_info = {0};
     buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
     buffer_info.size = size;
@@ -1081,7 +2180,7 @@ void create_buffer(SimpleVkApp* app, uint32_t nb_sharing_queues, uint32_t sharin
         buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
     }
 
-    if(vkCreateBuffer(app->device, &buffer_info, NULL, buffer) != VK_SUCCESS) {
+    if(vkCreateBuffer(app->device, &buffer_info, app->allocator, buffer) != VK_SUCCESS) {
         printf("failed to create vertex buffer of size\n");
     }
 
@@ -1101,12 +2200,32 @@ void create_buffer(SimpleVkApp* app, uint32_t nb_sharing_queues, uint32_t sharin
     allocate_info.memoryTypeIndex =
         find_memory_type(app, memory_requirements.memoryTypeBits, properties);
 
-    if(vkAllocateMemory(app->device, &allocate_info, NULL, buffer_memory)) {
+    if(gpu_memory_allocate(&(app->memory), &allocate_info, category, buffer_memory)) {
         printf("failed to allocate buffer memory\n");
     }
     vkBindBufferMemory(app->device, *buffer, *buffer_memory, 0);
 }
 
+// The queue belongs to its submit service: no vkQueueWaitIdle, a fence tells when it is done
+void submit_and_wait(SimpleVkApp* app, SubmitService* service, VkCommandBuffer command_buffer) {
+    VkFenceCreateInfo fence_info = {0};
+    fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    VkFence fence;
+    if(vkCreateFence(app->device, &fence_info, app->allocator, &fence) != VK_SUCCESS) {
+        printf("failed to create one time submit fence\n");
+        return;
+    }
+
+    SubmitBatch batch = {0};
+    batch.command_buffer_count = 1;
+    batch.command_buffers[0] = command_buffer;
+    batch.fence = fence;
+    submit_service_push(service, &batch);
+    vkWaitForFences(app->device, 1, &fence, VK_TRUE, UINT64_MAX);
+
+    vkDestroyFence(app->device, fence, app->allocator);
+}
+
 void copy_buffer(SimpleVkApp* app, VkBuffer src_buffer, VkBuffer dst_buffer, VkDeviceSize size) {
     VkCommandBufferAllocateInfo allocate_info = {0};
     allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -1133,87 +2252,363 @@ void copy_buffer(SimpleVkApp* app, VkBuffer src_buffer, VkBuffer dst_buffer, VkD
 
     vkEndCommandBuffer(command_buffer);
 
-    VkSubmitInfo submit_info = {0};
-    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submit_info.commandBufferCount = 1;
-    submit_info.pCommandBuffers = &command_buffer;
-
-    vkQueueSubmit(app->transfer_queue, 1, &submit_info, VK_NULL_HANDLE);
-    vkQueueWaitIdle(app->transfer_queue); // no fence, simply wait for the queue to finish
-    // to optimize, for example when we will have several buffers, it might be smarter to add a
-    // fence and wait for ALL buffers to finish copying
+    // to optimize, for example when we will have several buffers, it might be smarter to wait for
+    // ALL buffers to finish copying
+    submit_and_wait(app, app->transfer_submit, command_buffer);
 
     vkFreeCommandBuffers(app->device, app->transfer_command_pool, 1, &command_buffer);
 }
 
-void create_vertex_buffer(SimpleVkApp* app) {
-
-    VkDeviceSize shape_buffer_size = sizeof(Vertex) * NB_SQUARE_VERTICES;
-    uint32_t sharing_queues[2] = {app->queue_families_indices.graphics_family,
-                                  app->queue_families_indices.transfer_family};
-    // use a staging buffer, that will copy the data from CPU memory to inefficient GPU memory.
-    VkBuffer staging_buffer = {0};
-    VkDeviceMemory staging_memory = {0};
-    create_buffer(app, 1, NULL, &staging_buffer, shape_buffer_size,
-                  VK_BUFFER_USAGE_TRANSFER_SRC_BIT, &staging_memory,
-                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-    void* data;
-    vkMapMemory(app->device, staging_memory, 0, shape_buffer_size, 0, &data);
-    memcpy(data, SQUARE_VERTICES, (size_t)shape_buffer_size);
-    vkUnmapMemory(app->device, staging_memory);
-    // Since we went with a host coherent memory heap, we do not need to call cache sync operation
-    // (vkFush/InvalidateMappedMemoryRanges)
-
-    // the real buffer will live in device local memory, and a priori more efficient memory
-    create_buffer(app, 2, sharing_queues, &(app->shape_vertex_buffer), shape_buffer_size,
-                  VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-                  &(app->shape_vertex_buffer_memory), VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-    copy_buffer(app, staging_buffer, app->shape_vertex_buffer, shape_buffer_size);
+// Same as copy_buffer, for every mip level of a texture. The image is left ready to be sampled.
+void copy_buffer_to_image(SimpleVkApp* app, VkBuffer src_buffer, VkImage dst_image,
+                          const Ktx2Texture* texture) {
+    VkCommandBufferAllocateInfo allocate_info = {0};
+    allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocate_info.commandPool = app->transfer_command_pool;
+    allocate_info.commandBufferCount = 1;
 
-    vkDestroyBuffer(app->device, staging_buffer, NULL);
-    vkFreeMemory(app->device, staging_memory, NULL);
-}
+    VkCommandBuffer command_buffer = {0};
+    vkAllocateCommandBuffers(app->device, &allocate_info, &command_buffer);
 
-void create_index_buffer(SimpleVkApp* app) {
+    VkCommandBufferBeginInfo begin_info = {0};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(command_buffer, &begin_info);
 
-    VkDeviceSize buffer_size = sizeof(SQUARE_INDICES[0]) * NB_SQUARE_INDICES;
-    uint32_t sharing_queues[2] = {app->queue_families_indices.graphics_family,
-                                  app->queue_families_indices.transfer_family};
+    VkImageMemoryBarrier barrier = {0};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED; // concurrent image, no ownership
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = dst_image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = texture->level_count;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+
+    // one region per level, they are tightly packed in the buffer
+    VkBufferImageCopy regions[KTX2_MAX_LEVELS] = {0};
+    for(uint32_t level = 0; level < texture->level_count; level++) {
+        regions[level].bufferOffset = texture->levels[level].offset;
+        regions[level].imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        regions[level].imageSubresource.mipLevel = level;
+        regions[level].imageSubresource.baseArrayLayer = 0;
+        regions[level].imageSubresource.layerCount = 1;
+        regions[level].imageExtent =
+            (VkExtent3D){texture->levels[level].width, texture->levels[level].height, 1};
+    }
+    vkCmdCopyBufferToImage(command_buffer, src_buffer, dst_image,
+                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, texture->level_count, regions);
+
+    // the transfer queue cannot name the fragment stage: waiting for the fence below is what
+    // makes the copy visible to the draws
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = 0;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
 
-    VkBuffer staging_buffer = {0};
-    VkDeviceMemory staging_memory = {0};
-    create_buffer(app, 1, NULL, &staging_buffer, buffer_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                  &staging_memory,
-                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-    void* data;
-    vkMapMemory(app->device, staging_memory, 0, buffer_size, 0, &data);
-    memcpy(data, SQUARE_INDICES, (size_t)buffer_size);
-    vkUnmapMemory(app->device, staging_memory);
+    vkEndCommandBuffer(command_buffer);
 
-    create_buffer(app, 2, sharing_queues, &(app->shape_index_buffer), buffer_size,
-                  VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-                  &(app->shape_index_buffer_memory), VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    submit_and_wait(app, app->transfer_submit, command_buffer);
 
-    copy_buffer(app, staging_buffer, app->shape_index_buffer, buffer_size);
+    vkFreeCommandBuffers(app->device, app->transfer_command_pool, 1, &command_buffer);
+}
 
-    vkDestroyBuffer(app->device, staging_buffer, NULL);
-    vkFreeMemory(app->device, staging_memory, NULL);
+/* Render targets ********************/
+VkFormat find_depth_format(SimpleVkApp* app) {
+    // by order of preference, no need for stencil for now
+    VkFormat candidates[3] = {VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT,
+                              VK_FORMAT_D24_UNORM_S8_UINT};
+    for(size_t i = 0; i < 3; i++) {
+        VkFormatProperties properties = {0};
+        vkGetPhysicalDeviceFormatProperties(app->physical_device, candidates[i], &properties);
+        if(properties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) {
+            return candidates[i];
+        }
+    }
+    printf("failed to find a depth format\n");
+    return VK_FORMAT_UNDEFINED;
 }
 
-void create_uniform_buffers(SimpleVkApp* app) {
-    VkDeviceSize buffer_size = sizeof(UniformBufferObject);
-    uint32_t sharing_queues[2] = {app->queue_families_indices.graphics_family,
-                                  app->queue_families_indices.transfer_family};
+// Highest count not above the requested one that both color and depth attachments support
+VkSampleCountFlagBits choose_msaa_samples(SimpleVkApp* app, uint32_t requested) {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(app->physical_device, &properties);
+    VkSampleCountFlags supported = properties.limits.framebufferColorSampleCounts &
+                                   properties.limits.framebufferDepthSampleCounts;
+    VkSampleCountFlagBits candidates[4] = {VK_SAMPLE_COUNT_8_BIT, VK_SAMPLE_COUNT_4_BIT,
+                                           VK_SAMPLE_COUNT_2_BIT, VK_SAMPLE_COUNT_1_BIT};
+    for(size_t i = 0; i < 4; i++) {
+        if(candidates[i] <= requested && (supported & candidates[i])) {
+            return candidates[i];
+        }
+    }
+    return VK_SAMPLE_COUNT_1_BIT;
+}
 
-    app->uniform_buffers = calloc(MAX_FRAMES_IN_FLIGHT, sizeof(VkBuffer));
-    app->uniform_buffers_memory = calloc(MAX_FRAMES_IN_FLIGHT, sizeof(VkDeviceMemory));
-    app->uniform_buffers_mapped = calloc(MAX_FRAMES_IN_FLIGHT, sizeof(void*));
+// Attachments that only live during the render pass (never loaded nor stored) are transient. On
+// tile-based GPUs they can stay in tile memory, and lazily allocated memory is never committed.
+void create_attachment_image(SimpleVkApp* app, VkFormat format, VkSampleCountFlagBits samples,
+                             VkImageUsageFlags usage, VkImageAspectFlags aspect, VkImage* image,
+                             VkDeviceMemory* memory, VkImageView* view) {
+    VkImageCreateInfo image_info = {0};
+    image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_info.imageType = VK_IMAGE_TYPE_2D;
+    image_info.format = format;
+    image_info.extent =
+        (VkExtent3D){app->swapchain_extent.width, app->swapchain_extent.height, 1};
+    image_info.mipLevels = 1;
+    image_info.arrayLayers = 1;
+    image_info.samples = samples;
+    image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_info.usage = usage;
+    image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE; // graphics queue only
+    image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    if(vkCreateImage(app->device, &image_info, app->allocator, image) != VK_SUCCESS) {
+        printf("failed to create attachment image\n");
+    }
+
+    VkMemoryRequirements memory_requirements = {0};
+    vkGetImageMemoryRequirements(app->device, *image, &memory_requirements);
+
+    // not every device has lazily allocated memory (most desktop GPUs do not), so look for it
+    // without going through find_memory_type, which complains when it finds nothing
+    uint32_t memory_type = UINT32_MAX;
+    if(usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT) {
+        VkMemoryPropertyFlags lazy =
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+        VkPhysicalDeviceMemoryProperties memory_properties = {0};
+        vkGetPhysicalDeviceMemoryProperties(app->physical_device, &memory_properties);
+        for(uint32_t i = 0; i < memory_properties.memoryTypeCount; i++) {
+            if(memory_requirements.memoryTypeBits & (1 << i) &&
+               (memory_properties.memoryTypes[i].propertyFlags & lazy) == lazy) {
+                memory_type = i;
+                break;
+            }
+        }
+    }
+    if(memory_type == UINT32_MAX) {
+        memory_type = find_memory_type(app, memory_requirements.memoryTypeBits,
+                                       VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    }
+
+    VkMemoryAllocateInfo allocate_info = {0};
+    allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocate_info.allocationSize = memory_requirements.size;
+    allocate_info.memoryTypeIndex = memory_type;
+    if(gpu_memory_allocate(&(app->memory), &allocate_info, GPU_MEMORY_RENDER_TARGET, memory) !=
+       VK_SUCCESS) {
+        printf("failed to allocate attachment image memory\n");
+    }
+    vkBindImageMemory(app->device, *image, *memory, 0);
+
+    VkImageViewCreateInfo view_info = {0};
+    view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    view_info.image = *image;
+    view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    view_info.format = format;
+    view_info.subresourceRange.aspectMask = aspect;
+    view_info.subresourceRange.baseMipLevel = 0;
+    view_info.subresourceRange.levelCount = 1;
+    view_info.subresourceRange.baseArrayLayer = 0;
+    view_info.subresourceRange.layerCount = 1;
+    if(vkCreateImageView(app->device, &view_info, app->allocator, view) != VK_SUCCESS) {
+        printf("failed to create attachment image view\n");
+    }
+    // no explicit transition: the render pass takes them from undefined when clearing them
+}
+
+void create_render_targets(SimpleVkApp* app) {
+    app->depth_format = find_depth_format(app);
+    app->msaa_samples = choose_msaa_samples(app, REQUESTED_MSAA_SAMPLES);
+
+    // depth is never stored, whether it is multisampled or not
+    create_attachment_image(
+        app, app->depth_format, app->msaa_samples,
+        VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
+        VK_IMAGE_ASPECT_DEPTH_BIT, &(app->depth_image), &(app->depth_image_memory),
+        &(app->depth_image_view));
+
+    // the multisampled color is resolved in the scene color, then thrown away
+    if(app->msaa_samples != VK_SAMPLE_COUNT_1_BIT) {
+        create_attachment_image(
+            app, SCENE_COLOR_FORMAT, app->msaa_samples,
+            VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
+            VK_IMAGE_ASPECT_COLOR_BIT, &(app->msaa_color_image), &(app->msaa_color_image_memory),
+            &(app->msaa_color_image_view));
+    }
+
+    // The intermediate post-processing images only exist within the render pass in subpass mode.
+    // In separate passes mode they are stored, then sampled by the next pass.
+    VkImageUsageFlags intermediate_usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    if(app->post_mode == POST_MODE_SUBPASSES) {
+        intermediate_usage |=
+            VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+    } else {
+        intermediate_usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+    }
+    create_attachment_image(app, SCENE_COLOR_FORMAT, VK_SAMPLE_COUNT_1_BIT, intermediate_usage,
+                            VK_IMAGE_ASPECT_COLOR_BIT, &(app->scene_color_image),
+                            &(app->scene_color_image_memory), &(app->scene_color_image_view));
+    create_attachment_image(app, POST_COLOR_FORMAT, VK_SAMPLE_COUNT_1_BIT, intermediate_usage,
+                            VK_IMAGE_ASPECT_COLOR_BIT, &(app->ldr_color_image),
+                            &(app->ldr_color_image_memory), &(app->ldr_color_image_view));
+    create_attachment_image(app, POST_COLOR_FORMAT, VK_SAMPLE_COUNT_1_BIT,
+                            VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+                            VK_IMAGE_ASPECT_COLOR_BIT, &(app->post_color_image),
+                            &(app->post_color_image_memory), &(app->post_color_image_view));
+
+    app->scene_color_index = BINDLESS_INVALID_INDEX;
+    app->ldr_color_index = BINDLESS_INVALID_INDEX;
+    if(app->post_mode == POST_MODE_SEPARATE_PASSES) {
+        app->scene_color_index =
+            bindless_register_image(&(app->bindless), app->scene_color_image_view,
+                                    app->post_sampler, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        app->ldr_color_index =
+            bindless_register_image(&(app->bindless), app->ldr_color_image_view,
+                                    app->post_sampler, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    }
+    app->post_color_index =
+        bindless_register_image(&(app->bindless), app->post_color_image_view, app->post_sampler,
+                                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+}
+
+// Frames in flight may still render to them: they are destroyed by the deletion queue
+void destroy_render_targets(SimpleVkApp* app) {
+    DeletionQueue* queue = &(app->deletion_queue);
+    uint64_t frame = app->frame_number;
+    // the slots as well: a new image registered in one would show up in the frames in flight
+    uint32_t indices[3] = {app->scene_color_index, app->ldr_color_index, app->post_color_index};
+    for(size_t i = 0; i < 3; i++) {
+        deletion_queue_push_bindless_image(queue, &(app->bindless), indices[i], frame);
+    }
+
+    VkImage images[5] = {app->depth_image, app->msaa_color_image, app->scene_color_image,
+                         app->ldr_color_image, app->post_color_image};
+    VkImageView views[5] = {app->depth_image_view, app->msaa_color_image_view,
+                            app->scene_color_image_view, app->ldr_color_image_view,
+                            app->post_color_image_view};
+    VkDeviceMemory memories[5] = {app->depth_image_memory, app->msaa_color_image_memory,
+                                  app->scene_color_image_memory, app->ldr_color_image_memory,
+                                  app->post_color_image_memory};
+    // without msaa, the msaa handles are null and skipped
+    for(size_t i = 0; i < 5; i++) {
+        deletion_queue_push_image_view(queue, views[i], frame);
+        deletion_queue_push_image(queue, images[i], frame);
+        deletion_queue_push_memory(queue, memories[i], frame);
+    }
+}
+
+// same rounding as packUnorm4x8/packUnorm2x16 in GLSL
+uint32_t pack_unorm(float value, float max) {
+    value = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+    return (uint32_t)roundf(value * max);
+}
+
+uint32_t pack_unorm4x8(const vec4 value) {
+    return pack_unorm(value[0], 255.0f) | pack_unorm(value[1], 255.0f) << 8 |
+           pack_unorm(value[2], 255.0f) << 16 | pack_unorm(value[3], 255.0f) << 24;
+}
+
+uint32_t pack_unorm2x16(float x, float y) {
+    return pack_unorm(x, 65535.0f) | pack_unorm(y, 65535.0f) << 16;
+}
+
+// The pool counts in Vertex-sized elements: packed vertices take fewer of them, the last one
+// padded. Only drawn with vertex pulling, which finds them by word offset.
+uint32_t add_packed_mesh(SimpleVkApp* app, const Vertex* vertices, uint32_t vertex_count,
+                         const uint16_t* indices, uint32_t index_count) {
+    uint32_t element_count =
+        (uint32_t)((vertex_count * sizeof(PackedVertex) + sizeof(Vertex) - 1) / sizeof(Vertex));
+    PackedVertex* packed =
+        host_calloc(&(app->host_memory), element_count, sizeof(Vertex), HOST_SCOPE_APP);
+    if(packed == NULL) {
+        return GEOMETRY_MESH_NONE;
+    }
+    for(uint32_t i = 0; i < vertex_count; i++) {
+        packed[i].position[0] = vertices[i].position[0];
+        packed[i].position[1] = vertices[i].position[1];
+        vec4 color = {vertices[i].color[0], vertices[i].color[1], vertices[i].color[2], 1.0f};
+        packed[i].color = pack_unorm4x8(color);
+        packed[i].uv = pack_unorm2x16(vertices[i].uv[0], vertices[i].uv[1]);
+    }
+    uint32_t mesh = geometry_pool_add_mesh(&(app->geometry_pool), packed, element_count, indices,
+                                           index_count);
+    host_free(&(app->host_memory), packed);
+    return mesh;
+}
+
+// Compactions replace the vertex buffer: the frames in flight keep reading the old slot
+void update_vertex_table(SimpleVkApp* app) {
+    VkBuffer buffer = app->geometry_pool.buffers.vertex_buffer;
+    if(buffer == app->vertex_table_buffer) {
+        return;
+    }
+    deletion_queue_push_bindless_buffer(&(app->deletion_queue), &(app->bindless),
+                                        app->vertex_table_index, app->frame_number);
+    app->vertex_table_index = bindless_register_buffer(&(app->bindless), buffer, 0, VK_WHOLE_SIZE);
+    app->vertex_table_buffer = buffer;
+}
+
+void create_geometry_pool(SimpleVkApp* app) {
+    GeometryPoolCreateInfo info = {0};
+    info.device = app->device;
+    info.physical_device = app->physical_device;
+    info.allocator = app->allocator;
+    info.transfer_family = app->queue_families_indices.transfer_family;
+    info.transfer_command_pool = app->transfer_command_pool;
+    info.graphics_family = app->queue_families_indices.graphics_family;
+    info.vertex_stride = sizeof(Vertex);
+    info.index_type = VK_INDEX_TYPE_UINT16;
+    info.vertex_capacity = GEOMETRY_POOL_VERTEX_CAPACITY;
+    info.index_capacity = GEOMETRY_POOL_INDEX_CAPACITY;
+    info.deletion_queue = &(app->deletion_queue);
+    info.memory_tracker = &(app->memory);
+    info.transfer_submit = app->transfer_submit;
+    info.force_staging = app->staged_uploads;
+    if(!geometry_pool_create(&(app->geometry_pool), &info)) {
+        printf("failed to create geometry pool\n");
+    }
+
+    app->square_mesh =
+        geometry_pool_add_mesh(&(app->geometry_pool), SQUARE_VERTICES, (uint32_t)NB_SQUARE_VERTICES,
+                               SQUARE_INDICES, (uint32_t)NB_SQUARE_INDICES);
+    app->square_mesh_packed = add_packed_mesh(app, SQUARE_VERTICES, (uint32_t)NB_SQUARE_VERTICES,
+                                              SQUARE_INDICES, (uint32_t)NB_SQUARE_INDICES);
+    // the first frames should not be drawn without them
+    geometry_pool_finish_uploads(&(app->geometry_pool));
+
+    app->vertex_table_buffer = VK_NULL_HANDLE;
+    app->vertex_table_index = BINDLESS_INVALID_INDEX;
+    update_vertex_table(app);
+}
+
+void create_uniform_buffers(SimpleVkApp* app) {
+    VkDeviceSize buffer_size = sizeof(UniformBufferObject);
+    uint32_t sharing_queues[2] = {app->queue_families_indices.graphics_family,
+                                  app->queue_families_indices.transfer_family};
+
+    app->uniform_buffers =
+        host_calloc(&(app->host_memory), MAX_FRAMES_IN_FLIGHT, sizeof(VkBuffer), HOST_SCOPE_APP);
+    app->uniform_buffers_memory = host_calloc(&(app->host_memory), MAX_FRAMES_IN_FLIGHT,
+                                              sizeof(VkDeviceMemory), HOST_SCOPE_APP);
+    app->uniform_buffers_mapped =
+        host_calloc(&(app->host_memory), MAX_FRAMES_IN_FLIGHT, sizeof(void*), HOST_SCOPE_APP);
 
     for(size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
         create_buffer(app, 2, sharing_queues, app->uniform_buffers + i, buffer_size,
                       VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, app->uniform_buffers_memory + i,
-                      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+                      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                      GPU_MEMORY_UNIFORM);
         // persistent mapping: the buffer stays mapped to this pointer. That way we do not need to
         // map it every time we modify it, increasing performance.
         vkMapMemory(app->device, (app->uniform_buffers_memory)[i], 0, buffer_size, 0,
@@ -1221,63 +2616,235 @@ void create_uniform_buffers(SimpleVkApp* app) {
     }
 }
 
-/* Descriptor pool and sets **********/
-void create_descriptor_pool(SimpleVkApp* app) {
-    // what are the descriptor sets goint to contain, and how many
-    VkDescriptorPoolSize pool_size = {0};
-    pool_size.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    pool_size.descriptorCount = MAX_FRAMES_IN_FLIGHT; // one per frame
-
-    VkDescriptorPoolCreateInfo pool_create_info = {0};
-    pool_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    pool_create_info.poolSizeCount = 1;
-    pool_create_info.pPoolSizes = &pool_size;
-    pool_create_info.maxSets = MAX_FRAMES_IN_FLIGHT;
-
-    if(vkCreateDescriptorPool(app->device, &pool_create_info, NULL, &(app->descriptor_pool)) !=
-       VK_SUCCESS) {
-        printf("failed to create descriptor pool\n");
+// The HUD is rebuilt every frame straight into the buffer of its frame in flight: host visible
+// and coherent, mapped once, only ever written sequentially by the CPU
+void create_hud(SimpleVkApp* app) {
+    hud_init(&(app->hud), HUD_SCALE);
+    VkDeviceSize buffer_size = HUD_MAX_VERTICES * sizeof(HudVertex);
+    for(size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        create_buffer(app, 1, NULL, app->hud_vertex_buffers + i, buffer_size,
+                      VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, app->hud_vertex_buffers_memory + i,
+                      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                      GPU_MEMORY_VERTEX);
+        vkMapMemory(app->device, app->hud_vertex_buffers_memory[i], 0, buffer_size, 0,
+                    (void**)(app->hud_vertices + i));
     }
 }
 
-void create_descriptor_sets(SimpleVkApp* app) {
-    VkDescriptorSetLayout layouts[MAX_FRAMES_IN_FLIGHT];
-    for(size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        layouts[i] = app->descriptor_set_layout;
+// Loads a KTX2 texture with its mip chain, through a staging buffer. Formats the device cannot
+// sample are decoded to rgba8 first.
+bool load_static_texture(SimpleVkApp* app, const char* path, StaticTexture* texture) {
+    texture->bindless_index = BINDLESS_INVALID_INDEX;
+    Ktx2Texture file = {0};
+    if(!ktx2_load(path, &file)) {
+        return false;
+    }
+    int format_index = ktx2_compressed_format_index(file.format);
+    if(format_index >= 0 && !app->compressed_format_supported[format_index]) {
+        printf("%s: format %d not supported by the device, transcoding\n", path, file.format);
+        Ktx2Texture transcoded = {0};
+        bool success = ktx2_transcode_to_rgba8(&file, &transcoded);
+        ktx2_free(&file);
+        if(!success) {
+            return false;
+        }
+        file = transcoded;
     }
-    VkDescriptorSetAllocateInfo allocate_info = {0};
-    allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    allocate_info.descriptorPool = app->descriptor_pool;
-    allocate_info.descriptorSetCount = MAX_FRAMES_IN_FLIGHT;
-    allocate_info.pSetLayouts = layouts;
 
-    app->descriptor_sets = calloc(MAX_FRAMES_IN_FLIGHT, sizeof(VkDescriptorSet));
-    // like commands, they are freed when the pool is destroyed.
-    if(vkAllocateDescriptorSets(app->device, &allocate_info, app->descriptor_sets) != VK_SUCCESS) {
-        printf("failed to allocate descriptor sets");
+    uint32_t sharing_queues[2] = {app->queue_families_indices.graphics_family,
+                                  app->queue_families_indices.transfer_family};
+    VkBuffer staging_buffer = {0};
+    VkDeviceMemory staging_memory = {0};
+    create_buffer(app, 1, NULL, &staging_buffer, file.data_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                  &staging_memory,
+                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                  GPU_MEMORY_STAGING);
+    void* data;
+    vkMapMemory(app->device, staging_memory, 0, file.data_size, 0, &data);
+    memcpy(data, file.data, file.data_size);
+    vkUnmapMemory(app->device, staging_memory);
+
+    VkImageCreateInfo image_info = {0};
+    image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_info.imageType = VK_IMAGE_TYPE_2D;
+    image_info.format = file.format;
+    image_info.extent = (VkExtent3D){file.width, file.height, 1};
+    image_info.mipLevels = file.level_count;
+    image_info.arrayLayers = 1;
+    image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+    image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_info.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    // written by the transfer queue, sampled by the graphics one, like the vertex buffer
+    if(app->queue_families_indices.graphics_family != app->queue_families_indices.transfer_family) {
+        image_info.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        image_info.queueFamilyIndexCount = 2;
+        image_info.pQueueFamilyIndices = sharing_queues;
+    } else {
+        image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    }
+    image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    if(vkCreateImage(app->device, &image_info, app->allocator, &(texture->image)) != VK_SUCCESS) {
+        printf("failed to create image for %s\n", path);
     }
 
+    VkMemoryRequirements memory_requirements = {0};
+    vkGetImageMemoryRequirements(app->device, texture->image, &memory_requirements);
+    VkMemoryAllocateInfo allocate_info = {0};
+    allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocate_info.allocationSize = memory_requirements.size;
+    allocate_info.memoryTypeIndex = find_memory_type(app, memory_requirements.memoryTypeBits,
+                                                     VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    if(gpu_memory_allocate(&(app->memory), &allocate_info, GPU_MEMORY_TEXTURE,
+                           &(texture->memory)) != VK_SUCCESS) {
+        printf("failed to allocate image memory for %s\n", path);
+    }
+    vkBindImageMemory(app->device, texture->image, texture->memory, 0);
+
+    copy_buffer_to_image(app, staging_buffer, texture->image, &file);
+
+    vkDestroyBuffer(app->device, staging_buffer, app->allocator);
+    gpu_memory_free(&(app->memory), staging_memory);
+
+    VkImageViewCreateInfo view_info = {0};
+    view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    view_info.image = texture->image;
+    view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    view_info.format = file.format;
+    view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    view_info.subresourceRange.baseMipLevel = 0;
+    view_info.subresourceRange.levelCount = file.level_count;
+    view_info.subresourceRange.baseArrayLayer = 0;
+    view_info.subresourceRange.layerCount = 1;
+    if(vkCreateImageView(app->device, &view_info, app->allocator, &(texture->view)) != VK_SUCCESS) {
+        printf("failed to create image view for %s\n", path);
+    }
+    ktx2_free(&file);
+
+    // same filtering as the streamed textures
+    texture->bindless_index =
+        bindless_register_image(&(app->bindless), texture->view, app->texture_streamer.sampler,
+                                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    return true;
+}
+
+void destroy_static_texture(SimpleVkApp* app, StaticTexture* texture) {
+    if(texture->bindless_index != BINDLESS_INVALID_INDEX) {
+        bindless_release_image(&(app->bindless), texture->bindless_index);
+    }
+    vkDestroyImageView(app->device, texture->view, app->allocator);
+    vkDestroyImage(app->device, texture->image, app->allocator);
+    gpu_memory_free(&(app->memory), texture->memory);
+}
+
+void create_material_table(SimpleVkApp* app) {
+    VkDeviceSize table_size = sizeof(Material) * MAX_MATERIALS;
+    VkDeviceSize buffer_size = table_size * MAX_FRAMES_IN_FLIGHT;
+    uint32_t sharing_queues[2] = {app->queue_families_indices.graphics_family,
+                                  app->queue_families_indices.transfer_family};
+
+    // small and rarely written: keep it mapped rather than going through a staging buffer
+    create_buffer(app, 2, sharing_queues, &(app->material_buffer), buffer_size,
+                  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, &(app->material_buffer_memory),
+                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                  GPU_MEMORY_STORAGE);
+    vkMapMemory(app->device, app->material_buffer_memory, 0, buffer_size, 0,
+                (void**)&(app->material_buffer_mapped));
+
     for(size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        VkDescriptorBufferInfo buffer_info = {0};
-        buffer_info.buffer = (app->uniform_buffers)[i];
-        buffer_info.offset = 0;
-        buffer_info.range = sizeof(UniformBufferObject); // can also use VK_WHOLE_SIZE
+        app->material_table_indices[i] = bindless_register_buffer(
+            &(app->bindless), app->material_buffer, i * table_size, table_size);
+    }
 
-        VkWriteDescriptorSet descriptor_write = {0};
-        descriptor_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptor_write.dstSet = (app->descriptor_sets)[i];
-        descriptor_write.dstBinding = 0;
-        descriptor_write.dstArrayElement = 0;
-        descriptor_write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        descriptor_write.descriptorCount = 1;
-        descriptor_write.pBufferInfo = &buffer_info;
-        descriptor_write.pImageInfo = NULL;       // optionnal
-        descriptor_write.pTexelBufferView = NULL; // optional
+    // material 0 is the default one: vertex colors as they are
+    glm_vec4_one(app->materials[0].tint);
+    app->materials[0].texture_index = BINDLESS_INVALID_INDEX;
+    app->material_textures[0] = TEXTURE_HANDLE_NONE;
+    // material 1: the same, with a streamed texture
+    glm_vec4_one(app->materials[1].tint);
+    app->material_textures[1] =
+        texture_streamer_request(&(app->texture_streamer), MAKE_TEXTURE_PATH("checker.ppm"));
+    // material 2: with a block compressed texture
+    glm_vec4_one(app->materials[2].tint);
+    load_static_texture(app, MAKE_TEXTURE_PATH("checker_bc1.ktx2"), &(app->compressed_texture));
+    app->materials[2].texture_index = app->compressed_texture.bindless_index;
+    app->material_textures[2] = TEXTURE_HANDLE_NONE;
+
+    app->material_count = 3;
+    app->material_index = 1;
+}
 
-        vkUpdateDescriptorSets(app->device, 1, &descriptor_write, 0, NULL);
+// Copies the materials in the table of this frame, with the texture versions resident right now
+void update_materials(SimpleVkApp* app, uint32_t current_frame) {
+    Material* table = app->material_buffer_mapped + current_frame * MAX_MATERIALS;
+    for(uint32_t i = 0; i < app->material_count; i++) {
+        table[i] = app->materials[i];
+        if(app->material_textures[i] != TEXTURE_HANDLE_NONE) {
+            table[i].texture_index =
+                texture_streamer_get_index(&(app->texture_streamer), app->material_textures[i]);
+        }
     }
 }
 
+void create_texture_streamer(SimpleVkApp* app) {
+    TextureStreamerCreateInfo info = {0};
+    info.device = app->device;
+    info.physical_device = app->physical_device;
+    info.allocator = app->allocator;
+    info.bindless = &(app->bindless);
+    info.transfer_family = app->queue_families_indices.transfer_family;
+    info.transfer_command_pool = app->transfer_command_pool;
+    info.graphics_family = app->queue_families_indices.graphics_family;
+    info.graphics_command_pool = app->graphics_command_pool;
+    info.frames_in_flight = MAX_FRAMES_IN_FLIGHT;
+    info.memory_budget = TEXTURE_MEMORY_BUDGET;
+    info.preview_size = TEXTURE_PREVIEW_SIZE;
+    info.max_uploads_per_frame = TEXTURE_MAX_UPLOADS_PER_FRAME;
+    info.nb_worker_threads = 0;
+    info.memory_tracker = &(app->memory);
+    info.transfer_submit = app->transfer_submit;
+    info.graphics_submit = app->graphics_submit;
+    info.profiler = &(app->profiler);
+    texture_streamer_create(&(app->texture_streamer), &info);
+}
+
+/* Descriptor pool and sets **********/
+// The pools of a frame in flight grow when they run out, and are only reset when the resources
+// the sets point to change: in steady state, every set of a frame comes out of the cache.
+void create_descriptor_caches(SimpleVkApp* app) {
+    // what are the descriptor sets going to contain: a uniform buffer, or an input attachment
+    DescriptorPoolRatio ratios[] = {{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1},
+                                    {VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 1}};
+    for(size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        if(!descriptor_cache_create(&(app->descriptor_caches[i]), app->device, app->allocator,
+                                    DESCRIPTOR_SETS_PER_POOL, ratios, 2)) {
+            printf("failed to create descriptor cache\n");
+        }
+    }
+}
+
+// Set 0 of the scene: the uniforms of the frame being prepared
+VkDescriptorSet frame_descriptor_set(SimpleVkApp* app) {
+    DescriptorBinding binding = {0};
+    binding.binding = 0;
+    binding.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    binding.buffer.buffer = (app->uniform_buffers)[app->current_frame];
+    binding.buffer.offset = 0;
+    binding.buffer.range = sizeof(UniformBufferObject); // can also use VK_WHOLE_SIZE
+    return descriptor_cache_get(&(app->descriptor_caches[app->current_frame]),
+                                app->descriptor_set_layout, &binding, 1);
+}
+
+// Read by tonemap (scene color) and grade (ldr color), in the subpasses mode
+VkDescriptorSet post_input_set(SimpleVkApp* app, VkImageView view) {
+    DescriptorBinding binding = {0};
+    binding.binding = 0;
+    binding.type = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+    binding.image.imageView = view;
+    binding.image.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    return descriptor_cache_get(&(app->descriptor_caches[app->current_frame]),
+                                app->post_input_set_layout, &binding, 1);
+}
+
 /* Command pools and buffers *********/
 void create_command_pools(SimpleVkApp* app) {
     // should store that somewhere, I think I call it pretty (too) often
@@ -1287,21 +2854,23 @@ void create_command_pools(SimpleVkApp* app) {
     pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
     pool_info.queueFamilyIndex = indices.graphics_family;
 
-    if(vkCreateCommandPool(app->device, &pool_info, NULL, &(app->graphics_command_pool)) !=
-       VK_SUCCESS) {
+    if(vkCreateCommandPool(app->device, &pool_info, app->allocator,
+                           &(app->graphics_command_pool)) != VK_SUCCESS) {
         printf("failed to create graphics command pool \n");
     }
 
     pool_info.queueFamilyIndex = indices.transfer_family;
-    if(vkCreateCommandPool(app->device, &pool_info, NULL, &(app->transfer_command_pool)) !=
-       VK_SUCCESS) {
+    if(vkCreateCommandPool(app->device, &pool_info, app->allocator,
+                           &(app->transfer_command_pool)) != VK_SUCCESS) {
         printf("failed to create graphics command pool \n");
     }
 }
 
 void create_command_buffers(SimpleVkApp* app) {
-    app->graphics_command_buffers = calloc(MAX_FRAMES_IN_FLIGHT, sizeof(VkCommandBuffer));
-    app->transfer_command_buffers = calloc(MAX_FRAMES_IN_FLIGHT, sizeof(VkCommandBuffer));
+    app->graphics_command_buffers = host_calloc(&(app->host_memory), MAX_FRAMES_IN_FLIGHT,
+                                                sizeof(VkCommandBuffer), HOST_SCOPE_APP);
+    app->transfer_command_buffers = host_calloc(&(app->host_memory), MAX_FRAMES_IN_FLIGHT,
+                                                sizeof(VkCommandBuffer), HOST_SCOPE_APP);
 
     VkCommandBufferAllocateInfo allocate_info = {0};
     allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -1323,6 +2892,90 @@ void create_command_buffers(SimpleVkApp* app) {
     }
 }
 
+// Around the draws of a pass, inside its subpass
+void begin_pass_statistics(SimpleVkApp* app, VkCommandBuffer command_buffer, StatisticsPass pass) {
+    if(app->pipeline_statistics_supported) {
+        vkCmdBeginQuery(command_buffer, app->pipeline_statistics_queries,
+                        STATISTICS_PASS_COUNT * app->current_frame + pass, 0);
+    }
+}
+
+void end_pass_statistics(SimpleVkApp* app, VkCommandBuffer command_buffer, StatisticsPass pass) {
+    if(app->pipeline_statistics_supported) {
+        vkCmdEndQuery(command_buffer, app->pipeline_statistics_queries,
+                      STATISTICS_PASS_COUNT * app->current_frame + pass);
+    }
+}
+
+// The HUD built for this frame, a single draw. Its pipeline and layout share nothing with the
+// post pass it is drawn in, everything is bound again.
+void record_hud(SimpleVkApp* app, VkCommandBuffer command_buffer) {
+    if(app->hud_vertex_count == 0) {
+        return;
+    }
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                      pipeline_variants_get(&(app->pipeline_variants), app->hud_variant_id));
+    VkDeviceSize offset = 0;
+    vkCmdBindVertexBuffers(command_buffer, 0, 1, &(app->hud_vertex_buffers[app->current_frame]),
+                           &offset);
+    HudPushConstants push_constants = {0};
+    push_constants.pixel_to_ndc[0] = 2.0f / (float)app->swapchain_extent.width;
+    push_constants.pixel_to_ndc[1] = 2.0f / (float)app->swapchain_extent.height;
+    vkCmdPushConstants(command_buffer, app->hud_pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0,
+                       sizeof(HudPushConstants), &push_constants);
+    vkCmdDraw(command_buffer, app->hud_vertex_count, 1, 0, 0);
+}
+
+// One fullscreen triangle reading the previous pass from the bindless table
+// hud: the HUD is drawn over the result, before the pass ends
+void record_sampled_post_pass(SimpleVkApp* app, VkCommandBuffer command_buffer,
+                              VkRenderPass render_pass, VkFramebuffer framebuffer,
+                              PostPipeline post_pipeline, uint32_t source_index, bool hud) {
+    VkRenderPassBeginInfo renderpass_info = {0};
+    renderpass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderpass_info.renderPass = render_pass;
+    renderpass_info.framebuffer = framebuffer;
+    renderpass_info.renderArea.offset = (VkOffset2D){0, 0};
+    renderpass_info.renderArea.extent = app->swapchain_extent;
+    renderpass_info.clearValueCount = 0; // every pixel is overwritten
+    vkCmdBeginRenderPass(command_buffer, &renderpass_info, VK_SUBPASS_CONTENTS_INLINE);
+
+    vkCmdBindPipeline(
+        command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+        pipeline_variants_get(&(app->pipeline_variants), app->post_variant_ids[post_pipeline]));
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                            app->post_pipeline_layout, 1, 1, &(app->bindless.set), 0, NULL);
+    PostPushConstants push_constants = {0};
+    push_constants.source = source_index;
+    push_constants.texel_size[0] = 1.0f / (float)app->swapchain_extent.width;
+    push_constants.texel_size[1] = 1.0f / (float)app->swapchain_extent.height;
+    vkCmdPushConstants(command_buffer, app->post_pipeline_layout, VK_SHADER_STAGE_FRAGMENT_BIT, 0,
+                       sizeof(PostPushConstants), &push_constants);
+    begin_pass_statistics(app, command_buffer, POST_PIPELINE_PASSES[post_pipeline]);
+    vkCmdDraw(command_buffer, 3, 1, 0, 0);
+    // the HUD is left out
+    end_pass_statistics(app, command_buffer, POST_PIPELINE_PASSES[post_pipeline]);
+    if(hud) {
+        record_hud(app, command_buffer);
+    }
+
+    vkCmdEndRenderPass(command_buffer);
+}
+
+// Moves to the next subpass, and runs a fullscreen triangle reading the previous one
+void record_post_subpass(SimpleVkApp* app, VkCommandBuffer command_buffer,
+                         PostPipeline post_pipeline, VkDescriptorSet input_set) {
+    vkCmdNextSubpass(command_buffer, VK_SUBPASS_CONTENTS_INLINE);
+    vkCmdBindPipeline(
+        command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+        pipeline_variants_get(&(app->pipeline_variants), app->post_variant_ids[post_pipeline]));
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                            app->post_pipeline_layout, 0, 1, &input_set, 0, NULL);
+    begin_pass_statistics(app, command_buffer, POST_PIPELINE_PASSES[post_pipeline]);
+    vkCmdDraw(command_buffer, 3, 1, 0, 0);
+    end_pass_statistics(app, command_buffer, POST_PIPELINE_PASSES[post_pipeline]);
+}
+
 // Writes the commmands we want to execute into a command buffer
 void record_command_buffer(SimpleVkApp* app, VkCommandBuffer command_buffer, uint32_t image_index) {
 
@@ -1335,32 +2988,30 @@ void record_command_buffer(SimpleVkApp* app, VkCommandBuffer command_buffer, uin
     if(vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS) {
         printf("failed to begin recording command buffer\n");
     }
+    // queries have to be reset outside of a render pass
+    if(app->overdraw_query_supported) {
+        vkCmdResetQueryPool(command_buffer, app->overdraw_queries, app->current_frame, 1);
+    }
+    if(app->pipeline_statistics_supported) {
+        vkCmdResetQueryPool(command_buffer, app->pipeline_statistics_queries,
+                            STATISTICS_PASS_COUNT * app->current_frame, STATISTICS_PASS_COUNT);
+    }
+    if(app->frame_timer_supported) {
+        vkCmdResetQueryPool(command_buffer, app->frame_timestamps,
+                            FRAME_TIMESTAMP_COUNT * app->current_frame, FRAME_TIMESTAMP_COUNT);
+        vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                            app->frame_timestamps, FRAME_TIMESTAMP_COUNT * app->current_frame);
+    }
 
-    /* Starting render pass */
-    VkRenderPassBeginInfo renderpass_info = {0};
-    renderpass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    renderpass_info.renderPass = app->render_pass;
-    renderpass_info.framebuffer = app->swapchain_framebuffers[image_index];
-    renderpass_info.renderArea.offset = (VkOffset2D){0, 0};
-    renderpass_info.renderArea.extent = app->swapchain_extent;
-    // color to use in VK_ATTACHMENT_LOAD_OP_CLEAR
-    VkClearValue clear_color = {.color = {.float32 = {0.0f, 0.0f, 0.0f, 0.0f}}};
-    renderpass_info.clearValueCount = 1;
-    renderpass_info.pClearValues = &clear_color;
-    vkCmdBeginRenderPass(command_buffer, &renderpass_info, VK_SUBPASS_CONTENTS_INLINE);
-
-    /* Drawing Commands */
-    // Binds the pipeline
-    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, app->graphics_pipeline);
-
-    // Viewport and scissor state are dynamic, so we need to set them
+    // Viewport and scissor state are dynamic, so we need to set them. They stay set for every
+    // pipeline bound afterwards, in every render pass: all of them cover the whole screen.
     VkViewport viewport = {0};
     viewport.x = 0.0f;
     viewport.y = 0.0f;
     viewport.width = (float)(app->swapchain_extent.width);
     viewport.height = (float)(app->swapchain_extent.height);
     viewport.minDepth = 0.0f;
-    viewport.maxDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
     vkCmdSetViewport(command_buffer, 0, 1, &viewport);
 
     VkRect2D scissor = {0};
@@ -1368,63 +3019,171 @@ void record_command_buffer(SimpleVkApp* app, VkCommandBuffer command_buffer, uin
     scissor.extent = app->swapchain_extent;
     vkCmdSetScissor(command_buffer, 0, 1, &scissor);
 
-    // Bind buffers
-    VkBuffer vertex_buffers[] = {app->shape_vertex_buffer};
-    VkDeviceSize offsets[] = {0};
-    vkCmdBindVertexBuffers(command_buffer, 0, 1, vertex_buffers, offsets);
-    vkCmdBindIndexBuffer(command_buffer, app->shape_index_buffer, 0, VK_INDEX_TYPE_UINT16);
+    /* Starting render pass */
+    bool subpasses = app->post_mode == POST_MODE_SUBPASSES;
+    VkRenderPassBeginInfo renderpass_info = {0};
+    renderpass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderpass_info.renderPass = subpasses ? app->render_pass : app->scene_render_pass;
+    renderpass_info.framebuffer = app->scene_framebuffer;
+    renderpass_info.renderArea.offset = (VkOffset2D){0, 0};
+    renderpass_info.renderArea.extent = app->swapchain_extent;
+    // color to use in VK_ATTACHMENT_LOAD_OP_CLEAR
+    // one per attachment, in the same order (cf create_scene_render_pass). Values of the
+    // attachments that are not cleared are ignored.
+    VkClearValue clear_values[5] = {{.color = {.float32 = {0.0f, 0.0f, 0.0f, 0.0f}}},
+                                    {.depthStencil = {1.0f, 0}},
+                                    {.color = {.float32 = {0.0f, 0.0f, 0.0f, 0.0f}}},
+                                    {.color = {.float32 = {0.0f, 0.0f, 0.0f, 0.0f}}},
+                                    {.color = {.float32 = {0.0f, 0.0f, 0.0f, 0.0f}}}};
+    renderpass_info.clearValueCount =
+        (subpasses ? 4 : 2) + (app->msaa_samples != VK_SAMPLE_COUNT_1_BIT ? 1 : 0);
+    renderpass_info.pClearValues = clear_values;
+    vkCmdBeginRenderPass(command_buffer, &renderpass_info, VK_SUBPASS_CONTENTS_INLINE);
 
-    // Binds uniforms
-    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, app->pipeline_layout,
-                            0, 1, app->descriptor_sets, 0, NULL);
-    /**/
-    vkCmdDrawIndexed(command_buffer, (uint32_t)NB_SQUARE_INDICES, 1, 0, 0, 0);
+    /* Drawing Commands */
+    // counts every sample passing the depth test, ie every fragment shaded thanks to early-Z
+    if(app->overdraw_query_supported) {
+        vkCmdBeginQuery(command_buffer, app->overdraw_queries, app->current_frame,
+                        VK_QUERY_CONTROL_PRECISE_BIT);
+    }
+    begin_pass_statistics(app, command_buffer, STATISTICS_PASS_SCENE);
+    // binds pipelines, sets and buffers only when they change from one draw to the next
+    render_queue_record(&(app->render_queue), command_buffer);
+    end_pass_statistics(app, command_buffer, STATISTICS_PASS_SCENE);
+    if(app->overdraw_query_supported) {
+        vkCmdEndQuery(command_buffer, app->overdraw_queries, app->current_frame);
+    }
+    // the scene draws are done once every stage has finished them
+    if(app->frame_timer_supported) {
+        vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                            app->frame_timestamps, FRAME_TIMESTAMP_COUNT * app->current_frame + 1);
+    }
 
-    vkCmdEndRenderPass(command_buffer);
+    /* Post-processing */
+    if(subpasses) {
+        record_post_subpass(app, command_buffer, POST_PIPELINE_TONEMAP_SUBPASS,
+                            post_input_set(app, app->scene_color_image_view));
+        record_post_subpass(app, command_buffer, POST_PIPELINE_GRADE_SUBPASS,
+                            post_input_set(app, app->ldr_color_image_view));
+        vkCmdEndRenderPass(command_buffer);
+    } else {
+        vkCmdEndRenderPass(command_buffer);
+        record_sampled_post_pass(app, command_buffer, app->post_render_pass,
+                                 app->tonemap_framebuffer, POST_PIPELINE_TONEMAP_PASS,
+                                 app->scene_color_index, false);
+        record_sampled_post_pass(app, command_buffer, app->post_render_pass,
+                                 app->grade_framebuffer, POST_PIPELINE_GRADE_PASS,
+                                 app->ldr_color_index, false);
+    }
+    record_sampled_post_pass(app, command_buffer, app->present_render_pass,
+                             app->swapchain_framebuffers[image_index], POST_PIPELINE_FXAA,
+                             app->post_color_index, app->hud_enabled);
+
+    if(app->frame_timer_supported) {
+        vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                            app->frame_timestamps, FRAME_TIMESTAMP_COUNT * app->current_frame + 2);
+    }
     if(vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
         printf("failed to record command buffer");
     }
 }
 
 /* Swapchain maintenance *************/
+// Nothing is destroyed right away, everything goes through the deletion queue. The swapchain
+// handle stays valid until then, the new swapchain is created from it.
 void cleanup_swapchain(SimpleVkApp* app) {
+    destroy_framebuffers(app);
+
     for(size_t i = 0; i < app->swapchain_image_count; i++) {
-        vkDestroyFramebuffer(app->device, app->swapchain_framebuffers[i], NULL);
+        deletion_queue_push_image_view(&(app->deletion_queue), app->swapchain_images_views[i],
+                                       app->frame_number);
     }
-    free(app->swapchain_framebuffers);
+    host_free(&(app->host_memory), app->swapchain_images_views);
 
-    for(size_t i = 0; i < app->swapchain_image_count; i++) {
-        vkDestroyImageView(app->device, app->swapchain_images_views[i], NULL);
+    host_free(&(app->host_memory), app->swapchain_images);
+
+    destroy_render_targets(app);
+
+    deletion_queue_push_swapchain(&(app->deletion_queue), app->swapchain, app->frame_number);
+}
+
+// Frames before this one are finished on the GPU. Does not wait, only looks at the fences.
+uint64_t first_pending_frame(SimpleVkApp* app) {
+    uint64_t first = app->frame_number;
+    for(size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        if(app->in_flight_frame_numbers[i] < first &&
+           vkGetFenceStatus(app->device, app->in_flight[i]) == VK_NOT_READY) {
+            first = app->in_flight_frame_numbers[i];
+        }
     }
-    free(app->swapchain_images_views);
+    return first;
+}
 
-    free(app->swapchain_images);
+// One render finished semaphore per swapchain image: a present only waits on the submit that
+// rendered its image
+void create_present_semaphores(SimpleVkApp* app) {
+    app->image_ready_present = host_calloc(&(app->host_memory), app->swapchain_image_count,
+                                           sizeof(VkSemaphore), HOST_SCOPE_SWAPCHAIN);
+    VkSemaphoreCreateInfo semaphore_info = {0};
+    semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    for(size_t i = 0; i < app->swapchain_image_count; i++) {
+        if(vkCreateSemaphore(app->device, &semaphore_info, app->allocator,
+                             &(app->image_ready_present[i])) != VK_SUCCESS) {
+            printf("failed to create render finished semaphores for all swapchain images\n");
+        }
+    }
+}
 
-    vkDestroySwapchainKHR(app->device, app->swapchain, NULL);
+// image_count: the number of semaphores, which is the swapchain they were created for. The last
+// submit signaling them is of the previous frame: recreate_swapchain is never called between the
+// submit of a frame and the next frame, so frame_number is the right retire frame.
+void retire_present_semaphores(SimpleVkApp* app, uint32_t image_count) {
+    for(size_t i = 0; i < image_count; i++) {
+        deletion_queue_push_semaphore(&(app->deletion_queue), app->image_ready_present[i],
+                                      app->frame_number);
+    }
+    host_free(&(app->host_memory), app->image_ready_present);
+    app->image_ready_present = NULL;
 }
 
 void recreate_swapchain(SimpleVkApp* app) {
-    // this function will recreate the swapchain when anything change about the window
-    vkDeviceWaitIdle(app->device);
+    // the present thread must be done with the old swapchain before it becomes oldSwapchain
+    present_thread_flush(&(app->present_thread));
+    // this function will recreate the swapchain when anything change about the window. The frames
+    // in flight keep rendering with the old resources, they are only retired here.
+    deletion_queue_collect(&(app->deletion_queue), first_pending_frame(app));
 
     // clean everything that will be recreated very soon
     cleanup_swapchain(app);
+    app->framebuffer_resized = false;
+    app->swapchain_out_of_date = false;
+    // the render targets of the new mode are created with the new swapchain
+    app->post_mode = app->post_mode_requested;
 
     // call all the function that depends on the swapchain or the window size
+    uint32_t old_image_count = app->swapchain_image_count;
     create_swapchain(app);
+    // another present mode can come with another number of images, and draw_frame indexes the
+    // semaphores with the image index
+    if(app->swapchain_image_count != old_image_count) {
+        retire_present_semaphores(app, old_image_count);
+        create_present_semaphores(app);
+    }
     create_image_views(app);
+    create_render_targets(app);
     create_framebuffers(app);
 }
 
 /* Frame drawing commands ************/
 void create_synchronization_objects(SimpleVkApp* app) {
-    // Create a semaphore per swapchain image
-    app->image_ready_present = calloc(app->swapchain_image_count, sizeof(VkSemaphore));
+    create_present_semaphores(app);
 
     // in-flight fences are used to synchronize cpu frames and gpu frames, so only need as many as
     // max frames in flight.
-    app->image_available = calloc(MAX_FRAMES_IN_FLIGHT, sizeof(VkSemaphore));
-    app->in_flight = calloc(MAX_FRAMES_IN_FLIGHT, sizeof(VkFence));
+    app->image_available = host_calloc(&(app->host_memory), MAX_FRAMES_IN_FLIGHT,
+                                       sizeof(VkSemaphore), HOST_SCOPE_APP);
+    app->in_flight =
+        host_calloc(&(app->host_memory), MAX_FRAMES_IN_FLIGHT, sizeof(VkFence), HOST_SCOPE_APP);
 
     VkSemaphoreCreateInfo semaphore_info = {0};
     semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
@@ -1433,232 +3192,1229 @@ void create_synchronization_objects(SimpleVkApp* app) {
     fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT; // starts at 1 to not explode
 
     for(size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        if(vkCreateSemaphore(app->device, &semaphore_info, NULL, &(app->image_available[i])) !=
-           VK_SUCCESS) {
+        if(vkCreateSemaphore(app->device, &semaphore_info, app->allocator,
+                             &(app->image_available[i])) != VK_SUCCESS) {
             printf("failed to create semaphores for all frames in flight\n");
         }
-        if(vkCreateFence(app->device, &fence_info, NULL, &(app->in_flight[i])) != VK_SUCCESS) {
+        if(vkCreateFence(app->device, &fence_info, app->allocator,
+                         &(app->in_flight[i])) != VK_SUCCESS) {
             printf("failed to create fences for all frames in flight\n");
         }
     }
-    for(size_t i = 0; i < app->swapchain_image_count; i++) {
-        if(vkCreateSemaphore(app->device, &semaphore_info, NULL, &(app->image_ready_present[i])) !=
+}
+
+void update_ubo(SimpleVkApp* app, uint32_t current_frame) {
+    // objects are placed by the scene graph, the ubo only holds the camera
+    UniformBufferObject ubo = {GLM_MAT4_IDENTITY_INIT, GLM_MAT4_IDENTITY_INIT,
+                               GLM_MAT4_IDENTITY_INIT};
+    if(app->replay_frame != NULL) {
+        // the camera of the capture, projection included
+        memcpy(ubo.view, app->replay_frame->view, sizeof(mat4));
+        memcpy(ubo.proj, app->replay_frame->proj, sizeof(mat4));
+    } else {
+        glm_lookat((vec3){2.0, 2.0, 2.0}, (vec3){0.0, 0.0, 0.0}, GLM_ZUP, ubo.view);
+        glm_perspective(glm_rad(45.0),
+                        (float)app->swapchain_extent.width / (float)app->swapchain_extent.height,
+                        CAMERA_NEAR_PLANE, CAMERA_FAR_PLANE, ubo.proj);
+        ubo.proj[1][1] *= -1;
+    }
+    memcpy(app->capture_frame.view, ubo.view, sizeof(mat4));
+    memcpy(app->capture_frame.proj, ubo.proj, sizeof(mat4));
+
+    memcpy(app->uniform_buffers_mapped[current_frame], &ubo, sizeof(UniformBufferObject));
+    glm_mat4_copy(ubo.view, app->view);
+}
+
+// Places the turntable where the simulation has it, then brings the world matrices and the GPU
+// table of this frame up to date
+void update_scene(SimpleVkApp* app, uint32_t current_frame) {
+    if(app->replay_frame != NULL) {
+        // the nodes that moved in this frame of the capture, the simulation is not running.
+        // Nodes past a full scene graph were not created, see create_replay_scene.
+        for(uint32_t i = 0; i < app->replay_frame->transform_count; i++) {
+            if(app->replay_transforms[i].node >= app->scene.count) {
+                continue;
+            }
+            mat4 local;
+            memcpy(local, app->replay_transforms[i].local, sizeof(mat4));
+            scene_graph_set_local(&(app->scene), app->replay_transforms[i].node, local);
+        }
+    } else {
+        // a step in the past, so that there is a simulated state on each side of the rendered
+        // time
+        SimulationState state;
+        app->simulation_moving = simulation_sample(
+            &(app->simulation), simulation_now_s() - SIMULATION_STEP_S, &state);
+        if(state.turntable_angle != app->turntable_angle) {
+            app->turntable_angle = state.turntable_angle;
+            mat4 rotation = GLM_MAT4_IDENTITY_INIT;
+            glm_rotate(rotation, state.turntable_angle, GLM_ZUP);
+            scene_graph_set_local(&(app->scene), app->turntable_node, rotation);
+            if(app->capture.file != NULL) {
+                trace_writer_set_local(&(app->capture), app->turntable_node, (float*)rotation);
+            }
+        }
+    }
+    scene_graph_update(&(app->scene));
+    scene_graph_upload(&(app->scene), current_frame,
+                       app->transform_buffer_mapped + current_frame * MAX_SCENE_NODES);
+}
+
+/* Draw list *************************/
+void create_transform_table(SimpleVkApp* app) {
+    VkDeviceSize table_size = sizeof(mat4) * MAX_SCENE_NODES;
+    VkDeviceSize buffer_size = table_size * MAX_FRAMES_IN_FLIGHT;
+    uint32_t sharing_queues[2] = {app->queue_families_indices.graphics_family,
+                                  app->queue_families_indices.transfer_family};
+
+    // only the matrices that changed are written each frame: keep it mapped, like the materials
+    create_buffer(app, 2, sharing_queues, &(app->transform_buffer), buffer_size,
+                  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, &(app->transform_buffer_memory),
+                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                  GPU_MEMORY_STORAGE);
+    vkMapMemory(app->device, app->transform_buffer_memory, 0, buffer_size, 0,
+                (void**)&(app->transform_buffer_mapped));
+
+    for(size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        app->transform_table_indices[i] = bindless_register_buffer(
+            &(app->bindless), app->transform_buffer, i * table_size, table_size);
+    }
+}
+
+// The nodes of the capture, in the same order so that they keep their indices. The frames of the
+// trace move them, nothing else does.
+void create_replay_scene(SimpleVkApp* app) {
+    app->turntable_node = SCENE_NODE_NONE;
+    app->animate_scene = false;
+    app->draw_count = 0;
+    for(uint32_t i = 0; i < app->replay.header.node_count; i++) {
+        const TraceNode* node = app->replay.nodes + i;
+        mat4 local;
+        memcpy(local, node->local, sizeof(mat4));
+        // trace_reader_open checked that parents come first: only a full graph fails, and then
+        // every node after it would too
+        uint32_t index = scene_graph_add_node(&(app->scene), node->parent, local);
+        if(index == SCENE_NODE_NONE) {
+            printf("the scene graph is full, the last %u nodes of the trace are left out\n",
+                   app->replay.header.node_count - i);
+            break;
+        }
+        if(node->drawn && app->draw_count < MAX_DRAWS) {
+            app->draws[app->draw_count++].node = index;
+        }
+    }
+}
+
+// A stack of squares, each one above the previous, seen from above: they mostly hide each other.
+// They all sit on a spinning turntable.
+void create_draw_list(SimpleVkApp* app) {
+    create_transform_table(app);
+    scene_graph_create(&(app->scene), MAX_SCENE_NODES, MAX_FRAMES_IN_FLIGHT);
+    if(app->replaying) {
+        create_replay_scene(app);
+    } else {
+        mat4 identity = GLM_MAT4_IDENTITY_INIT;
+        app->turntable_node = scene_graph_add_node(&(app->scene), SCENE_NODE_NONE, identity);
+        app->animate_scene = true;
+
+        app->draw_count = NB_STACKED_SQUARES;
+        for(uint32_t i = 0; i < NB_STACKED_SQUARES; i++) {
+            // bottom first: the worst order for the camera, that is above the stack
+            mat4 local;
+            glm_translate_make(local, (vec3){0.0f, 0.0f, 0.1f * (float)i});
+            float scale = 1.0f + 0.15f * (float)(NB_STACKED_SQUARES - i);
+            glm_scale(local, (vec3){scale, scale, 1.0f});
+            app->draws[i].node = scene_graph_add_node(&(app->scene), app->turntable_node, local);
+        }
+    }
+    app->sort_draws = true;
+    render_queue_create(&(app->render_queue), MAX_DRAWS, 0);
+
+    // the turntable starts at angle 0, like its node
+    app->turntable_angle = 0.0f;
+    simulation_create(&(app->simulation), SIMULATION_STEP_S, TURNTABLE_SPEED, app->animate_scene);
+}
+
+// Every draw becomes a packet. The queue orders them by state, then front-to-back: the nearest
+// surfaces fill the depth buffer first, and the fragments of the ones they hide are rejected
+// before shading.
+void fill_render_queue(SimpleVkApp* app) {
+    PipelineKind kind = PIPELINE_KIND_OPAQUE;
+    if(app->debug_view == DEBUG_VIEW_DEPTH) {
+        kind = PIPELINE_KIND_DEBUG_DEPTH;
+    } else if(app->debug_view == DEBUG_VIEW_COVERAGE) {
+        kind = PIPELINE_KIND_DEBUG_COVERAGE;
+    }
+    bool pulled = app->vertex_fetch == VERTEX_FETCH_PULLED;
+    uint32_t pipeline_id = app->pipeline_variant_ids[app->post_mode][app->vertex_fetch][kind];
+
+    DrawPacket packet = {0};
+    packet.pipeline = pipeline_variants_get(&(app->pipeline_variants), pipeline_id);
+    packet.layout = app->pipeline_layout;
+    // uniforms, and the bindless table: the same for every draw, so bound once
+    packet.descriptor_set_count = 2;
+    packet.descriptor_sets[0] = frame_descriptor_set(app);
+    packet.descriptor_sets[1] = app->bindless.set;
+    // one binding for every mesh of the pool: they only differ by their offsets. Pulled vertices
+    // are read through the bindless table instead, and start where the push constants say.
+    uint32_t mesh_handle = pulled ? app->square_mesh_packed : app->square_mesh;
+    const GeometryMesh* mesh = geometry_pool_mesh(&(app->geometry_pool), mesh_handle);
+    packet.vertex_buffer = pulled ? VK_NULL_HANDLE : app->geometry_pool.buffers.vertex_buffer;
+    packet.index_buffer = app->geometry_pool.buffers.index_buffer;
+    packet.index_type = app->geometry_pool.info.index_type;
+    packet.count = mesh != NULL ? mesh->indices.count : 0;
+    packet.first_index = mesh != NULL ? mesh->indices.offset : 0;
+    packet.vertex_offset = mesh != NULL && !pulled ? (int32_t)mesh->vertices.offset : 0;
+    packet.instance_count = 1;
+    packet.push_constant_stages = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+    packet.push_constant_size = sizeof(PushConstants);
+
+    render_queue_reset(&(app->render_queue));
+    for(uint32_t i = 0; mesh != NULL && i < app->draw_count; i++) {
+        mat4 model_view;
+        glm_mat4_mul(app->view, app->scene.worlds[app->draws[i].node], model_view);
+        // the camera looks down -z in view space. Origin of the square = its center
+        app->draws[i].view_depth = -model_view[3][2];
+
+        // Per draw data: which transform and resources to read from the bindless arrays
+        PushConstants push_constants = {0};
+        push_constants.transform_table = app->transform_table_indices[app->current_frame];
+        push_constants.transform_index = app->draws[i].node;
+        push_constants.material_table = app->material_table_indices[app->current_frame];
+        push_constants.material_index = app->material_index;
+        if(pulled) {
+            push_constants.vertex_table = app->vertex_table_index;
+            push_constants.vertex_base =
+                mesh->vertices.offset * (uint32_t)(sizeof(Vertex) / sizeof(uint32_t));
+            push_constants.vertex_format = VERTEX_FORMAT_PACKED;
+        }
+        memcpy(packet.push_constants, &push_constants, sizeof(PushConstants));
+
+        // unsorted: equal keys keep the scene order
+        float depth = (app->draws[i].view_depth - CAMERA_NEAR_PLANE) /
+                      (CAMERA_FAR_PLANE - CAMERA_NEAR_PLANE);
+        uint64_t key = render_queue_make_key(RENDER_PASS_OPAQUE, pipeline_id,
+                                             app->material_index, mesh_handle,
+                                             app->sort_draws ? depth : 0.0f);
+        if(!render_queue_submit(&(app->render_queue), key, &packet)) {
+            printf("render queue full, dropping draws\n");
+            break;
+        }
+    }
+    render_queue_sort(&(app->render_queue));
+}
+
+void create_overdraw_queries(SimpleVkApp* app) {
+    if(!app->overdraw_query_supported) {
+        printf("precise occlusion queries not supported, overdraw will not be reported\n");
+        return;
+    }
+    VkQueryPoolCreateInfo pool_info = {0};
+    pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    pool_info.queryType = VK_QUERY_TYPE_OCCLUSION;
+    pool_info.queryCount = MAX_FRAMES_IN_FLIGHT;
+    if(vkCreateQueryPool(app->device, &pool_info, app->allocator,
+                         &(app->overdraw_queries)) != VK_SUCCESS) {
+        printf("failed to create overdraw query pool\n");
+        app->overdraw_query_supported = false;
+    }
+}
+
+// Called once the frame that used the query is done, so this never waits
+void read_overdraw_query(SimpleVkApp* app, uint32_t current_frame) {
+    if(!app->overdraw_query_supported || !app->overdraw_query_pending[current_frame]) {
+        return;
+    }
+    uint64_t samples = 0;
+    if(vkGetQueryPoolResults(app->device, app->overdraw_queries, current_frame, 1,
+                             sizeof(uint64_t), &samples, sizeof(uint64_t),
+                             VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+        return;
+    }
+    app->overdraw_query_pending[current_frame] = false;
+    app->overdraw_samples += samples;
+    app->overdraw_frames++;
+    if(app->overdraw_frames == OVERDRAW_REPORT_PERIOD) {
+        // the query counts samples: with msaa, each fragment covers up to msaa_samples of them
+        double pixels = (double)app->swapchain_extent.width * app->swapchain_extent.height *
+                        (double)app->msaa_samples;
+        printf("overdraw (draws %s): %.3f shaded fragments per pixel\n",
+               app->sort_draws ? "sorted front-to-back" : "unsorted",
+               (double)app->overdraw_samples / (pixels * OVERDRAW_REPORT_PERIOD));
+        app->overdraw_samples = 0;
+        app->overdraw_frames = 0;
+    }
+}
+
+void create_pipeline_statistics_queries(SimpleVkApp* app) {
+    if(!app->pipeline_statistics_supported) {
+        printf("pipeline statistics queries not supported, passes will not be reported\n");
+        return;
+    }
+    VkQueryPoolCreateInfo pool_info = {0};
+    pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    pool_info.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+    pool_info.queryCount = STATISTICS_PASS_COUNT * MAX_FRAMES_IN_FLIGHT;
+    pool_info.pipelineStatistics = PIPELINE_STATISTICS_FLAGS;
+    if(vkCreateQueryPool(app->device, &pool_info, app->allocator,
+                         &(app->pipeline_statistics_queries)) != VK_SUCCESS) {
+        printf("failed to create pipeline statistics query pool\n");
+        app->pipeline_statistics_supported = false;
+    }
+}
+
+void add_pipeline_statistics(PipelineStatistics* total, const PipelineStatistics* pass) {
+    total->input_vertices += pass->input_vertices;
+    total->input_primitives += pass->input_primitives;
+    total->vertex_invocations += pass->vertex_invocations;
+    total->clipping_invocations += pass->clipping_invocations;
+    total->clipping_primitives += pass->clipping_primitives;
+    total->fragment_invocations += pass->fragment_invocations;
+}
+
+// Averages per frame of each pass
+void print_pipeline_statistics(const PipelineStatistics* passes, uint32_t frame_count) {
+    if(frame_count == 0) {
+        return;
+    }
+    double frames = (double)frame_count;
+    printf("pipeline statistics per frame (%u frames):\n", frame_count);
+    printf("    pass      vertices  primitives  vs invocations  clipper in  clipper out  "
+           "fs invocations\n");
+    for(uint32_t pass = 0; pass < STATISTICS_PASS_COUNT; pass++) {
+        const PipelineStatistics* statistics = passes + pass;
+        printf("    %-8s %9.0f  %10.0f  %14.0f  %10.0f  %11.0f  %14.0f\n",
+               STATISTICS_PASS_NAMES[pass], (double)statistics->input_vertices / frames,
+               (double)statistics->input_primitives / frames,
+               (double)statistics->vertex_invocations / frames,
+               (double)statistics->clipping_invocations / frames,
+               (double)statistics->clipping_primitives / frames,
+               (double)statistics->fragment_invocations / frames);
+    }
+}
+
+// Called once the frame that used the queries is done, so this never waits
+void read_pipeline_statistics(SimpleVkApp* app, uint32_t current_frame) {
+    if(!app->pipeline_statistics_supported || !app->pipeline_statistics_pending[current_frame]) {
+        return;
+    }
+    PipelineStatistics passes[STATISTICS_PASS_COUNT] = {0};
+    if(vkGetQueryPoolResults(app->device, app->pipeline_statistics_queries,
+                             STATISTICS_PASS_COUNT * current_frame, STATISTICS_PASS_COUNT,
+                             sizeof(passes), passes, sizeof(PipelineStatistics),
+                             VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+        return;
+    }
+    app->pipeline_statistics_pending[current_frame] = false;
+    uint32_t replay_frame = app->in_flight_replay_frames[current_frame];
+    bool replay_measured = replay_frame != UINT32_MAX && replay_frame >= app->replay_warmup_frames;
+    for(uint32_t pass = 0; pass < STATISTICS_PASS_COUNT; pass++) {
+        add_pipeline_statistics(app->pipeline_statistics + pass, passes + pass);
+        if(replay_measured) {
+            add_pipeline_statistics(app->replay_statistics + pass, passes + pass);
+        }
+    }
+    app->replay_statistics_frames += replay_measured ? 1 : 0;
+    app->pipeline_statistics_frames++;
+    if(app->pipeline_statistics_frames == PIPELINE_STATISTICS_REPORT_PERIOD) {
+        print_pipeline_statistics(app->pipeline_statistics, app->pipeline_statistics_frames);
+        memset(app->pipeline_statistics, 0, sizeof(app->pipeline_statistics));
+        app->pipeline_statistics_frames = 0;
+    }
+}
+
+// Samples the GPU and CPU clocks together, GPU timestamps are converted from the last pair
+void calibrate_gpu_clock(SimpleVkApp* app) {
+    if(!app->calibrated_timestamps_supported) {
+        return;
+    }
+    if(app->get_calibrated_timestamps == NULL) {
+        app->get_calibrated_timestamps = (PFN_vkGetCalibratedTimestampsEXT)vkGetDeviceProcAddr(
+            app->device, "vkGetCalibratedTimestampsEXT");
+    }
+    VkCalibratedTimestampInfoEXT infos[2] = {0};
+    infos[0].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+    infos[0].timeDomain = VK_TIME_DOMAIN_DEVICE_EXT;
+    infos[1].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+    infos[1].timeDomain = VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT;
+    uint64_t timestamps[2] = {0};
+    uint64_t max_deviation = 0;
+    if(app->get_calibrated_timestamps == NULL ||
+       app->get_calibrated_timestamps(app->device, 2, infos, timestamps, &max_deviation) !=
            VK_SUCCESS) {
-            printf("failed to create render finished semaphores for all swapchain images\n");
+        printf("failed to calibrate the GPU clock, GPU zones are anchored on submits instead\n");
+        app->calibrated_timestamps_supported = false;
+        return;
+    }
+    app->gpu_calibration_ticks = timestamps[0];
+    app->gpu_calibration_ns = (int64_t)timestamps[1];
+}
+
+int64_t gpu_ticks_to_ns(SimpleVkApp* app, uint64_t ticks) {
+    // signed: the ticks may be from before the calibration
+    double ticks_since = (double)(int64_t)(ticks - app->gpu_calibration_ticks);
+    return app->gpu_calibration_ns + (int64_t)(ticks_since * app->timestamp_period_ns);
+}
+
+void create_frame_timer(SimpleVkApp* app) {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(app->physical_device, &properties);
+    uint32_t family_count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(app->physical_device, &family_count, NULL);
+    VkQueueFamilyProperties* families = host_calloc(
+        &(app->host_memory), family_count, sizeof(VkQueueFamilyProperties), HOST_SCOPE_APP);
+    vkGetPhysicalDeviceQueueFamilyProperties(app->physical_device, &family_count, families);
+    // timestampValidBits == 0: the queue does not support timestamps
+    app->frame_timer_supported =
+        families[app->queue_families_indices.graphics_family].timestampValidBits > 0;
+    host_free(&(app->host_memory), families);
+    if(!app->frame_timer_supported) {
+        printf("timestamps not supported on the graphics queue, frame time will not be reported\n");
+        return;
+    }
+    app->timestamp_period_ns = (double)properties.limits.timestampPeriod;
+
+    VkQueryPoolCreateInfo pool_info = {0};
+    pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    pool_info.queryCount = FRAME_TIMESTAMP_COUNT * MAX_FRAMES_IN_FLIGHT;
+    if(vkCreateQueryPool(app->device, &pool_info, app->allocator,
+                         &(app->frame_timestamps)) != VK_SUCCESS) {
+        printf("failed to create frame timestamp query pool\n");
+        app->frame_timer_supported = false;
+    }
+    calibrate_gpu_clock(app);
+}
+
+// Bytes per frame going through memory for the post-processing chain, not counting the scene
+// itself. This is what a tile-based GPU does; an immediate mode one writes transient attachments
+// to memory anyway, and gains less from the subpasses.
+double estimate_post_traffic_bytes(SimpleVkApp* app) {
+    double pixels = (double)app->swapchain_extent.width * app->swapchain_extent.height;
+    // both modes: grading stores post color (4 B), fxaa reads it (4 B, neighbours hit the cache)
+    // and stores the swapchain image (4 B)
+    double bytes_per_pixel = 4.0 + 4.0 + 4.0;
+    if(app->post_mode == POST_MODE_SEPARATE_PASSES) {
+        // scene color stored then read by tonemapping (8 B each), ldr color stored then read by
+        // grading (4 B each). In subpass mode they stay on chip.
+        bytes_per_pixel += 2.0 * 8.0 + 2.0 * 4.0;
+    }
+    return pixels * bytes_per_pixel;
+}
+
+// Called once the frame that wrote the timestamps is done, so this never waits
+void read_frame_timer(SimpleVkApp* app, uint32_t current_frame) {
+    if(!app->frame_timer_supported || !app->frame_timestamps_pending[current_frame]) {
+        return;
+    }
+    uint64_t timestamps[FRAME_TIMESTAMP_COUNT] = {0};
+    if(vkGetQueryPoolResults(app->device, app->frame_timestamps,
+                             FRAME_TIMESTAMP_COUNT * current_frame, FRAME_TIMESTAMP_COUNT,
+                             sizeof(timestamps), timestamps, sizeof(uint64_t),
+                             VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+        return;
+    }
+    app->frame_timestamps_pending[current_frame] = false;
+    double frame_ms = (double)(timestamps[2] - timestamps[0]) * app->timestamp_period_ns / 1e6;
+    double scene_ms = (double)(timestamps[1] - timestamps[0]) * app->timestamp_period_ns / 1e6;
+    app->gpu_scene_ms = hud_smooth(app->gpu_scene_ms, scene_ms);
+    app->gpu_post_ms = hud_smooth(app->gpu_post_ms, frame_ms - scene_ms);
+
+    if(!app->calibrated_timestamps_supported) {
+        app->gpu_calibration_ticks = timestamps[0];
+        app->gpu_calibration_ns = app->frame_submit_ns[current_frame];
+    }
+    int64_t scene_start_ns = gpu_ticks_to_ns(app, timestamps[0]);
+    int64_t scene_end_ns = gpu_ticks_to_ns(app, timestamps[1]);
+
+    profiler_record(&(app->profiler), "scene", PROFILER_GPU_TRACK, scene_start_ns, scene_end_ns);
+    profiler_record(&(app->profiler), "post", PROFILER_GPU_TRACK, scene_end_ns,
+                    gpu_ticks_to_ns(app, timestamps[2]));
+    uint32_t replay_frame = app->in_flight_replay_frames[current_frame];
+    if(app->replay_gpu_ms != NULL && replay_frame < app->replay.header.frame_count) {
+        app->replay_gpu_ms[replay_frame] = frame_ms;
+    }
+    app->frame_time_total_ms += frame_ms;
+    app->frame_time_frames++;
+    if(app->frame_time_frames == FRAME_TIME_REPORT_PERIOD) {
+        printf("post-processing as %s, %s vertices: %.3f ms GPU per frame, ~%.2f MB of post "
+               "traffic per frame\n",
+               app->post_mode == POST_MODE_SUBPASSES ? "subpasses" : "separate passes",
+               app->vertex_fetch == VERTEX_FETCH_PULLED ? "pulled" : "fixed-function",
+               app->frame_time_total_ms / FRAME_TIME_REPORT_PERIOD,
+               estimate_post_traffic_bytes(app) / (1024.0 * 1024.0));
+        app->frame_time_total_ms = 0.0;
+        app->frame_time_frames = 0;
+    }
+}
+
+/* Presentation *********************/
+void create_present_thread(SimpleVkApp* app) {
+    present_thread_create(&(app->present_thread), app->device, app->present_queue,
+                          app->present_queue_shared ? &(app->queue_mutex) : NULL,
+                          !app->sync_present);
+    printf("presenting from %s\n",
+           app->present_thread.threaded ? "a dedicated thread" : "the render thread");
+}
+
+void print_blocked_time(SimpleVkApp* app) {
+    if(app->blocked_frames == 0) {
+        return;
+    }
+    double frames = (double)app->blocked_frames;
+    printf("render thread blocked %.3f ms per frame: fence %.3f, acquire %.3f, present %.3f\n",
+           (app->blocked_fence_ms + app->blocked_acquire_ms + app->blocked_present_ms) / frames,
+           app->blocked_fence_ms / frames, app->blocked_acquire_ms / frames,
+           app->blocked_present_ms / frames);
+    app->blocked_fence_ms = 0.0;
+    app->blocked_acquire_ms = 0.0;
+    app->blocked_present_ms = 0.0;
+    app->blocked_frames = 0;
+}
+
+/* Capture and replay ***************/
+// The scene as it is before the first frame, the frames add what moves
+void start_capture(SimpleVkApp* app) {
+    if(app->capture_path == NULL ||
+       !trace_writer_open(&(app->capture), app->capture_path, app->swapchain_extent.width,
+                          app->swapchain_extent.height)) {
+        return;
+    }
+    for(uint32_t node = 0; node < app->scene.count; node++) {
+        bool drawn = false;
+        for(uint32_t i = 0; i < app->draw_count; i++) {
+            drawn = drawn || app->draws[i].node == node;
         }
+        trace_writer_add_node(&(app->capture), app->scene.parents[node], drawn,
+                              (float*)app->scene.locals[node]);
     }
+    printf("capturing to %s\n", app->capture_path);
 }
 
-void update_ubo(SimpleVkApp* app, uint32_t current_frame) {
+// Once the frame is sure to be drawn: the camera is already in capture_frame, from update_ubo
+void capture_frame(SimpleVkApp* app) {
+    TraceFrame* frame = &(app->capture_frame);
+    frame->debug_view = (uint8_t)app->debug_view;
+    frame->material_index = (uint8_t)app->material_index;
+    frame->post_mode = (uint8_t)app->post_mode;
+    frame->vertex_fetch = (uint8_t)app->vertex_fetch;
+    frame->sort_draws = app->sort_draws ? 1 : 0;
+    trace_writer_end_frame(&(app->capture), frame);
+}
 
-    float time = fmod((float)clock() / (float)CLOCKS_PER_SEC, 2 * M_PI);
-    time = time > 0 ? time : time + 2 * M_PI;
+// What the inputs would have changed, before the frame is drawn
+void apply_replay_frame(SimpleVkApp* app, uint32_t index) {
+    const TraceFrame* frame =
+        trace_reader_frame(&(app->replay), index, &(app->replay_transforms));
+    app->replay_frame = frame;
+    app->replay_frame_index = index;
+    app->debug_view = frame->debug_view % DEBUG_VIEW_COUNT;
+    app->material_index = frame->material_index % app->material_count;
+    // render targets and pipelines change at the start of draw_frame, like with F4
+    app->post_mode_requested = frame->post_mode % POST_MODE_COUNT;
+    app->vertex_fetch = frame->vertex_fetch % VERTEX_FETCH_COUNT;
+    app->sort_draws = frame->sort_draws != 0;
+}
 
-    UniformBufferObject ubo = {GLM_MAT4_IDENTITY_INIT, GLM_MAT4_IDENTITY_INIT,
-                               GLM_MAT4_IDENTITY_INIT};
-    glm_rotate(ubo.model, 20.0 * time * glm_rad(90.0), GLM_ZUP);
-    glm_lookat((vec3){2.0, 2.0, 2.0}, (vec3){0.0, 0.0, 0.0}, GLM_ZUP, ubo.view);
-    glm_perspective(glm_rad(45.0),
-                    (float)app->swapchain_extent.width / (float)app->swapchain_extent.height, 0.1,
-                    10.0, ubo.proj);
-    ubo.proj[1][1] *= -1;
+// Writes the window of frames asked for by F9 or --profile-frames, once the GPU zones of its last
+// frame are in
+void write_profile(SimpleVkApp* app) {
+    app->profile_write_frame = UINT64_MAX;
+    profiler_write_chrome_trace(&(app->profiler), app->profile_path, app->profile_first_frame,
+                                app->profile_end_frame);
+}
 
-    memcpy(app->uniform_buffers_mapped[current_frame], &ubo, sizeof(UniformBufferObject));
+ProfileZone begin_stage(SimpleVkApp* app, FrameStage stage) {
+    return profiler_begin(&(app->profiler), FRAME_STAGE_NAMES[stage]);
+}
+
+void end_stage(SimpleVkApp* app, FrameStage stage, const ProfileZone* zone) {
+    double ms = (double)profiler_end(zone) / 1e6;
+    app->stage_cpu_ms[stage] = hud_smooth(app->stage_cpu_ms[stage], ms);
+}
+
+// Writes the overlay of this frame in its vertex buffer. The counters are those of the previous
+// frame, the last one recorded.
+void build_hud(SimpleVkApp* app, uint32_t current_frame) {
+    app->hud_vertex_count = 0;
+    if(!app->hud_enabled) {
+        return;
+    }
+    ProfileZone zone = profiler_begin(&(app->profiler), "build hud");
+    Hud* hud = &(app->hud);
+    hud_begin(hud, app->hud_vertices[current_frame], HUD_MAX_VERTICES, 8.0f, 8.0f);
+
+    double fps = app->frame_interval_ms > 0.0 ? 1000.0 / app->frame_interval_ms : 0.0;
+    hud_printf(hud, HUD_COLOR_TEXT, "%.1f fps  %.2f ms", fps, app->frame_interval_ms);
+    hud_graph(hud, 32.0f * HUD_SCALE, HUD_FRAME_BUDGET_MS);
+
+    hud_printf(hud, HUD_COLOR_LABEL, "cpu ms");
+    for(uint32_t stage = 0; stage < FRAME_STAGE_COUNT; stage++) {
+        hud_printf(hud, HUD_COLOR_TEXT, " %-18s %6.3f", FRAME_STAGE_NAMES[stage],
+                   app->stage_cpu_ms[stage]);
+    }
+    if(app->frame_timer_supported) {
+        hud_printf(hud, HUD_COLOR_LABEL, "gpu ms");
+        hud_printf(hud, HUD_COLOR_TEXT, " %-18s %6.3f", "scene", app->gpu_scene_ms);
+        hud_printf(hud, HUD_COLOR_TEXT, " %-18s %6.3f", "post", app->gpu_post_ms);
+    }
+
+    hud_printf(hud, HUD_COLOR_TEXT, "%u draws  %llu triangles", app->render_queue.stats.draws,
+               (unsigned long long)app->render_queue.stats.triangles);
+
+    const GpuMemoryTracker* memory = &(app->memory);
+    for(uint32_t heap = 0; heap < memory->properties.memoryHeapCount; heap++) {
+        double usage = (double)memory->heap_usage[heap];
+        double budget = (double)memory->heap_budget[heap];
+        bool device_local =
+            memory->properties.memoryHeaps[heap].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+        hud_printf(hud, usage > budget * memory->pressure_ratio ? HUD_COLOR_BAD : HUD_COLOR_TEXT,
+                   "heap %u %-6s %8.1f / %.1f mib", heap, device_local ? "local" : "host",
+                   usage / (1024.0 * 1024.0), budget / (1024.0 * 1024.0));
+    }
+
+    hud_printf(hud, HUD_COLOR_TEXT, "%s  %u frames in flight  %u images",
+               present_mode_name(app->present_mode), (uint32_t)MAX_FRAMES_IN_FLIGHT,
+               app->swapchain_image_count);
+    app->hud_vertex_count = hud_end(hud);
+    if(hud->overflowed && !app->hud_overflow_reported) {
+        app->hud_overflow_reported = true;
+        printf("HUD is larger than %u vertices, it is cut\n", HUD_MAX_VERTICES);
+    }
+    profiler_end(&zone);
 }
 
 void draw_frame(SimpleVkApp* app) {
     VkResult last_result;
     uint32_t inflight_frame = app->current_frame;
+    if(app->frame_number == app->profile_write_frame) {
+        write_profile(app);
+    }
+    profiler_begin_frame(&(app->profiler), app->frame_number);
+    int64_t frame_start_ns = profiler_now_ns();
+    if(app->last_frame_start_ns != 0) {
+        double interval_ms = (double)(frame_start_ns - app->last_frame_start_ns) / 1e6;
+        hud_push_frame_time(&(app->hud), interval_ms);
+        app->frame_interval_ms = app->frame_interval_ms > 0.0
+                                     ? hud_smooth(app->frame_interval_ms, interval_ms)
+                                     : interval_ms;
+    }
+    app->last_frame_start_ns = frame_start_ns;
+    ProfileZone frame_zone = profiler_begin(&(app->profiler), "frame");
+
+    ProfileZone zone = begin_stage(app, FRAME_STAGE_WAIT_FENCE);
+    double wait_start = frame_pacer_now_ms();
     vkWaitForFences(app->device, 1, &(app->in_flight[inflight_frame]), VK_TRUE, UINT64_MAX);
+    app->blocked_fence_ms += frame_pacer_now_ms() - wait_start;
+    app->blocked_frames++;
+    end_stage(app, FRAME_STAGE_WAIT_FENCE, &zone);
+
+    zone = begin_stage(app, FRAME_STAGE_HOUSEKEEPING);
+    // the frame arena of the previous frame is not needed anymore
+    host_memory_begin_frame(&(app->host_memory));
+    // the sets of this slot can be written again
+    descriptor_cache_begin_frame(&(app->descriptor_caches[inflight_frame]));
+    // the frame that used this slot is done, and every frame before it
+    deletion_queue_collect(&(app->deletion_queue), first_pending_frame(app));
+    // before the streamer decides what it can afford to upload this frame
+    gpu_memory_poll(&(app->memory));
+    // the frame that used this slot is done: old texture versions may be freed
+    texture_streamer_update(&(app->texture_streamer), app->frame_number);
+    // finished copies and compactions, before the draws read the offsets
+    geometry_pool_update(&(app->geometry_pool), app->frame_number, first_pending_frame(app));
+    update_vertex_table(app);
+
+    if(app->post_mode_requested != app->post_mode) {
+        recreate_swapchain(app);
+        // the averages of the previous mode would be mixed with the new one
+        app->frame_time_total_ms = 0.0;
+        app->frame_time_frames = 0;
+        for(size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+            app->frame_timestamps_pending[i] = false;
+        }
+        printf("post-processing as %s\n",
+               app->post_mode == POST_MODE_SUBPASSES ? "subpasses" : "separate passes");
+    }
+    if(app->present_mode_changed || app->framebuffer_resized || app->swapchain_out_of_date) {
+        recreate_swapchain(app);
+    }
+    if(app->frame_number % GPU_CALIBRATION_PERIOD == 0) {
+        calibrate_gpu_clock(app);
+    }
+    end_stage(app, FRAME_STAGE_HOUSEKEEPING, &zone);
+
+    // the image is acquired on the present thread while this one prepares the frame, it is only
+    // needed to record
+    present_thread_acquire(&(app->present_thread), app->swapchain,
+                           app->image_available[inflight_frame]);
+
+    zone = begin_stage(app, FRAME_STAGE_UPDATE);
+    update_ubo(app, inflight_frame);
+    update_scene(app, inflight_frame);
+    update_materials(app, inflight_frame);
+    end_stage(app, FRAME_STAGE_UPDATE, &zone);
+    zone = begin_stage(app, FRAME_STAGE_FILL_RENDER_QUEUE);
+    fill_render_queue(app);
+    end_stage(app, FRAME_STAGE_FILL_RENDER_QUEUE, &zone);
+    zone = begin_stage(app, FRAME_STAGE_READ_QUERIES);
+    read_overdraw_query(app, inflight_frame);
+    read_frame_timer(app, inflight_frame);
+    read_pipeline_statistics(app, inflight_frame);
+    end_stage(app, FRAME_STAGE_READ_QUERIES, &zone);
 
     uint32_t image_index;
-    last_result =
-        vkAcquireNextImageKHR(app->device, app->swapchain, UINT64_MAX,
-                              app->image_available[inflight_frame], VK_NULL_HANDLE, &image_index);
+    zone = begin_stage(app, FRAME_STAGE_WAIT_ACQUIRE);
+    wait_start = frame_pacer_now_ms();
+    last_result = present_thread_wait_acquired(&(app->present_thread), &image_index);
+    app->blocked_acquire_ms += frame_pacer_now_ms() - wait_start;
+    end_stage(app, FRAME_STAGE_WAIT_ACQUIRE, &zone);
 
     if(last_result == VK_ERROR_OUT_OF_DATE_KHR) {
         recreate_swapchain(app);
+        profiler_end(&frame_zone);
         return;
     } else if(last_result != VK_SUCCESS && last_result != VK_SUBOPTIMAL_KHR) {
         printf("failed to acquire swapchain image");
     }
 
-    update_ubo(app, inflight_frame);
-
     // reset fence only if work will actually be performed
     vkResetFences(app->device, 1, &(app->in_flight[inflight_frame]));
 
+    if(app->capture.file != NULL) {
+        capture_frame(app);
+    }
+
+    zone = begin_stage(app, FRAME_STAGE_RECORD);
+    build_hud(app, inflight_frame);
     vkResetCommandBuffer(app->graphics_command_buffers[inflight_frame], 0);
     record_command_buffer(app, app->graphics_command_buffers[inflight_frame], image_index);
+    end_stage(app, FRAME_STAGE_RECORD, &zone);
+    app->overdraw_query_pending[inflight_frame] = app->overdraw_query_supported;
+    app->pipeline_statistics_pending[inflight_frame] = app->pipeline_statistics_supported;
+    app->frame_timestamps_pending[inflight_frame] = app->frame_timer_supported;
+    if(app->frame_number % RENDER_QUEUE_REPORT_PERIOD == 0) {
+        render_queue_print_stats(&(app->render_queue));
+    }
+    if(app->frame_number % SCENE_GRAPH_REPORT_PERIOD == 0) {
+        scene_graph_print_stats(&(app->scene));
+    }
+    if(app->frame_number % HOST_MEMORY_REPORT_PERIOD == 0) {
+        host_memory_print_stats(&(app->host_memory));
+    }
+    if(app->frame_number % FRAME_PACER_REPORT_PERIOD == 0) {
+        frame_pacer_print_stats(&(app->frame_pacer));
+    }
+    if(app->frame_number % SIMULATION_REPORT_PERIOD == 0) {
+        simulation_print_stats(&(app->simulation));
+    }
+    if(app->frame_number % BLOCKED_TIME_REPORT_PERIOD == 0) {
+        print_blocked_time(app);
+    }
+    if(app->frame_number % DESCRIPTOR_REPORT_PERIOD == 0) {
+        descriptor_cache_print_stats(app->descriptor_caches, MAX_FRAMES_IN_FLIGHT);
+    }
+    if(app->frame_number % SUBMIT_REPORT_PERIOD == 0) {
+        submit_service_print_stats(app->graphics_submit);
+        if(app->transfer_submit != app->graphics_submit) {
+            submit_service_print_stats(app->transfer_submit);
+        }
+    }
 
     /* Configure queue submission and synchronization */
-    VkSubmitInfo submit_info = {0};
-    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-
-    VkSemaphore wait_semaphores[] = {app->image_available[inflight_frame]};
-    VkPipelineStageFlags wait_stages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-    // Specify semaphores to wait on and the stages in which we should wait
-    submit_info.waitSemaphoreCount = 1;
-    submit_info.pWaitSemaphores = wait_semaphores; // when image is available...
-    submit_info.pWaitDstStageMask = wait_stages;   // ...can start writing to the color attachment
-    // in theory it can start computing shaders before the image is available.
+    SubmitBatch batch = {0};
+    // Specify semaphores to wait on and the stages in which we should wait: when image is
+    // available, can start writing to the color attachment. In theory it can start computing
+    // shaders before the image is available.
+    batch.wait_semaphore_count = 1;
+    batch.wait_semaphores[0] = app->image_available[inflight_frame];
+    batch.wait_stages[0] = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
     // command buffers to submit
-    submit_info.commandBufferCount = 1;
-    submit_info.pCommandBuffers = &(app->graphics_command_buffers[inflight_frame]);
+    batch.command_buffer_count = 1;
+    batch.command_buffers[0] = app->graphics_command_buffers[inflight_frame];
     // Semaphore(s) to signal once the command buffer(s) have finished
-    VkSemaphore signal_semaphores[] = {
-        app->image_ready_present[image_index]}; // index semaphore on swapchain index
-    submit_info.signalSemaphoreCount = 1;
-    submit_info.pSignalSemaphores = signal_semaphores;
-
-    if(vkQueueSubmit(app->graphics_queue, 1, &submit_info, app->in_flight[inflight_frame]) !=
-       VK_SUCCESS) {
-        printf("failed to submit draw command buff\n");
-    }
+    batch.signal_semaphore_count = 1;
+    batch.signal_semaphores[0] = app->image_ready_present[image_index]; // on swapchain index
+    batch.fence = app->in_flight[inflight_frame];
+    // returns right away, the submitter thread of the queue calls vkQueueSubmit
+    zone = begin_stage(app, FRAME_STAGE_SUBMIT);
+    uint64_t ticket = submit_service_push(app->graphics_submit, &batch);
+    app->in_flight_frame_numbers[inflight_frame] = app->frame_number;
+    app->in_flight_replay_frames[inflight_frame] =
+        app->replay_frame != NULL ? app->replay_frame_index : UINT32_MAX;
+    app->frame_submit_ns[inflight_frame] = profiler_now_ns();
+    end_stage(app, FRAME_STAGE_SUBMIT, &zone);
 
     /* Presentation */
-    // Submit the result back to the swap chain to have it show up on screen
-    VkPresentInfoKHR present_info = {0};
-    present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-    // which semaphore to wait on before presentation can happen
-    present_info.waitSemaphoreCount = 1;
-    present_info.pWaitSemaphores = signal_semaphores;
-    // swap chains to use, index for each swap chain
-    VkSwapchainKHR swapchains[] = {app->swapchain};
-    present_info.swapchainCount = 1;
-    present_info.pSwapchains = swapchains;
-    present_info.pImageIndices = &image_index;
-    // if you have several swap chains, can store VK_RESULTS in an array
-    present_info.pResults = NULL;
-
-    last_result = vkQueuePresentKHR(app->present_queue, &present_info);
-    if(last_result == VK_ERROR_OUT_OF_DATE_KHR || last_result == VK_SUBOPTIMAL_KHR ||
-       app->framebuffer_resized) {
-        app->framebuffer_resized = false;
-        recreate_swapchain(app);
-    } else if(last_result != VK_SUCCESS) {
-        printf("failed to present swapchain image\n");
+    // Submit the result back to the swap chain to have it show up on screen, once the semaphore
+    // is signaled. Returns right away when done on the present thread.
+    zone = begin_stage(app, FRAME_STAGE_PRESENT);
+    wait_start = frame_pacer_now_ms();
+    present_thread_present(&(app->present_thread), app->swapchain,
+                           app->image_ready_present[image_index], image_index,
+                           app->graphics_submit, ticket);
+    app->blocked_present_ms += frame_pacer_now_ms() - wait_start;
+    end_stage(app, FRAME_STAGE_PRESENT, &zone);
+
+    // from the present of this frame, or of an earlier one when presenting on the thread. Not
+    // recreated here: this frame still uses the swapchain resources, which are retired from the
+    // current frame number on, and only the next frame has a number past this one.
+    if(present_thread_out_of_date(&(app->present_thread))) {
+        app->swapchain_out_of_date = true;
     }
 
     app->current_frame = (inflight_frame + 1) % MAX_FRAMES_IN_FLIGHT;
+    app->frame_number++;
+    profiler_end(&frame_zone);
 }
 
-void init_vulkan(SimpleVkApp* app) {
-    create_instance(app);
-    setup_debug_messenger(app);
-
-    create_surface(app);
-
-    pick_physical_device(app);
-    create_logical_device(app);
-
-    create_swapchain(app);
-    create_image_views(app);
-
-    create_render_pass(app);
-    create_descriptor_set_layout(app);
-    create_graphics_pipeline(app);
-    create_framebuffers(app);
+void create_deletion_queue(SimpleVkApp* app) {
+    deletion_queue_create(&(app->deletion_queue), app->device, app->allocator, &(app->memory));
+}
 
-    create_command_pools(app);
-    create_command_buffers(app);
+typedef struct {
+    const char* name; // of its zone in the profile
+    void (*create)(SimpleVkApp* app);
+} InitStep;
+
+// In order: each step may use what the previous ones created
+static const InitStep INIT_STEPS[] = {
+    {"host memory", create_host_memory},
+    {"instance", create_instance},
+    {"debug messenger", setup_debug_messenger},
+    {"surface", create_surface},
+    {"physical device", pick_physical_device},
+    {"logical device", create_logical_device},
+    {"submit services", create_submit_services},
+    {"memory tracker", create_memory_tracker},
+    {"deletion queue", create_deletion_queue},
+    {"swapchain", create_swapchain},
+    {"image views", create_image_views},
+    // render targets are registered in the bindless table
+    {"descriptor set layout", create_descriptor_set_layout},
+    {"bindless table", create_bindless_table},
+    {"post descriptors", create_post_descriptors},
+    {"render targets", create_render_targets},
+    {"render passes", create_render_pass},
+    {"pipeline cache", create_pipeline_cache},
+    {"pipelines", create_graphics_pipeline},
+    {"framebuffers", create_framebuffers},
+    {"command pools", create_command_pools},
+    {"command buffers", create_command_buffers},
+    {"geometry pool", create_geometry_pool},
+    {"uniform buffers", create_uniform_buffers},
+    {"hud", create_hud},
+    {"texture streamer", create_texture_streamer},
+    {"material table", create_material_table},
+    {"descriptor caches", create_descriptor_caches},
+    {"draw list", create_draw_list},
+    {"overdraw queries", create_overdraw_queries},
+    {"pipeline statistics queries", create_pipeline_statistics_queries},
+    {"frame timer", create_frame_timer},
+    {"synchronization objects", create_synchronization_objects},
+    {"present thread", create_present_thread},
+};
 
-    create_vertex_buffer(app);
-    create_index_buffer(app);
-    create_uniform_buffers(app);
-    create_descriptor_pool(app);
-    create_descriptor_sets(app);
+void init_vulkan(SimpleVkApp* app) {
+    // first, so that the steps are timed too
+    profiler_create(&(app->profiler), PROFILER_DEFAULT_CAPACITY);
+    profiler_name_thread(&(app->profiler), "render");
+    ProfileZone init_zone = profiler_begin(&(app->profiler), "init");
+    for(size_t i = 0; i < sizeof(INIT_STEPS) / sizeof(INIT_STEPS[0]); i++) {
+        ProfileZone zone = profiler_begin(&(app->profiler), INIT_STEPS[i].name);
+        INIT_STEPS[i].create(app);
+        profiler_end(&zone);
+    }
+    profiler_end(&init_zone);
+}
 
-    create_synchronization_objects(app);
+// Whether the next frame could look different from the one on screen, or has work to finish
+bool needs_redraw(SimpleVkApp* app) {
+    return !app->render_on_demand || app->redraw_requested || app->animate_scene ||
+           app->simulation_moving ||
+           app->framebuffer_resized || app->swapchain_out_of_date ||
+           app->post_mode_requested != app->post_mode ||
+           app->present_mode_changed ||
+           // the profile is written once the frames after its window are drawn
+           app->profile_write_frame != UINT64_MAX ||
+           // the GPU copies of the transforms of the other frames in flight are not up to date
+           app->scene.dirty_count > 0 || app->scene.stale_count > 0 ||
+           // retired resources are only released by the next frames
+           app->deletion_queue.count > 0 || texture_streamer_busy(&(app->texture_streamer)) ||
+           geometry_pool_busy(&(app->geometry_pool));
 }
 
 void main_loop(SimpleVkApp* app) {
-    // clock_t tic, toc;
     while(!glfwWindowShouldClose(app->window)) {
+        if(!needs_redraw(app)) {
+            // nothing to draw: sleep until an input, and do not burst frames to catch up after
+            glfwWaitEventsTimeout(IDLE_WAIT_TIMEOUT_S);
+            frame_pacer_reset(&(app->frame_pacer));
+            continue;
+        }
         glfwPollEvents();
-        // tic = clock();
+        app->redraw_requested = false;
         draw_frame(app);
-        // toc = clock();
-        // printf("Elapsed: %f seconds\r", 1 / ((double)(toc - tic) / CLOCKS_PER_SEC));
+        // on top of the wait for a swapchain image, FIFO already limits to the refresh rate
+        frame_pacer_wait(&(app->frame_pacer));
     }
+    // the queues are not in use anymore, so the device can be waited on
+    present_thread_flush(&(app->present_thread));
+    submit_service_flush(app->graphics_submit);
+    submit_service_flush(app->transfer_submit);
     vkDeviceWaitIdle(app->device);
 }
 
+void write_replay_csv(SimpleVkApp* app, const double* frame_ms) {
+    FILE* file = fopen(app->replay_csv_path, "w");
+    if(!file) {
+        printf("failed to open %s\n", app->replay_csv_path);
+        return;
+    }
+    fprintf(file, "frame,cpu_ms,gpu_ms\n");
+    for(uint32_t i = 0; i < app->replay.header.frame_count; i++) {
+        fprintf(file, "%u,%.4f,%.4f\n", i, frame_ms[i], app->replay_gpu_ms[i]);
+    }
+    fclose(file);
+}
+
+// Every frame of the trace, back to back: no window, no inputs, no frame cap. Only the time
+// spent in draw_frame and on the GPU is reported, the frames warming up left out.
+void replay_loop(SimpleVkApp* app) {
+    uint32_t frame_count = app->replay.header.frame_count;
+    double* frame_ms =
+        host_calloc(&(app->host_memory), frame_count, sizeof(double), HOST_SCOPE_APP);
+    app->replay_gpu_ms =
+        host_calloc(&(app->host_memory), frame_count, sizeof(double), HOST_SCOPE_APP);
+    if(frame_ms == NULL || app->replay_gpu_ms == NULL) {
+        printf("failed to allocate the timings of %u frames\n", frame_count);
+        host_free(&(app->host_memory), frame_ms);
+        host_free(&(app->host_memory), app->replay_gpu_ms);
+        app->replay_gpu_ms = NULL;
+        return;
+    }
+    for(uint32_t i = 0; i < frame_count; i++) {
+        app->replay_gpu_ms[i] = -1.0;
+    }
+    // a trace too short for the warmup is measured whole: everything reading the warmup, the
+    // pipeline statistics too, must see the same value
+    if(app->replay_warmup_frames >= frame_count) {
+        app->replay_warmup_frames = 0;
+    }
+    uint32_t warmup = app->replay_warmup_frames;
+
+    double start_ms = frame_pacer_now_ms();
+    for(uint32_t i = 0; i < frame_count; i++) {
+        if(i == warmup) {
+            start_ms = frame_pacer_now_ms();
+        }
+        apply_replay_frame(app, i);
+        double frame_start_ms = frame_pacer_now_ms();
+        draw_frame(app);
+        frame_ms[i] = frame_pacer_now_ms() - frame_start_ms;
+    }
+    present_thread_flush(&(app->present_thread));
+    submit_service_flush(app->graphics_submit);
+    submit_service_flush(app->transfer_submit);
+    vkDeviceWaitIdle(app->device);
+    double total_ms = frame_pacer_now_ms() - start_ms;
+    // the last frames are done, their timestamps were not read yet
+    for(uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        read_frame_timer(app, i);
+        read_pipeline_statistics(app, i);
+    }
+    // a window ending with the trace has no frames after it
+    if(app->profile_write_frame != UINT64_MAX) {
+        write_profile(app);
+    }
+
+    uint32_t measured = frame_count - warmup;
+    printf("replayed %u frames (%u warming up) at %ux%u: %.3f s, %.1f fps\n", frame_count,
+           warmup, app->swapchain_extent.width, app->swapchain_extent.height, total_ms / 1000.0,
+           measured > 0 ? (double)measured * 1000.0 / total_ms : 0.0);
+    trace_print_timings("cpu frame", frame_ms + warmup, measured);
+    trace_print_timings("gpu frame", app->replay_gpu_ms + warmup, measured);
+    // the same for every build replaying the same trace, unless culling or batching changed
+    print_pipeline_statistics(app->replay_statistics, app->replay_statistics_frames);
+    if(app->replay_csv_path != NULL) {
+        write_replay_csv(app, frame_ms);
+    }
+    host_free(&(app->host_memory), frame_ms);
+    host_free(&(app->host_memory), app->replay_gpu_ms);
+    app->replay_gpu_ms = NULL;
+    app->replay_frame = NULL;
+}
+
 void cleanup(SimpleVkApp* app) {
     // Cleanup Vulkan
 
+    // peaks included, so this is what the whole run needed
+    gpu_memory_dump(&(app->memory), stdout);
+    print_blocked_time(app);
+
+    // everything was submitted and presented before the device went idle
+    present_thread_destroy(&(app->present_thread));
+    destroy_submit_services(app);
+
     // Swapchain
     cleanup_swapchain(app);
+    // a compaction still running retires the buffers it replaces
+    geometry_pool_print_stats(&(app->geometry_pool));
+    geometry_pool_destroy(&(app->geometry_pool));
+    // the device is idle: everything retired goes, the swapchain included
+    deletion_queue_destroy(&(app->deletion_queue));
 
     // Buffers
-    vkDestroyBuffer(app->device, app->shape_vertex_buffer, NULL);
-    vkFreeMemory(app->device, app->shape_vertex_buffer_memory, NULL);
+    for(size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        vkDestroyBuffer(app->device, (app->uniform_buffers)[i], app->allocator);
+        gpu_memory_free(&(app->memory), (app->uniform_buffers_memory)[i]);
+    }
+    host_free(&(app->host_memory), app->uniform_buffers);
+    host_free(&(app->host_memory), app->uniform_buffers_memory);
+    host_free(&(app->host_memory), app->uniform_buffers_mapped);
+    for(size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        vkDestroyBuffer(app->device, app->hud_vertex_buffers[i], app->allocator);
+        gpu_memory_free(&(app->memory), app->hud_vertex_buffers_memory[i]);
+    }
 
-    vkDestroyBuffer(app->device, app->shape_index_buffer, NULL);
-    vkFreeMemory(app->device, app->shape_index_buffer_memory, NULL);
+    vkDestroyBuffer(app->device, app->material_buffer, app->allocator);
+    gpu_memory_free(&(app->memory), app->material_buffer_memory);
+    destroy_static_texture(app, &(app->compressed_texture));
+    render_queue_destroy(&(app->render_queue));
+    simulation_destroy(&(app->simulation));
+    scene_graph_destroy(&(app->scene));
+    vkDestroyBuffer(app->device, app->transform_buffer, app->allocator);
+    gpu_memory_free(&(app->memory), app->transform_buffer_memory);
+    texture_streamer_destroy(&(app->texture_streamer));
 
     for(size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        vkDestroyBuffer(app->device, (app->uniform_buffers)[i], NULL);
-        vkFreeMemory(app->device, (app->uniform_buffers_memory)[i], NULL);
+        descriptor_cache_destroy(&(app->descriptor_caches[i]));
     }
-    free(app->uniform_buffers);
-    free(app->uniform_buffers_memory);
-    free(app->uniform_buffers_mapped);
+    vkDestroyDescriptorSetLayout(app->device, app->post_input_set_layout, app->allocator);
+    vkDestroySampler(app->device, app->post_sampler, app->allocator);
+    bindless_destroy(&(app->bindless));
 
-    vkDestroyDescriptorPool(app->device, app->descriptor_pool, NULL);
-    free(app->descriptor_sets);
-
-    vkDestroyDescriptorSetLayout(app->device, app->descriptor_set_layout, NULL);
+    vkDestroyDescriptorSetLayout(app->device, app->descriptor_set_layout, app->allocator);
 
     // Sync objects
     for(size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        vkDestroySemaphore(app->device, app->image_available[i], NULL);
-        vkDestroyFence(app->device, app->in_flight[i], NULL);
+        vkDestroySemaphore(app->device, app->image_available[i], app->allocator);
+        vkDestroyFence(app->device, app->in_flight[i], app->allocator);
     }
-    free(app->image_available);
-    free(app->in_flight);
+    host_free(&(app->host_memory), app->image_available);
+    host_free(&(app->host_memory), app->in_flight);
     for(size_t i = 0; i < app->swapchain_image_count; i++) {
-        vkDestroySemaphore(app->device, app->image_ready_present[i], NULL);
+        vkDestroySemaphore(app->device, app->image_ready_present[i], app->allocator);
     }
-    free(app->image_ready_present);
-
-    vkDestroyCommandPool(app->device, app->graphics_command_pool, NULL);
-    free(app->graphics_command_buffers);
-    vkDestroyCommandPool(app->device, app->transfer_command_pool, NULL);
-    free(app->transfer_command_buffers);
-
-    vkDestroyPipeline(app->device, app->graphics_pipeline, NULL);
-    vkDestroyPipelineLayout(app->device, app->pipeline_layout, NULL);
-    vkDestroyRenderPass(app->device, app->render_pass, NULL);
+    host_free(&(app->host_memory), app->image_ready_present);
 
-    vkDestroyDevice(app->device, NULL);
+    vkDestroyCommandPool(app->device, app->graphics_command_pool, app->allocator);
+    host_free(&(app->host_memory), app->graphics_command_buffers);
+    vkDestroyCommandPool(app->device, app->transfer_command_pool, app->allocator);
+    host_free(&(app->host_memory), app->transfer_command_buffers);
 
-    vkDestroySurfaceKHR(app->instance, app->surface, NULL);
+    if(app->overdraw_query_supported) {
+        vkDestroyQueryPool(app->device, app->overdraw_queries, app->allocator);
+    }
+    if(app->pipeline_statistics_supported) {
+        vkDestroyQueryPool(app->device, app->pipeline_statistics_queries, app->allocator);
+    }
+    if(app->frame_timer_supported) {
+        vkDestroyQueryPool(app->device, app->frame_timestamps, app->allocator);
+    }
+    pipeline_variants_destroy(app->device, app->allocator, &(app->pipeline_variants));
+    vkDestroyPipelineCache(app->device, app->pipeline_cache, app->allocator);
+    vkDestroyPipelineLayout(app->device, app->pipeline_layout, app->allocator);
+    vkDestroyPipelineLayout(app->device, app->post_pipeline_layout, app->allocator);
+    vkDestroyPipelineLayout(app->device, app->hud_pipeline_layout, app->allocator);
+    vkDestroyRenderPass(app->device, app->render_pass, app->allocator);
+    vkDestroyRenderPass(app->device, app->scene_render_pass, app->allocator);
+    vkDestroyRenderPass(app->device, app->post_render_pass, app->allocator);
+    vkDestroyRenderPass(app->device, app->present_render_pass, app->allocator);
+
+    gpu_memory_tracker_destroy(&(app->memory));
+    vkDestroyDevice(app->device, app->allocator);
+
+    vkDestroySurfaceKHR(app->instance, app->surface, app->allocator);
     if(ENABLE_VALIDATION_LAYERS && app->validation_layers_available) {
         PFN_vkDestroyDebugUtilsMessengerEXT function =
             (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(
                 app->instance, "vkDestroyDebugUtilsMessengerEXT");
         if(function != NULL) {
-            function(app->instance, app->debug_messenger, NULL);
+            function(app->instance, app->debug_messenger, app->allocator);
         }
     }
-    vkDestroyInstance(app->instance, NULL);
+    vkDestroyInstance(app->instance, app->allocator);
+    host_memory_print_stats(&(app->host_memory));
+    host_memory_destroy(&(app->host_memory));
+    profiler_destroy(&(app->profiler));
 
     // Cleanup glfw
-    glfwDestroyWindow(app->window);
-    glfwTerminate();
+    if(!app->replaying) {
+        glfwDestroyWindow(app->window);
+        glfwTerminate();
+    }
 }
 
+void print_usage(const char* program) {
+    printf("usage: %s [--max-fps N] [--present-mode fifo|mailbox|immediate] [--on-demand] "
+           "[--sync-present] [--vertex-pulling] [--staged-uploads] [--capture TRACE] "
+           "[--profile FILE] [--profile-frames FIRST COUNT] [--hud]\n",
+           program);
+}
+
+// Options of both builds: where F9 and --profile-frames write the profile, see write_profile
+void init_profile_options(SimpleVkApp* app) {
+    app->profile_path = PROFILE_DEFAULT_PATH;
+    app->profile_frame_count = PROFILE_DEFAULT_FRAMES;
+    app->profile_write_frame = UINT64_MAX;
+}
+
+// Returns the number of arguments used from argv[i], 0 if it is not a profile option
+int parse_profile_option(SimpleVkApp* app, int argc, char const* argv[], int i) {
+    if(strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+        app->profile_path = argv[i + 1];
+        return 2;
+    }
+    if(strcmp(argv[i], "--profile-frames") == 0 && i + 2 < argc) {
+        uint64_t first_frame = strtoull(argv[i + 1], NULL, 10);
+        app->profile_frame_count = strtoull(argv[i + 2], NULL, 10);
+        request_profile(app, first_frame, first_frame + app->profile_frame_count);
+        return 3;
+    }
+    return 0;
+}
+
+// Returns false when the program should stop there
+bool parse_arguments(SimpleVkApp* app, int argc, char const* argv[]) {
+    // MAILBOX was always used when available, it stays the default
+    app->present_mode_requested = VK_PRESENT_MODE_MAILBOX_KHR;
+    init_profile_options(app);
+    double max_fps = DEFAULT_MAX_FPS;
+    for(int i = 1; i < argc; i++) {
+        int profile_arguments = parse_profile_option(app, argc, argv, i);
+        if(profile_arguments > 0) {
+            i += profile_arguments - 1;
+        } else if(strcmp(argv[i], "--max-fps") == 0 && i + 1 < argc) {
+            max_fps = atof(argv[++i]);
+        } else if(strcmp(argv[i], "--present-mode") == 0 && i + 1 < argc) {
+            const char* mode = argv[++i];
+            if(strcmp(mode, "fifo") == 0) {
+                app->present_mode_requested = VK_PRESENT_MODE_FIFO_KHR;
+            } else if(strcmp(mode, "mailbox") == 0) {
+                app->present_mode_requested = VK_PRESENT_MODE_MAILBOX_KHR;
+            } else if(strcmp(mode, "immediate") == 0) {
+                app->present_mode_requested = VK_PRESENT_MODE_IMMEDIATE_KHR;
+            } else {
+                printf("unknown present mode %s\n", mode);
+                print_usage(argv[0]);
+                return false;
+            }
+        } else if(strcmp(argv[i], "--on-demand") == 0) {
+            app->render_on_demand = true;
+        } else if(strcmp(argv[i], "--sync-present") == 0) {
+            // acquire and present on the render thread, to compare the blocked time
+            app->sync_present = true;
+        } else if(strcmp(argv[i], "--vertex-pulling") == 0) {
+            app->vertex_fetch = VERTEX_FETCH_PULLED;
+        } else if(strcmp(argv[i], "--staged-uploads") == 0) {
+            // to compare the upload bandwidth with the direct path, printed at exit
+            app->staged_uploads = true;
+        } else if(strcmp(argv[i], "--hud") == 0) {
+            // F10 toggles it afterwards
+            app->hud_enabled = true;
+        } else if(strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+            // for the replay build, see replay_loop
+            app->capture_path = argv[++i];
+        } else {
+            print_usage(argv[0]);
+            return false;
+        }
+    }
+    frame_pacer_init(&(app->frame_pacer), max_fps, FRAME_PACER_DEFAULT_SPIN_MS);
+    return true;
+}
+
+void print_replay_usage(const char* program) {
+    printf("usage: %s TRACE [--warmup N] [--csv FILE] [--sync-present] [--staged-uploads] "
+           "[--profile FILE] [--profile-frames FIRST COUNT]\n",
+           program);
+}
+
+// The replay build only takes what does not change the frames themselves
+bool parse_replay_arguments(SimpleVkApp* app, int argc, char const* argv[]) {
+    // a headless surface does not wait for a display, ask for the mode that waits the least
+    app->present_mode_requested = VK_PRESENT_MODE_IMMEDIATE_KHR;
+    app->replay_warmup_frames = REPLAY_WARMUP_FRAMES;
+    init_profile_options(app);
+    const char* trace_path = NULL;
+    for(int i = 1; i < argc; i++) {
+        int profile_arguments = parse_profile_option(app, argc, argv, i);
+        if(profile_arguments > 0) {
+            i += profile_arguments - 1;
+        } else if(strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) {
+            app->replay_warmup_frames = (uint32_t)atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--csv") == 0 && i + 1 < argc) {
+            app->replay_csv_path = argv[++i];
+        } else if(strcmp(argv[i], "--sync-present") == 0) {
+            app->sync_present = true;
+        } else if(strcmp(argv[i], "--staged-uploads") == 0) {
+            app->staged_uploads = true;
+        } else if(argv[i][0] != '-' && trace_path == NULL) {
+            trace_path = argv[i];
+        } else {
+            print_replay_usage(argv[0]);
+            return false;
+        }
+    }
+    if(trace_path == NULL) {
+        print_replay_usage(argv[0]);
+        return false;
+    }
+    if(!trace_reader_open(&(app->replay), trace_path)) {
+        return false;
+    }
+    app->replaying = true;
+    frame_pacer_init(&(app->frame_pacer), 0.0, FRAME_PACER_DEFAULT_SPIN_MS);
+    return true;
+}
+
+#ifdef JUBILANT_REPLAY
+// replay_demo: draws a trace captured with --capture, headless
+int main(int argc, char const* argv[]) {
+    SimpleVkApp* app = calloc(1, sizeof(SimpleVkApp));
+    if(!parse_replay_arguments(app, argc, argv)) {
+        free(app);
+        return 1;
+    }
+
+    init_vulkan(app);
+
+    replay_loop(app);
+
+    cleanup(app);
+    trace_reader_close(&(app->replay));
+    free(app);
+
+    return 0;
+}
+#else
 int main(int argc, char const* argv[]) {
-    SimpleVkApp* app = malloc(sizeof(SimpleVkApp));
+    SimpleVkApp* app = calloc(1, sizeof(SimpleVkApp));
+    if(!parse_arguments(app, argc, argv)) {
+        free(app);
+        return 1;
+    }
 
     init_window(app);
     init_vulkan(app);
+    start_capture(app);
 
     main_loop(app);
 
+    trace_writer_close(&(app->capture));
     cleanup(app);
     free(app);
 
     return 0;
 }
+#endif
@@ -0,0 +1,164 @@
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "simulation.h"
+
+#define SLOT_MASK 3u
+#define FRESH_BIT 4u
+
+double simulation_now_s(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+}
+
+static void sleep_until(double time_s) {
+    struct timespec wake_up = {0};
+    wake_up.tv_sec = (time_t)time_s;
+    wake_up.tv_nsec = (long)((time_s - (double)wake_up.tv_sec) * 1e9);
+    while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake_up, NULL) == EINTR) {
+    }
+}
+
+static float wrap_angle(float angle) {
+    angle = fmodf(angle, 2.0f * (float)M_PI);
+    return angle < 0.0f ? angle + 2.0f * (float)M_PI : angle;
+}
+
+static void step(const Simulation* simulation, SimulationState* state, bool animating) {
+    state->step++;
+    state->time_s += simulation->step_s;
+    if(animating) {
+        state->turntable_angle = wrap_angle(state->turntable_angle + simulation->turntable_speed *
+                                                                         (float)simulation->step_s);
+    }
+}
+
+// Hands the back slot over to the renderer, and takes the one it was not using
+static void publish(Simulation* simulation, const SimulationState* previous,
+                    const SimulationState* current) {
+    SimulationSnapshot* snapshot = simulation->slots + simulation->back;
+    snapshot->previous = *previous;
+    snapshot->current = *current;
+    // release: the snapshot is written before the renderer can see the slot
+    uint32_t old = atomic_exchange_explicit(&(simulation->middle), simulation->back | FRESH_BIT,
+                                            memory_order_acq_rel);
+    simulation->back = old & SLOT_MASK;
+}
+
+static void* simulation_thread(void* arg) {
+    Simulation* simulation = arg;
+    // the back slot holds the initial state: nothing else touches it yet
+    SimulationState current = simulation->slots[simulation->back].current;
+    SimulationState previous = current;
+
+    while(!atomic_load(&(simulation->stopping))) {
+        sleep_until(current.time_s + simulation->step_s);
+
+        // every step that is due, at the times they stand for: the result does not depend on
+        // how late the thread woke up
+        uint64_t due = (uint64_t)((simulation_now_s() - current.time_s) / simulation->step_s);
+        if(due > SIMULATION_MAX_CATCH_UP_STEPS) {
+            uint64_t dropped = due - SIMULATION_MAX_CATCH_UP_STEPS;
+            current.time_s += (double)dropped * simulation->step_s;
+            previous = current;
+            atomic_fetch_add(&(simulation->dropped_steps), dropped);
+            due = SIMULATION_MAX_CATCH_UP_STEPS;
+        }
+        bool animating = atomic_load(&(simulation->animating));
+        for(uint64_t i = 0; i < due; i++) {
+            previous = current;
+            step(simulation, &current, animating);
+        }
+        if(due > 0) {
+            atomic_fetch_add(&(simulation->steps), due);
+            publish(simulation, &previous, &current);
+        }
+    }
+    return NULL;
+}
+
+void simulation_create(Simulation* simulation, double step_s, float turntable_speed,
+                       bool animating) {
+    memset(simulation, 0, sizeof(Simulation));
+    simulation->step_s = step_s;
+    simulation->turntable_speed = turntable_speed;
+    atomic_init(&(simulation->stopping), false);
+    atomic_init(&(simulation->animating), animating);
+    atomic_init(&(simulation->steps), 0);
+    atomic_init(&(simulation->dropped_steps), 0);
+
+    SimulationState initial = {0};
+    initial.time_s = simulation_now_s();
+    for(uint32_t i = 0; i < 3; i++) {
+        simulation->slots[i].previous = initial;
+        simulation->slots[i].current = initial;
+    }
+    simulation->front = 0;
+    atomic_init(&(simulation->middle), 1);
+    simulation->back = 2;
+
+    if(pthread_create(&(simulation->thread), NULL, simulation_thread, simulation) != 0) {
+        printf("failed to start the simulation thread\n");
+        return;
+    }
+    simulation->thread_started = true;
+}
+
+void simulation_destroy(Simulation* simulation) {
+    atomic_store(&(simulation->stopping), true);
+    if(simulation->thread_started) {
+        // it notices within a step
+        pthread_join(simulation->thread, NULL);
+    }
+    memset(simulation, 0, sizeof(Simulation));
+}
+
+void simulation_set_animating(Simulation* simulation, bool animating) {
+    atomic_store(&(simulation->animating), animating);
+}
+
+bool simulation_sample(Simulation* simulation, double render_time_s, SimulationState* state) {
+    if(atomic_load_explicit(&(simulation->middle), memory_order_relaxed) & FRESH_BIT) {
+        // acquire: the snapshot in the slot taken is complete
+        uint32_t old = atomic_exchange_explicit(&(simulation->middle), simulation->front,
+                                                memory_order_acq_rel);
+        simulation->front = old & SLOT_MASK;
+        simulation->snapshots_taken++;
+    }
+    const SimulationSnapshot* snapshot = simulation->slots + simulation->front;
+    const SimulationState* previous = &(snapshot->previous);
+    const SimulationState* current = &(snapshot->current);
+
+    // never extrapolated: when the simulation is behind, the last step is shown as is
+    double span = current->time_s - previous->time_s;
+    double alpha = span > 0.0 ? (render_time_s - previous->time_s) / span : 1.0;
+    alpha = alpha < 0.0 ? 0.0 : (alpha > 1.0 ? 1.0 : alpha);
+
+    *state = alpha < 0.5 ? *previous : *current;
+    state->time_s = previous->time_s + alpha * span;
+    // the short way around, the angles wrap
+    float delta = current->turntable_angle - previous->turntable_angle;
+    if(delta > (float)M_PI) {
+        delta -= 2.0f * (float)M_PI;
+    } else if(delta < -(float)M_PI) {
+        delta += 2.0f * (float)M_PI;
+    }
+    state->turntable_angle = wrap_angle(previous->turntable_angle + (float)alpha * delta);
+
+    return previous->turntable_angle != current->turntable_angle;
+}
+
+void simulation_print_stats(Simulation* simulation) {
+    printf("simulation: %llu steps of %.2f ms, %llu dropped, %llu snapshots rendered\n",
+           (unsigned long long)atomic_load(&(simulation->steps)), simulation->step_s * 1000.0,
+           (unsigned long long)atomic_load(&(simulation->dropped_steps)),
+           (unsigned long long)simulation->snapshots_taken);
+}
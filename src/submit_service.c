@@ -0,0 +1,247 @@
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <vulkan/vulkan.h>
+
+#include "submit_service.h"
+
+static double now_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec * 1000.0 + (double)now.tv_nsec / 1000000.0;
+}
+
+static void atomic_max(atomic_uint_fast64_t* value, uint64_t candidate) {
+    uint_fast64_t current = atomic_load_explicit(value, memory_order_relaxed);
+    while(candidate > current &&
+          !atomic_compare_exchange_weak_explicit(value, &current, candidate, memory_order_relaxed,
+                                                 memory_order_relaxed)) {
+    }
+}
+
+/* Ring ******************************/
+// Bounded queue with a sequence number per slot (D. Vyukov's): a producer claims a position with
+// a CAS, then publishes its slot by moving the sequence. No locks, and producers only contend on
+// the position counter.
+uint64_t submit_service_push(SubmitService* service, const SubmitBatch* batch) {
+    uint_fast64_t position =
+        atomic_load_explicit(&(service->enqueue_position), memory_order_relaxed);
+    SubmitSlot* slot;
+    while(true) {
+        slot = service->slots + (position & (SUBMIT_RING_CAPACITY - 1));
+        uint64_t sequence = atomic_load_explicit(&(slot->sequence), memory_order_acquire);
+        int64_t difference = (int64_t)sequence - (int64_t)position;
+        if(difference == 0) {
+            if(atomic_compare_exchange_weak_explicit(&(service->enqueue_position), &position,
+                                                     position + 1, memory_order_relaxed,
+                                                     memory_order_relaxed)) {
+                break;
+            }
+        } else if(difference < 0) {
+            // full: the submitter has a whole ring of batches to go through
+            sched_yield();
+            position = atomic_load_explicit(&(service->enqueue_position), memory_order_relaxed);
+        } else {
+            position = atomic_load_explicit(&(service->enqueue_position), memory_order_relaxed);
+        }
+    }
+    slot->batch = *batch;
+    slot->push_time_ms = now_ms();
+    // release: the batch is written before the submitter sees the slot as ready
+    atomic_store_explicit(&(slot->sequence), position + 1, memory_order_release);
+    sem_post(&(service->available));
+    return position + 1;
+}
+
+// Submitter side: positions were claimed, but maybe not published yet
+static bool ring_empty(SubmitService* service) {
+    return service->dequeue_position ==
+           atomic_load_explicit(&(service->enqueue_position), memory_order_acquire);
+}
+
+// Returns the ticket of the batch. A producer can post the semaphore for a later slot while the
+// next one is still being written: wait for it, it is a matter of instructions.
+static uint64_t pop(SubmitService* service, SubmitBatch* batch, double* push_time_ms) {
+    uint64_t position = service->dequeue_position;
+    SubmitSlot* slot = service->slots + (position & (SUBMIT_RING_CAPACITY - 1));
+    while(atomic_load_explicit(&(slot->sequence), memory_order_acquire) != position + 1) {
+        sched_yield();
+    }
+    *batch = slot->batch;
+    *push_time_ms = slot->push_time_ms;
+    // the slot can be written again on the next lap
+    atomic_store_explicit(&(slot->sequence), position + SUBMIT_RING_CAPACITY,
+                          memory_order_release);
+    service->dequeue_position++;
+    return position + 1;
+}
+
+/* Submitter thread ******************/
+static void submit(SubmitService* service, const SubmitBatch* batches, const double* push_times,
+                   const uint64_t* tickets, uint32_t count) {
+    if(count == 0) {
+        return;
+    }
+    VkSubmitInfo submit_infos[SUBMIT_MAX_COALESCED];
+    for(uint32_t i = 0; i < count; i++) {
+        const SubmitBatch* batch = batches + i;
+        submit_infos[i] = (VkSubmitInfo){0};
+        submit_infos[i].sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit_infos[i].waitSemaphoreCount = batch->wait_semaphore_count;
+        submit_infos[i].pWaitSemaphores = batch->wait_semaphores;
+        submit_infos[i].pWaitDstStageMask = batch->wait_stages;
+        submit_infos[i].commandBufferCount = batch->command_buffer_count;
+        submit_infos[i].pCommandBuffers = batch->command_buffers;
+        submit_infos[i].signalSemaphoreCount = batch->signal_semaphore_count;
+        submit_infos[i].pSignalSemaphores = batch->signal_semaphores;
+    }
+    // only the last batch of a call can have a fence, see submitter_thread
+    VkFence fence = batches[count - 1].fence;
+
+    if(service->queue_mutex != NULL) {
+        pthread_mutex_lock(service->queue_mutex);
+    }
+    VkResult result = vkQueueSubmit(service->queue, count, submit_infos, fence);
+    if(service->queue_mutex != NULL) {
+        pthread_mutex_unlock(service->queue_mutex);
+    }
+    if(result != VK_SUCCESS) {
+        printf("failed to submit %u batches to the %s queue\n", count, service->name);
+    }
+    atomic_store_explicit(&(service->submitted), tickets[count - 1], memory_order_release);
+
+    double end = now_ms();
+    uint64_t latency_total_us = 0;
+    uint64_t latency_max_us = 0;
+    for(uint32_t i = 0; i < count; i++) {
+        uint64_t latency_us = (uint64_t)((end - push_times[i]) * 1000.0);
+        latency_total_us += latency_us;
+        latency_max_us = latency_us > latency_max_us ? latency_us : latency_max_us;
+    }
+    atomic_fetch_add(&(service->submit_calls), 1);
+    atomic_fetch_add(&(service->batches), count);
+    atomic_max(&(service->largest_call), count);
+    atomic_fetch_add(&(service->latency_total_us), latency_total_us);
+    atomic_max(&(service->latency_max_us), latency_max_us);
+}
+
+static bool dependency_ready(SubmitService* service, const SubmitBatch* batch) {
+    // the ring of this service is in order already
+    return batch->after == NULL || batch->after == service ||
+           atomic_load_explicit(&(batch->after->submitted), memory_order_acquire) >=
+               batch->after_ticket;
+}
+
+static void* submitter_thread(void* arg) {
+    SubmitService* service = arg;
+    SubmitBatch batches[SUBMIT_MAX_COALESCED];
+    double push_times[SUBMIT_MAX_COALESCED];
+    uint64_t tickets[SUBMIT_MAX_COALESCED];
+    while(true) {
+        while(sem_wait(&(service->available)) != 0 && errno == EINTR) {
+        }
+
+        // take everything that is waiting, without blocking once the first one is in. The stop
+        // request posts too, without a batch: the ring is empty for it.
+        uint32_t count = 0;
+        bool more = true;
+        while(more && !ring_empty(service)) {
+            tickets[count] = pop(service, batches + count, push_times + count);
+            if(!dependency_ready(service, batches + count)) {
+                // what came before does not depend on it: out first, then wait
+                submit(service, batches, push_times, tickets, count);
+                batches[0] = batches[count];
+                push_times[0] = push_times[count];
+                tickets[0] = tickets[count];
+                count = 0;
+                while(!dependency_ready(service, batches)) {
+                    sched_yield();
+                }
+            }
+            count++;
+            // a fence covers the whole call, so it has to end it
+            if(count == SUBMIT_MAX_COALESCED || batches[count - 1].fence != VK_NULL_HANDLE) {
+                submit(service, batches, push_times, tickets, count);
+                count = 0;
+            }
+            more = sem_trywait(&(service->available)) == 0;
+        }
+        submit(service, batches, push_times, tickets, count);
+
+        if(atomic_load(&(service->stopping)) && ring_empty(service)) {
+            return NULL;
+        }
+    }
+}
+
+/* Lifetime **************************/
+void submit_service_create(SubmitService* service, const char* name, VkQueue queue,
+                           pthread_mutex_t* queue_mutex) {
+    memset(service, 0, sizeof(SubmitService));
+    service->name = name;
+    service->queue = queue;
+    service->queue_mutex = queue_mutex;
+    for(uint64_t i = 0; i < SUBMIT_RING_CAPACITY; i++) {
+        atomic_init(&(service->slots[i].sequence), i);
+    }
+    atomic_init(&(service->enqueue_position), 0);
+    atomic_init(&(service->submitted), 0);
+    atomic_init(&(service->stopping), false);
+    atomic_init(&(service->submit_calls), 0);
+    atomic_init(&(service->batches), 0);
+    atomic_init(&(service->largest_call), 0);
+    atomic_init(&(service->latency_total_us), 0);
+    atomic_init(&(service->latency_max_us), 0);
+    sem_init(&(service->available), 0, 0);
+
+    if(pthread_create(&(service->thread), NULL, submitter_thread, service) != 0) {
+        printf("failed to start the %s queue submitter\n", name);
+        return;
+    }
+    service->thread_started = true;
+}
+
+void submit_service_destroy(SubmitService* service) {
+    if(service->thread_started) {
+        atomic_store(&(service->stopping), true);
+        sem_post(&(service->available));
+        pthread_join(service->thread, NULL);
+    }
+    sem_destroy(&(service->available));
+    memset(service, 0, sizeof(SubmitService));
+}
+
+void submit_service_wait_submitted(SubmitService* service, uint64_t ticket) {
+    while(atomic_load_explicit(&(service->submitted), memory_order_acquire) < ticket) {
+        sched_yield();
+    }
+}
+
+void submit_service_flush(SubmitService* service) {
+    submit_service_wait_submitted(
+        service, atomic_load_explicit(&(service->enqueue_position), memory_order_relaxed));
+}
+
+void submit_service_print_stats(SubmitService* service) {
+    uint64_t calls = atomic_exchange(&(service->submit_calls), 0);
+    uint64_t batches = atomic_exchange(&(service->batches), 0);
+    uint64_t largest = atomic_exchange(&(service->largest_call), 0);
+    uint64_t latency_total_us = atomic_exchange(&(service->latency_total_us), 0);
+    uint64_t latency_max_us = atomic_exchange(&(service->latency_max_us), 0);
+    if(calls == 0) {
+        return;
+    }
+    printf("%s queue: %llu batches in %llu submits (%.2f per submit, at most %llu), latency "
+           "%.3f ms average, %.3f ms worst\n",
+           service->name, (unsigned long long)batches, (unsigned long long)calls,
+           (double)batches / (double)calls, (unsigned long long)largest,
+           (double)latency_total_us / 1000.0 / (double)batches, (double)latency_max_us / 1000.0);
+}
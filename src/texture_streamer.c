@@ -0,0 +1,1059 @@
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <vulkan/vulkan.h>
+
+#include "bindless.h"
+#include "gpu_memory.h"
+#include "submit_service.h"
+#include "texture_streamer.h"
+
+#define TEXTURE_FORMAT VK_FORMAT_R8G8B8A8_SRGB
+#define TEXTURE_TEXEL_SIZE 4
+// start_upload results that are not a slot
+#define UPLOAD_SLOTS_BUSY (-1)
+#define UPLOAD_FAILED (-2)
+
+typedef enum {
+    TEXTURE_JOB_LOAD,       // decode the file, and build the coarse preview
+    TEXTURE_JOB_DOWNSAMPLE, // shrink the source so that it fits in the budget
+} TextureJobType;
+
+struct TextureJob {
+    TextureJobType type;
+    uint32_t texture;
+
+    // inputs
+    char path[TEXTURE_STREAMER_MAX_PATH];
+    uint32_t preview_size;
+    const uint8_t* source; // owned by the texture, read-only while the job runs
+    uint32_t source_width;
+    uint32_t source_height;
+    uint32_t mip_bias;
+
+    // outputs
+    bool success;
+    uint8_t* pixels; // LOAD: full source. DOWNSAMPLE: the source at mip_bias
+    uint32_t width;
+    uint32_t height;
+    uint8_t* preview; // LOAD only, NULL when the source is already small enough
+    uint32_t preview_width;
+    uint32_t preview_height;
+
+    struct TextureJob* next;
+};
+
+/* CPU image helpers *****************/
+
+static int ppm_next_token(FILE* file) {
+    // skips whitespaces and comments, returns the first char of the next token
+    int c = fgetc(file);
+    while(c != EOF) {
+        if(c == '#') {
+            while(c != EOF && c != '\n') {
+                c = fgetc(file);
+            }
+        } else if(c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+            return c;
+        }
+        c = fgetc(file);
+    }
+    return EOF;
+}
+
+static bool ppm_read_uint(FILE* file, uint32_t* value) {
+    int c = ppm_next_token(file);
+    if(c < '0' || c > '9') {
+        return false;
+    }
+    *value = 0;
+    while(c >= '0' && c <= '9') {
+        *value = *value * 10 + (uint32_t)(c - '0');
+        c = fgetc(file);
+    }
+    // c is the single whitespace that ends the token
+    return true;
+}
+
+// Binary PPM (P6), 8 bits per channel. Returns rgba8 pixels, alpha is opaque.
+static uint8_t* load_ppm(const char* path, uint32_t* width, uint32_t* height) {
+    FILE* file = fopen(path, "rb");
+    if(!file) {
+        printf("failed to open texture file %s\n", path);
+        return NULL;
+    }
+
+    uint32_t max_value = 0;
+    if(fgetc(file) != 'P' || fgetc(file) != '6' || !ppm_read_uint(file, width) ||
+       !ppm_read_uint(file, height) || !ppm_read_uint(file, &max_value) || max_value > 255 ||
+       *width == 0 || *height == 0) {
+        printf("texture file %s is not a 8 bits binary ppm\n", path);
+        fclose(file);
+        return NULL;
+    }
+
+    size_t texel_count = (size_t)(*width) * (size_t)(*height);
+    uint8_t* rgb = malloc(texel_count * 3);
+    if(fread(rgb, 3, texel_count, file) != texel_count) {
+        printf("texture file %s is truncated\n", path);
+        free(rgb);
+        fclose(file);
+        return NULL;
+    }
+    fclose(file);
+
+    uint8_t* rgba = malloc(texel_count * TEXTURE_TEXEL_SIZE);
+    for(size_t i = 0; i < texel_count; i++) {
+        rgba[4 * i + 0] = rgb[3 * i + 0];
+        rgba[4 * i + 1] = rgb[3 * i + 1];
+        rgba[4 * i + 2] = rgb[3 * i + 2];
+        rgba[4 * i + 3] = 255;
+    }
+    free(rgb);
+    return rgba;
+}
+
+// 2x2 box filter. Odd sizes drop their last row/column, like the GPU blits do.
+static uint8_t* downsample_half(const uint8_t* src, uint32_t width, uint32_t height,
+                                uint32_t* out_width, uint32_t* out_height) {
+    uint32_t w = width > 1 ? width / 2 : 1;
+    uint32_t h = height > 1 ? height / 2 : 1;
+    uint8_t* dst = malloc((size_t)w * h * TEXTURE_TEXEL_SIZE);
+
+    for(uint32_t y = 0; y < h; y++) {
+        uint32_t y0 = height > 1 ? 2 * y : 0;
+        uint32_t y1 = height > 1 ? 2 * y + 1 : 0;
+        for(uint32_t x = 0; x < w; x++) {
+            uint32_t x0 = width > 1 ? 2 * x : 0;
+            uint32_t x1 = width > 1 ? 2 * x + 1 : 0;
+            for(uint32_t c = 0; c < TEXTURE_TEXEL_SIZE; c++) {
+                uint32_t sum = src[((size_t)y0 * width + x0) * TEXTURE_TEXEL_SIZE + c] +
+                               src[((size_t)y0 * width + x1) * TEXTURE_TEXEL_SIZE + c] +
+                               src[((size_t)y1 * width + x0) * TEXTURE_TEXEL_SIZE + c] +
+                               src[((size_t)y1 * width + x1) * TEXTURE_TEXEL_SIZE + c];
+                dst[((size_t)y * w + x) * TEXTURE_TEXEL_SIZE + c] = (uint8_t)((sum + 2) / 4);
+            }
+        }
+    }
+    *out_width = w;
+    *out_height = h;
+    return dst;
+}
+
+// Halves the image until it is at most max_size wide and high, or levels times.
+static uint8_t* downsample(const uint8_t* src, uint32_t width, uint32_t height, uint32_t levels,
+                           uint32_t max_size, uint32_t* out_width, uint32_t* out_height) {
+    uint8_t* current = NULL;
+    uint32_t w = width, h = height;
+    for(uint32_t i = 0; i < levels && (w > max_size || h > max_size); i++) {
+        uint8_t* next = downsample_half(current ? current : src, w, h, &w, &h);
+        free(current);
+        current = next;
+    }
+    *out_width = w;
+    *out_height = h;
+    return current; // NULL if nothing had to be done
+}
+
+static uint32_t mip_level_count(uint32_t width, uint32_t height) {
+    uint32_t size = width > height ? width : height;
+    uint32_t levels = 1;
+    while(size > 1) {
+        size /= 2;
+        levels++;
+    }
+    return levels;
+}
+
+static VkDeviceSize estimate_version_size(uint32_t width, uint32_t height) {
+    VkDeviceSize size = 0;
+    uint32_t levels = mip_level_count(width, height);
+    for(uint32_t i = 0; i < levels; i++) {
+        size += (VkDeviceSize)width * height * TEXTURE_TEXEL_SIZE;
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+    }
+    return size;
+}
+
+/* Worker threads ********************/
+
+static void run_job(TextureJob* job, Profiler* profiler) {
+    ProfileZone zone = profiler_begin(
+        profiler, job->type == TEXTURE_JOB_LOAD ? "load texture" : "downsample texture");
+    switch(job->type) {
+    case TEXTURE_JOB_LOAD:
+        job->pixels = load_ppm(job->path, &(job->width), &(job->height));
+        job->success = job->pixels != NULL;
+        if(job->success) {
+            job->preview = downsample(job->pixels, job->width, job->height, UINT32_MAX,
+                                      job->preview_size, &(job->preview_width),
+                                      &(job->preview_height));
+        }
+        break;
+    case TEXTURE_JOB_DOWNSAMPLE:
+        job->pixels = downsample(job->source, job->source_width, job->source_height,
+                                 job->mip_bias, 0, &(job->width), &(job->height));
+        job->success = job->pixels != NULL;
+        break;
+    }
+    profiler_end(&zone);
+}
+
+static void* texture_worker(void* arg) {
+    TextureStreamer* streamer = arg;
+    profiler_name_thread(streamer->info.profiler, "texture worker");
+
+    pthread_mutex_lock(&(streamer->job_mutex));
+    while(true) {
+        while(!streamer->stopping && streamer->pending_head == NULL) {
+            pthread_cond_wait(&(streamer->job_available), &(streamer->job_mutex));
+        }
+        if(streamer->stopping) {
+            break;
+        }
+        TextureJob* job = streamer->pending_head;
+        streamer->pending_head = job->next;
+        if(streamer->pending_head == NULL) {
+            streamer->pending_tail = NULL;
+        }
+        pthread_mutex_unlock(&(streamer->job_mutex));
+
+        run_job(job, streamer->info.profiler);
+
+        pthread_mutex_lock(&(streamer->job_mutex));
+        job->next = streamer->completed_head;
+        streamer->completed_head = job;
+    }
+    pthread_mutex_unlock(&(streamer->job_mutex));
+    return NULL;
+}
+
+static void push_job(TextureStreamer* streamer, TextureJob* job) {
+    job->next = NULL;
+    pthread_mutex_lock(&(streamer->job_mutex));
+    if(streamer->pending_tail) {
+        streamer->pending_tail->next = job;
+    } else {
+        streamer->pending_head = job;
+    }
+    streamer->pending_tail = job;
+    pthread_cond_signal(&(streamer->job_available));
+    pthread_mutex_unlock(&(streamer->job_mutex));
+}
+
+static void free_job(TextureJob* job) {
+    free(job->pixels);
+    free(job->preview);
+    free(job);
+}
+
+/* GPU resources *********************/
+
+static uint32_t find_memory_type_index(const TextureStreamer* streamer, uint32_t type_filter,
+                                       VkMemoryPropertyFlags properties) {
+    const VkPhysicalDeviceMemoryProperties* memory_properties = &(streamer->memory_properties);
+    for(uint32_t i = 0; i < memory_properties->memoryTypeCount; i++) {
+        if(type_filter & (1 << i) &&
+           ((memory_properties->memoryTypes[i].propertyFlags & properties) == properties)) {
+            return i;
+        }
+    }
+    printf("failed to find suitable memory type for texture\n");
+    return UINT32_MAX;
+}
+
+// Through the tracker when there is one, so that the textures show up in its report
+static VkResult allocate_memory(TextureStreamer* streamer,
+                                const VkMemoryAllocateInfo* allocate_info,
+                                GpuMemoryCategory category, VkDeviceMemory* memory) {
+    if(streamer->info.memory_tracker != NULL) {
+        return gpu_memory_allocate(streamer->info.memory_tracker, allocate_info, category, memory);
+    }
+    return vkAllocateMemory(streamer->info.device, allocate_info, streamer->info.allocator,
+                            memory);
+}
+
+static void free_memory(TextureStreamer* streamer, VkDeviceMemory memory) {
+    if(streamer->info.memory_tracker != NULL) {
+        gpu_memory_free(streamer->info.memory_tracker, memory);
+    } else {
+        vkFreeMemory(streamer->info.device, memory, streamer->info.allocator);
+    }
+}
+
+static bool create_version(TextureStreamer* streamer, uint32_t width, uint32_t height,
+                           TextureVersion* version) {
+    VkDevice device = streamer->info.device;
+    const VkAllocationCallbacks* allocator = streamer->info.allocator;
+    memset(version, 0, sizeof(TextureVersion));
+    version->width = width;
+    version->height = height;
+    version->mip_levels = mip_level_count(width, height);
+    version->bindless_index = BINDLESS_INVALID_INDEX;
+
+    VkImageCreateInfo image_info = {0};
+    image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_info.imageType = VK_IMAGE_TYPE_2D;
+    image_info.format = TEXTURE_FORMAT;
+    image_info.extent = (VkExtent3D){width, height, 1};
+    image_info.mipLevels = version->mip_levels;
+    image_info.arrayLayers = 1;
+    image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+    image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    // src and dst: every level but the last is blitted from, and every level but the first to
+    image_info.usage =
+        VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    // ownership is transferred explicitly from the transfer to the graphics family
+    image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    if(vkCreateImage(device, &image_info, allocator, &(version->image)) != VK_SUCCESS) {
+        printf("failed to create texture image\n");
+        return false;
+    }
+
+    VkMemoryRequirements memory_requirements = {0};
+    vkGetImageMemoryRequirements(device, version->image, &memory_requirements);
+    VkMemoryAllocateInfo allocate_info = {0};
+    allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocate_info.allocationSize = memory_requirements.size;
+    allocate_info.memoryTypeIndex = find_memory_type_index(
+        streamer, memory_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    if(allocate_memory(streamer, &allocate_info, GPU_MEMORY_TEXTURE, &(version->memory)) !=
+       VK_SUCCESS) {
+        printf("failed to allocate texture memory\n");
+        vkDestroyImage(device, version->image, allocator);
+        version->image = VK_NULL_HANDLE;
+        return false;
+    }
+    vkBindImageMemory(device, version->image, version->memory, 0);
+    version->size = memory_requirements.size;
+    streamer->texture_memory_type = allocate_info.memoryTypeIndex;
+
+    VkImageViewCreateInfo view_info = {0};
+    view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    view_info.image = version->image;
+    view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    view_info.format = TEXTURE_FORMAT;
+    view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    view_info.subresourceRange.baseMipLevel = 0;
+    view_info.subresourceRange.levelCount = version->mip_levels;
+    view_info.subresourceRange.baseArrayLayer = 0;
+    view_info.subresourceRange.layerCount = 1;
+    if(vkCreateImageView(device, &view_info, allocator, &(version->view)) != VK_SUCCESS) {
+        printf("failed to create texture image view\n");
+    }
+    return true;
+}
+
+static void destroy_version(TextureStreamer* streamer, TextureVersion* version) {
+    VkDevice device = streamer->info.device;
+    const VkAllocationCallbacks* allocator = streamer->info.allocator;
+    if(version->bindless_index != BINDLESS_INVALID_INDEX) {
+        bindless_release_image(streamer->info.bindless, version->bindless_index);
+    }
+    vkDestroyImageView(device, version->view, allocator);
+    vkDestroyImage(device, version->image, allocator);
+    free_memory(streamer, version->memory);
+    streamer->resident_bytes -= version->size;
+    memset(version, 0, sizeof(TextureVersion));
+    version->bindless_index = BINDLESS_INVALID_INDEX;
+}
+
+// Frames in flight may still sample the version: only destroy it once they are all done
+static void retire_version(TextureStreamer* streamer, TextureVersion* version,
+                           uint64_t frame_number) {
+    if(version->image == VK_NULL_HANDLE) {
+        return;
+    }
+    if(streamer->retired_count == streamer->retired_capacity) {
+        uint32_t capacity = streamer->retired_capacity == 0 ? 16 : 2 * streamer->retired_capacity;
+        RetiredTextureVersion* retired_versions =
+            realloc(streamer->retired, capacity * sizeof(RetiredTextureVersion));
+        if(retired_versions == NULL) {
+            // frames in flight may still sample it, it is leaked rather than destroyed now
+            printf("failed to grow the retired texture versions, an image is leaked\n");
+            memset(version, 0, sizeof(TextureVersion));
+            version->bindless_index = BINDLESS_INVALID_INDEX;
+            return;
+        }
+        streamer->retired = retired_versions;
+        streamer->retired_capacity = capacity;
+    }
+    RetiredTextureVersion* retired = streamer->retired + streamer->retired_count++;
+    retired->version = *version;
+    retired->retire_frame = frame_number + streamer->info.frames_in_flight;
+    memset(version, 0, sizeof(TextureVersion));
+    version->bindless_index = BINDLESS_INVALID_INDEX;
+}
+
+static void image_barrier(VkCommandBuffer command_buffer, VkImage image, uint32_t base_level,
+                          uint32_t level_count, VkImageLayout old_layout, VkImageLayout new_layout,
+                          VkAccessFlags src_access, VkAccessFlags dst_access,
+                          VkPipelineStageFlags src_stage, VkPipelineStageFlags dst_stage,
+                          uint32_t src_family, uint32_t dst_family) {
+    VkImageMemoryBarrier barrier = {0};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = old_layout;
+    barrier.newLayout = new_layout;
+    barrier.srcAccessMask = src_access;
+    barrier.dstAccessMask = dst_access;
+    barrier.srcQueueFamilyIndex = src_family;
+    barrier.dstQueueFamilyIndex = dst_family;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = base_level;
+    barrier.subresourceRange.levelCount = level_count;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+    vkCmdPipelineBarrier(command_buffer, src_stage, dst_stage, 0, 0, NULL, 0, NULL, 1, &barrier);
+}
+
+static void record_copy(TextureStreamer* streamer, TextureUpload* upload) {
+    const TextureStreamerCreateInfo* info = &(streamer->info);
+    VkCommandBuffer command_buffer = upload->transfer_command_buffer;
+    TextureVersion* version = &(upload->version);
+
+    VkCommandBufferBeginInfo begin_info = {0};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(command_buffer, &begin_info);
+
+    image_barrier(command_buffer, version->image, 0, version->mip_levels, VK_IMAGE_LAYOUT_UNDEFINED,
+                  VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0, VK_ACCESS_TRANSFER_WRITE_BIT,
+                  VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                  VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED);
+
+    // only the first level comes from the CPU, the graphics queue generates the others
+    VkBufferImageCopy region = {0};
+    region.bufferOffset = 0;
+    region.bufferRowLength = 0; // tightly packed
+    region.bufferImageHeight = 0;
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel = 0;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount = 1;
+    region.imageOffset = (VkOffset3D){0, 0, 0};
+    region.imageExtent = (VkExtent3D){version->width, version->height, 1};
+    vkCmdCopyBufferToImage(command_buffer, upload->staging_buffer, version->image,
+                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+    if(info->transfer_family != info->graphics_family) {
+        // release half of the ownership transfer, the graphics queue does the acquire
+        image_barrier(command_buffer, version->image, 0, version->mip_levels,
+                      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                      VK_ACCESS_TRANSFER_WRITE_BIT, 0, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                      VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, info->transfer_family,
+                      info->graphics_family);
+    }
+    vkEndCommandBuffer(command_buffer);
+}
+
+static void record_mip_generation(TextureStreamer* streamer, TextureUpload* upload) {
+    const TextureStreamerCreateInfo* info = &(streamer->info);
+    VkCommandBuffer command_buffer = upload->graphics_command_buffer;
+    TextureVersion* version = &(upload->version);
+
+    VkCommandBufferBeginInfo begin_info = {0};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(command_buffer, &begin_info);
+
+    if(info->transfer_family != info->graphics_family) {
+        image_barrier(command_buffer, version->image, 0, version->mip_levels,
+                      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0,
+                      VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+                      VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                      info->transfer_family, info->graphics_family);
+    }
+
+    // each level is blitted from the previous one, which is then done and can be sampled
+    int32_t width = (int32_t)version->width;
+    int32_t height = (int32_t)version->height;
+    for(uint32_t level = 1; level < version->mip_levels; level++) {
+        image_barrier(command_buffer, version->image, level - 1, 1,
+                      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                      VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+                      VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                      VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED);
+
+        int32_t next_width = width > 1 ? width / 2 : 1;
+        int32_t next_height = height > 1 ? height / 2 : 1;
+        VkImageBlit blit = {0};
+        blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        blit.srcSubresource.mipLevel = level - 1;
+        blit.srcSubresource.baseArrayLayer = 0;
+        blit.srcSubresource.layerCount = 1;
+        blit.srcOffsets[0] = (VkOffset3D){0, 0, 0};
+        blit.srcOffsets[1] = (VkOffset3D){width, height, 1};
+        blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        blit.dstSubresource.mipLevel = level;
+        blit.dstSubresource.baseArrayLayer = 0;
+        blit.dstSubresource.layerCount = 1;
+        blit.dstOffsets[0] = (VkOffset3D){0, 0, 0};
+        blit.dstOffsets[1] = (VkOffset3D){next_width, next_height, 1};
+        vkCmdBlitImage(command_buffer, version->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                       version->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit,
+                       streamer->blit_filter);
+
+        image_barrier(command_buffer, version->image, level - 1, 1,
+                      VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_READ_BIT,
+                      VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                      VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_QUEUE_FAMILY_IGNORED,
+                      VK_QUEUE_FAMILY_IGNORED);
+        width = next_width;
+        height = next_height;
+    }
+    image_barrier(command_buffer, version->image, version->mip_levels - 1, 1,
+                  VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                  VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+                  VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                  VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED);
+
+    vkEndCommandBuffer(command_buffer);
+}
+
+// Returns the upload slot, UPLOAD_SLOTS_BUSY if every slot is busy (nothing is done then, it can
+// be tried again later), or UPLOAD_FAILED if the GPU resources could not be created
+static int start_upload(TextureStreamer* streamer, uint32_t texture, const uint8_t* pixels,
+                        uint32_t width, uint32_t height, uint32_t mip_bias, bool is_preview) {
+    const TextureStreamerCreateInfo* info = &(streamer->info);
+    VkDevice device = info->device;
+    const VkAllocationCallbacks* allocator = streamer->info.allocator;
+
+    int slot = -1;
+    for(int i = 0; i < TEXTURE_STREAMER_MAX_UPLOADS; i++) {
+        if(!streamer->upload_in_use[i]) {
+            slot = i;
+            break;
+        }
+    }
+    if(slot < 0) {
+        return UPLOAD_SLOTS_BUSY;
+    }
+    TextureUpload* upload = streamer->uploads + slot;
+    memset(upload, 0, sizeof(TextureUpload));
+    upload->texture = texture;
+    upload->mip_bias = mip_bias;
+    upload->is_preview = is_preview;
+
+    if(!create_version(streamer, width, height, &(upload->version))) {
+        return UPLOAD_FAILED;
+    }
+    streamer->resident_bytes += upload->version.size;
+
+    /* Staging */
+    VkDeviceSize staging_size = (VkDeviceSize)width * height * TEXTURE_TEXEL_SIZE;
+    VkBufferCreateInfo buffer_info = {0};
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.size = staging_size;
+    buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    if(vkCreateBuffer(device, &buffer_info, allocator, &(upload->staging_buffer)) != VK_SUCCESS) {
+        printf("failed to create texture staging buffer\n");
+        destroy_version(streamer, &(upload->version));
+        return UPLOAD_FAILED;
+    }
+    VkMemoryRequirements memory_requirements = {0};
+    vkGetBufferMemoryRequirements(device, upload->staging_buffer, &memory_requirements);
+    VkMemoryAllocateInfo allocate_info = {0};
+    allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocate_info.allocationSize = memory_requirements.size;
+    allocate_info.memoryTypeIndex =
+        find_memory_type_index(streamer, memory_requirements.memoryTypeBits,
+                               VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                   VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    if(allocate_memory(streamer, &allocate_info, GPU_MEMORY_STAGING, &(upload->staging_memory)) !=
+       VK_SUCCESS) {
+        printf("failed to allocate texture staging memory\n");
+        vkDestroyBuffer(device, upload->staging_buffer, allocator);
+        destroy_version(streamer, &(upload->version));
+        return UPLOAD_FAILED;
+    }
+    vkBindBufferMemory(device, upload->staging_buffer, upload->staging_memory, 0);
+
+    void* data;
+    if(vkMapMemory(device, upload->staging_memory, 0, staging_size, 0, &data) != VK_SUCCESS) {
+        printf("failed to map texture staging memory\n");
+        free_memory(streamer, upload->staging_memory);
+        vkDestroyBuffer(device, upload->staging_buffer, allocator);
+        destroy_version(streamer, &(upload->version));
+        return UPLOAD_FAILED;
+    }
+    memcpy(data, pixels, (size_t)staging_size);
+    vkUnmapMemory(device, upload->staging_memory);
+
+    /* Commands */
+    VkCommandBufferAllocateInfo command_allocate_info = {0};
+    command_allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    command_allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    command_allocate_info.commandBufferCount = 1;
+    command_allocate_info.commandPool = info->transfer_command_pool;
+    vkAllocateCommandBuffers(device, &command_allocate_info, &(upload->transfer_command_buffer));
+    command_allocate_info.commandPool = info->graphics_command_pool;
+    vkAllocateCommandBuffers(device, &command_allocate_info, &(upload->graphics_command_buffer));
+
+    record_copy(streamer, upload);
+    record_mip_generation(streamer, upload);
+
+    /* Submission */
+    // the copy signals a semaphore the blits wait on, and the blits signal a fence that
+    // texture_streamer_update polls: nobody waits on the CPU
+    VkSemaphoreCreateInfo semaphore_info = {0};
+    semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    vkCreateSemaphore(device, &semaphore_info, allocator, &(upload->copy_done));
+    VkFenceCreateInfo fence_info = {0};
+    fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    vkCreateFence(device, &fence_info, allocator, &(upload->done));
+
+    SubmitBatch copy_batch = {0};
+    copy_batch.command_buffer_count = 1;
+    copy_batch.command_buffers[0] = upload->transfer_command_buffer;
+    copy_batch.signal_semaphore_count = 1;
+    copy_batch.signal_semaphores[0] = upload->copy_done;
+    uint64_t copy_ticket = submit_service_push(info->transfer_submit, &copy_batch);
+
+    SubmitBatch blit_batch = {0};
+    blit_batch.command_buffer_count = 1;
+    blit_batch.command_buffers[0] = upload->graphics_command_buffer;
+    blit_batch.wait_semaphore_count = 1;
+    blit_batch.wait_semaphores[0] = upload->copy_done;
+    blit_batch.wait_stages[0] = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    blit_batch.fence = upload->done;
+    // the copy has to be submitted before the wait on its semaphore
+    blit_batch.after = info->transfer_submit;
+    blit_batch.after_ticket = copy_ticket;
+    submit_service_push(info->graphics_submit, &blit_batch);
+
+    streamer->upload_in_use[slot] = true;
+    return slot;
+}
+
+static void release_texture_data(StreamedTexture* texture) {
+    free(texture->pixels);
+    texture->pixels = NULL;
+}
+
+// Retrying would fail the same way every frame: the texture keeps what it shows now
+static void fail_texture(StreamedTexture* texture) {
+    release_texture_data(texture);
+    texture->state = TEXTURE_STATE_FAILED;
+}
+
+static void finish_upload(TextureStreamer* streamer, int slot, uint64_t frame_number) {
+    const TextureStreamerCreateInfo* info = &(streamer->info);
+    VkDevice device = info->device;
+    const VkAllocationCallbacks* allocator = streamer->info.allocator;
+    TextureUpload* upload = streamer->uploads + slot;
+
+    vkFreeCommandBuffers(device, info->transfer_command_pool, 1,
+                         &(upload->transfer_command_buffer));
+    vkFreeCommandBuffers(device, info->graphics_command_pool, 1,
+                         &(upload->graphics_command_buffer));
+    vkDestroySemaphore(device, upload->copy_done, allocator);
+    vkDestroyFence(device, upload->done, allocator);
+    vkDestroyBuffer(device, upload->staging_buffer, allocator);
+    free_memory(streamer, upload->staging_memory);
+    streamer->upload_in_use[slot] = false;
+
+    upload->version.bindless_index =
+        bindless_register_image(info->bindless, upload->version.view, streamer->sampler,
+                                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+    if(upload->texture == TEXTURE_HANDLE_NONE) {
+        streamer->placeholder = upload->version;
+        return;
+    }
+
+    StreamedTexture* texture = streamer->textures + upload->texture;
+    if(texture->release_requested) {
+        retire_version(streamer, &(upload->version), frame_number);
+        release_texture_data(texture);
+        texture->state = TEXTURE_STATE_FREE;
+        return;
+    }
+
+    // swap: the new version is used from the next recorded frame on
+    retire_version(streamer, &(texture->current), frame_number);
+    texture->current = upload->version;
+    texture->mip_bias = upload->mip_bias;
+    if(upload->is_preview) {
+        texture->state = TEXTURE_STATE_PREVIEW;
+    } else {
+        texture->state = TEXTURE_STATE_RESIDENT;
+        free(texture->pixels);
+        texture->pixels = NULL;
+    }
+}
+
+/* Streaming *************************/
+
+// Smallest mip bias whose full chain fits in what is left of the budget, or UINT32_MAX
+static uint32_t pick_mip_bias(const TextureStreamer* streamer, const StreamedTexture* texture) {
+    VkDeviceSize available = streamer->resident_bytes < streamer->info.memory_budget
+                                 ? streamer->info.memory_budget - streamer->resident_bytes
+                                 : 0;
+    // our budget is not the only limit: the heap may be filling up with everything else
+    GpuMemoryTracker* tracker = streamer->info.memory_tracker;
+    if(tracker != NULL && streamer->texture_memory_type != UINT32_MAX) {
+        VkDeviceSize headroom = gpu_memory_headroom(tracker, streamer->texture_memory_type);
+        available = headroom < available ? headroom : available;
+    }
+    uint32_t width = texture->width, height = texture->height;
+    for(uint32_t bias = 0;
+        bias < 32 && (width > texture->current.width || height > texture->current.height);
+        bias++) {
+        if(estimate_version_size(width, height) <= available) {
+            return bias;
+        }
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+    }
+    return UINT32_MAX; // nothing better than the current version fits
+}
+
+static bool process_job(TextureStreamer* streamer, TextureJob* job, uint64_t frame_number) {
+    StreamedTexture* texture = streamer->textures + job->texture;
+    if(texture->release_requested) {
+        release_texture_data(texture);
+        texture->state = TEXTURE_STATE_FREE;
+        return true;
+    }
+
+    if(job->type == TEXTURE_JOB_LOAD) {
+        if(!job->success) {
+            texture->state = TEXTURE_STATE_FAILED;
+            return true;
+        }
+        int slot;
+        if(job->preview == NULL) {
+            // already small: no point in a preview, upload it as the final version
+            slot = start_upload(streamer, job->texture, job->pixels, job->width, job->height, 0,
+                                false);
+        } else {
+            slot = start_upload(streamer, job->texture, job->preview, job->preview_width,
+                                job->preview_height, UINT32_MAX, true);
+        }
+        if(slot == UPLOAD_SLOTS_BUSY) {
+            return false;
+        }
+        if(slot == UPLOAD_FAILED) {
+            // the job, and the source with it, is freed by the caller
+            texture->state = TEXTURE_STATE_FAILED;
+            return true;
+        }
+        texture->state =
+            job->preview == NULL ? TEXTURE_STATE_UPLOADING : TEXTURE_STATE_PREVIEW_UPLOADING;
+        // the texture keeps the source for its final version
+        texture->pixels = job->pixels;
+        texture->width = job->width;
+        texture->height = job->height;
+        job->pixels = NULL;
+        return true;
+    }
+
+    // TEXTURE_JOB_DOWNSAMPLE
+    int slot = start_upload(streamer, job->texture, job->pixels, job->width, job->height,
+                            job->mip_bias, false);
+    if(slot == UPLOAD_SLOTS_BUSY) {
+        return false;
+    }
+    if(slot == UPLOAD_FAILED) {
+        fail_texture(texture);
+        return true;
+    }
+    texture->state = TEXTURE_STATE_UPLOADING;
+    return true;
+}
+
+static void promote_previews(TextureStreamer* streamer, uint32_t* uploads_left) {
+    for(uint32_t i = 0; i < TEXTURE_STREAMER_MAX_TEXTURES && *uploads_left > 0; i++) {
+        StreamedTexture* texture = streamer->textures + i;
+        if(texture->state != TEXTURE_STATE_PREVIEW || texture->release_requested) {
+            continue;
+        }
+        uint32_t bias = pick_mip_bias(streamer, texture);
+        if(bias == UINT32_MAX) {
+            continue; // wait for some budget to free up
+        }
+        if(bias == 0) {
+            int slot = start_upload(streamer, i, texture->pixels, texture->width,
+                                    texture->height, 0, false);
+            if(slot == UPLOAD_SLOTS_BUSY) {
+                return;
+            }
+            if(slot == UPLOAD_FAILED) {
+                fail_texture(texture);
+                continue;
+            }
+            texture->state = TEXTURE_STATE_UPLOADING;
+            (*uploads_left)--;
+        } else {
+            TextureJob* job = calloc(1, sizeof(TextureJob));
+            job->type = TEXTURE_JOB_DOWNSAMPLE;
+            job->texture = i;
+            job->source = texture->pixels;
+            job->source_width = texture->width;
+            job->source_height = texture->height;
+            job->mip_bias = bias;
+            texture->state = TEXTURE_STATE_PREPARING;
+            push_job(streamer, job);
+        }
+    }
+}
+
+void texture_streamer_update(TextureStreamer* streamer, uint64_t frame_number) {
+    VkDevice device = streamer->info.device;
+
+    // 1. versions no frame in flight can reference anymore
+    uint32_t kept = 0;
+    for(uint32_t i = 0; i < streamer->retired_count; i++) {
+        if(streamer->retired[i].retire_frame <= frame_number) {
+            destroy_version(streamer, &(streamer->retired[i].version));
+        } else {
+            streamer->retired[kept++] = streamer->retired[i];
+        }
+    }
+    streamer->retired_count = kept;
+
+    // 2. finished uploads, polled
+    for(int i = 0; i < TEXTURE_STREAMER_MAX_UPLOADS; i++) {
+        if(streamer->upload_in_use[i] &&
+           vkGetFenceStatus(device, streamer->uploads[i].done) == VK_SUCCESS) {
+            finish_upload(streamer, i, frame_number);
+        }
+    }
+
+    // 3. what the workers produced. Jobs that cannot be uploaded this frame are put back.
+    pthread_mutex_lock(&(streamer->job_mutex));
+    TextureJob* completed = streamer->completed_head;
+    streamer->completed_head = NULL;
+    pthread_mutex_unlock(&(streamer->job_mutex));
+
+    uint32_t uploads_left = streamer->info.max_uploads_per_frame;
+    TextureJob* postponed = NULL;
+    while(completed) {
+        TextureJob* job = completed;
+        completed = job->next;
+        if(uploads_left > 0 && process_job(streamer, job, frame_number)) {
+            uploads_left--;
+            free_job(job);
+        } else {
+            job->next = postponed;
+            postponed = job;
+        }
+    }
+    if(postponed) {
+        pthread_mutex_lock(&(streamer->job_mutex));
+        TextureJob* last = postponed;
+        while(last->next) {
+            last = last->next;
+        }
+        last->next = streamer->completed_head;
+        streamer->completed_head = postponed;
+        pthread_mutex_unlock(&(streamer->job_mutex));
+    }
+
+    // 4. coarse versions that can now be replaced by a better one
+    promote_previews(streamer, &uploads_left);
+}
+
+uint32_t texture_streamer_request(TextureStreamer* streamer, const char* path) {
+    uint32_t handle = TEXTURE_HANDLE_NONE;
+    for(uint32_t i = 0; i < TEXTURE_STREAMER_MAX_TEXTURES; i++) {
+        if(streamer->textures[i].state == TEXTURE_STATE_FREE) {
+            handle = i;
+            break;
+        }
+    }
+    if(handle == TEXTURE_HANDLE_NONE) {
+        printf("too many textures, %s not loaded\n", path);
+        return handle;
+    }
+
+    StreamedTexture* texture = streamer->textures + handle;
+    memset(texture, 0, sizeof(StreamedTexture));
+    texture->state = TEXTURE_STATE_LOADING;
+    texture->current.bindless_index = BINDLESS_INVALID_INDEX;
+    snprintf(texture->path, TEXTURE_STREAMER_MAX_PATH, "%s", path);
+
+    TextureJob* job = calloc(1, sizeof(TextureJob));
+    job->type = TEXTURE_JOB_LOAD;
+    job->texture = handle;
+    job->preview_size = streamer->info.preview_size;
+    snprintf(job->path, TEXTURE_STREAMER_MAX_PATH, "%s", path);
+    push_job(streamer, job);
+    return handle;
+}
+
+void texture_streamer_release(TextureStreamer* streamer, uint32_t handle, uint64_t frame_number) {
+    if(handle >= TEXTURE_STREAMER_MAX_TEXTURES) {
+        return;
+    }
+    StreamedTexture* texture = streamer->textures + handle;
+    retire_version(streamer, &(texture->current), frame_number);
+
+    switch(texture->state) {
+    case TEXTURE_STATE_LOADING:
+    case TEXTURE_STATE_PREPARING:
+    case TEXTURE_STATE_PREVIEW_UPLOADING:
+    case TEXTURE_STATE_UPLOADING:
+        // a worker or the GPU still works on it, finished when they are done
+        texture->release_requested = true;
+        break;
+    default:
+        release_texture_data(texture);
+        texture->state = TEXTURE_STATE_FREE;
+        break;
+    }
+}
+
+uint32_t texture_streamer_get_index(const TextureStreamer* streamer, uint32_t handle) {
+    if(handle >= TEXTURE_STREAMER_MAX_TEXTURES ||
+       streamer->textures[handle].current.bindless_index == BINDLESS_INVALID_INDEX) {
+        return streamer->placeholder.bindless_index;
+    }
+    return streamer->textures[handle].current.bindless_index;
+}
+
+bool texture_streamer_busy(const TextureStreamer* streamer) {
+    // old versions are only freed by updates, they count as work left
+    if(streamer->retired_count > 0) {
+        return true;
+    }
+    for(uint32_t i = 0; i < TEXTURE_STREAMER_MAX_UPLOADS; i++) {
+        if(streamer->upload_in_use[i]) {
+            return true;
+        }
+    }
+    for(uint32_t i = 0; i < TEXTURE_STREAMER_MAX_TEXTURES; i++) {
+        switch(streamer->textures[i].state) {
+        case TEXTURE_STATE_LOADING:
+        case TEXTURE_STATE_PREVIEW_UPLOADING:
+        case TEXTURE_STATE_PREPARING:
+        case TEXTURE_STATE_UPLOADING:
+            return true;
+        default:
+            break;
+        }
+    }
+    return false;
+}
+
+void texture_streamer_create(TextureStreamer* streamer, const TextureStreamerCreateInfo* info) {
+    assert(info->transfer_submit != NULL && info->graphics_submit != NULL);
+    memset(streamer, 0, sizeof(TextureStreamer));
+    streamer->info = *info;
+    vkGetPhysicalDeviceMemoryProperties(info->physical_device, &(streamer->memory_properties));
+    streamer->texture_memory_type = UINT32_MAX;
+    streamer->textures = calloc(TEXTURE_STREAMER_MAX_TEXTURES, sizeof(StreamedTexture));
+
+    // linear filtering of the blits is an optional format feature
+    VkFormatProperties format_properties = {0};
+    vkGetPhysicalDeviceFormatProperties(info->physical_device, TEXTURE_FORMAT, &format_properties);
+    if(format_properties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT) {
+        streamer->blit_filter = VK_FILTER_LINEAR;
+    } else {
+        printf("linear blits not supported for textures, mips will be generated with nearest\n");
+        streamer->blit_filter = VK_FILTER_NEAREST;
+    }
+
+    VkSamplerCreateInfo sampler_info = {0};
+    sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    sampler_info.magFilter = VK_FILTER_LINEAR;
+    sampler_info.minFilter = VK_FILTER_LINEAR;
+    sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    sampler_info.anisotropyEnable = VK_FALSE;
+    sampler_info.minLod = 0.0f;
+    sampler_info.maxLod = VK_LOD_CLAMP_NONE;
+    sampler_info.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+    if(vkCreateSampler(info->device, &sampler_info, info->allocator, &(streamer->sampler)) !=
+       VK_SUCCESS) {
+        printf("failed to create texture sampler\n");
+    }
+
+    // the placeholder is the only texture waited for: it is tiny and must exist from frame 0
+    const uint8_t placeholder_pixels[2 * 2 * TEXTURE_TEXEL_SIZE] = {
+        255, 255, 255, 255, 200, 200, 200, 255, 200, 200, 200, 255, 255, 255, 255, 255};
+    int slot = start_upload(streamer, TEXTURE_HANDLE_NONE, placeholder_pixels, 2, 2, 0, false);
+    if(slot >= 0) {
+        vkWaitForFences(info->device, 1, &(streamer->uploads[slot].done), VK_TRUE, UINT64_MAX);
+        finish_upload(streamer, slot, 0);
+    }
+
+    pthread_mutex_init(&(streamer->job_mutex), NULL);
+    pthread_cond_init(&(streamer->job_available), NULL);
+    streamer->nb_workers = info->nb_worker_threads;
+    if(streamer->nb_workers == 0) {
+        long nb_cores = sysconf(_SC_NPROCESSORS_ONLN);
+        streamer->nb_workers = nb_cores > 1 ? (uint32_t)(nb_cores - 1) : 1;
+    }
+    streamer->workers = calloc(streamer->nb_workers, sizeof(pthread_t));
+    for(uint32_t i = 0; i < streamer->nb_workers; i++) {
+        if(pthread_create(streamer->workers + i, NULL, texture_worker, streamer) != 0) {
+            printf("failed to spawn texture worker %u\n", i);
+            streamer->nb_workers = i;
+            break;
+        }
+    }
+}
+
+void texture_streamer_destroy(TextureStreamer* streamer) {
+    VkDevice device = streamer->info.device;
+    const VkAllocationCallbacks* allocator = streamer->info.allocator;
+
+    pthread_mutex_lock(&(streamer->job_mutex));
+    streamer->stopping = true;
+    pthread_cond_broadcast(&(streamer->job_available));
+    pthread_mutex_unlock(&(streamer->job_mutex));
+    for(uint32_t i = 0; i < streamer->nb_workers; i++) {
+        pthread_join(streamer->workers[i], NULL);
+    }
+    free(streamer->workers);
+    pthread_mutex_destroy(&(streamer->job_mutex));
+    pthread_cond_destroy(&(streamer->job_available));
+
+    // jobs never started or never picked up: their source pointers are not owned by them
+    for(TextureJob* job = streamer->pending_head; job != NULL;) {
+        TextureJob* next = job->next;
+        free_job(job);
+        job = next;
+    }
+    for(TextureJob* job = streamer->completed_head; job != NULL;) {
+        TextureJob* next = job->next;
+        free_job(job);
+        job = next;
+    }
+
+    for(int i = 0; i < TEXTURE_STREAMER_MAX_UPLOADS; i++) {
+        if(streamer->upload_in_use[i]) {
+            vkWaitForFences(device, 1, &(streamer->uploads[i].done), VK_TRUE, UINT64_MAX);
+            finish_upload(streamer, i, 0);
+        }
+    }
+    for(uint32_t i = 0; i < streamer->retired_count; i++) {
+        destroy_version(streamer, &(streamer->retired[i].version));
+    }
+    free(streamer->retired);
+
+    for(uint32_t i = 0; i < TEXTURE_STREAMER_MAX_TEXTURES; i++) {
+        if(streamer->textures[i].current.image != VK_NULL_HANDLE) {
+            destroy_version(streamer, &(streamer->textures[i].current));
+        }
+        release_texture_data(streamer->textures + i);
+    }
+    free(streamer->textures);
+
+    destroy_version(streamer, &(streamer->placeholder));
+    vkDestroySampler(device, streamer->sampler, allocator);
+}
@@ -0,0 +1,205 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+
+/* Capture ***************************/
+bool trace_writer_open(TraceWriter* writer, const char* path, uint32_t width, uint32_t height) {
+    memset(writer, 0, sizeof(TraceWriter));
+    writer->file = fopen(path, "wb");
+    if(!writer->file) {
+        printf("failed to open trace file %s\n", path);
+        return false;
+    }
+    writer->header.magic = TRACE_MAGIC;
+    writer->header.version = TRACE_VERSION;
+    writer->header.width = width;
+    writer->header.height = height;
+    // the counts are written again on close
+    fwrite(&(writer->header), sizeof(TraceHeader), 1, writer->file);
+    return true;
+}
+
+void trace_writer_close(TraceWriter* writer) {
+    if(!writer->file) {
+        return;
+    }
+    fseek(writer->file, 0, SEEK_SET);
+    fwrite(&(writer->header), sizeof(TraceHeader), 1, writer->file);
+    fclose(writer->file);
+    printf("captured %u frames\n", writer->header.frame_count);
+    memset(writer, 0, sizeof(TraceWriter));
+}
+
+void trace_writer_add_node(TraceWriter* writer, uint32_t parent, bool drawn, const float* local) {
+    if(writer->nodes_done) {
+        printf("trace nodes have to come before the first frame\n");
+        return;
+    }
+    TraceNode node = {0};
+    node.parent = parent;
+    node.drawn = drawn ? 1 : 0;
+    memcpy(node.local, local, sizeof(node.local));
+    fwrite(&node, sizeof(TraceNode), 1, writer->file);
+    writer->header.node_count++;
+}
+
+void trace_writer_set_local(TraceWriter* writer, uint32_t node, const float* local) {
+    // only the last matrix of a node in a frame matters
+    uint32_t slot = 0;
+    while(slot < writer->transform_count && writer->transforms[slot].node != node) {
+        slot++;
+    }
+    if(slot == TRACE_MAX_TRANSFORMS) {
+        printf("more than %u nodes moved in a frame, node %u is not captured\n",
+               TRACE_MAX_TRANSFORMS, node);
+        return;
+    }
+    writer->transforms[slot].node = node;
+    memcpy(writer->transforms[slot].local, local, sizeof(writer->transforms[slot].local));
+    if(slot == writer->transform_count) {
+        writer->transform_count++;
+    }
+}
+
+void trace_writer_end_frame(TraceWriter* writer, const TraceFrame* frame) {
+    writer->nodes_done = true;
+    TraceFrame record = *frame;
+    record.padding = 0;
+    record.transform_count = (uint16_t)writer->transform_count;
+    fwrite(&record, sizeof(TraceFrame), 1, writer->file);
+    fwrite(writer->transforms, sizeof(TraceTransform), writer->transform_count, writer->file);
+    writer->transform_count = 0;
+    writer->header.frame_count++;
+}
+
+/* Replay ****************************/
+bool trace_reader_open(TraceReader* reader, const char* path) {
+    memset(reader, 0, sizeof(TraceReader));
+    FILE* file = fopen(path, "rb");
+    if(!file) {
+        printf("failed to open trace file %s\n", path);
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    long file_size = ftell(file);
+    rewind(file);
+    if(file_size < 0) {
+        printf("failed to get the size of trace file %s\n", path);
+        fclose(file);
+        return false;
+    }
+    reader->data = malloc(file_size > 0 ? file_size : 1);
+    if(reader->data == NULL) {
+        printf("failed to allocate %ld bytes for trace file %s\n", file_size, path);
+        fclose(file);
+        return false;
+    }
+    reader->size = fread(reader->data, 1, file_size, file);
+    fclose(file);
+
+    if(reader->size < sizeof(TraceHeader)) {
+        printf("%s is not a trace\n", path);
+        trace_reader_close(reader);
+        return false;
+    }
+    memcpy(&(reader->header), reader->data, sizeof(TraceHeader));
+    size_t offset = sizeof(TraceHeader) + reader->header.node_count * sizeof(TraceNode);
+    if(reader->header.magic != TRACE_MAGIC || reader->header.version != TRACE_VERSION ||
+       offset > reader->size) {
+        printf("%s is not a trace, or one of another version\n", path);
+        trace_reader_close(reader);
+        return false;
+    }
+    reader->nodes = (const TraceNode*)(reader->data + sizeof(TraceHeader));
+    // the replay builds its scene graph from these indices: parents must come first
+    for(uint32_t i = 0; i < reader->header.node_count; i++) {
+        if(reader->nodes[i].parent != TRACE_NODE_NONE && reader->nodes[i].parent >= i) {
+            printf("%s: node %u has parent %u, which does not come before it\n", path, i,
+                   reader->nodes[i].parent);
+            trace_reader_close(reader);
+            return false;
+        }
+    }
+
+    // the frames are counted again: a capture that was not closed has 0 in its header
+    size_t frame_capacity = (reader->size - offset) / sizeof(TraceFrame);
+    reader->frame_offsets = calloc(frame_capacity + 1, sizeof(size_t));
+    if(reader->frame_offsets == NULL) {
+        printf("failed to allocate the frame offsets of %s\n", path);
+        trace_reader_close(reader);
+        return false;
+    }
+    uint32_t frame_count = 0;
+    while(offset + sizeof(TraceFrame) <= reader->size) {
+        const TraceFrame* frame = (const TraceFrame*)(reader->data + offset);
+        size_t frame_size = sizeof(TraceFrame) + frame->transform_count * sizeof(TraceTransform);
+        if(offset + frame_size > reader->size) {
+            break;
+        }
+        const TraceTransform* transforms =
+            (const TraceTransform*)(reader->data + offset + sizeof(TraceFrame));
+        for(uint32_t i = 0; i < frame->transform_count; i++) {
+            if(transforms[i].node >= reader->header.node_count) {
+                printf("%s: frame %u moves node %u, there are %u\n", path, frame_count,
+                       transforms[i].node, reader->header.node_count);
+                trace_reader_close(reader);
+                return false;
+            }
+        }
+        reader->frame_offsets[frame_count++] = offset;
+        offset += frame_size;
+    }
+    if(frame_count != reader->header.frame_count) {
+        printf("%s: %u frames found, the header says %u\n", path, frame_count,
+               reader->header.frame_count);
+        reader->header.frame_count = frame_count;
+    }
+    return true;
+}
+
+void trace_reader_close(TraceReader* reader) {
+    free(reader->data);
+    free(reader->frame_offsets);
+    memset(reader, 0, sizeof(TraceReader));
+}
+
+const TraceFrame* trace_reader_frame(const TraceReader* reader, uint32_t index,
+                                     const TraceTransform** transforms) {
+    const uint8_t* frame = reader->data + reader->frame_offsets[index];
+    *transforms = (const TraceTransform*)(frame + sizeof(TraceFrame));
+    return (const TraceFrame*)frame;
+}
+
+/* Timings ***************************/
+static int compare_ms(const void* a, const void* b) {
+    double left = *(const double*)a;
+    double right = *(const double*)b;
+    return (left > right) - (left < right);
+}
+
+void trace_print_timings(const char* label, const double* ms, uint32_t count) {
+    double* sorted = malloc((count > 0 ? count : 1) * sizeof(double));
+    uint32_t measured = 0;
+    double total = 0.0;
+    for(uint32_t i = 0; i < count; i++) {
+        if(ms[i] >= 0.0) {
+            sorted[measured++] = ms[i];
+            total += ms[i];
+        }
+    }
+    if(measured == 0) {
+        printf("%s: not measured\n", label);
+        free(sorted);
+        return;
+    }
+    qsort(sorted, measured, sizeof(double), compare_ms);
+    printf("%s: %.3f ms average, %.3f median, %.3f p95, %.3f worst (%u frames)\n", label,
+           total / (double)measured, sorted[measured / 2],
+           sorted[(uint32_t)(0.95 * (double)(measured - 1))], sorted[measured - 1], measured);
+    free(sorted);
+}